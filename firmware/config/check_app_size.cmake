@@ -0,0 +1,15 @@
+# Reports how much of its OTA slot the app leaves free; fails when it does not
+# fit, and warns when less than MARGIN is left
+#
+#   cmake -DAPP_BIN=<app.bin> -DSLOT_SIZE=<bytes> -DMARGIN=<bytes> -P check_app_size.cmake
+#
+file(SIZE ${APP_BIN} app_size)
+math(EXPR slot_size "${SLOT_SIZE}")
+math(EXPR free_size "${slot_size} - ${app_size}")
+math(EXPR free_kib "${free_size} / 1024")
+message(STATUS "App size: ${app_size} bytes, ${free_size} bytes (${free_kib} KiB) free of the ${slot_size} byte OTA slot")
+if(free_size LESS 0)
+  message(FATAL_ERROR "The app does not fit its OTA slot, see config/partitions.csv")
+elseif(free_size LESS MARGIN)
+  message(WARNING "The app leaves less than ${MARGIN} bytes of its OTA slot free, see config/partitions.csv")
+endif()
@@ -0,0 +1,59 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/* built for the host, or for the linux target of ESP-IDF */
+#ifndef APP_CLOCK_VIRTUAL
+#if !defined(ESP_PLATFORM) || CONFIG_IDF_TARGET_LINUX
+#define APP_CLOCK_VIRTUAL 1
+#else
+#define APP_CLOCK_VIRTUAL 0
+#endif
+#endif
+
+#if !APP_CLOCK_VIRTUAL
+#include <esp_timer.h>
+#endif
+
+/**
+ * @brief The one clock every module of the app reads.
+ *
+ * On target it is esp_timer, 64-bit microseconds since boot, which do not
+ * wrap for the life of the device and can be read from an ISR. Built for
+ * the host it is a virtual clock that only moves when a test sets or
+ * advances it, so that days of timeouts run in no time.
+ *
+ * millis() and micros() are the low 32 bits, for the modules that compare
+ * short intervals by their difference; anything that can be far apart,
+ * like the last motion, is kept in 64 bits.
+ */
+class AppClock {
+ public:
+  __attribute__((always_inline)) static inline int64_t nowUs() {
+#if APP_CLOCK_VIRTUAL
+    return virtual_us_.load(std::memory_order_relaxed);
+#else
+    return esp_timer_get_time();
+#endif
+  }
+  static int64_t nowMs() { return nowUs() / 1000; }
+  static uint32_t millis() { return static_cast<uint32_t>(nowMs()); }
+  static uint32_t micros() { return static_cast<uint32_t>(nowUs()); }
+
+#if APP_CLOCK_VIRTUAL
+  static void set(int64_t us) {
+    virtual_us_.store(us, std::memory_order_relaxed);
+  }
+  static void advance(int64_t us) {
+    virtual_us_.fetch_add(us, std::memory_order_relaxed);
+  }
+
+ private:
+  static inline std::atomic<int64_t> virtual_us_{0};
+#endif
+};
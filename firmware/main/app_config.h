@@ -40,3 +40,23 @@
 #else
 #error "unsupported target"
 #endif
+
+/* All IR emitters and receivers, up to IRRemote::IR_TX_CHANNELS_MAX and
+ * IR_RX_CHANNELS_MAX, e.g. {CONFIG_APP_PIN_IR_TRANSMITTER, 3} */
+#ifndef CONFIG_APP_PINS_IR_TRANSMITTER
+#define CONFIG_APP_PINS_IR_TRANSMITTER {CONFIG_APP_PIN_IR_TRANSMITTER}
+#endif
+#ifndef CONFIG_APP_PINS_IR_RECEIVER
+#define CONFIG_APP_PINS_IR_RECEIVER {CONFIG_APP_PIN_IR_RECEIVER}
+#endif
+
+/* Task layout, chosen in menuconfig (Smart Light > Task layout) */
+#if CONFIG_APP_TASK_LAYOUT_SPLIT
+#define CONFIG_APP_CORE_NETWORK 0   //< web server, with the network stacks
+#define CONFIG_APP_CORE_REALTIME 1  //< IR, sensors and automation
+#define CONFIG_APP_TASK_LAYOUT_NAME "split"
+#else
+#define CONFIG_APP_CORE_NETWORK tskNO_AFFINITY
+#define CONFIG_APP_CORE_REALTIME tskNO_AFFINITY
+#define CONFIG_APP_TASK_LAYOUT_NAME "shared"
+#endif
@@ -0,0 +1,80 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+
+/**
+ * @brief Wakes the controller loop when one of its inputs changes.
+ *
+ * GPIO edges, the IR receiver, the command bus and serial input each set a
+ * bit, and the loop blocks in wait() until a bit is set or its own next
+ * deadline comes. The bits only tell why the loop woke up; it still reads
+ * every input itself, so a spurious wake costs one pass.
+ */
+class AppEvents {
+ public:
+  enum Bit : EventBits_t {
+    kButton = 1 << 0,
+    kMotion = 1 << 1,
+    kIrReceived = 1 << 2,
+    kCommand = 1 << 3,
+    kSerial = 1 << 4,
+  };
+  static constexpr const EventBits_t kAll = (1 << 5) - 1;
+
+  bool begin();
+  void set(EventBits_t bits);
+  bool setFromIsr(EventBits_t bits);
+  EventBits_t wait(uint32_t timeout_ms);
+
+  /* adapters for the callbacks of the sources, which take a context */
+  template <EventBits_t kBits>
+  static void notify(void* events) {
+    static_cast<AppEvents*>(events)->set(kBits);
+  }
+  template <EventBits_t kBits>
+  static bool notifyFromIsr(void* events) {
+    return static_cast<AppEvents*>(events)->setFromIsr(kBits);
+  }
+  template <EventBits_t kBits>
+  static void IRAM_ATTR gpioIsr(void* events) {
+    if (notifyFromIsr<kBits>(events)) portYIELD_FROM_ISR();
+  }
+
+ private:
+  EventGroupHandle_t group_ = nullptr;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool AppEvents::begin() {
+  group_ = xEventGroupCreate();
+  return group_ != nullptr;
+}
+
+inline void AppEvents::set(EventBits_t bits) {
+  if (group_) xEventGroupSetBits(group_, bits);
+}
+
+inline bool AppEvents::setFromIsr(EventBits_t bits) {
+  BaseType_t woken = pdFALSE;
+  /* deferred to the timer task, which is what may be woken */
+  if (group_) xEventGroupSetBitsFromISR(group_, bits, &woken);
+  return woken == pdTRUE;
+}
+
+inline EventBits_t AppEvents::wait(uint32_t timeout_ms) {
+  if (!group_) {
+    /* no way to be woken, fall back to polling */
+    vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+    return kAll;
+  }
+  return xEventGroupWaitBits(group_, kAll, pdTRUE, pdFALSE,
+                             pdMS_TO_TICKS(timeout_ms)) &
+         kAll;
+}
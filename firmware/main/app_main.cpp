@@ -19,8 +19,8 @@ void setup() {
 }
 
 void loop() {
+  /* blocks until an input changes or a deadline of the controller comes */
   app_.handle();
-  yield();
 }
 
 #else  // Matter Light Example
@@ -31,9 +31,11 @@ void loop() {
 #include "app_log.h"
 #include "matter_light.h"
 #include "rgb_led.h"
+#include "timer_wheel.h"
 
 MatterLight matter_light_;
-RgbLed led_(CONFIG_APP_PIN_RGB_LED);
+TimerWheel timers_;
+RgbLed led_(CONFIG_APP_PIN_RGB_LED, timers_);
 
 void setup() {
   Serial.begin(CONFIG_MONITOR_BAUD);
@@ -73,7 +75,7 @@ void loop() {
          event.switch_state ? "ON" : "OFF");
   }
 
-  led_.update();
+  timers_.advance(AppClock::millis());
   yield();
 }
 #endif
@@ -0,0 +1,76 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @brief Smooths the raw samples of the brightness sensor, in fixed point.
+ *
+ * kOversample consecutive samples are summed into one, which is their mean
+ * with kOversampleBits more bits. The median of the last three of those
+ * drops a single spike, and a first-order IIR filter with a gain of
+ * 1 / 2^kIirShift smooths what is left. The first output seeds the IIR
+ * filter, so the value does not ramp up from zero after reset().
+ *
+ * The filter only does integer arithmetic on the samples it is given, so
+ * recorded sample streams can be run through it anywhere.
+ */
+class BrightnessFilter {
+ public:
+  static constexpr const int kSampleBits = 12;
+  static constexpr const uint32_t kSampleMax = (1 << kSampleBits) - 1;
+  static constexpr const int kOversampleBits = 5;
+  static constexpr const int kOversample = 1 << kOversampleBits;
+  static constexpr const int kIirShift = 2;
+  /* of the output, on top of the sample */
+  static constexpr const int kFractionBits = kOversampleBits + 8;
+
+  void add(uint16_t sample);
+  void reset() { *this = BrightnessFilter(); }
+
+  /* an output is ready after the first kOversample samples */
+  bool ready() const { return outputs_ > 0; }
+  uint32_t outputCount() const { return outputs_; }
+  /* the sample scale with kFractionBits fraction bits */
+  uint32_t value() const { return static_cast<uint32_t>(iir_); }
+  uint16_t sample() const {
+    return (value() + (1 << (kFractionBits - 1))) >> kFractionBits;
+  }
+  float normalized() const {
+    return static_cast<float>(value()) / (kSampleMax << kFractionBits);
+  }
+
+ private:
+  uint32_t sum_ = 0;
+  int count_ = 0;
+  uint32_t window_[3] = {};  //< oversampled, the newest at outputs_ % 3
+  uint32_t outputs_ = 0;
+  int32_t iir_ = 0;
+
+  uint32_t median_() const;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void BrightnessFilter::add(uint16_t sample) {
+  sum_ += std::min<uint32_t>(sample, kSampleMax);
+  if (++count_ < kOversample) return;
+  window_[outputs_ % 3] = sum_;
+  sum_ = 0;
+  count_ = 0;
+  const int32_t input = median_() << (kFractionBits - kOversampleBits);
+  /* the shift rounds down, which is below the resolution of the sample */
+  iir_ = outputs_ ? iir_ + ((input - iir_) >> kIirShift) : input;
+  ++outputs_;
+}
+
+inline uint32_t BrightnessFilter::median_() const {
+  /* the newest, until there are three */
+  if (outputs_ < 2) return window_[outputs_ % 3];
+  const uint32_t a = window_[0], b = window_[1], c = window_[2];
+  return std::max(std::min(a, b), std::min(std::max(a, b), c));
+}
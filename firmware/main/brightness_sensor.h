@@ -4,43 +4,228 @@
  */
 #pragma once
 #include <Arduino.h>
+#include <esp_adc/adc_cali.h>
+#include <esp_adc/adc_cali_scheme.h>
+#include <esp_adc/adc_continuous.h>
 
-class BrightnessSensor {
- public:
-  explicit BrightnessSensor(uint8_t pin) : pin_(pin) {}
+#include <atomic>
 
-  void update(float threshold = 0.5f, float hysteresis = 0.1f) {
-    int raw = analogRead(pin_);
-    float value = constrain(static_cast<float>(raw) / 1023.0f, 0.0f, 1.0f);
+#include "app_clock.h"
+#include "app_log.h"
+#include "brightness_filter.h"
 
-    bool new_bright;
-    if (was_bright_) {
-      new_bright = (value >= threshold - hysteresis);
-    } else {
-      new_bright = (value >= threshold + hysteresis);
-    }
+/**
+ * @brief Ambient brightness from a phototransistor on an ADC pin.
+ *
+ * The ADC samples the pin at kSampleRateHz in continuous mode, and the DMA
+ * hands over a frame of kFrameSamples at a time. The conversion callback
+ * runs the samples through a BrightnessFilter and publishes its output, so
+ * update() only reads the latest value and never waits for the ADC.
+ *
+ * The brightness is the filtered value relative to the 12-bit full scale.
+ * Its voltage comes from the eFuse calibration of the ADC, and is turned
+ * into lux by kLuxTable, for the NJL7502L with a 100 kOhm load (33 uA at
+ * 100 lx, so about 33 mV per lx, until it saturates near 3 V).
+ */
+class BrightnessSensor {
+ public:
+  static constexpr const uint32_t kSampleRateHz = 1000;
+  static constexpr const int kFrameSamples = BrightnessFilter::kOversample;
+  static constexpr const int kFullScaleMv = 3300;  //< uncalibrated
+  struct LuxPoint {
+    uint16_t millivolts;
+    uint16_t lux;
+  };
+  static constexpr const LuxPoint kLuxTable[] = {
+      {0, 0}, {330, 10}, {1650, 50}, {2640, 80}, {3000, 91},
+  };
 
-    if (new_bright != was_bright_) {
-      last_change_millis_ = millis();
-      was_bright_ = new_bright;
-    }
+  explicit BrightnessSensor(uint8_t pin) : pin_(pin) {}
 
-    is_bright_ = new_bright;
-    normalized_value_ = value;
-  }
+  bool begin();
+  /* stopped, the ADC lets the chip sleep; started again, the value is
+   * fresh after the first frame */
+  void setSampling(bool sampling);
+  void update(float threshold = 0.125f, float hysteresis = 0.025f);
 
   float getNormalized() const { return normalized_value_; }
+  int getMillivolts() const { return millivolts_; }
+  int getLux() const { return lux_; }
 
   bool isBright() const { return is_bright_; }
 
-  unsigned long getMillisSinceChange() const {
-    return millis() - last_change_millis_;
+  int64_t getMillisSinceChange() const {
+    return AppClock::nowMs() - last_change_ms_;
   }
 
+  static int toLux(int millivolts);
+
  private:
+  static constexpr const size_t kFrameBytes =
+      kFrameSamples * SOC_ADC_DIGI_RESULT_BYTES;
+
   const uint8_t pin_;
+  adc_continuous_handle_t adc_ = nullptr;
+  adc_cali_handle_t cali_ = nullptr;
+  adc_channel_t channel_ = ADC_CHANNEL_0;
+  bool sampling_ = false;
+  BrightnessFilter filter_;  //< conversion callback only
+  std::atomic<uint32_t> filtered_{0};  //< BrightnessFilter::value()
+  std::atomic<uint32_t> frames_{0};    //< published since the start
+  uint32_t filtered_raw_ = UINT32_MAX;  //< that millivolts_ is for
   float normalized_value_ = 0.0f;
+  int millivolts_ = 0;
+  int lux_ = 0;
   bool is_bright_ = false;
   bool was_bright_ = false;
-  unsigned long last_change_millis_ = 0;
+  int64_t last_change_ms_ = 0;
+
+  bool beginCalibration_(adc_unit_t unit);
+  /* not in IRAM, it is held off while the flash is written */
+  static bool onConvDone_(adc_continuous_handle_t handle,
+                          const adc_continuous_evt_data_t* edata,
+                          void* this_ptr);
 };
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool BrightnessSensor::begin() {
+  adc_unit_t unit;
+  if (adc_continuous_io_to_channel(pin_, &unit, &channel_) != ESP_OK) {
+    LOGE("[ADC] Pin %d has no ADC channel", pin_);
+    return false;
+  }
+  adc_continuous_handle_cfg_t handle_config{};
+  handle_config.max_store_buf_size = kFrameBytes;
+  handle_config.conv_frame_size = kFrameBytes;
+  /* the frames are taken in the callback, the pool is never read */
+  handle_config.flags.flush_pool = true;
+  if (adc_continuous_new_handle(&handle_config, &adc_) != ESP_OK) {
+    LOGE("[ADC] Failed to create continuous ADC");
+    return false;
+  }
+  adc_digi_pattern_config_t pattern{};
+  pattern.atten = ADC_ATTEN_DB_12;
+  pattern.channel = channel_;
+  pattern.unit = unit;
+  pattern.bit_width = BrightnessFilter::kSampleBits;
+  adc_continuous_config_t config{};
+  config.pattern_num = 1;
+  config.adc_pattern = &pattern;
+  config.sample_freq_hz = kSampleRateHz;
+  config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+  config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+  adc_continuous_evt_cbs_t callbacks{};
+  callbacks.on_conv_done = onConvDone_;
+  if (adc_continuous_config(adc_, &config) != ESP_OK ||
+      adc_continuous_register_event_callbacks(adc_, &callbacks, this) !=
+          ESP_OK) {
+    LOGE("[ADC] Failed to configure continuous ADC");
+    return false;
+  }
+  if (!beginCalibration_(unit)) {
+    LOGW("[ADC] No calibration, assuming %d mV full scale", kFullScaleMv);
+  }
+  setSampling(true);
+  return true;
+}
+
+inline bool BrightnessSensor::beginCalibration_(adc_unit_t unit) {
+#if ADC_CALI_SCHEME_CURVE_FITTING_SUPPORTED
+  adc_cali_curve_fitting_config_t config{};
+  config.unit_id = unit;
+  config.chan = channel_;
+  config.atten = ADC_ATTEN_DB_12;
+  config.bitwidth = ADC_BITWIDTH_12;
+  return adc_cali_create_scheme_curve_fitting(&config, &cali_) == ESP_OK;
+#elif ADC_CALI_SCHEME_LINE_FITTING_SUPPORTED
+  adc_cali_line_fitting_config_t config{};
+  config.unit_id = unit;
+  config.atten = ADC_ATTEN_DB_12;
+  config.bitwidth = ADC_BITWIDTH_12;
+  return adc_cali_create_scheme_line_fitting(&config, &cali_) == ESP_OK;
+#else
+  return false;
+#endif
+}
+
+inline void BrightnessSensor::setSampling(bool sampling) {
+  if (!adc_ || sampling == sampling_) return;
+  if (sampling) {
+    /* stopped, the callback does not run */
+    filter_.reset();
+    frames_ = 0;
+    sampling_ = adc_continuous_start(adc_) == ESP_OK;
+    if (!sampling_) LOGE("[ADC] Failed to start continuous ADC");
+  } else {
+    adc_continuous_stop(adc_);
+    sampling_ = false;
+  }
+}
+
+inline void BrightnessSensor::update(float threshold, float hysteresis) {
+  /* the last value stands until the first frame after a start */
+  if (frames_.load()) {
+    const uint32_t filtered = filtered_.load();
+    normalized_value_ =
+        static_cast<float>(filtered) /
+        (BrightnessFilter::kSampleMax << BrightnessFilter::kFractionBits);
+    const uint32_t raw = filtered >> BrightnessFilter::kFractionBits;
+    if (raw != filtered_raw_) {
+      filtered_raw_ = raw;
+      if (!cali_ ||
+          adc_cali_raw_to_voltage(cali_, raw, &millivolts_) != ESP_OK) {
+        millivolts_ = raw * kFullScaleMv / BrightnessFilter::kSampleMax;
+      }
+      lux_ = toLux(millivolts_);
+    }
+  }
+  const float value = normalized_value_;
+
+  bool new_bright;
+  if (was_bright_) {
+    new_bright = (value >= threshold - hysteresis);
+  } else {
+    new_bright = (value >= threshold + hysteresis);
+  }
+
+  if (new_bright != was_bright_) {
+    last_change_ms_ = AppClock::nowMs();
+    was_bright_ = new_bright;
+  }
+
+  is_bright_ = new_bright;
+}
+
+inline int BrightnessSensor::toLux(int millivolts) {
+  constexpr int kSize = sizeof(kLuxTable) / sizeof(kLuxTable[0]);
+  if (millivolts <= kLuxTable[0].millivolts) return kLuxTable[0].lux;
+  for (int i = 1; i < kSize; ++i) {
+    const LuxPoint& a = kLuxTable[i - 1];
+    const LuxPoint& b = kLuxTable[i];
+    if (millivolts > b.millivolts) continue;
+    /* linear in between, rounded */
+    const int span = b.millivolts - a.millivolts;
+    return a.lux + ((millivolts - a.millivolts) * (b.lux - a.lux) +
+                    span / 2) / span;
+  }
+  return kLuxTable[kSize - 1].lux;  //< saturated
+}
+
+inline bool BrightnessSensor::onConvDone_(
+    adc_continuous_handle_t, const adc_continuous_evt_data_t* edata,
+    void* this_ptr) {
+  auto* self = static_cast<BrightnessSensor*>(this_ptr);
+  const auto* results = reinterpret_cast<const adc_digi_output_data_t*>(
+      edata->conv_frame_buffer);
+  const size_t count = edata->size / SOC_ADC_DIGI_RESULT_BYTES;
+  for (size_t i = 0; i < count; ++i) {
+    if (results[i].type2.channel != self->channel_) continue;
+    self->filter_.add(results[i].type2.data);
+  }
+  if (self->filter_.ready()) {
+    self->filtered_.store(self->filter_.value());
+    self->frames_.fetch_add(1);
+  }
+  return false;  //< no task to wake, the value is read on the next pass
+}
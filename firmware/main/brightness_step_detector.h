@@ -0,0 +1,75 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+/**
+ * @brief Detects a step of the ambient brightness in a given direction.
+ *
+ * Samples are fed at a fixed period. Until the detector is armed they fill a
+ * short history, whose mean becomes the baseline when it is armed. After
+ * that, the step is detected once kSettleSamples consecutive samples differ
+ * from the baseline by at least the minimum step in the expected direction,
+ * so a single spike does not count and a lamp that ramps up slowly does.
+ *
+ * The detector only does arithmetic on the values it is given, so recorded
+ * brightness traces can be run through it anywhere.
+ */
+class BrightnessStepDetector {
+ public:
+  enum class Direction : int { Down = -1, Up = 1 };
+
+  static constexpr const int kHistorySize = 8;
+  static constexpr const int kSettleSamples = 3;
+  static constexpr const float kMinStepDefault = 0.0125f;
+
+  explicit BrightnessStepDetector(float min_step = kMinStepDefault)
+      : min_step_(min_step) {}
+
+  void add(float value);
+  void arm(Direction direction);
+  void disarm() { armed_ = false; }
+
+  bool armed() const { return armed_; }
+  bool detected() const { return armed_ && settled_ >= kSettleSamples; }
+  float baseline() const { return baseline_; }
+  float step() const { return last_ - baseline_; }
+
+ private:
+  const float min_step_;
+  float history_[kHistorySize] = {};
+  int history_size_ = 0;
+  int history_next_ = 0;
+  bool armed_ = false;
+  Direction direction_ = Direction::Up;
+  float baseline_ = 0.0f;
+  float last_ = 0.0f;
+  int settled_ = 0;  //< consecutive samples beyond the step
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void BrightnessStepDetector::add(float value) {
+  last_ = value;
+  if (!armed_) {
+    history_[history_next_] = value;
+    history_next_ = (history_next_ + 1) % kHistorySize;
+    if (history_size_ < kHistorySize) ++history_size_;
+    return;
+  }
+  const float step = (value - baseline_) * static_cast<int>(direction_);
+  settled_ = step >= min_step_ ? settled_ + 1 : 0;
+}
+
+inline void BrightnessStepDetector::arm(Direction direction) {
+  float sum = 0.0f;
+  for (int i = 0; i < history_size_; ++i) sum += history_[i];
+  baseline_ = history_size_ ? sum / history_size_ : last_;
+  direction_ = direction;
+  settled_ = 0;
+  armed_ = true;
+  /* the next disarmed period starts a fresh history */
+  history_size_ = 0;
+  history_next_ = 0;
+}
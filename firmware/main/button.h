@@ -5,6 +5,8 @@
 #pragma once
 #include <Arduino.h>
 
+#include "app_clock.h"
+
 class Button {
  public:
   Button(uint8_t pin, uint32_t longPressMs = 5000, uint32_t debounceMs = 20)
@@ -13,6 +15,9 @@ class Button {
   }
 
   void update();
+  uint8_t pin() const { return pin_; }
+  /* the level is settling or held, update() has to follow the clock */
+  bool busy() const { return pressing_ || last_raw_ != prev_; }
   bool pressing() const { return pressing_; }
   bool pressed() const { return pressed_; }
   bool longPressed() const { return long_pressed_; }
@@ -33,14 +38,14 @@ class Button {
   bool long_hold_start_triggered_ = false;
 
   bool last_raw_ = false;
-  unsigned long last_debounce_time_ = 0;
-  unsigned long pressed_at_ = 0;
+  uint32_t last_debounce_time_ = 0;
+  uint32_t pressed_at_ = 0;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
 inline void Button::update() {
-  unsigned long now = millis();
+  const uint32_t now = AppClock::millis();
   bool raw = digitalRead(pin_) == LOW;
 
   if (raw != last_raw_) {
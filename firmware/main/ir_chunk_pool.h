@@ -0,0 +1,74 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Fixed pool of chunks that are chained into frames of any length.
+ *
+ * The consumer of the free chunks (an ISR) takes them with allocate() and
+ * links them through Chunk::next; the producer (the main loop) hands whole
+ * chains back with release() once it has read them. Free chunks go around a
+ * single-producer/single-consumer ring of indices, so neither side blocks
+ * or allocates, and a short frame only holds the chunks it needs.
+ */
+template <typename T, size_t kChunkSize, size_t kChunks>
+class IRChunkPool {
+  static_assert(kChunks && (kChunks & (kChunks - 1)) == 0,
+                "kChunks must be a power of two");
+  static_assert(kChunks < UINT16_MAX, "chunk indices are 16 bits");
+
+ public:
+  using Index = uint16_t;
+  static constexpr const Index kNone = UINT16_MAX;
+
+  struct Chunk {
+    Index next;
+    uint16_t size;
+    T data[kChunkSize];
+  };
+
+  IRChunkPool() {
+    for (size_t i = 0; i < kChunks; ++i) free_[i] = i;
+    free_head_.store(kChunks, std::memory_order_relaxed);
+  }
+
+  Chunk& operator[](Index index) { return chunks_[index]; }
+  const Chunk& operator[](Index index) const { return chunks_[index]; }
+
+  /* consumer side (ISR) */
+  Index allocate() {
+    const uint32_t tail = free_tail_.load(std::memory_order_relaxed);
+    if (free_head_.load(std::memory_order_acquire) == tail) return kNone;
+    const Index index = free_[tail & (kChunks - 1)];
+    free_tail_.store(tail + 1, std::memory_order_release);
+    chunks_[index].next = kNone;
+    chunks_[index].size = 0;
+    return index;
+  }
+
+  /* producer side (main loop) */
+  void release(Index index) {
+    uint32_t head = free_head_.load(std::memory_order_relaxed);
+    for (; index != kNone; index = chunks_[index].next) {
+      free_[head++ & (kChunks - 1)] = index;
+    }
+    free_head_.store(head, std::memory_order_release);
+  }
+
+  size_t available() const {
+    return free_head_.load(std::memory_order_acquire) -
+           free_tail_.load(std::memory_order_acquire);
+  }
+
+ private:
+  Chunk chunks_[kChunks];
+  Index free_[kChunks];
+  std::atomic<uint32_t> free_head_{0};
+  std::atomic<uint32_t> free_tail_{0};
+};
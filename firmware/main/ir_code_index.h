@@ -0,0 +1,228 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#include "ir_protocol.h"
+
+/**
+ * @brief Hash index over learned IR codes.
+ *
+ * Decoded codes are filed under a hash of their protocol fields. Raw codes
+ * are filed under the frame length and the short/long pattern of their
+ * timings, with the threshold taken from the widest gap between the widths
+ * of the learned code. Raw codes that share a length and fit one threshold
+ * form a group, usually one per remote.
+ *
+ * A received width is classified by what the group accepts, not by the
+ * threshold: it is short if only the short widths of the group accept it
+ * (IRProtocolCodec::rawBounds()), long if only the long ones do, and
+ * ambiguous if both may. The pattern is looked up once for each way the
+ * ambiguous widths can go, so every code that matches the received code is
+ * found, however its timings jitter. With more than kMaxProbeBits ambiguous
+ * widths the codes of the group are verified one by one instead.
+ *
+ * A lookup hashes the received code once per group of its length and
+ * verifies only the codes that share its hash, so its cost does not grow
+ * with the number of learned codes.
+ */
+class IRCodeIndex {
+ public:
+  using Id = uint16_t;
+  static constexpr const int kMaxProbeBits = 4;
+
+  void clear();
+  void add(Id id, const IRCode& code);
+  bool find(const IRCode& received, Id& id) const;
+  size_t size() const { return size_; }
+  size_t rawGroupCount() const { return raw_groups_.size(); }
+
+ private:
+  struct Entry {
+    Id id;
+    const IRCode* code;
+  };
+  using Table = std::unordered_multimap<uint32_t, Entry>;
+  using Pattern = std::vector<uint32_t>;  //< a bit per width, long is 1
+
+  /* raw codes of one length, split at one threshold */
+  struct RawGroup {
+    size_t size;
+    uint32_t threshold;              //< learned widths from here are long
+    uint32_t short_max = 0;          //< widest a short width accepts
+    uint32_t long_min = UINT32_MAX;  //< narrowest a long width accepts
+    Table table;
+  };
+
+  Table decoded_;
+  std::vector<RawGroup> raw_groups_;
+  size_t size_ = 0;
+
+  bool findRaw_(const RawGroup& group, const IRCode& received,
+                Id& id) const;
+  static bool findIn_(const Table& table, uint32_t hash,
+                      const IRCode& received, Id& id);
+  static uint32_t hashFields_(const IRCode& code);
+  static uint32_t hashPattern_(size_t size, const Pattern& pattern);
+  static void splitWidths_(const IRRemote::IRData& raw, uint32_t& min,
+                           uint32_t& max);
+  /* FNV-1a */
+  static void mix_(uint32_t& hash, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      hash ^= (value >> (8 * i)) & 0xFF;
+      hash *= 16777619u;
+    }
+  }
+  static constexpr const uint32_t kHashSeed = 2166136261u;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void IRCodeIndex::clear() {
+  decoded_.clear();
+  raw_groups_.clear();
+  size_ = 0;
+}
+
+inline void IRCodeIndex::add(Id id, const IRCode& code) {
+  if (code.empty()) return;
+  ++size_;
+  if (code.protocol != IRProtocol::Raw) {
+    decoded_.emplace(hashFields_(code), Entry{id, &code});
+    return;
+  }
+  /* a threshold in (split_min, split_max] classifies the code alike */
+  uint32_t split_min, split_max;
+  splitWidths_(code.raw, split_min, split_max);
+  auto group = std::find_if(
+      raw_groups_.begin(), raw_groups_.end(), [&](const RawGroup& group) {
+        return group.size == code.raw.size() &&
+               split_min < group.threshold && group.threshold <= split_max;
+      });
+  if (group == raw_groups_.end()) {
+    /* the geometric mean is as far from either side in relative terms */
+    const uint32_t mean = std::sqrt(double(split_min) * split_max);
+    raw_groups_.push_back(RawGroup{
+        code.raw.size(), std::clamp(mean, split_min + 1, split_max)});
+    group = raw_groups_.end() - 1;
+  }
+  Pattern pattern((code.raw.size() + 31) / 32);
+  for (size_t i = 0; i < code.raw.size(); ++i) {
+    uint32_t min, max;
+    IRProtocolCodec::rawBounds(code, i, min, max);
+    if (code.raw[i] >= group->threshold) {
+      pattern[i / 32] |= 1u << (i % 32);
+      group->long_min = std::min(group->long_min, min);
+    } else {
+      group->short_max = std::max(group->short_max, max);
+    }
+  }
+  group->table.emplace(hashPattern_(code.raw.size(), pattern),
+                       Entry{id, &code});
+}
+
+inline bool IRCodeIndex::find(const IRCode& received, Id& id) const {
+  if (received.protocol != IRProtocol::Raw) {
+    return findIn_(decoded_, hashFields_(received), received, id);
+  }
+  for (const auto& group : raw_groups_) {
+    if (group.size != received.raw.size()) continue;
+    if (findRaw_(group, received, id)) return true;
+  }
+  return false;
+}
+
+inline bool IRCodeIndex::findRaw_(const RawGroup& group,
+                                  const IRCode& received, Id& id) const {
+  Pattern pattern((received.raw.size() + 31) / 32);
+  size_t ambiguous[kMaxProbeBits];
+  int ambiguous_count = 0;
+  for (size_t i = 0; i < received.raw.size(); ++i) {
+    const uint32_t width = received.raw[i];
+    const bool can_be_short = width <= group.short_max;
+    const bool can_be_long = width >= group.long_min;
+    if (!can_be_short && !can_be_long) return false;  //< no code accepts it
+    if (!can_be_short) pattern[i / 32] |= 1u << (i % 32);
+    if (!can_be_short || !can_be_long) continue;
+    if (ambiguous_count == kMaxProbeBits) {
+      /* too many ways to go, verify the codes of the group instead */
+      for (const auto& [hash, entry] : group.table) {
+        if (IRProtocolCodec::matches(received, *entry.code)) {
+          id = entry.id;
+          return true;
+        }
+      }
+      return false;
+    }
+    ambiguous[ambiguous_count++] = i;
+  }
+  for (uint32_t probe = 0; probe < (1u << ambiguous_count); ++probe) {
+    Pattern variant = pattern;
+    for (int k = 0; k < ambiguous_count; ++k) {
+      if (probe & (1u << k)) {
+        variant[ambiguous[k] / 32] |= 1u << (ambiguous[k] % 32);
+      }
+    }
+    const uint32_t hash = hashPattern_(received.raw.size(), variant);
+    if (findIn_(group.table, hash, received, id)) return true;
+  }
+  return false;
+}
+
+inline bool IRCodeIndex::findIn_(const Table& table, uint32_t hash,
+                                 const IRCode& received, Id& id) {
+  const auto range = table.equal_range(hash);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (IRProtocolCodec::matches(received, *it->second.code)) {
+      id = it->second.id;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline uint32_t IRCodeIndex::hashFields_(const IRCode& code) {
+  uint32_t hash = kHashSeed;
+  mix_(hash, static_cast<uint32_t>(code.protocol));
+  mix_(hash, code.bits);
+  mix_(hash, code.address);
+  mix_(hash, static_cast<uint32_t>(code.command));
+  mix_(hash, static_cast<uint32_t>(code.command >> 32));
+  return hash;
+}
+
+inline uint32_t IRCodeIndex::hashPattern_(size_t size,
+                                          const Pattern& pattern) {
+  uint32_t hash = kHashSeed;
+  mix_(hash, size);
+  for (const uint32_t word : pattern) mix_(hash, word);
+  return hash;
+}
+
+/* the widest gap between the widths of a code, by ratio, so that 1T/3T
+ * pulse distance bits fall on either side */
+inline void IRCodeIndex::splitWidths_(const IRRemote::IRData& raw,
+                                      uint32_t& min, uint32_t& max) {
+  IRRemote::IRData widths = raw;
+  std::sort(widths.begin(), widths.end());
+  /* with a single width, everything is short */
+  min = widths.empty() ? 0 : widths.back();
+  max = UINT32_MAX;
+  double widest = 0.0;
+  for (size_t i = 1; i < widths.size(); ++i) {
+    if (widths[i] == widths[i - 1]) continue;
+    const double ratio =
+        double(widths[i]) / std::max<uint16_t>(widths[i - 1], 1);
+    if (ratio > widest) {
+      widest = ratio;
+      min = widths[i - 1];
+      max = widths[i];
+    }
+  }
+}
@@ -0,0 +1,269 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "ir_code_library.h"
+
+#include <esp_rom_crc.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cinttypes>
+#include <cstring>
+#include <vector>
+
+#include "app_log.h"
+#include "ir_code_storage.h"
+
+namespace {
+
+constexpr char kMagic[4] = {'I', 'R', 'L', 'B'};
+constexpr size_t kCopyChunkSize = 64;
+
+}  // namespace
+
+IRCodeLibrary::~IRCodeLibrary() {
+  if (base_) esp_partition_munmap(mmap_handle_);
+}
+
+bool IRCodeLibrary::begin() {
+  partition_ = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA,
+      static_cast<esp_partition_subtype_t>(kPartitionSubtype),
+      kPartitionLabel);
+  if (!partition_) {
+    /* an OTA update keeps the partition table, which may predate it */
+    LOGW("[IR-Lib] Partition \"%s\" not found, the library is off until "
+         "the partition table is flashed over USB",
+         kPartitionLabel);
+    return false;
+  }
+  bank_size_ = partition_->size / 2 / partition_->erase_size *
+               partition_->erase_size;
+  const void* ptr = nullptr;
+  if (bank_size_ < kHeaderSize ||
+      esp_partition_mmap(partition_, 0, 2 * bank_size_,
+                         ESP_PARTITION_MMAP_DATA, &ptr,
+                         &mmap_handle_) != ESP_OK) {
+    LOGE("[IR-Lib] Failed to map partition \"%s\"", kPartitionLabel);
+    return false;
+  }
+  base_ = static_cast<const uint8_t*>(ptr);
+
+  const bool valid[2] = {isValidBank_(0), isValidBank_(1)};
+  active_ = -1;
+  if (valid[0] && valid[1]) {
+    const uint32_t g0 = getLe_(bank_(0) + 8, 4);
+    const uint32_t g1 = getLe_(bank_(1) + 8, 4);
+    active_ = int32_t(g1 - g0) > 0 ? 1 : 0;
+  } else if (valid[0] || valid[1]) {
+    active_ = valid[0] ? 0 : 1;
+  }
+  LOGI("[IR-Lib] %zu codes, %zu/%zu bytes (generation: %" PRIu32 ")",
+       count(), usedBytes(), capacity(), generation());
+  return true;
+}
+
+size_t IRCodeLibrary::count() const {
+  return active_ < 0 ? 0 : getLe_(bank_(active_) + 6, 2);
+}
+
+bool IRCodeLibrary::entry(size_t index, Entry& entry) const {
+  if (index >= count()) return false;
+  const uint8_t* bank = bank_(active_);
+  const uint8_t* p = bank + kHeaderSize + index * kEntrySize;
+  entry.index = index;
+  entry.name = reinterpret_cast<const char*>(p);
+  entry.record = bank + getLe_(p + kNameSize, 4);
+  entry.size = getLe_(p + kNameSize + 4, 2);
+  return true;
+}
+
+bool IRCodeLibrary::find(const char* name, Entry& entry) const {
+  size_t index;
+  return lowerBound_(name, index) && this->entry(index, entry);
+}
+
+size_t IRCodeLibrary::usedBytes() const {
+  return active_ < 0 ? 0 : getLe_(bank_(active_) + 12, 4);
+}
+
+uint32_t IRCodeLibrary::generation() const {
+  return active_ < 0 ? 0 : getLe_(bank_(active_) + 8, 4);
+}
+
+bool IRCodeLibrary::isValidName(const char* name) {
+  const size_t length = strnlen(name, kNameSize);
+  if (length == 0 || length > kMaxNameLength) return false;
+  for (size_t i = 0; i < length; ++i) {
+    const char c = name[i];
+    if (!isalnum(static_cast<unsigned char>(c)) && c != '_' && c != '-' &&
+        c != '.') {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IRCodeLibrary::isValidBank_(int bank) const {
+  const uint8_t* p = bank_(bank);
+  if (memcmp(p, kMagic, sizeof(kMagic)) != 0 || p[4] != kVersion) {
+    return false;
+  }
+  const size_t count = getLe_(p + 6, 2);
+  const size_t size = getLe_(p + 12, 4);
+  const size_t records = kHeaderSize + count * kEntrySize;
+  if (size > bank_size_ || size < records ||
+      esp_rom_crc32_le(0, p + kHeaderSize, size - kHeaderSize) !=
+          getLe_(p + 16, 4)) {
+    return false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    const uint8_t* e = p + kHeaderSize + i * kEntrySize;
+    const size_t offset = getLe_(e + kNameSize, 4);
+    if (e[kMaxNameLength] != '\0' || offset < records ||
+        offset + getLe_(e + kNameSize + 4, 2) > size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IRCodeLibrary::lowerBound_(const char* name, size_t& index) const {
+  size_t lo = 0;
+  size_t hi = count();
+  Entry e;
+  while (lo < hi) {
+    const size_t mid = (lo + hi) / 2;
+    entry(mid, e);
+    if (strncmp(e.name, name, kNameSize) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  index = lo;
+  return entry(lo, e) && strncmp(e.name, name, kNameSize) == 0;
+}
+
+bool IRCodeLibrary::claim_() {
+  if (!ready()) return false;
+  if (writing_) {
+    LOGW("[IR-Lib] Busy with another change");
+    return false;
+  }
+  writing_ = true;
+  return true;
+}
+
+/* writes the library with the change into the other bank, returns that
+ * bank, or -1 if it failed */
+int IRCodeLibrary::write_(const Change& change) {
+  const size_t old_count = count();
+  size_t insert_at = old_count;
+  if (change.name) lowerBound_(change.name, insert_at);
+  /* visits the entries of the new library in index order */
+  auto for_each = [&](auto&& visit) {
+    Entry e;
+    for (size_t i = 0; i <= old_count; ++i) {
+      if (change.name && i == insert_at) {
+        if (!visit(change.name, change.record, change.size)) return false;
+      }
+      if (i == old_count) break;
+      if (int(i) == change.remove || !entry(i, e)) continue;
+      if (!visit(e.name, e.record, e.size)) return false;
+    }
+    return true;
+  };
+
+  size_t count = 0;
+  size_t records_size = 0;
+  for_each([&](const char*, const uint8_t*, size_t size) {
+    ++count;
+    records_size += size;
+    return true;
+  });
+  const size_t size = kHeaderSize + count * kEntrySize + records_size;
+  if (change.size > UINT16_MAX || count > UINT16_MAX || size > bank_size_) {
+    LOGE("[IR-Lib] No space left (%zu/%zu bytes)", size, bank_size_);
+    return -1;
+  }
+
+  const int target = active_ == 0 ? 1 : 0;
+  const size_t bank_offset = target * bank_size_;
+  if (esp_partition_erase_range(partition_, bank_offset, bank_size_) !=
+      ESP_OK) {
+    LOGE("[IR-Lib] Failed to erase bank %d", target);
+    return -1;
+  }
+
+  /* the CRC covers the index and then the records, in write order */
+  uint32_t crc = 0;
+  size_t offset = kHeaderSize + count * kEntrySize;
+  size_t index_offset = bank_offset + kHeaderSize;
+  bool ok = for_each([&](const char* name, const uint8_t*, size_t size) {
+    uint8_t e[kEntrySize] = {};
+    strncpy(reinterpret_cast<char*>(e), name, kMaxNameLength);
+    putLe_(e + kNameSize, offset, 4);
+    putLe_(e + kNameSize + 4, size, 2);
+    offset += size;
+    index_offset += kEntrySize;
+    return writeBytes_(index_offset - kEntrySize, e, sizeof(e), crc);
+  });
+  offset = bank_offset + kHeaderSize + count * kEntrySize;
+  ok = ok && for_each([&](const char*, const uint8_t* record, size_t size) {
+    offset += size;
+    return writeBytes_(offset - size, record, size, crc);
+  });
+
+  uint8_t header[kHeaderSize] = {};
+  memcpy(header, kMagic, sizeof(kMagic));
+  header[4] = kVersion;
+  putLe_(header + 6, count, 2);
+  putLe_(header + 8, generation() + 1, 4);
+  putLe_(header + 12, size, 4);
+  putLe_(header + 16, crc, 4);
+  ok = ok && esp_partition_write(partition_, bank_offset, header,
+                                 sizeof(header)) == ESP_OK;
+  if (!ok || !isValidBank_(target)) {
+    LOGE("[IR-Lib] Failed to write bank %d", target);
+    return -1;
+  }
+  return target;
+}
+
+bool IRCodeLibrary::switch_(int bank) {
+  writing_ = false;
+  if (bank < 0) return false;
+  active_ = bank;
+  LOGI("[IR-Lib] %zu codes, %zu/%zu bytes (generation: %" PRIu32 ")",
+       count(), usedBytes(), capacity(), generation());
+  return true;
+}
+
+bool IRCodeLibrary::writeBytes_(size_t offset, const uint8_t* data,
+                                size_t size, uint32_t& crc) {
+  /* data may live in the mapped partition, so stage it in RAM */
+  uint8_t chunk[kCopyChunkSize];
+  for (size_t done = 0; done < size;) {
+    const size_t n = std::min(size - done, sizeof(chunk));
+    memcpy(chunk, data + done, n);
+    if (esp_partition_write(partition_, offset + done, chunk, n) != ESP_OK) {
+      return false;
+    }
+    crc = esp_rom_crc32_le(crc, chunk, n);
+    done += n;
+  }
+  return true;
+}
+
+uint32_t IRCodeLibrary::getLe_(const uint8_t* p, int bytes) {
+  uint32_t value = 0;
+  for (int i = 0; i < bytes; ++i) value |= uint32_t(p[i]) << (8 * i);
+  return value;
+}
+
+void IRCodeLibrary::putLe_(uint8_t* p, uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; ++i) p[i] = value >> (8 * i);
+}
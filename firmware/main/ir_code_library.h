@@ -0,0 +1,194 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <esp_partition.h>
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "ir_code_storage.h"
+#include "ir_protocol.h"
+
+/**
+ * @brief Named IR codes kept in a dedicated, memory-mapped flash partition.
+ *
+ * The partition is split into two banks, each holding a complete library
+ * (multi-byte integers are little endian):
+ *
+ *   "IRLB" | u8 version | u8 reserved | u16 count | u32 generation |
+ *   u32 size | u32 CRC-32 of the rest | index | records
+ *
+ * The index has one `char name[24] | u32 offset | u16 size | u16 reserved`
+ * entry per code, sorted by name, where the offset is from the start of the
+ * bank and the record is an IRCodeStorage record. Lookups and transmission
+ * read the index and the records in place, so codes are never copied to the
+ * heap.
+ *
+ * A change writes the whole library into the other bank, header last, and
+ * begin() picks the valid bank of the newer generation, so an interrupted
+ * write leaves the previous library in place. Records of the active bank
+ * stay valid until the next change after that.
+ *
+ * Readers and changes are serialized by a lock of the caller's. A change
+ * given that lock takes it only to claim the library and to switch banks:
+ * the other bank is erased and written without it, while readers go on with
+ * the active one, and a change made by a lock holder meanwhile fails. A
+ * change without a lock is made by a holder of it.
+ *
+ * A partition table that predates the library, as an OTA update keeps it,
+ * has no partition for it; begin() then fails and the library stays off,
+ * ready() false and every change refused.
+ */
+class IRCodeLibrary {
+ public:
+  static constexpr const char* kPartitionLabel = "ir_codes";
+  static constexpr const uint8_t kPartitionSubtype = 0x40;
+  static constexpr const uint8_t kVersion = 1;
+  static constexpr const size_t kHeaderSize = 20;
+  static constexpr const size_t kEntrySize = 32;
+  static constexpr const size_t kNameSize = 24;
+  static constexpr const size_t kMaxNameLength = kNameSize - 1;
+  static constexpr const uint16_t kTransmitKeyBase = 0x100;
+
+  struct Entry {
+    uint16_t index = 0;
+    const char* name = nullptr;  //< in the mapped partition
+    const uint8_t* record = nullptr;
+    uint16_t size = 0;
+
+    IRProtocol protocol() const { return static_cast<IRProtocol>(record[2]); }
+  };
+
+  ~IRCodeLibrary();
+
+  bool begin();
+  bool ready() const { return base_ != nullptr; }
+  size_t count() const;
+  bool entry(size_t index, Entry& entry) const;
+  bool find(const char* name, Entry& entry) const;
+  size_t usedBytes() const;
+  size_t capacity() const { return bank_size_; }
+  uint32_t generation() const;
+
+  bool put(const char* name, const IRCode& code) {
+    return put(name, code, held_);
+  }
+  bool remove(const char* name) { return remove(name, held_); }
+  bool rename(const char* from, const char* to) {
+    return rename(from, to, held_);
+  }
+  template <typename Lock>
+  bool put(const char* name, const IRCode& code, Lock& lock);
+  template <typename Lock>
+  bool remove(const char* name, Lock& lock);
+  template <typename Lock>
+  bool rename(const char* from, const char* to, Lock& lock);
+
+  static bool isValidName(const char* name);
+  /* one transmitter key per code, so that different codes never coalesce */
+  static uint16_t transmitKey(const Entry& entry) {
+    return kTransmitKeyBase + entry.index;
+  }
+
+ private:
+  /* new library = active library - `remove` + (`name`, `record`) */
+  struct Change {
+    int remove = -1;
+    const char* name = nullptr;
+    const uint8_t* record = nullptr;
+    size_t size = 0;
+  };
+  /* the lock of a caller that holds it already */
+  struct Held {
+    void lock() {}
+    void unlock() {}
+  };
+
+  Held held_;
+
+  const esp_partition_t* partition_ = nullptr;
+  esp_partition_mmap_handle_t mmap_handle_ = 0;
+  const uint8_t* base_ = nullptr;
+  size_t bank_size_ = 0;
+  int active_ = -1;  //< bank in use, or -1 while the library is empty
+  bool writing_ = false;  //< a change is writing the other bank
+
+  const uint8_t* bank_(int bank) const { return base_ + bank * bank_size_; }
+  bool isValidBank_(int bank) const;
+  bool lowerBound_(const char* name, size_t& index) const;
+  template <typename Lock, typename Plan>
+  bool change_(Lock& lock, Plan&& plan);
+  bool claim_();
+  int write_(const Change& change);
+  bool switch_(int bank);
+  bool writeBytes_(size_t offset, const uint8_t* data, size_t size,
+                   uint32_t& crc);
+  static uint32_t getLe_(const uint8_t* p, int bytes);
+  static void putLe_(uint8_t* p, uint32_t value, int bytes);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Lock>
+inline bool IRCodeLibrary::put(const char* name, const IRCode& code,
+                               Lock& lock) {
+  if (!isValidName(name) || code.empty()) return false;
+  std::vector<uint8_t> record;
+  IRCodeStorage::pack(code, record);
+  return change_(lock, [&](Change& change) {
+    size_t index;
+    if (lowerBound_(name, index)) change.remove = index;
+    change.name = name;
+    change.record = record.data();
+    change.size = record.size();
+    return true;
+  });
+}
+
+template <typename Lock>
+inline bool IRCodeLibrary::remove(const char* name, Lock& lock) {
+  return change_(lock, [&](Change& change) {
+    size_t index;
+    if (!lowerBound_(name, index)) return false;
+    change.remove = index;
+    return true;
+  });
+}
+
+template <typename Lock>
+inline bool IRCodeLibrary::rename(const char* from, const char* to,
+                                  Lock& lock) {
+  if (!isValidName(to)) return false;
+  return change_(lock, [&](Change& change) {
+    size_t index, existing;
+    Entry source;
+    if (!lowerBound_(from, index) || lowerBound_(to, existing) ||
+        !entry(index, source)) {
+      return false;
+    }
+    /* the record is copied from the active bank, which is not written */
+    change.remove = index;
+    change.name = to;
+    change.record = source.record;
+    change.size = source.size;
+    return true;
+  });
+}
+
+/* no other change can switch banks once this one is claimed, so the active
+ * bank is read without the lock */
+template <typename Lock, typename Plan>
+inline bool IRCodeLibrary::change_(Lock& lock, Plan&& plan) {
+  {
+    std::lock_guard<Lock> guard(lock);
+    if (!claim_()) return false;
+  }
+  Change change;
+  const int bank = plan(change) ? write_(change) : -1;
+  std::lock_guard<Lock> guard(lock);
+  return switch_(bank);
+}
@@ -0,0 +1,329 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "ir_code_storage.h"
+
+#include <algorithm>
+
+#include "app_log.h"
+
+namespace {
+
+constexpr size_t kHeaderSize = 4;  //< magic, version, protocol, repeat
+constexpr size_t kCrcSize = 2;
+constexpr uint8_t kLiteralIndex = 15;
+constexpr uint8_t kToleranceFlag = 0x80;
+/* widths a carrier period apart are as far apart as a receiver can tell */
+constexpr uint32_t kClusterSpreadUs =
+    1'000'000 / IRRemote::IR_CARRIER_FREQUENCY_HZ;
+
+struct Cluster {
+  uint32_t lo;
+  uint32_t hi;
+  uint32_t sum;
+  uint32_t count;
+  uint32_t tolerance;
+};
+
+}  // namespace
+
+void IRCodeStorage::pack(const IRCode& code, std::vector<uint8_t>& record) {
+  record.clear();
+  record.push_back(kMagic);
+  record.push_back(kVersion);
+  record.push_back(static_cast<uint8_t>(code.protocol));
+  record.push_back(code.repeat);
+  if (code.protocol != IRProtocol::Raw) {
+    record.push_back(code.bits);
+    putVarint_(code.address, record);
+    putVarint64_(code.command, record);
+  } else if (code.raw.empty()) {
+    record.insert(record.end(), code.packed.begin(), code.packed.end());
+  } else {
+    encodeTimings_(code.raw, code.tolerance, record);
+  }
+  const uint16_t crc = crc16_(record.data(), record.size());
+  record.push_back(crc & 0xFF);
+  record.push_back(crc >> 8);
+}
+
+bool IRCodeStorage::unpack(const uint8_t* record, size_t size, IRCode& code) {
+  if (!checkRecord_(record, size)) return false;
+  IRCode result;
+  result.protocol = static_cast<IRProtocol>(record[2]);
+  result.repeat = record[3];
+  const uint8_t* p = record + kHeaderSize;
+  const uint8_t* end = record + size - kCrcSize;
+  if (result.protocol == IRProtocol::Raw) {
+    /* the timings are expanded on first use, see unpack(IRCode&) */
+    result.packed.assign(p, end);
+  } else if (!unpackFields_(p, end, result)) {
+    return false;
+  }
+  code = std::move(result);
+  return true;
+}
+
+bool IRCodeStorage::unpack(IRCode& code) {
+  if (code.protocol != IRProtocol::Raw || code.packed.empty()) return true;
+  if (!decodeTimings(code.packed, code.raw, &code.tolerance)) {
+    LOGE("[IR] Broken packed timings (%zu bytes)", code.packed.size());
+    code.raw.clear();
+    code.tolerance.clear();
+    return false;
+  }
+  code.packed.clear();
+  code.packed.shrink_to_fit();
+  return true;
+}
+
+bool IRCodeStorage::decode(const uint8_t* record, size_t size,
+                           IRRemote::IRData& data) {
+  if (!checkRecord_(record, size)) return false;
+  const uint8_t* p = record + kHeaderSize;
+  const uint8_t* end = record + size - kCrcSize;
+  if (record[2] == static_cast<uint8_t>(IRProtocol::Raw)) {
+    return decodeTimings(p, end, data);
+  }
+  /* a decoded code has no timings, so this IRCode stays off the heap */
+  IRCode code;
+  code.protocol = static_cast<IRProtocol>(record[2]);
+  code.repeat = record[3];
+  return unpackFields_(p, end, code) && IRProtocolCodec::encode(code, data);
+}
+
+bool IRCodeStorage::decodeTimings(const std::vector<uint8_t>& packed,
+                                  IRRemote::IRData& data,
+                                  IRRemote::IRData* tolerance) {
+  return decodeTimings(packed.data(), packed.data() + packed.size(), data,
+                       tolerance);
+}
+
+bool IRCodeStorage::decodeTimings(const uint8_t* p, const uint8_t* end,
+                                  IRRemote::IRData& data,
+                                  IRRemote::IRData* tolerance) {
+  uint32_t count = 0;
+  if (!getVarint_(p, end, count) || count > IRRemote::RAW_DATA_MAX_SIZE ||
+      p == end) {
+    return false;
+  }
+  const bool has_tolerance = *p & kToleranceFlag;
+  const uint8_t dictionary_size = *p++ & ~kToleranceFlag;
+  if (dictionary_size > kMaxDictionarySize) return false;
+  uint32_t dictionary[kMaxDictionarySize];
+  uint32_t bounds[kMaxDictionarySize] = {};
+  for (int i = 0; i < dictionary_size; ++i) {
+    if (!getVarint_(p, end, dictionary[i])) return false;
+    if (has_tolerance && !getVarint_(p, end, bounds[i])) return false;
+  }
+
+  data.clear();
+  data.reserve(count);
+  if (tolerance) tolerance->clear();
+  if (tolerance && has_tolerance) tolerance->reserve(count);
+  while (data.size() < count) {
+    uint32_t run = 0;
+    if (!getVarint_(p, end, run)) return false;
+    const uint8_t index = run & 0x0F;
+    const uint32_t length = run >> 4;
+    if (length == 0 || data.size() + length > count) return false;
+    if (index == kLiteralIndex) {
+      uint32_t width = 0;
+      uint32_t bound = 0;
+      if (length != 1 || !getVarint_(p, end, width)) return false;
+      if (has_tolerance && !getVarint_(p, end, bound)) return false;
+      data.push_back(width);
+      if (tolerance && has_tolerance) tolerance->push_back(bound);
+    } else if (index < dictionary_size) {
+      data.insert(data.end(), length, dictionary[index]);
+      if (tolerance && has_tolerance)
+        tolerance->insert(tolerance->end(), length, bounds[index]);
+    } else {
+      return false;
+    }
+  }
+  return p == end;
+}
+
+bool IRCodeStorage::saveToPreferences(Preferences& prefs, const char* key,
+                                      const IRCode& code) {
+  std::vector<uint8_t> record;
+  pack(code, record);
+  IRRemote::IRData timings;
+  IRProtocolCodec::encode(code, timings);
+  IRProtocolCodec::print(code, key);
+  LOGI("[IR] %s: %zu bytes (raw timings: %zu bytes)", key, record.size(),
+       timings.size() * sizeof(IRRemote::IRDataElement));
+  return record.size() == prefs.putBytes(key, record.data(), record.size());
+}
+
+bool IRCodeStorage::loadFromPreferences(Preferences& prefs, const char* key,
+                                        IRCode& code) {
+  code = IRCode{};
+  const size_t size = prefs.getBytesLength(key);
+  if (size == 0) return false;
+  std::vector<uint8_t> record(size);
+  prefs.getBytes(key, record.data(), size);
+  if (unpack(record.data(), record.size(), code)) {
+    LOGI("[IR] %s: %s (%zu bytes)", key,
+         IRProtocolCodec::protocolName(code.protocol), size);
+    return true;
+  }
+
+  /* codes recorded by older firmware are plain uint16_t arrays */
+  if (size % sizeof(IRRemote::IRDataElement) == 0) {
+    IRRemote::IRData raw;
+    if (!IRRemote::loadFromPreferences(prefs, key, raw)) return false;
+    code = IRProtocolCodec::fromRaw(raw);
+    return true;
+  }
+  LOGE("[IR] %s: broken record (%zu bytes)", key, size);
+  return false;
+}
+
+bool IRCodeStorage::checkRecord_(const uint8_t* record, size_t size) {
+  if (size < kHeaderSize + kCrcSize || record[0] != kMagic ||
+      record[1] < kMinVersion || record[1] > kVersion) {
+    return false;
+  }
+  const size_t body_end = size - kCrcSize;
+  const uint16_t crc = record[body_end] | (record[body_end + 1] << 8);
+  return crc == crc16_(record, body_end) &&
+         record[2] <= static_cast<uint8_t>(IRProtocol::Sony);
+}
+
+bool IRCodeStorage::unpackFields_(const uint8_t* p, const uint8_t* end,
+                                  IRCode& code) {
+  uint32_t address = 0;
+  if (p == end) return false;
+  code.bits = *p++;
+  if (!getVarint_(p, end, address) || !getVarint64_(p, end, code.command) ||
+      p != end) {
+    return false;
+  }
+  code.address = address;
+  return true;
+}
+
+void IRCodeStorage::encodeTimings_(const IRRemote::IRData& data,
+                                   const IRRemote::IRData& tolerance,
+                                   std::vector<uint8_t>& out) {
+  /* cluster the sorted widths, each cluster spanning at most a carrier
+   * period, so that a width comes back within that of what was captured */
+  IRRemote::IRData sorted(data);
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<Cluster> clusters;
+  for (const uint32_t width : sorted) {
+    if (clusters.empty() || width > clusters.back().lo + kClusterSpreadUs) {
+      clusters.push_back({width, width, 0, 0, 0});
+    }
+    clusters.back().hi = width;
+    clusters.back().sum += width;
+    clusters.back().count++;
+  }
+
+  /* the most frequent clusters form the dictionary, the rest are literals */
+  if (clusters.size() > kMaxDictionarySize) {
+    std::stable_sort(clusters.begin(), clusters.end(),
+                     [](const Cluster& a, const Cluster& b) {
+                       return a.count > b.count;
+                     });
+    clusters.resize(kMaxDictionarySize);
+  }
+
+  auto lookup = [&clusters](uint32_t width) -> uint8_t {
+    for (size_t i = 0; i < clusters.size(); ++i) {
+      if (clusters[i].lo <= width && width <= clusters[i].hi) return i;
+    }
+    return kLiteralIndex;
+  };
+
+  auto mean = [](const Cluster& cluster) -> uint32_t {
+    return (cluster.sum + cluster.count / 2) / cluster.count;
+  };
+
+  /* a shared width keeps the loosest bound of its elements, widened by how
+   * far each element moves when it is replaced by the shared width */
+  const bool has_tolerance = tolerance.size() == data.size();
+  if (has_tolerance) {
+    for (size_t i = 0; i < data.size(); ++i) {
+      const uint8_t index = lookup(data[i]);
+      if (index == kLiteralIndex) continue;
+      const uint32_t width = mean(clusters[index]);
+      const uint32_t shift =
+          data[i] > width ? data[i] - width : width - data[i];
+      clusters[index].tolerance =
+          std::max<uint32_t>(clusters[index].tolerance, tolerance[i] + shift);
+    }
+  }
+
+  putVarint_(data.size(), out);
+  out.push_back(clusters.size() | (has_tolerance ? kToleranceFlag : 0));
+  for (const auto& cluster : clusters) {
+    putVarint_(mean(cluster), out);
+    if (has_tolerance) putVarint_(cluster.tolerance, out);
+  }
+
+  for (size_t i = 0; i < data.size();) {
+    const uint8_t index = lookup(data[i]);
+    if (index == kLiteralIndex) {
+      putVarint_((1 << 4) | kLiteralIndex, out);
+      if (has_tolerance) {
+        putVarint_(data[i], out);
+        putVarint_(tolerance[i++], out);
+      } else {
+        putVarint_(data[i++], out);
+      }
+      continue;
+    }
+    size_t j = i + 1;
+    while (j < data.size() && lookup(data[j]) == index) ++j;
+    putVarint_(((j - i) << 4) | index, out);
+    i = j;
+  }
+}
+
+void IRCodeStorage::putVarint_(uint32_t value, std::vector<uint8_t>& out) {
+  putVarint64_(value, out);
+}
+
+void IRCodeStorage::putVarint64_(uint64_t value, std::vector<uint8_t>& out) {
+  while (value >= 0x80) {
+    out.push_back((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  out.push_back(value);
+}
+
+bool IRCodeStorage::getVarint_(const uint8_t*& p, const uint8_t* end,
+                               uint32_t& value) {
+  uint64_t value64 = 0;
+  if (!getVarint64_(p, end, value64) || value64 > UINT32_MAX) return false;
+  value = value64;
+  return true;
+}
+
+bool IRCodeStorage::getVarint64_(const uint8_t*& p, const uint8_t* end,
+                                 uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && p < end; shift += 7) {
+    const uint8_t byte = *p++;
+    value |= uint64_t(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) return true;
+  }
+  return false;
+}
+
+uint16_t IRCodeStorage::crc16_(const uint8_t* data, size_t size) {
+  /* CRC-16/CCITT-FALSE */
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < size; ++i) {
+    crc ^= uint16_t(data[i]) << 8;
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
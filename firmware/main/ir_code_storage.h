@@ -0,0 +1,73 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Preferences.h>
+
+#include <vector>
+
+#include "ir_protocol.h"
+
+/**
+ * @brief Compact, versioned on-flash encoding of learned IR codes.
+ *
+ * Record layout (version 2, multi-byte integers are little endian):
+ *
+ *   'I' | version | protocol | repeat | body | CRC-16/CCITT
+ *
+ * The body of a decoded code is `bits | varint address | varint command`.
+ * The body of a raw code is `varint count | k | k varint widths | runs`:
+ * the timings are clustered into a dictionary of at most 15 widths [us],
+ * each the mean of widths that lie within a carrier period of each other
+ * (26 us at 38 kHz), and each run of equal dictionary entries is a varint of
+ * `(length << 4) | index`. Index 15 escapes a single width that is not in
+ * the dictionary and is followed by its varint value. When bit 7 of k is
+ * set, every dictionary width and escaped width is followed by the varint
+ * bound of a learned template (IRCode::tolerance). Version 1 records are
+ * the same without that bit.
+ *
+ * Raw timings are kept packed in IRCode::packed when loaded and are only
+ * expanded by unpack() when the code is first used. decode() expands a
+ * record in place, e.g. from memory-mapped flash, without an IRCode.
+ */
+class IRCodeStorage {
+ public:
+  static constexpr const uint8_t kMagic = 'I';
+  static constexpr const uint8_t kVersion = 2;
+  static constexpr const uint8_t kMinVersion = 1;
+  static constexpr const size_t kMaxDictionarySize = 15;
+
+  static void pack(const IRCode& code, std::vector<uint8_t>& record);
+  static bool unpack(const uint8_t* record, size_t size, IRCode& code);
+  static bool unpack(IRCode& code);
+  static bool decode(const uint8_t* record, size_t size,
+                     IRRemote::IRData& data);
+  static bool decodeTimings(const std::vector<uint8_t>& packed,
+                            IRRemote::IRData& data,
+                            IRRemote::IRData* tolerance = nullptr);
+  static bool decodeTimings(const uint8_t* p, const uint8_t* end,
+                            IRRemote::IRData& data,
+                            IRRemote::IRData* tolerance = nullptr);
+
+  static bool saveToPreferences(Preferences& prefs, const char* key,
+                                const IRCode& code);
+  static bool loadFromPreferences(Preferences& prefs, const char* key,
+                                  IRCode& code);
+
+ private:
+  static bool checkRecord_(const uint8_t* record, size_t size);
+  static bool unpackFields_(const uint8_t* p, const uint8_t* end,
+                            IRCode& code);
+  static void encodeTimings_(const IRRemote::IRData& data,
+                             const IRRemote::IRData& tolerance,
+                             std::vector<uint8_t>& out);
+  static void putVarint_(uint32_t value, std::vector<uint8_t>& out);
+  static void putVarint64_(uint64_t value, std::vector<uint8_t>& out);
+  static bool getVarint_(const uint8_t*& p, const uint8_t* end,
+                         uint32_t& value);
+  static bool getVarint64_(const uint8_t*& p, const uint8_t* end,
+                           uint64_t& value);
+  static uint16_t crc16_(const uint8_t* data, size_t size);
+};
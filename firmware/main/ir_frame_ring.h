@@ -0,0 +1,69 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Single-producer/single-consumer ring of frame slots.
+ *
+ * The producer (an ISR) fills the slot returned by acquire() and publishes
+ * it; the consumer (the main loop) reads front(), or any published slot
+ * through peek(), and pops it. The indices
+ * are free-running counters exchanged with acquire/release ordering, so the
+ * ring is safe when both sides run on different cores.
+ */
+template <typename Frame, size_t kSlots>
+class IRFrameRing {
+  static_assert(kSlots && (kSlots & (kSlots - 1)) == 0,
+                "kSlots must be a power of two");
+
+ public:
+  /* producer side */
+  Frame* acquire() {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= kSlots) {
+      overflow_count_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    return &slots_[head & (kSlots - 1)];
+  }
+  void publish() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+
+  /* consumer side */
+  const Frame* front() const { return peek(0); }
+  const Frame* peek(size_t index) const {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) - tail <= index) return nullptr;
+    return &slots_[(tail + index) & (kSlots - 1)];
+  }
+  void pop() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+  }
+  void clear() {
+    tail_.store(head_.load(std::memory_order_acquire),
+                std::memory_order_release);
+  }
+
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+  uint32_t overflowCount() const {
+    return overflow_count_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  Frame slots_[kSlots];
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+  std::atomic<uint32_t> overflow_count_{0};
+};
@@ -0,0 +1,143 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "ir_learner.h"
+
+#include <algorithm>
+
+#include "app_log.h"
+
+void IRLearner::begin(int captures) {
+  target_ = std::max(1, std::min(captures, kMaxCaptures));
+  captures_.clear();
+}
+
+bool IRLearner::add(const IRRemote::IRData& data) {
+  if (count() < target_) captures_.push_back(data);
+  LOGI("[IR] Captured %d/%d (size: %zu)", count(), target_, data.size());
+  return count() >= target_;
+}
+
+bool IRLearner::build(IRCode& code) const {
+  code = IRCode{};
+  if (captures_.empty()) return false;
+  if (buildDecoded_(code)) return true;
+  return buildRaw_(code);
+}
+
+bool IRLearner::isAmbiguous(const IRCode& a, const IRCode& b) {
+  if (a.empty() || b.empty() || a.protocol != b.protocol) return false;
+  if (a.protocol != IRProtocol::Raw) {
+    return a.bits == b.bits && a.address == b.address &&
+           a.command == b.command;
+  }
+  if (a.raw.size() != b.raw.size()) return false;
+  /* codes learned from a single frame are matched with a 50% tolerance */
+  for (size_t i = 0; i < a.raw.size(); ++i) {
+    const uint32_t ta = a.tolerance.empty() ? a.raw[i] / 2 : a.tolerance[i];
+    const uint32_t tb = b.tolerance.empty() ? b.raw[i] / 2 : b.tolerance[i];
+    if (a.raw[i] > b.raw[i] + ta + tb || b.raw[i] > a.raw[i] + ta + tb)
+      return false;
+  }
+  return true;
+}
+
+bool IRLearner::buildDecoded_(IRCode& code) const {
+  /* a protocol code wins when more than half of the captures agree on it */
+  std::vector<IRCode> decoded;
+  for (const auto& data : captures_) {
+    IRCode candidate;
+    if (IRProtocolCodec::decode(data, candidate)) decoded.push_back(candidate);
+  }
+  for (const auto& candidate : decoded) {
+    const int votes = std::count_if(
+        decoded.begin(), decoded.end(), [&candidate](const IRCode& other) {
+          return IRProtocolCodec::matches(other, candidate);
+        });
+    if (2 * votes > count()) {
+      code = candidate;
+      LOGI("[IR] Learned %s code from %d/%d captures",
+           IRProtocolCodec::protocolName(code.protocol), votes, count());
+      return true;
+    }
+  }
+  return false;
+}
+
+bool IRLearner::buildRaw_(IRCode& code) const {
+  /* align on the most common frame length, preferring the shorter one */
+  size_t length = 0;
+  int length_votes = 0;
+  for (const auto& data : captures_) {
+    const int votes = std::count_if(
+        captures_.begin(), captures_.end(),
+        [&data](const IRRemote::IRData& other) {
+          return other.size() == data.size();
+        });
+    if (votes > length_votes ||
+        (votes == length_votes && data.size() < length)) {
+      length = data.size();
+      length_votes = votes;
+    }
+  }
+  if (length < IRRemote::RAW_DATA_MIN_SIZE) return false;
+  std::vector<const IRRemote::IRData*> aligned;
+  for (const auto& data : captures_) {
+    if (data.size() == length) aligned.push_back(&data);
+  }
+
+  /* the median of each element rejects a single bad capture */
+  std::vector<uint32_t> medians(length);
+  std::vector<uint32_t> samples(aligned.size());
+  for (size_t i = 0; i < length; ++i) {
+    for (size_t j = 0; j < aligned.size(); ++j) samples[j] = (*aligned[j])[i];
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2,
+                     samples.end());
+    medians[i] = samples[samples.size() / 2];
+  }
+
+  /* cluster the medians, starting a new cluster beyond +20%+50us */
+  std::vector<size_t> order(length);
+  for (size_t i = 0; i < length; ++i) order[i] = i;
+  std::sort(order.begin(), order.end(),
+            [&medians](size_t a, size_t b) { return medians[a] < medians[b]; });
+  code.raw.resize(length);
+  code.tolerance.resize(length);
+  size_t clusters = 0;
+  for (size_t begin = 0; begin < length;) {
+    const uint32_t lo = medians[order[begin]];
+    size_t end = begin;
+    uint32_t sum = 0;
+    while (end < length && medians[order[end]] <= lo + lo / 5 + 50) {
+      sum += medians[order[end++]];
+    }
+    const uint32_t width = (sum + (end - begin) / 2) / (end - begin);
+    uint32_t spread = 0;
+    for (size_t k = begin; k < end; ++k) {
+      for (const auto* data : aligned) {
+        const uint32_t sample = (*data)[order[k]];
+        spread = std::max(spread, sample > width ? sample - width
+                                                 : width - sample);
+      }
+    }
+    const uint32_t tolerance =
+        std::min<uint32_t>(spread + jitterMargin_(width), UINT16_MAX);
+    for (size_t k = begin; k < end; ++k) {
+      code.raw[order[k]] = width;
+      code.tolerance[order[k]] = tolerance;
+    }
+    ++clusters;
+    begin = end;
+  }
+  LOGI("[IR] Learned raw template (size: %zu, widths: %zu) from %zu/%d "
+       "captures",
+       length, clusters, aligned.size(), count());
+  return true;
+}
+
+uint32_t IRLearner::jitterMargin_(uint32_t width) {
+  /* what a later press may add on top of the spread seen while learning */
+  return width / 8 + 60;
+}
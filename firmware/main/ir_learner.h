@@ -0,0 +1,40 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <vector>
+
+#include "ir_protocol.h"
+
+/**
+ * @brief Builds a learned IR code from several presses of the same button.
+ *
+ * Frames that decode to a known protocol are decided by majority vote. The
+ * others are aligned by length and every element is clustered with the
+ * widths of the other captures, giving a canonical template whose
+ * per-element bounds cover the observed spread plus a jitter margin.
+ */
+class IRLearner {
+ public:
+  static constexpr const int kCapturesDefault = 3;
+  static constexpr const int kMaxCaptures = 8;
+
+  void begin(int captures = kCapturesDefault);
+  bool add(const IRRemote::IRData& data);  //< true when all captures are in
+  int count() const { return captures_.size(); }
+  int target() const { return target_; }
+  bool build(IRCode& code) const;
+
+  /* whether a frame could match both codes */
+  static bool isAmbiguous(const IRCode& a, const IRCode& b);
+
+ private:
+  int target_ = kCapturesDefault;
+  std::vector<IRRemote::IRData> captures_;
+
+  bool buildDecoded_(IRCode& code) const;
+  bool buildRaw_(IRCode& code) const;
+  static uint32_t jitterMargin_(uint32_t width);
+};
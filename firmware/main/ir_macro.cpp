@@ -0,0 +1,335 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "ir_macro.h"
+
+#include <cctype>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+#include "app_log.h"
+
+namespace {
+
+using Op = IRMacro::Op;
+using Cond = IRMacro::Cond;
+
+constexpr const char* kCondNames[] = {"up", "down", "steps", "on", "off"};
+
+/* copies the next token into `token`, returns false at the end of text */
+bool nextToken(const char*& p, char* token, size_t size) {
+  while (*p && (isspace(static_cast<unsigned char>(*p)) || *p == ';')) ++p;
+  if (!*p) return false;
+  size_t length = 0;
+  while (*p && !isspace(static_cast<unsigned char>(*p)) && *p != ';') {
+    if (length + 1 < size) token[length] = *p;
+    ++length;
+    ++p;
+  }
+  token[length < size ? length : size - 1] = '\0';
+  return length < size;
+}
+
+bool parseNumber(const char* token, long min, long max, long& value) {
+  char* end = nullptr;
+  value = strtol(token, &end, 10);
+  return *token && *end == '\0' && value >= min && value <= max;
+}
+
+bool parseCond(const char* token, Cond& cond) {
+  for (size_t i = 0; i < sizeof(kCondNames) / sizeof(kCondNames[0]); ++i) {
+    if (strcmp(token, kCondNames[i]) == 0) {
+      cond = static_cast<Cond>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+bool IRMacro::compile(const char* text, Program& program) {
+  enum class Kind : uint8_t { Repeat, If, Else, While };
+  struct Block {
+    Kind kind;
+    uint8_t start;  //< first instruction of the loop
+    uint8_t patch;  //< offset byte of the forward jump
+  };
+  Block blocks[kMaxDepth];
+  size_t depth = 0;
+  program = Program{};
+
+  /* one byte stays reserved for the final End */
+  auto emit = [&program](std::initializer_list<uint8_t> bytes) {
+    if (program.size + bytes.size() >= kMaxCodeSize) {
+      LOGE("[IR-Macro] Longer than %zu bytes", kMaxCodeSize);
+      return false;
+    }
+    for (const uint8_t byte : bytes) program.code[program.size++] = byte;
+    return true;
+  };
+  auto patch = [&program](uint8_t at) {
+    const int offset = program.size - (at + 1);
+    if (offset > INT8_MAX) return false;
+    program.code[at] = offset;
+    return true;
+  };
+  auto fail = [](const char* reason, const char* token) {
+    LOGE("[IR-Macro] %s: %s", reason, token);
+    return false;
+  };
+
+  char token[IRCodeLibrary::kNameSize + 1];
+  char arg[IRCodeLibrary::kNameSize + 1];
+  for (const char* p = text; nextToken(p, token, sizeof(token));) {
+    long value;
+    Cond cond;
+    if (strcmp(token, "send") == 0) {
+      if (!nextToken(p, arg, sizeof(arg)) ||
+          !IRCodeLibrary::isValidName(arg)) {
+        return fail("Invalid code name", arg);
+      }
+      size_t index = 0;
+      while (index < program.name_count &&
+             strcmp(program.names[index], arg) != 0) {
+        ++index;
+      }
+      if (index == kMaxNames) return fail("Too many codes", arg);
+      if (index == program.name_count) {
+        strlcpy(program.names[program.name_count++], arg,
+                IRCodeLibrary::kNameSize);
+      }
+      if (!emit({uint8_t(Op::Send), uint8_t(index)})) return false;
+    } else if (strcmp(token, "wait") == 0) {
+      if (!nextToken(p, arg, sizeof(arg)) ||
+          !parseNumber(arg, 0, UINT16_MAX, value)) {
+        return fail("Invalid wait", arg);
+      }
+      if (!emit({uint8_t(Op::Wait), uint8_t(value), uint8_t(value >> 8)})) {
+        return false;
+      }
+    } else if (strcmp(token, "step") == 0) {
+      if (!emit({uint8_t(Op::Step)})) return false;
+    } else if (strcmp(token, "repeat") == 0 || strcmp(token, "if") == 0 ||
+               strcmp(token, "while") == 0) {
+      if (depth == kMaxDepth) return fail("Too deeply nested", token);
+      if (!nextToken(p, arg, sizeof(arg))) {
+        return fail("Missing argument", token);
+      }
+      Block& block = blocks[depth++];
+      block.start = program.size;
+      if (token[0] == 'r') {
+        if (!parseNumber(arg, 1, UINT8_MAX, value)) {
+          return fail("Invalid count", arg);
+        }
+        block.kind = Kind::Repeat;
+        if (!emit({uint8_t(Op::Repeat), uint8_t(value)})) return false;
+        block.start = program.size;
+        continue;
+      }
+      if (!parseCond(arg, cond)) return fail("Invalid condition", arg);
+      block.kind = token[0] == 'i' ? Kind::If : Kind::While;
+      if (!emit({uint8_t(Op::JumpUnless), uint8_t(cond), 0})) return false;
+      block.patch = program.size - 1;
+    } else if (strcmp(token, "else") == 0) {
+      if (depth == 0 || blocks[depth - 1].kind != Kind::If) {
+        return fail("Unexpected", token);
+      }
+      Block& block = blocks[depth - 1];
+      if (!emit({uint8_t(Op::Jump), 0})) return false;
+      if (!patch(block.patch)) return fail("Block too long", token);
+      block.kind = Kind::Else;
+      block.patch = program.size - 1;
+    } else if (strcmp(token, "end") == 0) {
+      if (depth == 0) return fail("Unexpected", token);
+      const Block& block = blocks[--depth];
+      if (block.kind == Kind::Repeat) {
+        const int back = program.size + 2 - block.start;
+        if (back > UINT8_MAX) return fail("Block too long", token);
+        if (!emit({uint8_t(Op::Loop), uint8_t(back)})) return false;
+        continue;
+      }
+      if (block.kind == Kind::While) {
+        const int offset = block.start - (program.size + 2);
+        if (offset < INT8_MIN) return fail("Block too long", token);
+        if (!emit({uint8_t(Op::Jump), uint8_t(int8_t(offset))})) {
+          return false;
+        }
+      }
+      if (!patch(block.patch)) return fail("Block too long", token);
+    } else {
+      return fail("Unknown statement", token);
+    }
+  }
+  if (depth) return fail("Missing", "end");
+  program.code[program.size++] = uint8_t(Op::End);
+  return true;
+}
+
+void IRMacro::print(const Program& program) {
+  for (size_t pc = 0; pc < program.size;) {
+    const uint8_t* p = program.code + pc;
+    switch (static_cast<Op>(p[0])) {
+      case Op::End:
+        LOGI("[IR-Macro] %3zu end", pc);
+        pc += 1;
+        break;
+      case Op::Send:
+        LOGI("[IR-Macro] %3zu send %s", pc, program.names[p[1]]);
+        pc += 2;
+        break;
+      case Op::Wait:
+        LOGI("[IR-Macro] %3zu wait %u", pc, p[1] | p[2] << 8);
+        pc += 3;
+        break;
+      case Op::Step:
+        LOGI("[IR-Macro] %3zu step", pc);
+        pc += 1;
+        break;
+      case Op::Repeat:
+        LOGI("[IR-Macro] %3zu repeat %u", pc, p[1]);
+        pc += 2;
+        break;
+      case Op::Loop:
+        LOGI("[IR-Macro] %3zu loop -> %zu", pc, pc + 2 - p[1]);
+        pc += 2;
+        break;
+      case Op::Jump:
+        LOGI("[IR-Macro] %3zu jump -> %zu", pc, pc + 2 + int8_t(p[1]));
+        pc += 2;
+        break;
+      case Op::JumpUnless:
+        LOGI("[IR-Macro] %3zu unless %s -> %zu", pc,
+             condName(static_cast<Cond>(p[1])), pc + 3 + int8_t(p[2]));
+        pc += 3;
+        break;
+      default:
+        LOGE("[IR-Macro] %3zu broken opcode %u", pc, p[0]);
+        return;
+    }
+  }
+  LOGI("[IR-Macro] %u bytes, %u codes", program.size, program.name_count);
+}
+
+const char* IRMacro::condName(Cond cond) {
+  const size_t index = static_cast<size_t>(cond);
+  constexpr size_t count = sizeof(kCondNames) / sizeof(kCondNames[0]);
+  return index < count ? kCondNames[index] : "?";
+}
+
+bool IRMacroRunner::start(const IRMacro::Program& program, int argument,
+                          uint32_t delay_ms) {
+  if (program.size == 0) return false;
+  if (running_) LOGW("[IR-Macro] Previous run canceled");
+  program_ = program;
+  running_ = true;
+  sending_ = false;
+  pc_ = 0;
+  depth_ = 0;
+  argument_ = argument;
+  wait_until_ms_ = AppClock::millis() + delay_ms;
+  presses_ = 0;
+  return true;
+}
+
+void IRMacroRunner::cancel() {
+  if (!running_) return;
+  running_ = false;
+  LOGW("[IR-Macro] Canceled (%" PRIu32 " presses)", presses_);
+}
+
+void IRMacroRunner::handle(bool light_on) {
+  if (!running_) return;
+  if (sending_) {
+    if (transmitter_.pending(key_)) return;
+    /* the press is on air, the next one may be queued behind it */
+    sending_ = false;
+    wait_until_ms_ = AppClock::millis();
+  }
+  if (int32_t(AppClock::millis() - wait_until_ms_) < 0) return;
+
+  for (int ops = 0; ops < kMaxOpsPerHandle; ++ops) {
+    if (pc_ >= program_.size) return fail_("broken bytecode");
+    const uint8_t* p = program_.code + pc_;
+    switch (static_cast<IRMacro::Op>(p[0])) {
+      case IRMacro::Op::End:
+        running_ = false;
+        LOGI("[IR-Macro] Done (%" PRIu32 " presses)", presses_);
+        return;
+      case IRMacro::Op::Send: {
+        const char* name = program_.names[p[1]];
+        IRCodeLibrary::Entry entry;
+        if (!library_.find(name, entry)) {
+          LOGE("[IR-Macro] %s not found", name);
+          return fail_("missing code");
+        }
+        if (!transmitter_.post(key_, entry.record, entry.size, entry.name,
+                               IRTransmitter::Priority::Normal, 0)) {
+          return fail_("transmitter busy");
+        }
+        ++presses_;
+        sending_ = true;
+        pc_ += 2;
+        return;
+      }
+      case IRMacro::Op::Wait:
+        wait_until_ms_ = AppClock::millis() + (p[1] | p[2] << 8);
+        pc_ += 3;
+        return;
+      case IRMacro::Op::Step:
+        argument_ += argument_ > 0 ? -1 : argument_ < 0 ? 1 : 0;
+        pc_ += 1;
+        break;
+      case IRMacro::Op::Repeat:
+        if (depth_ == IRMacro::kMaxDepth) return fail_("nested");
+        counters_[depth_++] = p[1];
+        pc_ += 2;
+        break;
+      case IRMacro::Op::Loop:
+        if (depth_ == 0) return fail_("broken bytecode");
+        if (--counters_[depth_ - 1] > 0) {
+          pc_ = pc_ + 2 - p[1];
+        } else {
+          --depth_;
+          pc_ += 2;
+        }
+        break;
+      case IRMacro::Op::Jump:
+        pc_ = pc_ + 2 + int8_t(p[1]);
+        break;
+      case IRMacro::Op::JumpUnless:
+        pc_ += 3;
+        if (!test_(static_cast<IRMacro::Cond>(p[1]), light_on)) {
+          pc_ += int8_t(p[2]);
+        }
+        break;
+      default:
+        return fail_("broken bytecode");
+    }
+  }
+}
+
+bool IRMacroRunner::test_(IRMacro::Cond cond, bool light_on) const {
+  switch (cond) {
+    case IRMacro::Cond::Up:
+      return argument_ > 0;
+    case IRMacro::Cond::Down:
+      return argument_ < 0;
+    case IRMacro::Cond::Steps:
+      return argument_ != 0;
+    case IRMacro::Cond::On:
+      return light_on;
+    case IRMacro::Cond::Off:
+      return !light_on;
+  }
+  return false;
+}
+
+void IRMacroRunner::fail_(const char* reason) {
+  running_ = false;
+  LOGE("[IR-Macro] Aborted at %u: %s", pc_, reason);
+}
@@ -0,0 +1,108 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ir_code_library.h"
+#include "ir_transmitter.h"
+
+/**
+ * @brief Timed sequences of IR library codes, compiled into a bytecode.
+ *
+ * A macro is written as a line of statements separated by spaces or `;`:
+ *
+ *   send <name>                    press the library code <name>
+ *   wait <ms>                      pause between presses
+ *   step                           move the argument one step toward zero
+ *   repeat <n> ... end             run the body n (1-255) times
+ *   if <cond> ... [else ...] end   run the body on a condition
+ *   while <cond> ... end           run the body as long as a condition holds
+ *
+ * where <cond> is `up`, `down` or `steps` (the argument is positive,
+ * negative or not zero) or `on` / `off` (the light). The argument is a
+ * signed register that the owner of a run may change while it is running,
+ * e.g. to retarget a dimming run.
+ *
+ * Bytecode (jump offsets are signed, from the end of the instruction):
+ *
+ *   End | Send u8 name | Wait u16 ms | Step | Repeat u8 n | Loop u8 back |
+ *   Jump s8 offset | JumpUnless u8 cond s8 offset
+ */
+class IRMacro {
+ public:
+  static constexpr const size_t kMaxCodeSize = 128;
+  static constexpr const size_t kMaxNames = 8;
+  static constexpr const size_t kMaxDepth = 4;  //< nested blocks
+
+  enum class Op : uint8_t {
+    End,
+    Send,
+    Wait,
+    Step,
+    Repeat,
+    Loop,
+    Jump,
+    JumpUnless,
+  };
+  enum class Cond : uint8_t { Up, Down, Steps, On, Off };
+
+  struct Program {
+    uint8_t code[kMaxCodeSize] = {};
+    uint8_t size = 0;
+    uint8_t name_count = 0;
+    char names[kMaxNames][IRCodeLibrary::kNameSize] = {};
+  };
+
+  static bool compile(const char* text, Program& program);
+  static void print(const Program& program);
+  static const char* condName(Cond cond);
+};
+
+/**
+ * @brief Runs one macro at a time without blocking the controller loop.
+ *
+ * handle() is ticked from the loop and executes instructions until the run
+ * has to wait. Presses are pipelined: a press is posted to the transmitter
+ * under the key of the runner, and the next instruction runs as soon as the
+ * transmit task has taken it, so the following press is already queued
+ * while the previous one is on air. A wait starts at that point, too.
+ */
+class IRMacroRunner {
+ public:
+  static constexpr const int kMaxOpsPerHandle = 32;
+
+  IRMacroRunner(IRCodeLibrary& library, IRTransmitter& transmitter,
+                uint16_t transmit_key)
+      : library_(library), transmitter_(transmitter), key_(transmit_key) {}
+
+  bool start(const IRMacro::Program& program, int argument = 0,
+             uint32_t delay_ms = 0);
+  void cancel();
+  void handle(bool light_on);
+
+  bool running() const { return running_; }
+  int argument() const { return argument_; }
+  void setArgument(int argument) { argument_ = argument; }
+  uint32_t presses() const { return presses_; }
+
+ private:
+  IRCodeLibrary& library_;
+  IRTransmitter& transmitter_;
+  const uint16_t key_;
+  IRMacro::Program program_;
+  bool running_ = false;
+  bool sending_ = false;  //< the last press is still pending
+  uint8_t pc_ = 0;
+  uint8_t depth_ = 0;
+  uint8_t counters_[IRMacro::kMaxDepth] = {};
+  int argument_ = 0;
+  uint32_t wait_until_ms_ = 0;
+  uint32_t presses_ = 0;
+
+  bool test_(IRMacro::Cond cond, bool light_on) const;
+  void fail_(const char* reason);
+};
@@ -0,0 +1,266 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "ir_protocol.h"
+
+#include <cinttypes>
+
+#include "app_log.h"
+#include "ir_code_storage.h"
+
+namespace {
+
+constexpr uint16_t kSonyHeaderMark = 2400;
+constexpr uint16_t kSonyUnit = 600;
+constexpr uint16_t kSonyFramePeriod = 45'000;
+constexpr uint16_t kNecRepeatSpace = 2250;
+constexpr uint16_t kMinFrameGapUs = 4'000;
+
+}  // namespace
+
+const IRProtocolCodec::PulseDistanceFormat IRProtocolCodec::kNec = {
+    9000, 4500, 560, 560, 1690, 40'000,
+};
+const IRProtocolCodec::PulseDistanceFormat IRProtocolCodec::kAeha = {
+    3400, 1700, 425, 425, 1275, 13'000,
+};
+
+bool IRProtocolCodec::decode(const IRRemote::IRData& data, IRCode& code) {
+  code = IRCode{};
+  size_t index = 0;
+  uint64_t payload = 0;
+  if (decodePulseDistance_(data, index, kNec, code.bits, payload) &&
+      code.bits == 32) {
+    code.protocol = IRProtocol::NEC;
+  } else if (decodePulseDistance_(data, index = 0, kAeha, code.bits,
+                                  payload) &&
+             code.bits >= 16) {
+    code.protocol = IRProtocol::AEHA;
+  } else if (decodeSony_(data, index = 0, code.bits, payload) &&
+             (code.bits == 12 || code.bits == 15 || code.bits == 20)) {
+    code.protocol = IRProtocol::Sony;
+  } else {
+    code = IRCode{};
+    return false;
+  }
+
+  /* everything after the first frame must be a repetition of it, otherwise
+   * the code would not survive an encode round trip */
+  while (index < data.size()) {
+    if (data[index++] < kMinFrameGapUs) return false;
+    uint8_t repeat_bits = 0;
+    uint64_t repeat_payload = 0;
+    if (code.protocol == IRProtocol::NEC && index + 3 <= data.size() &&
+        isNear_(data[index], kNec.header_mark) &&
+        isNear_(data[index + 1], kNecRepeatSpace) &&
+        isNear_(data[index + 2], kNec.bit_mark)) {
+      index += 3;
+    } else if (code.protocol == IRProtocol::Sony) {
+      if (!decodeSony_(data, index, repeat_bits, repeat_payload)) return false;
+    } else {
+      const auto& format = code.protocol == IRProtocol::NEC ? kNec : kAeha;
+      if (!decodePulseDistance_(data, index, format, repeat_bits,
+                                repeat_payload)) {
+        return false;
+      }
+    }
+    if (repeat_bits && (repeat_bits != code.bits || repeat_payload != payload))
+      return false;
+    if (code.repeat < UINT8_MAX) ++code.repeat;
+  }
+
+  if (code.protocol == IRProtocol::Sony) {
+    code.command = payload & 0x7F;
+    code.address = payload >> 7;
+  } else {
+    code.address = payload & 0xFFFF;
+    code.command = payload >> 16;
+  }
+  return true;
+}
+
+bool IRProtocolCodec::encode(const IRCode& code, IRRemote::IRData& data) {
+  data.clear();
+  switch (code.protocol) {
+    case IRProtocol::Raw:
+      if (code.raw.empty() && !code.packed.empty())
+        return IRCodeStorage::decodeTimings(code.packed, data);
+      data = code.raw;
+      return !data.empty();
+    case IRProtocol::NEC:
+    case IRProtocol::AEHA: {
+      const auto& format = code.protocol == IRProtocol::NEC ? kNec : kAeha;
+      const uint64_t payload = code.address | (code.command << 16);
+      encodePulseDistance_(format, code.bits, payload, data);
+      for (int i = 0; i < code.repeat; ++i) {
+        data.push_back(format.frame_gap);
+        if (code.protocol == IRProtocol::NEC) {
+          data.insert(data.end(),
+                      {kNec.header_mark, kNecRepeatSpace, kNec.bit_mark});
+        } else {
+          encodePulseDistance_(format, code.bits, payload, data);
+        }
+      }
+      return true;
+    }
+    case IRProtocol::Sony: {
+      const uint64_t payload = code.command | (uint64_t(code.address) << 7);
+      for (int i = 0; i <= code.repeat; ++i) {
+        const size_t start = data.size();
+        encodeSony_(code.bits, payload, data);
+        if (i == code.repeat) break;
+        uint32_t duration = 0;
+        for (size_t j = start; j < data.size(); ++j) duration += data[j];
+        data.push_back(kSonyFramePeriod > duration + kMinFrameGapUs
+                           ? kSonyFramePeriod - duration
+                           : kMinFrameGapUs);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+IRCode IRProtocolCodec::fromRaw(const IRRemote::IRData& data) {
+  IRCode code;
+  if (decode(data, code)) return code;
+  /* the first frame may have been decoded before a mismatching one */
+  code = IRCode{};
+  code.raw = data;
+  return code;
+}
+
+bool IRProtocolCodec::matches(const IRCode& received, const IRCode& learned) {
+  if (received.protocol != learned.protocol) return false;
+  if (learned.protocol == IRProtocol::Raw) {
+    if (received.raw.size() != learned.raw.size()) return false;
+    for (size_t i = 0; i < learned.raw.size(); ++i) {
+      uint32_t min, max;
+      rawBounds(learned, i, min, max);
+      if (received.raw[i] < min || received.raw[i] > max) return false;
+    }
+    return true;
+  }
+  return received.bits == learned.bits && received.address == learned.address &&
+         received.command == learned.command;
+}
+
+void IRProtocolCodec::rawBounds(const IRCode& learned, size_t index,
+                                uint32_t& min, uint32_t& max) {
+  const uint32_t width = learned.raw[index];
+  /* the bound of a learned template, or half the width, as
+   * IRRemote::isIrDataEqual() allows by default */
+  const uint32_t tolerance = learned.tolerance.size() == learned.raw.size()
+                                 ? learned.tolerance[index]
+                                 : width / 2;
+  min = width > tolerance ? width - tolerance : 0;
+  max = width + tolerance;
+}
+
+const char* IRProtocolCodec::protocolName(IRProtocol protocol) {
+  switch (protocol) {
+    case IRProtocol::Raw:
+      return "Raw";
+    case IRProtocol::NEC:
+      return "NEC";
+    case IRProtocol::AEHA:
+      return "AEHA";
+    case IRProtocol::Sony:
+      return "Sony";
+  }
+  return "Unknown";
+}
+
+void IRProtocolCodec::print(const IRCode& code, const char* label) {
+  if (code.protocol == IRProtocol::Raw) return IRRemote::print(code.raw, label);
+  LOGI("[IR] %s (bits: %d, address: 0x%04X, command: 0x%" PRIX64
+       ", repeat: %d) %s",
+       protocolName(code.protocol), code.bits, code.address, code.command,
+       code.repeat, label ? label : "");
+}
+
+bool IRProtocolCodec::decodePulseDistance_(const IRRemote::IRData& data,
+                                           size_t& index,
+                                           const PulseDistanceFormat& format,
+                                           uint8_t& bits, uint64_t& payload) {
+  bits = 0;
+  payload = 0;
+  if (index + 3 > data.size() || !isNear_(data[index], format.header_mark) ||
+      !isNear_(data[index + 1], format.header_space)) {
+    return false;
+  }
+  index += 2;
+
+  const uint32_t threshold = (format.zero_space + format.one_space) / 2;
+  while (index < data.size()) {
+    if (!isNear_(data[index], format.bit_mark)) return false;
+    /* the stop mark is followed by the end of data or by a frame gap */
+    if (index + 1 == data.size() ||
+        !isNear_(data[index + 1], data[index + 1] < threshold
+                                      ? format.zero_space
+                                      : format.one_space)) {
+      ++index;
+      return bits > 0;
+    }
+    if (bits == 64) return false;
+    if (data[index + 1] >= threshold) payload |= uint64_t(1) << bits;
+    ++bits;
+    index += 2;
+  }
+  return false;
+}
+
+bool IRProtocolCodec::decodeSony_(const IRRemote::IRData& data, size_t& index,
+                                  uint8_t& bits, uint64_t& payload) {
+  bits = 0;
+  payload = 0;
+  if (index + 3 > data.size() || !isNear_(data[index], kSonyHeaderMark) ||
+      !isNear_(data[index + 1], kSonyUnit)) {
+    return false;
+  }
+  index += 2;
+
+  while (index < data.size()) {
+    const bool one = isNear_(data[index], 2 * kSonyUnit);
+    if (!one && !isNear_(data[index], kSonyUnit)) return false;
+    if (bits == 64) return false;
+    if (one) payload |= uint64_t(1) << bits;
+    ++bits;
+    ++index;
+    /* the last mark is followed by the end of data or by a frame gap */
+    if (index == data.size() || !isNear_(data[index], kSonyUnit)) return true;
+    ++index;
+  }
+  return false;
+}
+
+void IRProtocolCodec::encodePulseDistance_(const PulseDistanceFormat& format,
+                                           uint8_t bits, uint64_t payload,
+                                           IRRemote::IRData& data) {
+  data.push_back(format.header_mark);
+  data.push_back(format.header_space);
+  for (int i = 0; i < bits; ++i) {
+    data.push_back(format.bit_mark);
+    data.push_back(((payload >> i) & 1) ? format.one_space
+                                        : format.zero_space);
+  }
+  data.push_back(format.bit_mark);
+}
+
+void IRProtocolCodec::encodeSony_(uint8_t bits, uint64_t payload,
+                                  IRRemote::IRData& data) {
+  data.push_back(kSonyHeaderMark);
+  data.push_back(kSonyUnit);
+  for (int i = 0; i < bits; ++i) {
+    if (i) data.push_back(kSonyUnit);
+    data.push_back(((payload >> i) & 1) ? 2 * kSonyUnit : kSonyUnit);
+  }
+}
+
+bool IRProtocolCodec::isNear_(uint32_t measured, uint32_t expected) {
+  /* receiver modules stretch marks and shrink spaces by about 100 us */
+  const uint32_t tolerance = expected / 4 + 100;
+  return measured + tolerance >= expected && measured <= expected + tolerance;
+}
@@ -0,0 +1,76 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include "ir_remote.h"
+
+enum class IRProtocol : uint8_t {
+  Raw,   //< unknown protocol, timings are kept as is
+  NEC,   //< NEC (32 bits, T = 562 us)
+  AEHA,  //< AEHA / Kaden-kyo (16-64 bits, T = 350-500 us)
+  Sony,  //< Sony SIRC (12, 15 or 20 bits, T = 600 us)
+};
+
+/**
+ * @brief Learned IR code, reduced to protocol fields when possible.
+ *
+ * Only codes of an unknown protocol keep their raw timings; the others are
+ * rebuilt from (protocol, address, command, repeat) when they are sent.
+ * Raw codes learned from several captures also carry the bound of each
+ * element, see IRLearner.
+ */
+struct IRCode {
+  IRProtocol protocol = IRProtocol::Raw;
+  uint8_t bits = 0;    //< payload length including the address
+  uint8_t repeat = 0;  //< number of repeat frames following the first one
+  uint16_t address = 0;
+  uint64_t command = 0;
+  IRRemote::IRData raw;         //< only used for IRProtocol::Raw
+  IRRemote::IRData tolerance;   //< per-element bound of raw [us], if learned
+  std::vector<uint8_t> packed;  //< raw timings not expanded yet
+
+  bool empty() const {
+    return protocol == IRProtocol::Raw && raw.empty() && packed.empty();
+  }
+};
+
+class IRProtocolCodec {
+ public:
+  static bool decode(const IRRemote::IRData& data, IRCode& code);
+  static bool encode(const IRCode& code, IRRemote::IRData& data);
+  static IRCode fromRaw(const IRRemote::IRData& data);
+  static bool matches(const IRCode& received, const IRCode& learned);
+  /* the received widths [us] a raw code accepts at index, inclusive */
+  static void rawBounds(const IRCode& learned, size_t index, uint32_t& min,
+                        uint32_t& max);
+
+  static const char* protocolName(IRProtocol protocol);
+  static void print(const IRCode& code, const char* label = NULL);
+
+ private:
+  struct PulseDistanceFormat {
+    uint16_t header_mark;
+    uint16_t header_space;
+    uint16_t bit_mark;
+    uint16_t zero_space;
+    uint16_t one_space;
+    uint16_t frame_gap;
+  };
+
+  static const PulseDistanceFormat kNec;
+  static const PulseDistanceFormat kAeha;
+
+  static bool decodePulseDistance_(const IRRemote::IRData& data, size_t& index,
+                                   const PulseDistanceFormat& format,
+                                   uint8_t& bits, uint64_t& payload);
+  static bool decodeSony_(const IRRemote::IRData& data, size_t& index,
+                          uint8_t& bits, uint64_t& payload);
+  static void encodePulseDistance_(const PulseDistanceFormat& format,
+                                   uint8_t bits, uint64_t payload,
+                                   IRRemote::IRData& data);
+  static void encodeSony_(uint8_t bits, uint64_t payload,
+                          IRRemote::IRData& data);
+  static bool isNear_(uint32_t measured, uint32_t expected);
+};
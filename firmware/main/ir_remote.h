@@ -6,27 +6,148 @@
 
 #include <Arduino.h>
 #include <Preferences.h>
+#include <driver/rmt_rx.h>
+#include <driver/rmt_tx.h>
+#include <soc/soc_caps.h>
+
+#include <atomic>
 
 #include "app_log.h"
+#include "ir_chunk_pool.h"
+#include "ir_frame_ring.h"
+#include "ir_trace.h"
 
+/**
+ * @brief IR transmitters and receivers on the RMT peripheral.
+ *
+ * Each emitter and receiver pin gets its own RMT channel. A frame can be sent
+ * on any set of emitters at once, and the transmissions on different
+ * channels run in parallel. All receivers feed the same decoder: a frame
+ * that overlaps a frame published from another receiver is the same signal
+ * seen twice, and is dropped. The receive callbacks of all receivers share
+ * the chunk pool and the frame ring, which take a single producer, so they
+ * run one at a time under rx_lock_, even with the interrupts of the
+ * channels on two cores.
+ *
+ * Received symbols are streamed, a piece at a time, into chunks chained
+ * from a fixed pool, so a frame is only limited by the free chunks. A frame
+ * of at least IR_PART_MIN_SIZE durations may be followed by further parts
+ * (as air-conditioner codes are): a frame starting within IR_PART_GAP_US
+ * after it is joined into the same code, with the gap kept as a space. Such
+ * a code becomes available once IR_PART_SPAN_US has passed without a
+ * further part.
+ *
+ * A held button makes the remote resend its frame, or a short repeat code
+ * (as NEC does), within IR_FINALIZING_TIMEOUT_US of the frame before. These
+ * are folded into the code they repeat, which then becomes available once as
+ * a single press, with the repeat count and the held duration in press().
+ * A code that no further part or repeat code can join any more is available
+ * right away; a resent frame published after that is dropped as a repeat of
+ * the press before, rather than taken for a new press.
+ */
 class IRRemote {
  public:
-  static constexpr const int RAW_DATA_BUFFER_SIZE = 800;
+  static constexpr const int RAW_DATA_CHUNK_SIZE = 24;
+  static constexpr const int RAW_DATA_CHUNKS = 128;
+  static constexpr const int RAW_DATA_MAX_SIZE =
+      RAW_DATA_CHUNK_SIZE * RAW_DATA_CHUNKS;
   static constexpr const int RAW_DATA_MIN_SIZE = 8;
-  static constexpr const int RAW_DATA_TIMEOUT_US = 40'000;
+  static constexpr const int IR_REPEAT_MIN_SIZE = 3;  //< NEC repeat code
+  static constexpr const int IR_REPEAT_CODE_MAX_US = 15'000;  //< NEC 11.8ms
+  static constexpr const int RAW_DATA_GLITCH_US = 100;
+  static constexpr const int RAW_DATA_TIMEOUT_US = 30'000;  //< < 2^15 ticks
   static constexpr const int IR_FINALIZING_TIMEOUT_US = 100'000;
+  static constexpr const int IR_PART_MIN_SIZE = 128;    //< 64 bits or more
+  static constexpr const int IR_PART_GAP_US = 50'000;    //< < UINT16_MAX
+  static constexpr const int IR_PART_SPAN_US = 400'000;  //< end to end
+  static constexpr const uint32_t IR_CARRIER_FREQUENCY_HZ = 38'000;
+  static constexpr const float IR_CARRIER_DUTY_CYCLE = 0.33f;
+  static constexpr const uint32_t RMT_RESOLUTION_HZ = 1'000'000;  //< 1 us
+  static constexpr const uint16_t RMT_DURATION_MAX = 0x7FFF;  //< 15 bits
+  static constexpr const uint32_t RMT_RX_FILTER_NS = 2'000;  //< hw limit ~3us
+  static constexpr const int RMT_RX_SYMBOL_BUFFER_SIZE = 64;  //< per piece
+  static constexpr const int RX_FRAME_SLOTS = 8;
+  /* the RMT TX channels, but the one the RGB LED is driven by */
+  static constexpr const int IR_TX_CHANNELS_MAX =
+      SOC_RMT_TX_CANDIDATES_PER_GROUP - 1;
+  static constexpr const int IR_RX_CHANNELS_MAX = 2;
   using IRDataElement = uint16_t;
   using IRData = std::vector<IRDataElement>;
+  using IRSymbols = std::vector<rmt_symbol_word_t>;
+  using ChannelMask = uint8_t;  //< bit i is transmitter i
+  static constexpr const ChannelMask kAllChannels =
+      (1 << IR_TX_CHANNELS_MAX) - 1;
+  /* called from the ISR when a channel is done sending or a receiver has
+   * ended a frame, returns true if a higher priority task was woken */
+  using IsrHandler = bool (*)(void* arg);
 
-  void begin(int tx, int rx);
+  /* attributes of the available code */
+  struct Press {
+    uint16_t parts = 0;
+    uint16_t repeats = 0;  //< repeat frames folded into the code
+    uint32_t held_ms = 0;  //< end of the code to end of its last repeat
+  };
+
+  void begin(int tx, int rx,
+             uint32_t carrier_frequency_hz = IR_CARRIER_FREQUENCY_HZ,
+             float carrier_duty_cycle = IR_CARRIER_DUTY_CYCLE);
+  void begin(const int* tx_pins, int tx_count, const int* rx_pins,
+             int rx_count,
+             uint32_t carrier_frequency_hz = IR_CARRIER_FREQUENCY_HZ,
+             float carrier_duty_cycle = IR_CARRIER_DUTY_CYCLE);
+  bool setCarrier(uint32_t frequency_hz, float duty_cycle);
+  int getTxChannelCount() const { return tx_count_; }
+  int getRxChannelCount() const { return rx_count_; }
+  ChannelMask txChannels() const { return (1 << tx_count_) - 1; }
+  void onSent(IsrHandler handler, void* arg) {
+    sent_arg_ = arg;
+    sent_handler_ = handler;
+  }
+  void onReceived(IsrHandler handler, void* arg) {
+    received_arg_ = arg;
+    received_handler_ = handler;
+  }
 
   void clear();
-  bool available();
+  bool available() { return assemble_(AppClock::nowUs()); }
   bool waitForAvailable(int timeout_ms = -1);
   IRData get();
+  const Press& press() const { return rx_press_; }
+  /* a code is being folded, available() turns true on its own later */
+  bool assembling() const { return rx_building_.active; }
+  void pop() { rx_ready_ = false; }
+  template <typename Handler>
+  size_t drain(Handler&& handler, size_t max_frames = RX_FRAME_SLOTS);
 
-  void send(const IRData& data);
+  void send(const IRData& data, ChannelMask channels = kAllChannels);
+  void send(const IRSymbols& symbols, ChannelMask channels = kAllChannels);
+  bool sending(ChannelMask channels = kAllChannels) const {
+    return sendingChannels() & channels;
+  }
+  ChannelMask sendingChannels() const {
+    return tx_active_.load(std::memory_order_acquire);
+  }
+  bool waitForSent(int timeout_ms = -1, ChannelMask channels = kAllChannels);
 
+  /* with power management, an enabled RMT channel keeps the chip out of
+   * light sleep; both kinds are enabled by begin() */
+  void setTransmittersEnabled(bool enabled);
+  void setReceiversEnabled(bool enabled);
+
+  uint32_t getFilteredEdgeCount() const {
+    return filtered_edges_.load(std::memory_order_relaxed);
+  }
+  uint32_t getOverflowCount() const { return rx_frames_.overflowCount(); }
+  uint32_t getTruncatedCount() const {
+    return truncated_frames_.load(std::memory_order_relaxed);
+  }
+  uint32_t getDuplicateCount() const {
+    return duplicate_frames_.load(std::memory_order_relaxed);
+  }
+  size_t getFreeChunkCount() const { return rx_pool_.available(); }
+  IRTraceRecorder& trace() { return trace_; }
+
+  static void encode(const IRData& data, IRSymbols& symbols);
   static void print(const IRData& data, const char* label = NULL);
   static bool isIrDataEqual(const IRData& a, const IRData& b,
                             float tolerance_percent = 50.0f);
@@ -37,80 +158,259 @@ class IRRemote {
                                   IRData& data);
 
  private:
-  enum class IR_RECEIVER_STATE {
-    IR_RECEIVER_OFF,
-    IR_RECEIVER_START,
-    IR_RECEIVER_RECEIVING,
-    IR_RECEIVER_WAITING_BLANK,
-    IR_RECEIVER_FINALIZING,
-    IR_RECEIVER_AVAILABLE,
+  using ChunkPool =
+      IRChunkPool<IRDataElement, RAW_DATA_CHUNK_SIZE, RAW_DATA_CHUNKS>;
+
+  /* one received frame, published by the receiver callback */
+  struct RxFrame {
+    ChunkPool::Index first;
+    uint16_t size;    //< a further part may follow if >= IR_PART_MIN_SIZE
+    uint16_t gap_us;  //< blank before the frame, if continued
+    bool continued;   //< a further part of the previous frame
+    bool repeat;      //< close behind the previous frame, but no part of it
+    uint32_t duration_us;
+    uint64_t end_us;  //< end of the last mark
   };
 
-  int pin_tx_, pin_rx_;
-  volatile IR_RECEIVER_STATE state_;
-  uint16_t raw_index_;
-  uint16_t raw_data_[RAW_DATA_BUFFER_SIZE];
-  uint64_t prev_us_;
+  /* frame being received, only touched from the RMT callbacks */
+  struct RxState {
+    ChunkPool::Index first = ChunkPool::kNone;
+    ChunkPool::Index last = ChunkPool::kNone;
+    ChunkPool::Index spare = ChunkPool::kNone;  //< chains of dropped frames
+    uint16_t size = 0;
+    uint16_t glitch = 0;     //< pulse to merge with its neighbours
+    bool skip_next = false;  //< the gap after leading noise
+    bool failed = false;     //< out of chunks
+    uint32_t duration_us = 0;
+    uint64_t part_end_us = 0;  //< end of the part a next one may continue
+  };
 
-  void isr();
-  static void IRAM_ATTR isrEntryPoint(void* this_ptr);
+  /* one emitter */
+  struct TxChannel {
+    rmt_channel_handle_t channel = nullptr;
+    rmt_encoder_handle_t encoder = nullptr;
+    IRSymbols symbols;  //< read by the driver until the channel is done
+  };
+
+  /* one receiver, only touched from the RMT callbacks */
+  struct RxChannel {
+    rmt_channel_handle_t channel = nullptr;
+    rmt_symbol_word_t symbols[RMT_RX_SYMBOL_BUFFER_SIZE];
+    RxState state;
+    uint64_t prev_us = 0;  //< end of the last frame or own transmission
+  };
+
+  /* last frame published, to tell a frame seen by two receivers */
+  struct RxLast {
+    uint8_t receiver = UINT8_MAX;
+    uint64_t start_us = 0;
+    uint64_t end_us = 0;
+  };
+
+  ChunkPool rx_pool_;
+  IRFrameRing<RxFrame, RX_FRAME_SLOTS> rx_frames_;
+  RxChannel rx_[IR_RX_CHANNELS_MAX];
+  int rx_count_ = 0;
+  bool rx_enabled_ = true;
+  RxLast rx_last_;
+  portMUX_TYPE rx_lock_ = portMUX_INITIALIZER_UNLOCKED;  //< the callbacks
+  rmt_receive_config_t rx_config_{};
+  TxChannel tx_[IR_TX_CHANNELS_MAX];
+  int tx_count_ = 0;
+  bool tx_enabled_ = true;
+  std::atomic<ChannelMask> tx_active_{0};
+  IsrHandler sent_handler_ = nullptr;
+  void* sent_arg_ = nullptr;
+  IsrHandler received_handler_ = nullptr;
+  void* received_arg_ = nullptr;
+  std::atomic<uint32_t> filtered_edges_{0};
+  std::atomic<uint32_t> truncated_frames_{0};
+  std::atomic<uint32_t> duplicate_frames_{0};
+  IRTraceRecorder trace_;  //< raw frames as seen by the receiver callbacks
+
+  /* code being assembled from the published frames, only touched by the
+   * reader */
+  struct RxCode {
+    bool active = false;
+    bool continuable = false;  //< the last part may be continued
+    uint32_t last_duration_us = 0;
+    uint64_t parts_end_us = 0;  //< end of the last part
+    uint64_t end_us = 0;        //< end of the last part or repeat
+  };
+
+  IRData rx_code_;  //< joined parts of the available code
+  uint16_t rx_head_size_ = 0;  //< widths of the first part of rx_code_
+  bool rx_ready_ = false;
+  RxCode rx_building_;
+  Press rx_press_;
+
+  bool beginReceiver_(RxChannel& rx, int pin);
+  bool beginTransmitter_(TxChannel& tx, int pin,
+                         uint32_t carrier_frequency_hz,
+                         float carrier_duty_cycle);
+  bool startReceive_(RxChannel& rx);
+  void transmit_(int index, const IRSymbols& symbols);
+  void isr(const rmt_symbol_word_t* symbols, size_t num_symbols,
+           uint64_t now_us, bool last = true, uint8_t receiver = 0);
+  void appendWidth_(RxState& rx, uint16_t width);
+  void pushWidth_(RxState& rx, uint16_t width);
+  void endFrame_(RxChannel& channel, uint8_t receiver, uint64_t end_us);
+  void recycle_(RxState& rx);
+  bool assemble_(uint64_t now_us);
+  bool isRepeat_(const RxFrame& frame) const;
+  void appendFrame_(const RxFrame& frame);
+  static bool isWidthClose_(uint32_t width, uint32_t expected,
+                            uint32_t tolerance_q8) {
+    const uint32_t diff =
+        width > expected ? width - expected : expected - width;
+    return (diff << 8) <= expected * tolerance_q8;
+  }
+  static bool IRAM_ATTR onRxDone_(rmt_channel_handle_t channel,
+                                  const rmt_rx_done_event_data_t* edata,
+                                  void* this_ptr);
+  static bool IRAM_ATTR onTxDone_(rmt_channel_handle_t channel,
+                                  const rmt_tx_done_event_data_t* edata,
+                                  void* this_ptr);
+
+  friend class IRReplay;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
-inline void IRRemote::begin(int tx, int rx) {
-  pin_tx_ = tx;
-  pin_rx_ = rx;
-  state_ = IR_RECEIVER_STATE::IR_RECEIVER_START;
-  pinMode(pin_tx_, OUTPUT);
-  pinMode(pin_rx_, INPUT);
-  digitalWrite(pin_tx_, LOW);
-  attachInterruptArg(pin_rx_, isrEntryPoint, this, CHANGE);
+inline void IRRemote::begin(int tx, int rx, uint32_t carrier_frequency_hz,
+                            float carrier_duty_cycle) {
+  begin(&tx, 1, &rx, 1, carrier_frequency_hz, carrier_duty_cycle);
+}
+
+inline void IRRemote::begin(const int* tx_pins, int tx_count,
+                            const int* rx_pins, int rx_count,
+                            uint32_t carrier_frequency_hz,
+                            float carrier_duty_cycle) {
+  if (tx_count > IR_TX_CHANNELS_MAX) {
+    LOGW("[IR] %d transmitters, %d RMT channels left for them", tx_count,
+         IR_TX_CHANNELS_MAX);
+  }
+  for (int i = 0; i < tx_count && tx_count_ < IR_TX_CHANNELS_MAX; ++i) {
+    if (!beginTransmitter_(tx_[tx_count_], tx_pins[i], carrier_frequency_hz,
+                           carrier_duty_cycle)) {
+      LOGE("[IR] Failed to initialize RMT transmitter (pin %d)", tx_pins[i]);
+      continue;
+    }
+    ++tx_count_;
+  }
+  /* pulses shorter than the hardware filter never reach the buffer, and a
+   * space longer than the idle threshold terminates the frame */
+  rx_config_.signal_range_min_ns = RMT_RX_FILTER_NS;
+  rx_config_.signal_range_max_ns = RAW_DATA_TIMEOUT_US * 1000;
+  /* long frames are handed over a buffer at a time, see onRxDone_() */
+  rx_config_.flags.en_partial_rx = true;
+  for (int i = 0; i < rx_count && rx_count_ < IR_RX_CHANNELS_MAX; ++i) {
+    /* counted first, the callback looks the channel up as soon as it runs */
+    RxChannel& rx = rx_[rx_count_++];
+    if (!beginReceiver_(rx, rx_pins[i])) {
+      LOGE("[IR] Failed to initialize RMT receiver (pin %d)", rx_pins[i]);
+      rx.channel = nullptr;
+      --rx_count_;
+    }
+  }
+  LOGI("[IR] %d transmitters, %d receivers", tx_count_, rx_count_);
+}
+
+inline bool IRRemote::beginReceiver_(RxChannel& rx, int pin) {
+  rmt_rx_channel_config_t rx_config{};
+  rx_config.gpio_num = static_cast<gpio_num_t>(pin);
+  rx_config.clk_src = RMT_CLK_SRC_DEFAULT;
+  rx_config.resolution_hz = RMT_RESOLUTION_HZ;
+  esp_err_t err = ESP_FAIL;
+#if SOC_RMT_SUPPORT_DMA
+  /* let the GDMA fill the frame buffer when a DMA capable channel is free */
+  rx_config.mem_block_symbols = RMT_RX_SYMBOL_BUFFER_SIZE;
+  rx_config.flags.with_dma = true;
+  err = rmt_new_rx_channel(&rx_config, &rx.channel);
+#endif
+  if (err != ESP_OK) {
+    rx_config.mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL;
+    rx_config.flags.with_dma = false;
+    err = rmt_new_rx_channel(&rx_config, &rx.channel);
+  }
+  if (err != ESP_OK) return false;
+
+  rmt_rx_event_callbacks_t callbacks{};
+  callbacks.on_recv_done = onRxDone_;
+  if (rmt_rx_register_event_callbacks(rx.channel, &callbacks, this) !=
+          ESP_OK ||
+      rmt_enable(rx.channel) != ESP_OK) {
+    return false;
+  }
+  return startReceive_(rx);
+}
+
+inline bool IRRemote::startReceive_(RxChannel& rx) {
+  return rmt_receive(rx.channel, rx.symbols, sizeof(rx.symbols),
+                     &rx_config_) == ESP_OK;
+}
+
+inline bool IRRemote::beginTransmitter_(TxChannel& tx, int pin,
+                                        uint32_t carrier_frequency_hz,
+                                        float carrier_duty_cycle) {
+  rmt_tx_channel_config_t tx_config{};
+  tx_config.gpio_num = static_cast<gpio_num_t>(pin);
+  tx_config.clk_src = RMT_CLK_SRC_DEFAULT;
+  tx_config.resolution_hz = RMT_RESOLUTION_HZ;
+  tx_config.mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL;
+  tx_config.trans_queue_depth = 1;
+  if (rmt_new_tx_channel(&tx_config, &tx.channel) != ESP_OK) return false;
+
+  rmt_tx_event_callbacks_t callbacks{};
+  callbacks.on_trans_done = onTxDone_;
+  rmt_copy_encoder_config_t encoder_config{};
+  rmt_carrier_config_t carrier_config{};
+  carrier_config.frequency_hz = carrier_frequency_hz;
+  carrier_config.duty_cycle = carrier_duty_cycle;
+  if (rmt_tx_register_event_callbacks(tx.channel, &callbacks, this) !=
+          ESP_OK ||
+      rmt_new_copy_encoder(&encoder_config, &tx.encoder) != ESP_OK ||
+      rmt_apply_carrier(tx.channel, &carrier_config) != ESP_OK ||
+      rmt_enable(tx.channel) != ESP_OK) {
+    return false;
+  }
+  tx.symbols.reserve(RAW_DATA_CHUNK_SIZE * 16);  //< grows for long codes
+  return true;
+}
+
+inline bool IRRemote::setCarrier(uint32_t frequency_hz, float duty_cycle) {
+  if (tx_count_ == 0) return false;
+  rmt_carrier_config_t carrier_config{};
+  carrier_config.frequency_hz = frequency_hz;
+  carrier_config.duty_cycle = duty_cycle;
+  bool ok = true;
+  for (int i = 0; i < tx_count_; ++i) {
+    ok &= rmt_apply_carrier(tx_[i].channel, &carrier_config) == ESP_OK;
+  }
+  if (!ok) {
+    LOGE("[IR] Invalid carrier: %" PRIu32 " Hz, duty %.2f", frequency_hz,
+         duty_cycle);
+    return false;
+  }
+  LOGD("[IR] Carrier: %" PRIu32 " Hz, duty %.2f", frequency_hz, duty_cycle);
+  return true;
 }
 
 inline void IRRemote::clear() {
-  LOGD("[IR] clear");
-  state_ = IR_RECEIVER_STATE::IR_RECEIVER_START;
-}
-
-inline bool IRRemote::available() {
-  noInterrupts();
-  uint32_t diff = micros() - prev_us_;
-  interrupts();
-  switch (state_) {
-    case IR_RECEIVER_STATE::IR_RECEIVER_OFF:
-    case IR_RECEIVER_STATE::IR_RECEIVER_START:
-    case IR_RECEIVER_STATE::IR_RECEIVER_AVAILABLE:
-      break;
-    case IR_RECEIVER_STATE::IR_RECEIVER_RECEIVING:
-      if (diff > RAW_DATA_TIMEOUT_US)
-        state_ = IR_RECEIVER_STATE::IR_RECEIVER_WAITING_BLANK;
-      break;
-    case IR_RECEIVER_STATE::IR_RECEIVER_WAITING_BLANK:
-      if (diff > IR_FINALIZING_TIMEOUT_US)
-        state_ = IR_RECEIVER_STATE::IR_RECEIVER_FINALIZING;
-      break;
-    case IR_RECEIVER_STATE::IR_RECEIVER_FINALIZING:
-      if (raw_index_ < RAW_DATA_MIN_SIZE) {
-        LOGD("[IR] Raw Data Size: %d (skipped)", raw_index_);
-        state_ = IR_RECEIVER_STATE::IR_RECEIVER_START;
-        break;
-      } else if (raw_index_ >= RAW_DATA_BUFFER_SIZE) {
-        LOGE("[IR] Raw Data Size: %d (overflow)", raw_index_);
-        state_ = IR_RECEIVER_STATE::IR_RECEIVER_START;
-        break;
-      }
-      LOGI("[IR] Raw Data Size: %d", raw_index_);
-      state_ = IR_RECEIVER_STATE::IR_RECEIVER_AVAILABLE;
-      break;
+  LOGD("[IR] clear (%zu frames discarded)", rx_frames_.size());
+  while (const auto* frame = rx_frames_.front()) {
+    rx_pool_.release(frame->first);
+    rx_frames_.pop();
   }
-  return state_ == IR_RECEIVER_STATE::IR_RECEIVER_AVAILABLE;
+  rx_ready_ = false;
+  rx_building_ = RxCode{};
+  rx_head_size_ = 0;
 }
 
 inline bool IRRemote::waitForAvailable(int timeout_ms) {
-  unsigned long start = millis();
+  const uint32_t start = AppClock::millis();
   while (!available()) {
-    if (timeout_ms > 0 && millis() - start > timeout_ms) {
+    if (timeout_ms > 0 && AppClock::millis() - start > timeout_ms) {
       return false;
     }
     delay(1);
@@ -119,61 +419,401 @@ inline bool IRRemote::waitForAvailable(int timeout_ms) {
 }
 
 inline IRRemote::IRData IRRemote::get() {
-  return IRData{raw_data_, raw_data_ + raw_index_};
-}
-
-inline void IRRemote::isrEntryPoint(void* this_ptr) {
-  static_cast<IRRemote*>(this_ptr)->isr();
-}
-
-inline void IRRemote::send(const IRData& data) {
-  noInterrupts();
-  {
-    enum IR_RECEIVER_STATE state_cache = state_;
-    state_ = IR_RECEIVER_STATE::IR_RECEIVER_OFF;
-    for (uint16_t count = 0; count < data.size(); count++) {
-      uint64_t us = micros();
-      uint16_t time = data[count];
-      do {
-        digitalWrite(pin_tx_, !(count & 1));
-        delayMicroseconds(8);
-        digitalWrite(pin_tx_, 0);
-        delayMicroseconds(16);
-      } while (int32_t(us + time - micros()) > 0);
+  if (!available()) return {};
+  LOGI("[IR] Raw Data Size: %zu (parts: %u, repeats: %u, held: %" PRIu32
+       " ms)",
+       rx_code_.size(), rx_press_.parts, rx_press_.repeats, rx_press_.held_ms);
+  return rx_code_;
+}
+
+/**
+ * @brief Fold the published frames into the code being assembled.
+ *
+ * Frames are taken off the ring as they arrive, so a long hold does not fill
+ * it up. Parts join the code until a repeat has been seen, and repeats count
+ * as long as they are a repeat code or the same frame as the first part. The
+ * code is complete once a frame that does neither follows, or no further
+ * frame can be published in time to join it: a frame is published
+ * RAW_DATA_TIMEOUT_US after its end, a part ends within IR_PART_SPAN_US of
+ * the part before it, and a repeat starts within IR_FINALIZING_TIMEOUT_US of
+ * the frame before and lasts as long as a repeat code, or as the repeat
+ * before it. The time is read before the ring, so a frame published in the
+ * meantime is seen.
+ */
+inline bool IRRemote::assemble_(uint64_t now_us) {
+  if (rx_ready_) return true;
+  RxCode& code = rx_building_;
+  while (const RxFrame* frame = rx_frames_.front()) {
+    if (code.active) {
+      if (frame->continued && rx_press_.repeats == 0) {
+        rx_code_.push_back(frame->gap_us);
+        appendFrame_(*frame);
+        ++rx_press_.parts;
+        code.parts_end_us = frame->end_us;
+      } else if (frame->repeat && isRepeat_(*frame)) {
+        ++rx_press_.repeats;
+        code.continuable = false;
+      } else {
+        break;  //< the next code
+      }
+      code.last_duration_us = frame->duration_us;
+      code.end_us = frame->end_us;
+      rx_pool_.release(frame->first);
+      rx_frames_.pop();
+      continue;
+    }
+    if (frame->size >= RAW_DATA_MIN_SIZE &&
+        !(frame->repeat && rx_head_size_ && isRepeat_(*frame))) {
+      code.active = true;
+      rx_head_size_ = frame->size;
+      code.last_duration_us = frame->duration_us;
+      code.parts_end_us = frame->end_us;
+      code.end_us = frame->end_us;
+      rx_code_.clear();
+      appendFrame_(*frame);
+      rx_press_ = Press{1, 0, 0};
+    }
+    /* otherwise a repeat of a press that is already complete */
+    rx_pool_.release(frame->first);
+    rx_frames_.pop();
+  }
+  if (!code.active) return false;
+
+  if (!rx_frames_.front()) {
+    uint64_t wait_us = IR_FINALIZING_TIMEOUT_US + IR_REPEAT_CODE_MAX_US;
+    if (code.continuable) {
+      wait_us = IR_PART_SPAN_US;
+    } else if (rx_press_.repeats) {
+      wait_us = IR_FINALIZING_TIMEOUT_US + code.last_duration_us;
+    }
+    if (now_us < code.end_us + wait_us + RAW_DATA_TIMEOUT_US) return false;
+  }
+  /* the code itself takes no time to hold, a press without repeats is 0 */
+  rx_press_.held_ms = (code.end_us - code.parts_end_us) / 1000;
+  code = RxCode{};
+  rx_ready_ = true;
+  return true;
+}
+
+inline void IRRemote::appendFrame_(const RxFrame& frame) {
+  for (auto index = frame.first; index != ChunkPool::kNone;
+       index = rx_pool_[index].next) {
+    const auto& chunk = rx_pool_[index];
+    rx_code_.insert(rx_code_.end(), chunk.data, chunk.data + chunk.size);
+  }
+  rx_building_.continuable = frame.size >= IR_PART_MIN_SIZE;
+}
+
+/* a held remote resends its frame, or sends a repeat code shorter than any */
+inline bool IRRemote::isRepeat_(const RxFrame& frame) const {
+  if (frame.size < RAW_DATA_MIN_SIZE) return true;
+  if (frame.size != rx_head_size_) return false;
+  size_t i = 0;
+  for (auto index = frame.first; index != ChunkPool::kNone;
+       index = rx_pool_[index].next) {
+    const auto& chunk = rx_pool_[index];
+    for (size_t j = 0; j < chunk.size; ++j, ++i) {
+      if (!isWidthClose_(chunk.data[j], rx_code_[i], 128)) return false;
     }
-    state_ = state_cache;
-  }
-  interrupts();
-  LOGD("[IR] Send OK (size: %zu)", data.size());
-}
-
-inline void IRRemote::isr() {
-  uint64_t us = micros();
-  uint32_t diff = us - prev_us_;
-
-  switch (state_) {
-    case IR_RECEIVER_STATE::IR_RECEIVER_OFF:
-    case IR_RECEIVER_STATE::IR_RECEIVER_FINALIZING:
-    case IR_RECEIVER_STATE::IR_RECEIVER_AVAILABLE:
-      break;
-    case IR_RECEIVER_STATE::IR_RECEIVER_START:
-      raw_index_ = 0;
-      state_ = IR_RECEIVER_STATE::IR_RECEIVER_RECEIVING;
-      break;
-    case IR_RECEIVER_STATE::IR_RECEIVER_RECEIVING:
-      if (diff > RAW_DATA_TIMEOUT_US) {
-        state_ = IR_RECEIVER_STATE::IR_RECEIVER_WAITING_BLANK;
-        break;
+  }
+  return true;
+}
+
+template <typename Handler>
+inline size_t IRRemote::drain(Handler&& handler, size_t max_frames) {
+  size_t count = 0;
+  while (count < max_frames && available()) {
+    const IRData data = get();
+    const Press press = rx_press_;
+    pop();
+    handler(data, press);
+    ++count;
+  }
+  return count;
+}
+
+inline bool IRRemote::onRxDone_(rmt_channel_handle_t channel,
+                                const rmt_rx_done_event_data_t* edata,
+                                void* this_ptr) {
+  IRRemote* self = static_cast<IRRemote*>(this_ptr);
+  const uint64_t now_us = AppClock::nowUs();
+  const bool last = edata->flags.is_last;
+  uint8_t receiver = 0;
+  while (receiver < self->rx_count_ &&
+         self->rx_[receiver].channel != channel) {
+    ++receiver;
+  }
+  if (receiver == self->rx_count_) return false;
+  portENTER_CRITICAL_ISR(&self->rx_lock_);
+  self->trace_.record(now_us, edata->received_symbols, edata->num_symbols,
+                      last, receiver);
+  self->isr(edata->received_symbols, edata->num_symbols, now_us, last,
+            receiver);
+  portEXIT_CRITICAL_ISR(&self->rx_lock_);
+  /* the symbols have been copied out, so the buffer can be reused right away;
+   * until the last piece, the driver keeps receiving into it on its own */
+  if (!last) return false;
+  self->startReceive_(self->rx_[receiver]);
+  return self->received_handler_ &&
+         self->received_handler_(self->received_arg_);
+}
+
+inline void IRRemote::send(const IRData& data, ChannelMask channels) {
+  channels &= txChannels();
+  if (!channels) return;
+  /* the previous frame may still be read by the RMT driver */
+  waitForSent(-1, channels);
+  int encoded = -1;
+  for (int i = 0; i < tx_count_; ++i) {
+    if (!(channels & (1 << i))) continue;
+    if (encoded < 0) {
+      encode(data, tx_[i].symbols);
+      encoded = i;
+    } else {
+      tx_[i].symbols = tx_[encoded].symbols;
+    }
+  }
+  /* the channels start within microseconds of each other */
+  for (int i = 0; i < tx_count_; ++i) {
+    if (channels & (1 << i)) transmit_(i, tx_[i].symbols);
+  }
+  LOGD("[IR] Send queued (size: %zu, symbols: %zu, channels: 0x%x)",
+       data.size(), tx_[encoded].symbols.size(), channels);
+}
+
+inline void IRRemote::send(const IRSymbols& symbols, ChannelMask channels) {
+  channels &= txChannels();
+  if (!channels || symbols.empty()) return;
+  /* symbols must stay valid until the transmission is done */
+  waitForSent(-1, channels);
+  for (int i = 0; i < tx_count_; ++i) {
+    if (channels & (1 << i)) transmit_(i, symbols);
+  }
+}
+
+inline void IRRemote::transmit_(int index, const IRSymbols& symbols) {
+  const ChannelMask bit = 1 << index;
+  rmt_transmit_config_t transmit_config{};
+  tx_active_.fetch_or(bit, std::memory_order_acq_rel);
+  if (rmt_transmit(tx_[index].channel, tx_[index].encoder, symbols.data(),
+                   symbols.size() * sizeof(rmt_symbol_word_t),
+                   &transmit_config) != ESP_OK) {
+    tx_active_.fetch_and(ChannelMask(~bit), std::memory_order_acq_rel);
+    LOGE("[IR] Send failed (channel: %d, symbols: %zu)", index,
+         symbols.size());
+  }
+}
+
+inline bool IRRemote::waitForSent(int timeout_ms, ChannelMask channels) {
+  bool done = true;
+  for (int i = 0; i < tx_count_; ++i) {
+    if (!sending(channels & (1 << i))) continue;
+    done &= rmt_tx_wait_all_done(tx_[i].channel, timeout_ms) == ESP_OK;
+  }
+  return done;
+}
+
+inline void IRRemote::setTransmittersEnabled(bool enabled) {
+  if (tx_enabled_ == enabled) return;
+  /* the frames on air are finished first */
+  if (!enabled) waitForSent();
+  for (int i = 0; i < tx_count_; ++i) {
+    enabled ? rmt_enable(tx_[i].channel) : rmt_disable(tx_[i].channel);
+  }
+  tx_enabled_ = enabled;
+}
+
+inline void IRRemote::setReceiversEnabled(bool enabled) {
+  if (rx_enabled_ == enabled) return;
+  for (int i = 0; i < rx_count_; ++i) {
+    RxChannel& rx = rx_[i];
+    if (enabled) {
+      rmt_enable(rx.channel);
+      startReceive_(rx);
+    } else {
+      rmt_disable(rx.channel);
+      /* the callback has stopped, a frame cut off here is dropped */
+      recycle_(rx.state);
+    }
+  }
+  rx_enabled_ = enabled;
+}
+
+/**
+ * @brief Encode alternating mark/space durations [us] into RMT symbols.
+ *
+ * Durations longer than the 15-bit RMT field are split across symbols of the
+ * same level, and zero durations are skipped so that they cannot terminate
+ * the transmission early.
+ */
+inline void IRRemote::encode(const IRData& data, IRSymbols& symbols) {
+  symbols.clear();
+  bool half = false;  //< true if the last symbol has only its first half set
+  for (size_t i = 0; i < data.size(); ++i) {
+    const uint16_t level = (i & 1) ? 0 : 1;
+    uint32_t remaining = data[i];
+    while (remaining > 0) {
+      const uint16_t duration =
+          remaining > RMT_DURATION_MAX ? RMT_DURATION_MAX : remaining;
+      remaining -= duration;
+      if (half) {
+        symbols.back().level1 = level;
+        symbols.back().duration1 = duration;
+      } else {
+        rmt_symbol_word_t symbol{};
+        symbol.level0 = level;
+        symbol.duration0 = duration;
+        symbols.push_back(symbol);
       }
-      if (raw_index_ < RAW_DATA_BUFFER_SIZE) raw_data_[raw_index_++] = diff;
-      break;
-    case IR_RECEIVER_STATE::IR_RECEIVER_WAITING_BLANK:
-      if (diff > IR_FINALIZING_TIMEOUT_US)
-        state_ = IR_RECEIVER_STATE::IR_RECEIVER_FINALIZING;
-      break;
+      half = !half;
+    }
   }
+  /* a zero duration in the last half marks the end of the transmission */
+  if (!half) symbols.push_back(rmt_symbol_word_t{});
+}
+
+inline bool IRRemote::onTxDone_(rmt_channel_handle_t channel,
+                                const rmt_tx_done_event_data_t*,
+                                void* this_ptr) {
+  IRRemote* self = static_cast<IRRemote*>(this_ptr);
+  const uint64_t now_us = AppClock::nowUs();
+  /* what the receivers saw until now was our own frame */
+  for (int i = 0; i < self->rx_count_; ++i) self->rx_[i].prev_us = now_us;
+  for (int i = 0; i < self->tx_count_; ++i) {
+    if (self->tx_[i].channel != channel) continue;
+    self->tx_active_.fetch_and(ChannelMask(~(1 << i)),
+                               std::memory_order_acq_rel);
+  }
+  return self->sent_handler_ && self->sent_handler_(self->sent_arg_);
+}
 
-  prev_us_ = us;
+inline void IRRemote::isr(const rmt_symbol_word_t* symbols,
+                          size_t num_symbols, uint64_t now_us, bool last,
+                          uint8_t receiver) {
+  RxChannel& channel = rx_[receiver];
+  RxState& rx = channel.state;
+  for (size_t i = 0; i < num_symbols; ++i) {
+    rx.duration_us += symbols[i].duration0 + symbols[i].duration1;
+    if (symbols[i].duration0 == 0) break;
+    appendWidth_(rx, symbols[i].duration0);
+    if (symbols[i].duration1 == 0) break;
+    appendWidth_(rx, symbols[i].duration1);
+  }
+  /* the frame ended an idle threshold after its last edge */
+  if (last) endFrame_(channel, receiver, now_us - RAW_DATA_TIMEOUT_US);
+}
+
+/**
+ * @brief Append a received duration [us] to the frame being received.
+ *
+ * Pulses shorter than RAW_DATA_GLITCH_US are treated as noise: a glitch
+ * inside a frame is merged with its neighbours, and a glitch at either end
+ * is dropped together with the adjacent gap. Two edges are counted per
+ * removed pulse.
+ */
+inline void IRRemote::appendWidth_(RxState& rx, uint16_t width) {
+  if (rx.skip_next) {
+    rx.skip_next = false;  //< the gap after leading noise
+    return;
+  }
+  if (rx.glitch) {
+    auto& chunk = rx_pool_[rx.last];
+    const uint32_t merged = chunk.data[chunk.size - 1] + rx.glitch + width;
+    chunk.data[chunk.size - 1] = merged > UINT16_MAX ? UINT16_MAX : merged;
+    rx.glitch = 0;
+    return;
+  }
+  if (width >= RAW_DATA_GLITCH_US) return pushWidth_(rx, width);
+  filtered_edges_.fetch_add(2, std::memory_order_relaxed);
+  if (rx.size == 0) {
+    rx.skip_next = true;
+  } else {
+    rx.glitch = width;
+  }
+}
+
+inline void IRRemote::pushWidth_(RxState& rx, uint16_t width) {
+  if (rx.failed) return;
+  if (rx.last == ChunkPool::kNone ||
+      rx_pool_[rx.last].size == RAW_DATA_CHUNK_SIZE) {
+    ChunkPool::Index index = rx.spare;
+    if (index != ChunkPool::kNone) {
+      rx.spare = rx_pool_[index].next;
+      rx_pool_[index].next = ChunkPool::kNone;
+      rx_pool_[index].size = 0;
+    } else {
+      index = rx_pool_.allocate();
+    }
+    if (index == ChunkPool::kNone) {
+      rx.failed = true;
+      return;
+    }
+    if (rx.last == ChunkPool::kNone) {
+      rx.first = index;
+    } else {
+      rx_pool_[rx.last].next = index;
+    }
+    rx.last = index;
+  }
+  auto& chunk = rx_pool_[rx.last];
+  chunk.data[chunk.size++] = width;
+  ++rx.size;
+}
+
+inline void IRRemote::endFrame_(RxChannel& channel, uint8_t receiver,
+                                uint64_t end_us) {
+  RxState& rx = channel.state;
+  if (rx.glitch) {
+    /* trailing noise, drop the preceding gap too */
+    --rx_pool_[rx.last].size;
+    --rx.size;
+  }
+  const uint64_t start_us = end_us - rx.duration_us;
+  const uint64_t blank_us = start_us - channel.prev_us;
+  const uint64_t part_end_us = rx.part_end_us;
+  channel.prev_us = end_us;
+  rx.part_end_us = 0;
+
+  /* the reflection of our own transmission and a frame that ran out of
+   * chunks are dropped; a frame close behind the previous one that does not
+   * continue it is a repeat, which the reader folds into its press */
+  const bool continued = part_end_us && blank_us < IR_PART_GAP_US &&
+                         end_us - part_end_us <= IR_PART_SPAN_US;
+  const bool repeat = !continued && blank_us < IR_FINALIZING_TIMEOUT_US;
+  if (rx.failed) truncated_frames_.fetch_add(1, std::memory_order_relaxed);
+  if (tx_active_.load(std::memory_order_acquire) || rx.failed ||
+      rx.size < (repeat ? IR_REPEAT_MIN_SIZE : RAW_DATA_MIN_SIZE)) {
+    return recycle_(rx);
+  }
+  const bool continuable = rx.size >= IR_PART_MIN_SIZE;
+  if (receiver != rx_last_.receiver && start_us < rx_last_.end_us &&
+      rx_last_.start_us < end_us) {
+    /* the same signal, published from another receiver already */
+    duplicate_frames_.fetch_add(1, std::memory_order_relaxed);
+    recycle_(rx);
+    if (continuable) rx.part_end_us = end_us;
+    return;
+  }
+  auto* frame = rx_frames_.acquire();
+  if (!frame) return recycle_(rx);
+  frame->first = rx.first;
+  frame->size = rx.size;
+  frame->gap_us = continued ? blank_us : 0;
+  frame->continued = continued;
+  frame->repeat = repeat;
+  frame->duration_us = rx.duration_us;
+  frame->end_us = end_us;
+  rx_frames_.publish();
+  rx_last_ = RxLast{receiver, start_us, end_us};
+  rx = RxState{ChunkPool::kNone, ChunkPool::kNone, rx.spare};
+  if (continuable) rx.part_end_us = end_us;
+}
+
+inline void IRRemote::recycle_(RxState& rx) {
+  /* only the reader returns chunks to the pool, so keep them for reuse */
+  if (rx.last != ChunkPool::kNone) rx_pool_[rx.last].next = rx.spare;
+  if (rx.first != ChunkPool::kNone) rx.spare = rx.first;
+  rx = RxState{ChunkPool::kNone, ChunkPool::kNone, rx.spare};
 }
 
 inline void IRRemote::print(const IRData& data, const char* label) {
@@ -191,13 +831,10 @@ inline void IRRemote::print(const IRData& data, const char* label) {
 inline bool IRRemote::isIrDataEqual(const IRData& a, const IRData& b,
                                     float tolerance_percent) {
   if (a.size() != b.size()) return false;
+  /* compare in Q8 fixed point: |a - b| <= b * tolerance */
+  const uint32_t tolerance_q8 = tolerance_percent * 256.0f / 100.0f;
   for (size_t i = 0; i < a.size(); ++i) {
-    float expected = static_cast<float>(b[i]);
-    float diff = std::abs(static_cast<float>(a[i]) - expected);
-    float allowed = expected * (tolerance_percent / 100.0f);
-    if (diff > allowed) {
-      return false;
-    }
+    if (!isWidthClose_(a[i], b[i], tolerance_q8)) return false;
   }
   return true;
 }
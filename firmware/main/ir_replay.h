@@ -0,0 +1,257 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <memory>
+
+#include "ir_protocol.h"
+#include "ir_remote.h"
+#include "ir_trace.h"
+
+/**
+ * @brief Replays IR traces through the receiver state machine.
+ *
+ * Every run uses a fresh, unstarted IRRemote and feeds the recorded frames
+ * into its receive path with the recorded timestamps as the clock, so the
+ * result depends only on the trace and can be compared across firmware
+ * versions. The live receiver is not touched.
+ *
+ * Built for the host, the virtual AppClock is set to each timestamp and the
+ * codes are read through available(), as the app reads them; elapsed_us is
+ * then measured on the wall clock.
+ */
+class IRReplay {
+ public:
+  struct Stats {
+    uint32_t records = 0;
+    uint32_t frames = 0;     //< records that ended a frame
+    uint32_t decoded = 0;    //< codes, with their parts joined
+    uint32_t parts = 0;      //< frames joined into the decoded codes
+    uint32_t repeats = 0;    //< repeat frames folded into the decoded codes
+    uint32_t dropped = 0;    //< short frames, stray repeats and overflows
+    uint32_t truncated = 0;  //< frames that ran out of chunks
+    uint32_t filtered_edges = 0;
+    uint64_t edges = 0;
+    uint32_t elapsed_us = 0;
+    uint32_t checksum = 2166136261u;  //< FNV-1a of the decoded codes
+  };
+
+  struct SynthOptions {
+    int frames = 32;
+    int jitter_us = 60;        //< uniform +/- on every mark and space
+    int glitches = 1;          //< short pulses injected per frame
+    int overlap_percent = 10;  //< frames run into the next one
+    int repeat_percent = 10;   //< presses held for a repeat code
+    int long_percent = 10;     //< air-conditioner codes sent in parts
+    uint32_t seed = 1;
+  };
+
+  static constexpr const int kLongCodeParts = 3;
+  static constexpr const int kLongCodePartBytes = 19;
+
+  static bool run(const uint8_t* trace, size_t size, Stats& stats);
+  static bool synthesize(IRTraceRecorder& trace, const SynthOptions& options);
+  /* the stats on one line, as print() logs them */
+  static void format(const Stats& stats, char* text, size_t size);
+  static void print(const Stats& stats);
+
+ private:
+  static uint32_t next_(uint32_t& state) {
+    /* xorshift32 keeps synthetic traces reproducible from the seed */
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  }
+  static void encodeLongPart_(uint32_t& state, IRRemote::IRData& data);
+  static bool available_(IRRemote& remote, uint64_t now_us) {
+#if APP_CLOCK_VIRTUAL
+    AppClock::set(now_us);
+    return remote.available();
+#else
+    return remote.assemble_(now_us);
+#endif
+  }
+  static uint32_t elapsedUs_() {
+#if APP_CLOCK_VIRTUAL
+    using namespace std::chrono;
+    return duration_cast<microseconds>(
+               steady_clock::now().time_since_epoch())
+        .count();
+#else
+    return AppClock::micros();
+#endif
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool IRReplay::run(const uint8_t* trace, size_t size, Stats& stats) {
+  stats = Stats{};
+  std::unique_ptr<IRRemote> remote(new (std::nothrow) IRRemote());
+  if (!remote) return false;
+
+  auto collect = [&](uint64_t now_us) {
+    while (available_(*remote, now_us)) {
+      ++stats.decoded;
+      stats.parts += remote->rx_press_.parts;
+      stats.repeats += remote->rx_press_.repeats;
+      stats.checksum = (stats.checksum ^ remote->rx_press_.repeats) * 16777619u;
+      for (const auto width : remote->rx_code_) {
+        stats.checksum = (stats.checksum ^ width) * 16777619u;
+      }
+      remote->pop();
+    }
+  };
+  uint64_t last_us = 0;
+  const uint32_t start_us = elapsedUs_();
+  const bool ok = IRTraceRecorder::forEach(
+      trace, size,
+      [&](uint64_t end_us, const rmt_symbol_word_t* symbols, size_t count,
+          uint16_t flags) {
+        const bool last = !(flags & IRTraceRecorder::kPartial);
+        ++stats.records;
+        stats.frames += last;
+        for (size_t i = 0; i < count; ++i) {
+          stats.edges += (symbols[i].duration0 != 0);
+          stats.edges += (symbols[i].duration1 != 0);
+        }
+        const uint32_t truncated = remote->getTruncatedCount();
+        const uint8_t receiver = (flags & IRTraceRecorder::kReceiverMask) >>
+                                 IRTraceRecorder::kReceiverShift;
+        if (receiver >= IRRemote::IR_RX_CHANNELS_MAX) return;
+        last_us = end_us;
+        remote->isr(symbols, count, end_us, last, receiver);
+        stats.truncated += remote->getTruncatedCount() - truncated;
+        collect(end_us);
+      });
+  /* the last code is only complete once no further part can follow */
+  collect(last_us + IRRemote::IR_PART_SPAN_US +
+          IRRemote::IR_FINALIZING_TIMEOUT_US + 1'000'000);
+  stats.elapsed_us = elapsedUs_() - start_us;
+  stats.filtered_edges = remote->getFilteredEdgeCount();
+  stats.dropped =
+      stats.frames - stats.parts - stats.repeats - stats.truncated;
+  return ok;
+}
+
+inline bool IRReplay::synthesize(IRTraceRecorder& trace,
+                                 const SynthOptions& options) {
+  if (!trace.reset(IRRemote::RMT_RESOLUTION_HZ)) return false;
+  uint32_t state = options.seed ? options.seed : 1;
+  auto chance = [&state](int percent) {
+    return int(next_(state) % 100) < percent;
+  };
+
+  uint64_t now_us = 1'000'000;
+  IRRemote::IRData data;
+  IRRemote::IRSymbols symbols;
+  bool held = false;
+  for (int n = 0; n < options.frames; ++n) {
+    IRCode code;
+    code.protocol = IRProtocol::NEC;
+    code.bits = 32;
+    code.address = next_(state);
+    code.command = next_(state) & 0xFFFF;
+    IRProtocolCodec::encode(code, data);
+    const int parts =
+        !held && chance(options.long_percent) ? kLongCodeParts : 1;
+    if (held) {
+      /* NEC repeat code: leader mark, short space and stop mark */
+      data.assign({9000, 2250, 560});
+    } else if (parts > 1) {
+      encodeLongPart_(state, data);
+    } else if (chance(options.overlap_percent)) {
+      /* a second remote starts before the receiver sees the line idle */
+      IRRemote::IRData other;
+      code.address = next_(state);
+      IRProtocolCodec::encode(code, other);
+      data.push_back(IRRemote::RAW_DATA_TIMEOUT_US / 4);
+      data.insert(data.end(), other.begin(), other.end());
+    }
+    for (auto& width : data) {
+      const int jitter = options.jitter_us
+                             ? int(next_(state) % (2 * options.jitter_us + 1)) -
+                                   options.jitter_us
+                             : 0;
+      width = std::max(1, std::min(int(width) + jitter, int(UINT16_MAX)));
+    }
+    for (int g = 0; g < options.glitches && data.size() > 4; ++g) {
+      /* split a space with a pulse shorter than the glitch filter */
+      const size_t i = 1 + 2 * (next_(state) % (data.size() / 2 - 1));
+      const uint16_t pulse = 10 + next_(state) % 40;
+      if (data[i] <= pulse + 2) continue;
+      const uint16_t left = (data[i] - pulse) / 2;
+      const uint16_t right = data[i] - pulse - left;
+      data[i] = left;
+      data.insert(data.begin() + i + 1, {pulse, right});
+    }
+
+    bool full = false;
+    for (int part = 0; part < parts && !full; ++part) {
+      if (part > 0) {
+        /* apart enough to end the frame, close enough to continue it */
+        now_us += IRRemote::IR_PART_GAP_US - IRRemote::RAW_DATA_TIMEOUT_US -
+                  5'000 - next_(state) % 10'000;
+        encodeLongPart_(state, data);
+      }
+      /* the receiver reports a long frame a symbol buffer at a time */
+      IRRemote::encode(data, symbols);
+      const size_t piece = IRRemote::RMT_RX_SYMBOL_BUFFER_SIZE;
+      for (size_t i = 0; i < symbols.size() && !full; i += piece) {
+        const size_t n = std::min(piece, symbols.size() - i);
+        const bool last = i + n == symbols.size();
+        for (size_t j = i; j < i + n; ++j) {
+          now_us += symbols[j].duration0 + symbols[j].duration1;
+        }
+        if (last) now_us += IRRemote::RAW_DATA_TIMEOUT_US;
+        full = !trace.append(now_us, symbols.data() + i, n, last);
+      }
+    }
+    if (full) break;
+    /* the next press follows after a pause, or the button is held */
+    held = chance(options.repeat_percent);
+    now_us += held ? IRRemote::IR_FINALIZING_TIMEOUT_US / 2
+                   : 200'000 + next_(state) % 800'000;
+  }
+  return true;
+}
+
+/**
+ * @brief Encode one part of a synthetic air-conditioner code.
+ *
+ * The parts are pulse distance frames of kLongCodePartBytes random bytes,
+ * far longer than the RMT symbol buffer.
+ */
+inline void IRReplay::encodeLongPart_(uint32_t& state,
+                                      IRRemote::IRData& data) {
+  data.assign({3400, 1700});
+  for (int i = 0; i < kLongCodePartBytes * 8; ++i) {
+    data.push_back(430);
+    data.push_back(next_(state) & 1 ? 1300 : 430);
+  }
+  data.push_back(430);
+}
+
+inline void IRReplay::format(const Stats& stats, char* text, size_t size) {
+  const uint32_t elapsed_us = stats.elapsed_us ? stats.elapsed_us : 1;
+  snprintf(text, size,
+           "records: %" PRIu32 ", frames: %" PRIu32 ", decoded: %" PRIu32
+           " (parts: %" PRIu32 ", repeats: %" PRIu32 "), dropped: %" PRIu32
+           ", truncated: %" PRIu32 ", edges: %" PRIu64 " (filtered: %" PRIu32
+           "), %" PRIu32 " us, %" PRIu64 " edges/s, checksum: %08" PRIX32,
+           stats.records, stats.frames, stats.decoded, stats.parts,
+           stats.repeats, stats.dropped, stats.truncated, stats.edges,
+           stats.filtered_edges, stats.elapsed_us,
+           stats.edges * 1'000'000 / elapsed_us, stats.checksum);
+}
+
+inline void IRReplay::print(const Stats& stats) {
+  char text[320];
+  format(stats, text, sizeof(text));
+  LOGI("[IR-Replay] %s", text);
+}
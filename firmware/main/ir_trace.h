@@ -0,0 +1,157 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <driver/rmt_types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+/**
+ * @brief Binary trace of received RMT frames for offline replay.
+ *
+ * Trace layout (multi-byte integers are little endian):
+ *
+ *   "IRTR" | u8 version | u8 reserved[3] | u32 resolution [Hz] | records
+ *
+ * Each record is `u64 end [us] | u16 num_symbols | u16 flags | symbols`,
+ * where the end is the time the receiver reported the symbols and every
+ * symbol is the raw 32-bit RMT word (15-bit duration, 1-bit level, twice).
+ * A long frame is reported in pieces; all but its last record have the
+ * kPartial flag set. The flags also hold the index of the receiver that
+ * reported the symbols (kReceiverMask).
+ *
+ * The receiver callback is the only writer while recording; readers look at
+ * the committed size, so a trace can be dumped while it is still growing.
+ */
+class IRTraceRecorder {
+ public:
+  static constexpr const size_t kCapacity = 16 * 1024;
+  static constexpr const uint8_t kVersion = 1;
+  static constexpr const size_t kHeaderSize = 12;
+  static constexpr const size_t kRecordHeaderSize = 12;
+  static constexpr const size_t kMaxRecordSymbols = 512;  //< on replay
+  static constexpr const uint16_t kPartial = 1 << 0;  //< record flag
+  static constexpr const int kReceiverShift = 8;
+  static constexpr const uint16_t kReceiverMask = 0x0F << kReceiverShift;
+
+  bool reset(uint32_t resolution_hz);
+  bool start(uint32_t resolution_hz);
+  void stop() { recording_.store(false, std::memory_order_release); }
+  bool recording() const { return recording_.load(std::memory_order_acquire); }
+  void record(uint64_t end_us, const rmt_symbol_word_t* symbols,
+              size_t num_symbols, bool last = true, uint8_t receiver = 0);
+  bool append(uint64_t end_us, const rmt_symbol_word_t* symbols,
+              size_t num_symbols, bool last = true, uint8_t receiver = 0);
+
+  const uint8_t* data() const { return buffer_.get(); }
+  size_t size() const { return size_.load(std::memory_order_acquire); }
+  uint32_t droppedCount() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  /* calls handler(end_us, symbols, num_symbols, flags) for each record */
+  template <typename Handler>
+  static bool forEach(const uint8_t* trace, size_t size, Handler&& handler);
+
+ private:
+  std::unique_ptr<uint8_t[]> buffer_;
+  std::atomic<size_t> size_{0};
+  std::atomic<bool> recording_{false};
+  std::atomic<uint32_t> dropped_{0};
+
+  static void putLe_(uint8_t* p, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) p[i] = value >> (8 * i);
+  }
+  static uint64_t getLe_(const uint8_t* p, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i) value |= uint64_t(p[i]) << (8 * i);
+    return value;
+  }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool IRTraceRecorder::start(uint32_t resolution_hz) {
+  if (!reset(resolution_hz)) return false;
+  recording_.store(true, std::memory_order_release);
+  return true;
+}
+
+inline bool IRTraceRecorder::reset(uint32_t resolution_hz) {
+  stop();
+  if (!buffer_) buffer_.reset(new (std::nothrow) uint8_t[kCapacity]);
+  if (!buffer_) return false;
+  memcpy(buffer_.get(), "IRTR", 4);
+  buffer_[4] = kVersion;
+  buffer_[5] = buffer_[6] = buffer_[7] = 0;
+  putLe_(buffer_.get() + 8, resolution_hz, 4);
+  size_.store(kHeaderSize, std::memory_order_release);
+  dropped_.store(0, std::memory_order_relaxed);
+  return true;
+}
+
+inline void IRTraceRecorder::record(uint64_t end_us,
+                                    const rmt_symbol_word_t* symbols,
+                                    size_t num_symbols, bool last,
+                                    uint8_t receiver) {
+  if (!recording()) return;
+  if (!append(end_us, symbols, num_symbols, last, receiver)) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+inline bool IRTraceRecorder::append(uint64_t end_us,
+                                    const rmt_symbol_word_t* symbols,
+                                    size_t num_symbols, bool last,
+                                    uint8_t receiver) {
+  const size_t size = size_.load(std::memory_order_relaxed);
+  const size_t bytes =
+      kRecordHeaderSize + num_symbols * sizeof(rmt_symbol_word_t);
+  if (!buffer_ || size < kHeaderSize || num_symbols > UINT16_MAX ||
+      size + bytes > kCapacity) {
+    return false;
+  }
+  uint8_t* p = buffer_.get() + size;
+  putLe_(p, end_us, 8);
+  putLe_(p + 8, num_symbols, 2);
+  putLe_(p + 10,
+         (last ? 0 : kPartial) |
+             ((receiver << kReceiverShift) & kReceiverMask),
+         2);
+  memcpy(p + kRecordHeaderSize, symbols,
+         num_symbols * sizeof(rmt_symbol_word_t));
+  size_.store(size + bytes, std::memory_order_release);
+  return true;
+}
+
+template <typename Handler>
+inline bool IRTraceRecorder::forEach(const uint8_t* trace, size_t size,
+                                     Handler&& handler) {
+  if (size < kHeaderSize || memcmp(trace, "IRTR", 4) != 0 ||
+      trace[4] != kVersion) {
+    return false;
+  }
+  rmt_symbol_word_t symbols[kMaxRecordSymbols];
+  for (size_t offset = kHeaderSize; offset < size;) {
+    if (offset + kRecordHeaderSize > size) return false;
+    const uint64_t end_us = getLe_(trace + offset, 8);
+    const size_t num_symbols = getLe_(trace + offset + 8, 2);
+    const uint16_t flags = getLe_(trace + offset + 10, 2);
+    const size_t bytes = num_symbols * sizeof(rmt_symbol_word_t);
+    offset += kRecordHeaderSize;
+    if (offset + bytes > size) return false;
+    /* copy out, since records are not aligned in the trace */
+    const size_t count = std::min(num_symbols, kMaxRecordSymbols);
+    memcpy(symbols, trace + offset, count * sizeof(rmt_symbol_word_t));
+    handler(end_us, symbols, count, flags);
+    offset += bytes;
+  }
+  return true;
+}
@@ -0,0 +1,387 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "app_config.h"
+#include "app_log.h"
+#include "ir_code_storage.h"
+#include "ir_remote.h"
+#include "power_manager.h"
+
+/**
+ * @brief Sends IR frames from a dedicated task so that callers never block.
+ *
+ * Commands wait in a small bounded set of slots, one per key. The first
+ * command for a key is due at once, so a single toggle goes out without
+ * delay. One posted within the coalescing window after a frame for its key
+ * started waits out the rest of the window, and a command posted for a key
+ * that is still pending replaces the pending one, so a burst of on/off/on
+ * changes goes out as the first frame and one frame of the final state.
+ * Due commands are sent by priority, then in posting order, and
+ * consecutive frames are kept apart by a frame gap.
+ *
+ * A command goes out on a set of emitters. The task starts a command as
+ * soon as all of its emitters are idle and past their frame gap, without
+ * waiting for frames on other emitters, so frames for different targets
+ * are on air in parallel. The receiver's sent callback wakes the task when
+ * an emitter is done.
+ *
+ * A caller that sends a sequence of presses under one key can pass a zero
+ * coalescing window and post the next press once pending() turns false,
+ * i.e. as soon as the task has taken the previous one.
+ *
+ * A stored record, e.g. in memory-mapped flash, is expanded straight into
+ * the frame buffer of its slot. Frame buffers are handed between the slots
+ * and the task instead of being freed, so sending does not allocate once
+ * the buffers have grown to the longest frame.
+ *
+ * In the power save mode, the task holds a power lock and keeps the RMT
+ * channels of the emitters enabled only while it has commands, so that the
+ * chip may sleep in between.
+ */
+class IRTransmitter {
+ public:
+  enum class Priority : uint8_t { Low, Normal, High };
+
+  static constexpr const int kQueueSize = 4;
+  static constexpr const uint32_t kCoalesceWindowMs = 150;
+  static constexpr const uint32_t kFrameGapMs = 100;
+  static constexpr const uint32_t kTaskStackSize = 4096;
+  static constexpr const UBaseType_t kTaskPriority =
+      CONFIG_APP_TASK_PRIORITY_IR_TX;
+
+  IRTransmitter(IRRemote& ir_remote, PowerManager& power)
+      : ir_remote_(ir_remote), power_(power) {}
+
+  bool begin();
+  bool post(uint16_t key, IRRemote::IRData&& data, const char* label,
+            Priority priority = Priority::Normal,
+            IRRemote::ChannelMask channels = IRRemote::kAllChannels);
+  bool post(uint16_t key, const uint8_t* record, size_t size,
+            const char* label, Priority priority = Priority::Normal,
+            uint32_t window_ms = kCoalesceWindowMs,
+            IRRemote::ChannelMask channels = IRRemote::kAllChannels);
+  bool idle() const;
+  bool pending(uint16_t key) const;
+
+  /* called from the task right before a frame goes out */
+  using SendHandler = void (*)(void* arg);
+  void onSend(SendHandler handler, void* arg) {
+    send_arg_ = arg;
+    send_handler_ = handler;
+  }
+
+  uint32_t getCoalescedCount() const { return coalesced_count_.load(); }
+  uint32_t getDroppedCount() const { return dropped_count_.load(); }
+
+ private:
+  /* when a frame for a key last started, for the coalescing window */
+  struct Started {
+    uint16_t key = 0;
+    uint32_t at_ms = 0;
+    bool valid = false;
+  };
+
+  struct Command {
+    bool pending = false;
+    uint16_t key = 0;
+    Priority priority = Priority::Normal;
+    uint32_t sequence = 0;
+    uint32_t due_ms = 0;
+    IRRemote::ChannelMask channels = 0;
+    char label[32] = "";  //< copied, the caller's string may not outlive it
+    IRRemote::IRData data;
+  };
+
+  IRRemote& ir_remote_;
+  PowerManager& power_;
+  Command commands_[kQueueSize];
+  Started started_[kQueueSize];
+  SemaphoreHandle_t mutex_ = nullptr;
+  TaskHandle_t task_ = nullptr;
+  uint32_t sequence_ = 0;
+  /* end of the gap after the last frame, per emitter */
+  uint32_t not_before_ms_[IRRemote::IR_TX_CHANNELS_MAX] = {};
+  char labels_[IRRemote::IR_TX_CHANNELS_MAX][32] = {};  //< frames on air
+  std::atomic<IRRemote::ChannelMask> in_flight_{0};
+  std::atomic<uint32_t> coalesced_count_{0};
+  std::atomic<uint32_t> dropped_count_{0};
+  SendHandler send_handler_ = nullptr;
+  void* send_arg_ = nullptr;
+
+  template <typename Fill>
+  bool post_(uint16_t key, const char* label, Priority priority,
+             uint32_t window_ms, IRRemote::ChannelMask channels, Fill&& fill);
+  Command* findSlot_(uint16_t key, Priority priority);
+  uint32_t dueAt_(uint16_t key, uint32_t window_ms) const;
+  void noteStarted_(uint16_t key, uint32_t now);
+  bool takeDue_(Command& command, uint32_t& wait_ms);
+  void finishSent_();
+  void setPowered_(bool powered);
+  void run_();
+  static void taskEntry_(void* this_ptr);
+  static bool onSent_(void* this_ptr);
+  static bool isBefore_(uint32_t a, uint32_t b) { return int32_t(a - b) < 0; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline bool IRTransmitter::begin() {
+  mutex_ = xSemaphoreCreateMutex();
+  if (!mutex_) {
+    LOGE("[IR-Tx] Failed to create mutex");
+    return false;
+  }
+  if (xTaskCreatePinnedToCore(taskEntry_, "ir_tx", kTaskStackSize, this,
+                              kTaskPriority, &task_,
+                              CONFIG_APP_CORE_REALTIME) != pdPASS) {
+    LOGE("[IR-Tx] Failed to create task");
+    return false;
+  }
+  ir_remote_.onSent(onSent_, this);
+  return true;
+}
+
+inline bool IRTransmitter::post(uint16_t key, IRRemote::IRData&& data,
+                                const char* label, Priority priority,
+                                IRRemote::ChannelMask channels) {
+  return post_(key, label, priority, kCoalesceWindowMs, channels,
+               [&data](IRRemote::IRData& frame) {
+                 frame = std::move(data);
+                 return true;
+               });
+}
+
+inline bool IRTransmitter::post(uint16_t key, const uint8_t* record,
+                                size_t size, const char* label,
+                                Priority priority, uint32_t window_ms,
+                                IRRemote::ChannelMask channels) {
+  return post_(key, label, priority, window_ms, channels,
+               [=](IRRemote::IRData& frame) {
+                 return IRCodeStorage::decode(record, size, frame);
+               });
+}
+
+template <typename Fill>
+inline bool IRTransmitter::post_(uint16_t key, const char* label,
+                                 Priority priority, uint32_t window_ms,
+                                 IRRemote::ChannelMask channels,
+                                 Fill&& fill) {
+  if (!task_) return false;
+  channels &= ir_remote_.txChannels();
+  if (!channels) {
+    LOGE("[IR-Tx] %s dropped (no emitter)", label);
+    return false;
+  }
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  Command* command = findSlot_(key, priority);
+  if (!command) {
+    xSemaphoreGive(mutex_);
+    dropped_count_.fetch_add(1);
+    LOGW("[IR-Tx] %s dropped (queue full)", label);
+    return false;
+  }
+  if (command->pending && command->key == key) {
+    /* keep the place in line and the deadline of the command it replaces */
+    coalesced_count_.fetch_add(1);
+    LOGI("[IR-Tx] %s replaces %s", label, command->label);
+    command->priority = std::max(command->priority, priority);
+  } else {
+    if (command->pending) {
+      dropped_count_.fetch_add(1);
+      LOGW("[IR-Tx] %s dropped for %s", command->label, label);
+    }
+    command->key = key;
+    command->priority = priority;
+    command->sequence = sequence_++;
+    command->due_ms = dueAt_(key, window_ms);
+  }
+  command->channels = channels;
+  strlcpy(command->label, label, sizeof(command->label));
+  const bool filled = fill(command->data);
+  command->pending = filled;
+  xSemaphoreGive(mutex_);
+  if (!filled) {
+    LOGE("[IR-Tx] %s dropped (broken record)", label);
+    return false;
+  }
+  xTaskNotifyGive(task_);
+  return true;
+}
+
+inline bool IRTransmitter::idle() const {
+  if (in_flight_.load()) return false;
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  bool pending = false;
+  for (const auto& command : commands_) pending |= command.pending;
+  xSemaphoreGive(mutex_);
+  return !pending;
+}
+
+inline bool IRTransmitter::pending(uint16_t key) const {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  bool pending = false;
+  for (const auto& command : commands_) {
+    pending |= command.pending && command.key == key;
+  }
+  xSemaphoreGive(mutex_);
+  return pending;
+}
+
+inline IRTransmitter::Command* IRTransmitter::findSlot_(uint16_t key,
+                                                        Priority priority) {
+  Command* free_slot = nullptr;
+  Command* victim = nullptr;
+  for (auto& command : commands_) {
+    if (command.pending && command.key == key) return &command;
+    if (!command.pending) {
+      if (!free_slot) free_slot = &command;
+      continue;
+    }
+    /* the newest of the lowest priority commands gives way when full */
+    if (command.priority < priority &&
+        (!victim || command.priority < victim->priority ||
+         (command.priority == victim->priority &&
+          isBefore_(victim->sequence, command.sequence)))) {
+      victim = &command;
+    }
+  }
+  return free_slot ? free_slot : victim;
+}
+
+inline uint32_t IRTransmitter::dueAt_(uint16_t key,
+                                      uint32_t window_ms) const {
+  const uint32_t now = AppClock::millis();
+  for (const auto& started : started_) {
+    if (!started.valid || started.key != key) continue;
+    const uint32_t end = started.at_ms + window_ms;
+    return isBefore_(now, end) ? end : now;
+  }
+  return now;
+}
+
+inline void IRTransmitter::noteStarted_(uint16_t key, uint32_t now) {
+  /* the entry of the key, or else the one started longest ago */
+  Started* entry = &started_[0];
+  for (auto& started : started_) {
+    if (started.valid && started.key == key) {
+      entry = &started;
+      break;
+    }
+    if (!started.valid) {
+      if (entry->valid) entry = &started;
+    } else if (entry->valid && isBefore_(started.at_ms, entry->at_ms)) {
+      entry = &started;
+    }
+  }
+  entry->key = key;
+  entry->at_ms = now;
+  entry->valid = true;
+}
+
+inline bool IRTransmitter::takeDue_(Command& command, uint32_t& wait_ms) {
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  const uint32_t now = AppClock::millis();
+  const IRRemote::ChannelMask busy = in_flight_.load();
+  Command* next = nullptr;
+  wait_ms = UINT32_MAX;
+  for (auto& candidate : commands_) {
+    /* a command waits for all of its emitters, the sent callback wakes the
+     * task once they are idle */
+    if (!candidate.pending || (candidate.channels & busy)) continue;
+    uint32_t due = candidate.due_ms;
+    for (int i = 0; i < IRRemote::IR_TX_CHANNELS_MAX; ++i) {
+      if ((candidate.channels & (1 << i)) &&
+          isBefore_(due, not_before_ms_[i])) {
+        due = not_before_ms_[i];
+      }
+    }
+    if (isBefore_(now, due)) {
+      wait_ms = std::min(wait_ms, due - now);
+      continue;
+    }
+    if (!next || candidate.priority > next->priority ||
+        (candidate.priority == next->priority &&
+         isBefore_(candidate.sequence, next->sequence))) {
+      next = &candidate;
+    }
+  }
+  if (next) {
+    /* the slot gets the buffer of the frame sent before */
+    std::swap(command, *next);
+    next->pending = false;
+    for (int i = 0; i < IRRemote::IR_TX_CHANNELS_MAX; ++i) {
+      if (command.channels & (1 << i)) {
+        strlcpy(labels_[i], command.label, sizeof(labels_[i]));
+      }
+    }
+    in_flight_.fetch_or(command.channels);
+    noteStarted_(command.key, now);
+  }
+  xSemaphoreGive(mutex_);
+  return next;
+}
+
+inline void IRTransmitter::finishSent_() {
+  const IRRemote::ChannelMask done =
+      in_flight_.load() & ~ir_remote_.sendingChannels();
+  if (!done) return;
+  xSemaphoreTake(mutex_, portMAX_DELAY);
+  const uint32_t now = AppClock::millis();
+  for (int i = 0; i < IRRemote::IR_TX_CHANNELS_MAX; ++i) {
+    if (!(done & (1 << i))) continue;
+    not_before_ms_[i] = now + kFrameGapMs;
+    LOGW("[IR-Tx] %s sent (channel: %d)", labels_[i], i);
+  }
+  in_flight_.fetch_and(IRRemote::ChannelMask(~done));
+  xSemaphoreGive(mutex_);
+}
+
+inline void IRTransmitter::run_() {
+  Command command;
+  for (;;) {
+    finishSent_();
+    uint32_t wait_ms;
+    if (!takeDue_(command, wait_ms)) {
+      /* nothing left to send, not even after a frame gap */
+      if (wait_ms == UINT32_MAX && !in_flight_.load()) setPowered_(false);
+      ulTaskNotifyTake(pdTRUE, wait_ms == UINT32_MAX
+                                   ? portMAX_DELAY
+                                   : pdMS_TO_TICKS(wait_ms) + 1);
+      continue;
+    }
+    LOGW("[IR-Tx] %s (size: %zu, channels: 0x%x)", command.label,
+         command.data.size(), command.channels);
+    setPowered_(true);
+    /* returns once the frame is on air, the emitters were idle */
+    if (send_handler_) send_handler_(send_arg_);
+    ir_remote_.send(command.data, command.channels);
+  }
+}
+
+inline void IRTransmitter::setPowered_(bool powered) {
+  power_.hold(PowerManager::Lock::IrTx, powered);
+  if (PowerManager::kEnabled) ir_remote_.setTransmittersEnabled(powered);
+}
+
+inline void IRTransmitter::taskEntry_(void* this_ptr) {
+  static_cast<IRTransmitter*>(this_ptr)->run_();
+}
+
+inline bool IRTransmitter::onSent_(void* this_ptr) {
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(static_cast<IRTransmitter*>(this_ptr)->task_,
+                         &woken);
+  return woken == pdTRUE;
+}
@@ -12,39 +12,29 @@
 #include <esp_matter_cluster.h>
 #include <esp_matter_core.h>
 #include <esp_matter_endpoint.h>
-#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
 #include <inttypes.h>
 #include <platform/ConfigurationManager.h>
 #include <system/SystemClock.h>
 
-class MatterLight {
- public:
-  enum class EventType : uint8_t {
-    LightOn,
-    LightOff,
-    SwitchOn,
-    SwitchOff,
-    NightOn,
-    NightOff,
-  };
-
-  struct Event {
-    uint64_t timestamp_ms;
-    EventType type;
-    bool light_state;
-    bool switch_state;
-    bool night_state;
-  };
+#include <atomic>
+
+#include "app_clock.h"
+#include "matter_light_events.h"
 
+class MatterLight : public MatterLightEvents {
+ public:
   static constexpr const char *kManualCode = "34970112332";
   static constexpr const char *kQrUrl =
       "https://project-chip.github.io/connectedhomeip/"
       "qrcode.html?data=MT:Y.K9042C00KA0648G00";
 
+  /* with dimmable_light, the light endpoint also has a LevelControl
+   * cluster (a dimmable light device instead of an on/off light) */
   bool begin(bool initial_light_on, bool initial_switch_on,
-             bool initial_night_on = false, bool enable_night_endpoint = true) {
+             bool initial_night_on = false, bool enable_night_endpoint = true,
+             bool dimmable_light = false, uint8_t initial_level = 254) {
     esp_matter::node::config_t node_cfg{};
     node_ = esp_matter::node::create(&node_cfg, &MatterLight::attrCb_, nullptr,
                                      this);
@@ -53,8 +43,21 @@ class MatterLight {
       return false;
     }
 
+    // Light endpoint (dimmable)
+    if (dimmable_light) {
+      esp_matter::endpoint::dimmable_light::config_t cfg{};
+      cfg.on_off.on_off = initial_light_on;
+      cfg.level_control.current_level = initial_level;
+      ep_light_ =
+          esp_matter::endpoint::dimmable_light::create(node_, &cfg, 0, this);
+      if (!ep_light_ || !setOnOffAttr_(ep_light_, initial_light_on)) {
+        ESP_LOGE(TAG, "dimmable_light::create failed");
+        return false;
+      }
+    }
+
     // Light endpoint
-    {
+    if (!ep_light_) {
       esp_matter::endpoint::on_off_light::config_t cfg{};
       cfg.on_off.on_off = initial_light_on;
       ep_light_ =
@@ -127,7 +130,48 @@ class MatterLight {
   }
 
   bool getEvent(Event &out, TickType_t ticks = portMAX_DELAY) {
-    return queue_ && (xQueueReceive(queue_, &out, ticks) == pdTRUE);
+    const bool pending = hasLatest();
+    if (queue_ && xQueueReceive(queue_, &out, pending ? 0 : ticks) == pdTRUE) {
+      return true;
+    }
+    LatestState latest;
+    if (!takeLatest(latest)) return false;
+    out = latest.event;
+    return true;
+  }
+  /* events go to the sink, called from the Matter task, instead of the
+   * queue read by getEvent(); it returns false when it is full */
+  using EventSink = bool (*)(const Event &event, void *arg);
+  void onEvent(EventSink sink, void *arg) {
+    sink_arg_ = arg;
+    sink_ = sink;
+  }
+
+  /* events that did not fit, to be taken once the queue has been drained */
+  bool hasLatest() const {
+    return mailbox_pending_.load(std::memory_order_acquire);
+  }
+  bool takeLatest(LatestState &out) {
+    if (!hasLatest()) return false;
+    portENTER_CRITICAL(&mailbox_lock_);
+    out = mailbox_;
+    mailbox_pending_.store(false, std::memory_order_relaxed);
+    portEXIT_CRITICAL(&mailbox_lock_);
+    return true;
+  }
+  uint32_t getOverflowCount() const { return overflow_count_.load(); }
+  uint32_t getCoalescedCount() const { return coalesced_count_.load(); }
+
+  /* pushes the event of a write of the switch endpoint with the value it
+   * already has, as a Matter controller may do; for load tests */
+  void replaySwitchState() {
+    Event ev{};
+    ev.timestamp_ms = AppClock::nowMs();
+    (void)readOnAttr_(ep_light_, ev.light_state);
+    (void)readOnAttr_(ep_plugin_, ev.switch_state);
+    (void)readOnAttr_(ep_night_, ev.night_state);
+    ev.type = ev.switch_state ? EventType::SwitchOn : EventType::SwitchOff;
+    pushEvent_(ev);
   }
 
   void printOnboarding() const {
@@ -147,6 +191,12 @@ class MatterLight {
   bool setLightState(bool on) { return setOnOffAttr_(ep_light_, on); }
   bool setSwitchState(bool on) { return setOnOffAttr_(ep_plugin_, on); }
   bool setNightState(bool on) { return setOnOffAttr_(ep_night_, on); }
+  bool setLightLevel(uint8_t level) {
+    auto *attr = levelAttr_(ep_light_);
+    if (!attr) return false;
+    esp_matter_attr_val_t v = esp_matter_nullable_uint8(level);
+    return esp_matter::attribute::set_val(attr, &v) == ESP_OK;
+  }
 
   bool openCommissioningWindow(uint16_t timeout_seconds = 300) {
     auto err = chip::Server::GetInstance().GetCommissioningWindowManager()
@@ -177,6 +227,13 @@ class MatterLight {
   esp_matter::endpoint_t *ep_plugin_ = nullptr;
   esp_matter::endpoint_t *ep_night_ = nullptr;
   QueueHandle_t queue_ = nullptr;
+  EventSink sink_ = nullptr;
+  void *sink_arg_ = nullptr;
+  LatestState mailbox_;
+  std::atomic<bool> mailbox_pending_{false};
+  portMUX_TYPE mailbox_lock_ = portMUX_INITIALIZER_UNLOCKED;
+  std::atomic<uint32_t> overflow_count_{0};  //< went to the mailbox
+  std::atomic<uint32_t> coalesced_count_{0};  //< replaced in the mailbox
 
   bool setOnOffAttr_(esp_matter::endpoint_t *ep, bool on) {
     if (!ep) return false;
@@ -205,10 +262,72 @@ class MatterLight {
     return true;
   }
 
+  esp_matter::attribute_t *levelAttr_(esp_matter::endpoint_t *ep) const {
+    if (!ep) return nullptr;
+    auto *cluster =
+        esp_matter::cluster::get(ep, chip::app::Clusters::LevelControl::Id);
+    if (!cluster) return nullptr;
+    return esp_matter::attribute::get(
+        cluster,
+        chip::app::Clusters::LevelControl::Attributes::CurrentLevel::Id);
+  }
+
+  /* an event that does not fit goes to the mailbox, and so do the ones after
+   * it until the mailbox is taken, so that none is overtaken */
+  void pushEvent_(const Event &ev) {
+    if (!hasLatest() && deliver_(ev)) return;
+    portENTER_CRITICAL(&mailbox_lock_);
+    const bool pending = mailbox_pending_.load(std::memory_order_relaxed);
+    if (!pending) mailbox_ = LatestState{};
+    mailbox_.merge(ev);
+    mailbox_pending_.store(true, std::memory_order_release);
+    portEXIT_CRITICAL(&mailbox_lock_);
+    overflow_count_.fetch_add(1, std::memory_order_relaxed);
+    if (pending) {
+      coalesced_count_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      ESP_LOGW(TAG, "Event queue full, keeping the latest state");
+    }
+  }
+
+  bool deliver_(const Event &ev) {
+    if (sink_) return sink_(ev, sink_arg_);
+    return queue_ && xQueueSend(queue_, &ev, 0) == pdTRUE;
+  }
+
+  /* a transition reports every intermediate level, the consumer merges them */
+  static esp_err_t levelCb_(uint16_t endpoint_id, esp_matter_attr_val_t *val) {
+    MatterLight *self = findOwnerByEndpoint_(endpoint_id);
+    /* a null level is stored as 0xFF */
+    if (!self || !self->ep_light_ ||
+        endpoint_id != esp_matter::endpoint::get_id(self->ep_light_) ||
+        val->val.u8 == UINT8_MAX) {
+      return ESP_OK;
+    }
+    Event ev{};
+    ev.timestamp_ms = AppClock::nowMs();
+    ev.type = EventType::LightLevel;
+    (void)self->readOnAttr_(self->ep_light_, ev.light_state);
+    (void)self->readOnAttr_(self->ep_plugin_, ev.switch_state);
+    (void)self->readOnAttr_(self->ep_night_, ev.night_state);
+    ev.light_level = val->val.u8;
+    ESP_LOGI(TAG, "Level update ep=0x%04x level=%u", endpoint_id,
+             ev.light_level);
+    self->pushEvent_(ev);
+    return ESP_OK;
+  }
+
   static esp_err_t attrCb_(esp_matter::attribute::callback_type_t type,
                            uint16_t endpoint_id, uint32_t cluster_id,
                            uint32_t attribute_id, esp_matter_attr_val_t *val,
                            void *) {
+    if (type == esp_matter::attribute::POST_UPDATE &&
+        cluster_id == chip::app::Clusters::LevelControl::Id &&
+        attribute_id ==
+            chip::app::Clusters::LevelControl::Attributes::CurrentLevel::Id &&
+        val) {
+      return levelCb_(endpoint_id, val);
+    }
     if (type != esp_matter::attribute::POST_UPDATE ||
         cluster_id != chip::app::Clusters::OnOff::Id ||
         attribute_id !=
@@ -244,7 +363,7 @@ class MatterLight {
     }
 
     Event ev{};
-    ev.timestamp_ms = (uint64_t)(esp_timer_get_time() / 1000ULL);
+    ev.timestamp_ms = AppClock::nowMs();
     ev.type = (endpoint_id == ep_light)
                   ? (light_now ? EventType::LightOn : EventType::LightOff)
               : (endpoint_id == ep_plugin)
@@ -256,10 +375,7 @@ class MatterLight {
 
     ESP_LOGI(TAG, "OnOff update ep=0x%04x state=%s", endpoint_id,
              updated_state ? "ON" : "OFF");
-    if (self->queue_) {
-      if (xQueueSend(self->queue_, &ev, 0) != pdTRUE)
-        ESP_LOGE(TAG, "xQueueSend failed");
-    }
+    self->pushEvent_(ev);
     return ESP_OK;
   }
 
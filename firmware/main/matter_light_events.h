@@ -0,0 +1,60 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief The events of the Matter endpoints, MatterLight::Event and the
+ * rest, apart from the Matter stack, so that the modules which only pass
+ * them on also build for the host.
+ */
+struct MatterLightEvents {
+  enum class EventType : uint8_t {
+    LightOn,
+    LightOff,
+    SwitchOn,
+    SwitchOff,
+    NightOn,
+    NightOff,
+    LightLevel,
+  };
+
+  struct Event {
+    uint64_t timestamp_ms;
+    EventType type;
+    bool light_state;
+    bool switch_state;
+    bool night_state;
+    uint8_t light_level;  //< for LightLevel
+  };
+
+  static constexpr uint8_t kNullLevel = UINT8_MAX;
+
+  /* the latest state after a run of events, every event carries the state
+   * of all endpoints */
+  struct LatestState {
+    Event event{};  //< the last one
+    uint16_t events = 0;
+    bool light_switched = false;  //< a LightOn or LightOff among them
+    uint8_t light_level = kNullLevel;  //< of the last LightLevel among them
+
+    void merge(const Event &ev) {
+      event = ev;
+      ++events;
+      if (ev.type == EventType::LightOn || ev.type == EventType::LightOff) {
+        light_switched = true;
+      } else if (ev.type == EventType::LightLevel) {
+        light_level = ev.light_level;
+      }
+    }
+    void merge(const LatestState &other) {
+      event = other.event;
+      events += other.events;
+      light_switched |= other.light_switched;
+      if (other.light_level != kNullLevel) light_level = other.light_level;
+    }
+  };
+};
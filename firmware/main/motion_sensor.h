@@ -7,22 +7,40 @@
 
 #include <climits>
 
+#include "app_clock.h"
+
 class MotionSensor {
  public:
   explicit MotionSensor(uint8_t pin) : pin_(pin) {
     pinMode(pin_, INPUT_PULLDOWN);
   }
 
+  uint8_t pin() const { return pin_; }
+
+  /* the output is held HIGH while there is motion, so the motion lasts
+   * until the falling edge, whenever update() sees it */
   void update() {
-    if (digitalRead(pin_) == HIGH) {
-      last_motion_time_ms_ = millis();
+    const bool motion = digitalRead(pin_) == HIGH;
+    if (motion || motion_) {
+      last_motion_ms_ = AppClock::nowMs();
       seen_motion_ = true;
     }
+    motion_ = motion;
   }
 
   int getSecondsSinceLastMotion() const {
     if (!seen_motion_) return INT_MAX;
-    return (millis() - last_motion_time_ms_) / 1000;
+    if (motion_) return 0;
+    /* 64 bits, a room can be empty for longer than millis() wraps */
+    const int64_t seconds = (AppClock::nowMs() - last_motion_ms_) / 1000;
+    return seconds < INT_MAX ? seconds : INT_MAX;
+  }
+
+  /* when the last motion ended, which getSecondsSinceLastMotion() counts
+   * from; false while there is motion or before the first one */
+  bool getLastMotionEndMs(int64_t& ms) const {
+    ms = last_motion_ms_;
+    return seen_motion_ && !motion_;
   }
 
   bool isOccupied(int timeout_seconds) const {
@@ -31,6 +49,7 @@ class MotionSensor {
 
  private:
   const uint8_t pin_;
-  unsigned long last_motion_time_ms_ = 0;
+  int64_t last_motion_ms_ = 0;
   bool seen_motion_ = false;
+  bool motion_ = false;
 };
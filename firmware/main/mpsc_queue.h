@@ -0,0 +1,84 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Bounded multi-producer/single-consumer queue.
+ *
+ * A producer claims a slot by advancing the head counter, fills it and
+ * publishes it through the sequence number of the slot, so producers on
+ * different tasks and cores never wait for each other; push() only fails
+ * when the queue is full. The consumer takes the slots in the order they
+ * were claimed, and a slot that is claimed but not published yet holds back
+ * the ones behind it.
+ */
+template <typename T, size_t kSlots>
+class MpscQueue {
+  static_assert(kSlots && (kSlots & (kSlots - 1)) == 0,
+                "kSlots must be a power of two");
+
+ public:
+  MpscQueue() {
+    for (size_t i = 0; i < kSlots; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  /* producer side, any task */
+  bool push(const T& value) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    for (;;) {
+      Slot& slot = slots_[head & (kSlots - 1)];
+      const int32_t lag =
+          slot.sequence.load(std::memory_order_acquire) - head;
+      if (lag < 0) return false;  //< the consumer has not freed it yet
+      if (lag > 0) {
+        head = head_.load(std::memory_order_relaxed);  //< claimed by another
+        continue;
+      }
+      if (head_.compare_exchange_weak(head, head + 1,
+                                      std::memory_order_relaxed)) {
+        slot.value = value;
+        slot.sequence.store(head + 1, std::memory_order_release);
+        return true;
+      }
+    }
+  }
+
+  /* consumer side */
+  bool pop(T& value) {
+    Slot& slot = slots_[tail_ & (kSlots - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+      return false;
+    }
+    value = slot.value;
+    slot.sequence.store(tail_ + kSlots, std::memory_order_release);
+    ++tail_;
+    return true;
+  }
+  bool empty() const { return front() == nullptr; }
+  /* the value pop() would take next, valid until that pop() */
+  const T* front() const {
+    const Slot& slot = slots_[tail_ & (kSlots - 1)];
+    if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+      return nullptr;
+    }
+    return &slot.value;
+  }
+
+ private:
+  struct Slot {
+    std::atomic<uint32_t> sequence{0};
+    T value{};
+  };
+
+  Slot slots_[kSlots];
+  std::atomic<uint32_t> head_{0};
+  uint32_t tail_ = 0;  //< consumer only
+};
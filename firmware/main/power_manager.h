@@ -0,0 +1,250 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <driver/gpio.h>
+#include <esp_pm.h>
+#include <esp_sleep.h>
+#include <esp_wifi.h>
+#include <freertos/FreeRTOS.h>
+#include <hal/gpio_ll.h>
+#include <soc/gpio_struct.h>
+
+#include "app_clock.h"
+#include "app_log.h"
+
+/**
+ * @brief Power save mode, opted in with Smart Light > Power save.
+ *
+ * The CPU runs at the lowest frequency of the range, and the chip goes into
+ * light sleep whenever all tasks are blocked and no lock is held. The IR
+ * transmitter holds a lock while it has frames to send and the web server
+ * while a client is connected, which also raise the CPU to full speed; the
+ * controller holds one while the room is occupied or work is in progress.
+ * Wi-Fi sleeps between beacons and wakes every listen interval.
+ *
+ * GPIO wakes the chip from light sleep by level only, so right before it
+ * sleeps each wake pin is set to wake on the level it does not have, and it
+ * goes back to its edge interrupt on wake-up. The pins must have a CHANGE
+ * interrupt attached; the one latched by the wake-up is then taken as the
+ * edge.
+ *
+ * The time spent with a lock held and in light sleep is counted in either
+ * mode. Without the mode, nothing is configured and the locks are no-ops.
+ */
+class PowerManager {
+ public:
+  enum class Lock : uint8_t { IrTx, Http, Awake };
+  static constexpr const int kLockCount = 3;
+  static constexpr const int kMaxWakePins = 4;
+#if CONFIG_APP_POWER_SAVE
+  static constexpr const bool kEnabled = true;
+#else
+  static constexpr const bool kEnabled = false;
+#endif
+
+  struct Stats {
+    int64_t uptime_us = 0;
+    int64_t locked_us = 0;  //< with any of the locks held
+    int64_t sleep_us = 0;
+    uint32_t sleep_count = 0;
+    int64_t held_us[kLockCount] = {};
+    uint32_t hold_count[kLockCount] = {};
+  };
+
+  /* the pins, with their interrupts, before begin() */
+  void addWakePin(int pin);
+  bool begin();
+  /* each lock is held and released by one task */
+  void hold(Lock lock, bool held);
+  Stats getStats() const;
+  static const char* getLockName(Lock lock);
+
+ private:
+  struct LockState {
+    esp_pm_lock_handle_t handle = nullptr;
+    bool held = false;
+    int64_t since_us = 0;
+    int64_t held_us = 0;
+    uint32_t count = 0;
+  };
+
+  LockState locks_[kLockCount];
+  int locked_count_ = 0;
+  int64_t locked_since_us_ = 0;
+  int64_t locked_us_ = 0;
+  int64_t sleep_us_ = 0;
+  uint32_t sleep_count_ = 0;
+  int wake_pins_[kMaxWakePins] = {};
+  int wake_pin_count_ = 0;
+  mutable portMUX_TYPE mux_ = portMUX_INITIALIZER_UNLOCKED;
+
+  bool configureSleep_();
+  void configureWiFi_();
+  static esp_err_t IRAM_ATTR onSleepEnter_(int64_t sleep_time_us,
+                                           void* this_ptr);
+  static esp_err_t IRAM_ATTR onSleepExit_(int64_t sleep_time_us,
+                                          void* this_ptr);
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void PowerManager::addWakePin(int pin) {
+  if (wake_pin_count_ < kMaxWakePins) wake_pins_[wake_pin_count_++] = pin;
+}
+
+inline bool PowerManager::begin() {
+#if CONFIG_APP_POWER_SAVE
+  /* the CPU and APB locks both keep the chip out of light sleep */
+  const esp_pm_lock_type_t types[kLockCount] = {
+      ESP_PM_CPU_FREQ_MAX, ESP_PM_CPU_FREQ_MAX, ESP_PM_NO_LIGHT_SLEEP};
+  for (int i = 0; i < kLockCount; ++i) {
+    if (esp_pm_lock_create(types[i], 0, getLockName(Lock(i)),
+                           &locks_[i].handle) != ESP_OK) {
+      LOGE("[Power] Failed to create lock %s", getLockName(Lock(i)));
+      return false;
+    }
+  }
+  esp_pm_config_t config{};
+  config.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+  config.min_freq_mhz = CONFIG_APP_POWER_MIN_CPU_FREQ_MHZ;
+  config.light_sleep_enable = configureSleep_();
+  if (esp_pm_configure(&config) != ESP_OK) {
+    LOGE("[Power] Failed to configure power management");
+    return false;
+  }
+  configureWiFi_();
+  LOGI("[Power] CPU %d-%d MHz, light sleep %s, %d wake pins",
+       config.min_freq_mhz, config.max_freq_mhz,
+       config.light_sleep_enable ? "on" : "off", wake_pin_count_);
+#else
+  if (esp_wifi_set_ps(WIFI_PS_NONE) != ESP_OK) {
+    LOGW("[Wi-Fi] Failed to disable power save");
+  }
+#endif
+  return true;
+}
+
+inline bool PowerManager::configureSleep_() {
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+  for (int i = 0; i < wake_pin_count_; ++i) {
+    /* the pin must stay powered, and be read, during light sleep */
+    gpio_sleep_sel_dis(static_cast<gpio_num_t>(wake_pins_[i]));
+  }
+  esp_pm_sleep_cbs_register_config_t callbacks{};
+  callbacks.enter_cb = onSleepEnter_;
+  callbacks.exit_cb = onSleepExit_;
+  callbacks.enter_cb_user_arg = this;
+  callbacks.exit_cb_user_arg = this;
+  if (esp_sleep_enable_gpio_wakeup() != ESP_OK ||
+      esp_pm_light_sleep_register_cbs(&callbacks) != ESP_OK) {
+    LOGE("[Power] Failed to set up the wake pins");
+    return false;
+  }
+  return true;
+#else
+  LOGW("[Power] Light sleep needs CONFIG_PM_LIGHT_SLEEP_CALLBACKS");
+  return false;
+#endif
+}
+
+inline void PowerManager::configureWiFi_() {
+#if CONFIG_APP_POWER_SAVE
+  /* the listen interval only applies to the max modem mode, and from the
+   * next association */
+  wifi_config_t config{};
+  if (esp_wifi_get_config(WIFI_IF_STA, &config) == ESP_OK) {
+    config.sta.listen_interval = CONFIG_APP_POWER_WIFI_LISTEN_INTERVAL;
+    esp_wifi_set_config(WIFI_IF_STA, &config);
+  }
+  const wifi_ps_type_t type = CONFIG_APP_POWER_WIFI_LISTEN_INTERVAL > 1
+                                  ? WIFI_PS_MAX_MODEM
+                                  : WIFI_PS_MIN_MODEM;
+  if (esp_wifi_set_ps(type) != ESP_OK) {
+    LOGW("[Wi-Fi] Failed to enable power save");
+  }
+#endif
+}
+
+inline void PowerManager::hold(Lock lock, bool held) {
+  LockState& state = locks_[int(lock)];
+  if (state.held == held) return;
+#if CONFIG_APP_POWER_SAVE
+  if (state.handle && held) esp_pm_lock_acquire(state.handle);
+  if (state.handle && !held) esp_pm_lock_release(state.handle);
+#endif
+  const int64_t now_us = AppClock::nowUs();
+  portENTER_CRITICAL(&mux_);
+  state.held = held;
+  if (held) {
+    state.since_us = now_us;
+    ++state.count;
+    if (locked_count_++ == 0) locked_since_us_ = now_us;
+  } else {
+    state.held_us += now_us - state.since_us;
+    if (--locked_count_ == 0) locked_us_ += now_us - locked_since_us_;
+  }
+  portEXIT_CRITICAL(&mux_);
+}
+
+inline PowerManager::Stats PowerManager::getStats() const {
+  Stats stats;
+  const int64_t now_us = AppClock::nowUs();
+  portENTER_CRITICAL(&mux_);
+  stats.uptime_us = now_us;
+  stats.locked_us =
+      locked_us_ + (locked_count_ ? now_us - locked_since_us_ : 0);
+  stats.sleep_us = sleep_us_;
+  stats.sleep_count = sleep_count_;
+  for (int i = 0; i < kLockCount; ++i) {
+    const LockState& state = locks_[i];
+    stats.held_us[i] =
+        state.held_us + (state.held ? now_us - state.since_us : 0);
+    stats.hold_count[i] = state.count;
+  }
+  portEXIT_CRITICAL(&mux_);
+  return stats;
+}
+
+inline const char* PowerManager::getLockName(Lock lock) {
+  switch (lock) {
+    case Lock::IrTx:
+      return "ir_tx";
+    case Lock::Http:
+      return "http";
+    case Lock::Awake:
+      return "awake";
+  }
+  return "";
+}
+
+inline esp_err_t PowerManager::onSleepEnter_(int64_t, void* this_ptr) {
+  auto* self = static_cast<PowerManager*>(this_ptr);
+  for (int i = 0; i < self->wake_pin_count_; ++i) {
+    const uint32_t pin = self->wake_pins_[i];
+    /* the HAL is inline, the driver is not in IRAM */
+    const bool high = gpio_ll_get_level(&GPIO, pin);
+    gpio_ll_set_intr_type(&GPIO, pin,
+                          high ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+    gpio_ll_wakeup_enable(&GPIO, pin);
+  }
+  return ESP_OK;
+}
+
+inline esp_err_t PowerManager::onSleepExit_(int64_t sleep_time_us,
+                                            void* this_ptr) {
+  auto* self = static_cast<PowerManager*>(this_ptr);
+  for (int i = 0; i < self->wake_pin_count_; ++i) {
+    const uint32_t pin = self->wake_pins_[i];
+    gpio_ll_wakeup_disable(&GPIO, pin);
+    gpio_ll_set_intr_type(&GPIO, pin, GPIO_INTR_ANYEDGE);
+  }
+  portENTER_CRITICAL_SAFE(&self->mux_);
+  self->sleep_us_ += sleep_time_us;
+  ++self->sleep_count_;
+  portEXIT_CRITICAL_SAFE(&self->mux_);
+  return ESP_OK;
+}
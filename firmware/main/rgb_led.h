@@ -5,39 +5,49 @@
 #pragma once
 #include <Arduino.h>
 
+#include "timer_wheel.h"
+
 class RgbLed {
  public:
   enum class Color { Off, Red, Green, Blue, Yellow, Cyan, Magenta, White };
 
-  explicit RgbLed(uint8_t pin) : pin_(pin) {}
+  RgbLed(uint8_t pin, TimerWheel& timers) : pin_(pin), timers_(timers) {}
 
   void setBackground(Color color) { setColor(color, /*is_background=*/true); }
 
   void off() { setBackground(Color::Off); }
 
   void blinkOnce(Color color, uint16_t durationMs = 200) {
-    blinkStart_ = millis();
-    blinkDuration_ = durationMs;
-    blinking_ = true;
+    timers_.arm(blink_timer_, durationMs);
     setColor(color, /*is_background=*/false);
   }
 
-  void update() {
-    if (blinking_ && millis() - blinkStart_ >= blinkDuration_) {
-      rgbLedWrite(pin_, r_, g_, b_);
-      blinking_ = false;
-    }
+  bool blinking() const { return blink_timer_.armed(); }
+
+  /* the RMT channel of the LED keeps the chip out of light sleep; the LED
+   * holds its color, and the next write sets the channel up again */
+  void release() {
+    if (!driven_ || blinking()) return;
+    rmtDeinit(pin_);
+    driven_ = false;
   }
 
  private:
   const uint8_t pin_;
+  TimerWheel& timers_;
   uint8_t r_ = 0;
   uint8_t g_ = 0;
   uint8_t b_ = 0;
+  bool shown_ = false;   //< the background has been written
+  bool driven_ = false;  //< the RMT channel is set up
 
-  bool blinking_ = false;
-  uint32_t blinkStart_ = 0;
-  uint16_t blinkDuration_ = 0;
+  /* back to the background color when the blink is over */
+  TimerWheel::Timer blink_timer_{
+      [](void* led) {
+        auto* self = static_cast<RgbLed*>(led);
+        self->write_(self->r_, self->g_, self->b_);
+      },
+      this};
 
   void setColor(Color color, bool is_background) {
     uint8_t rawR = 0, rawG = 0, rawB = 0;
@@ -77,14 +87,23 @@ class RgbLed {
     }
 
     if (is_background) {
+      /* set on every pass, but only written when it changes */
+      const bool changed = !shown_ || scaledR != r_ || scaledG != g_ ||
+                           scaledB != b_;
+      shown_ = true;
       r_ = scaledR;
       g_ = scaledG;
       b_ = scaledB;
-      if (!blinking_) {
-        rgbLedWrite(pin_, r_, g_, b_);
+      if (changed && !blinking()) {
+        write_(r_, g_, b_);
       }
     } else {
-      rgbLedWrite(pin_, scaledR, scaledG, scaledB);
+      write_(scaledR, scaledG, scaledB);
     }
   }
+
+  void write_(uint8_t r, uint8_t g, uint8_t b) {
+    rgbLedWrite(pin_, r, g, b);
+    driven_ = true;
+  }
 };
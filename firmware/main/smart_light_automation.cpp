@@ -7,34 +7,37 @@
 
 #include "app_log.h"
 
-void SmartLightAutomation::applyMatterEvent(const MatterLight::Event& event,
-                                            SmartLightRuntimeState& state,
-                                            bool& force_light_resync) {
+void SmartLightAutomation::applyMatterEvent(
+    const MatterLightEvents::Event& event, SmartLightRuntimeState& state,
+    bool& force_light_resync) {
   state.light_state = event.light_state;
   state.switch_state = event.switch_state;
   state.night_state = event.night_state;
 
   switch (event.type) {
-    case MatterLight::EventType::LightOn:
+    case MatterLightEvents::EventType::LightOn:
       LOGW("[Event] Light ON");
       force_light_resync = true;
       break;
-    case MatterLight::EventType::LightOff:
+    case MatterLightEvents::EventType::LightOff:
       LOGW("[Event] Light OFF");
       force_light_resync = true;
       break;
-    case MatterLight::EventType::SwitchOn:
+    case MatterLightEvents::EventType::SwitchOn:
       LOGW("[Event] Switch ON");
       break;
-    case MatterLight::EventType::SwitchOff:
+    case MatterLightEvents::EventType::SwitchOff:
       LOGW("[Event] Switch OFF");
       break;
-    case MatterLight::EventType::NightOn:
+    case MatterLightEvents::EventType::NightOn:
       LOGW("[Event] Night ON");
       break;
-    case MatterLight::EventType::NightOff:
+    case MatterLightEvents::EventType::NightOff:
       LOGW("[Event] Night OFF");
       break;
+    case MatterLightEvents::EventType::LightLevel:
+      LOGW("[Event] Light Level %u", event.light_level);
+      break;
   }
 }
 
@@ -45,6 +48,25 @@ void SmartLightAutomation::applyButtonPress(bool pressed,
   LOGW("[LightState] %d (Button)", state.light_state);
 }
 
+void SmartLightAutomation::applyIrPress(bool on, uint32_t held_ms,
+                                        SmartLightRuntimeState& state) {
+  /* a long hold sets the motion sensor along with the light, a short press
+   * on the button of the current state toggles it */
+  if (held_ms >= kIrLongHoldMs) {
+    state.light_state = on;
+    state.switch_state = on;
+    LOGW("[SwitchState] %d (IR hold)", state.switch_state);
+    return;
+  }
+  if (state.light_state != on) {
+    state.light_state = on;
+    state.switch_state = on;
+  } else {
+    state.switch_state = !state.switch_state;
+  }
+  LOGW("[SwitchState] %d (IR)", state.switch_state);
+}
+
 SmartLightStateDelta SmartLightAutomation::computeStateDelta(
     const SmartLightRuntimeState& previous_state,
     const SmartLightRuntimeState& state) {
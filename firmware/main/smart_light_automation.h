@@ -6,7 +6,7 @@
 
 #include <Arduino.h>
 
-#include "matter_light.h"
+#include "matter_light_events.h"
 #include "rgb_led.h"
 
 struct SmartLightRuntimeState {
@@ -29,11 +29,15 @@ struct SmartLightStateDelta {
 class SmartLightAutomation {
  public:
   static constexpr int kOccupancyTimeoutSeconds = 3;
+  /* an IR button held this long beyond its code, see applyIrPress() */
+  static constexpr uint32_t kIrLongHoldMs = 1000;
 
-  static void applyMatterEvent(const MatterLight::Event& event,
+  static void applyMatterEvent(const MatterLightEvents::Event& event,
                                SmartLightRuntimeState& state,
                                bool& force_light_resync);
   static void applyButtonPress(bool pressed, SmartLightRuntimeState& state);
+  static void applyIrPress(bool on, uint32_t held_ms,
+                           SmartLightRuntimeState& state);
   static SmartLightStateDelta computeStateDelta(
       const SmartLightRuntimeState& previous_state,
       const SmartLightRuntimeState& state);
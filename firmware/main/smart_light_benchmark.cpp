@@ -0,0 +1,116 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "smart_light_benchmark.h"
+
+#include <WiFi.h>
+
+#include <algorithm>
+#include <cinttypes>
+
+#include "app_config.h"
+#include "app_log.h"
+
+void SmartLightBenchmark::begin() {
+  ir_transmitter_.onSend(onSend_, this);
+}
+
+bool SmartLightBenchmark::start(int inputs) {
+  if (running_.exchange(true)) {
+    LOGE("[Bench] Already running");
+    return false;
+  }
+  inputs_ = std::clamp(inputs, 1, kMaxInputs);
+  /* both act as the network side, which the inputs usually come from */
+  if (xTaskCreatePinnedToCore(webTaskEntry_, "bench_web", kTaskStackSize,
+                              this, kTaskPriority, nullptr,
+                              CONFIG_APP_CORE_NETWORK) != pdPASS ||
+      xTaskCreatePinnedToCore(taskEntry_, "bench", kTaskStackSize, this,
+                              kTaskPriority, nullptr,
+                              CONFIG_APP_CORE_NETWORK) != pdPASS) {
+    LOGE("[Bench] Failed to create task");
+    running_ = false;
+    return false;
+  }
+  return true;
+}
+
+void SmartLightBenchmark::run_() {
+  task_ = xTaskGetCurrentTaskHandle();
+  LOGI("[Bench] %d inputs, %s layout", inputs_, CONFIG_APP_TASK_LAYOUT_NAME);
+  latency_count_ = 0;
+  missed_count_ = 0;
+  web_request_count_ = 0;
+  for (int i = 0; i < inputs_; ++i) {
+    vTaskDelay(pdMS_TO_TICKS(kSettleMs));
+    /* they carry the settled state, so the toggle behind them still counts */
+    for (int j = 0; j < kMatterBurst; ++j) matter_light_.replaySwitchState();
+    ulTaskNotifyTake(pdTRUE, 0);  //< a frame sent for something else
+    const uint32_t input_us = AppClock::micros();
+    commands_.push(SmartLightCommand(SmartLightCommand::Type::ToggleLight,
+                                     SmartLightCommand::Source::Serial));
+    if (!ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kFrameTimeoutMs))) {
+      ++missed_count_;
+      continue;
+    }
+    latencies_us_[latency_count_++] = frame_us_.load() - input_us;
+  }
+  report_();
+  task_ = nullptr;
+  running_ = false;  //< stops the web load too
+  vTaskDelete(nullptr);
+}
+
+void SmartLightBenchmark::loadWeb_() {
+  WiFiClient client;
+  uint8_t buffer[256];
+  while (running_) {
+    if (client.connect(IPAddress(127, 0, 0, 1), 80)) {
+      client.print("GET / HTTP/1.0\r\n\r\n");
+      const uint32_t start_ms = AppClock::millis();
+      while ((client.connected() || client.available()) &&
+             AppClock::millis() - start_ms < kFrameTimeoutMs) {
+        if (client.read(buffer, sizeof(buffer)) <= 0) vTaskDelay(1);
+      }
+      client.stop();
+      ++web_request_count_;
+    }
+    vTaskDelay(pdMS_TO_TICKS(kWebLoadPeriodMs));
+  }
+  vTaskDelete(nullptr);
+}
+
+void SmartLightBenchmark::report_() {
+  std::sort(latencies_us_, latencies_us_ + latency_count_);
+  const auto percentile_ms = [this](int percent) {
+    if (!latency_count_) return 0.0f;
+    return latencies_us_[(latency_count_ - 1) * percent / 100] / 1000.0f;
+  };
+  LOGI("[Bench] %s layout, loop on core %d at priority %d",
+       CONFIG_APP_TASK_LAYOUT_NAME, CONFIG_ARDUINO_RUNNING_CORE,
+       CONFIG_APP_TASK_PRIORITY_LOOP);
+  LOGI("[Bench] %d inputs, %d missed, %" PRIu32 " web requests",
+       latency_count_, missed_count_, web_request_count_.load());
+  LOGI("[Bench] Input to IR: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, "
+       "max %.1f ms",
+       percentile_ms(50), percentile_ms(90), percentile_ms(99),
+       percentile_ms(100));
+}
+
+void SmartLightBenchmark::taskEntry_(void* this_ptr) {
+  static_cast<SmartLightBenchmark*>(this_ptr)->run_();
+}
+
+void SmartLightBenchmark::webTaskEntry_(void* this_ptr) {
+  static_cast<SmartLightBenchmark*>(this_ptr)->loadWeb_();
+}
+
+void SmartLightBenchmark::onSend_(void* this_ptr) {
+  auto* self = static_cast<SmartLightBenchmark*>(this_ptr);
+  TaskHandle_t task = self->task_.load();
+  if (!self->running_ || !task) return;
+  self->frame_us_ = AppClock::micros();
+  xTaskNotifyGive(task);
+}
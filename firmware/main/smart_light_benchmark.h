@@ -0,0 +1,73 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <atomic>
+
+#include "ir_transmitter.h"
+#include "matter_light.h"
+#include "smart_light_command_bus.h"
+
+/**
+ * @brief Measures the latency from an input to its IR frame under load.
+ *
+ * Started from the serial console, it toggles the light a number of times
+ * as an input from the network core would, and takes the time from the
+ * push of each toggle to the moment the transmitter task starts its frame.
+ * Meanwhile a second task keeps fetching the web page over the loopback
+ * interface, and each toggle comes right after a burst of Matter events
+ * that repeat the current switch state, so the toggle waits behind them on
+ * the command bus. The percentiles are reported with the task layout, so
+ * that builds with different layouts can be compared.
+ *
+ * The light is toggled for real, and a toggle whose frame does not start
+ * within kFrameTimeoutMs is counted as missed.
+ */
+class SmartLightBenchmark {
+ public:
+  static constexpr const int kMaxInputs = 200;
+  static constexpr const int kDefaultInputs = 50;
+  static constexpr const int kMatterBurst = 8;
+  static constexpr const uint32_t kFrameTimeoutMs = 2000;
+  /* past the frame gap and the brightness check of the last frame */
+  static constexpr const uint32_t kSettleMs = 500;
+  static constexpr const uint32_t kWebLoadPeriodMs = 20;
+  static constexpr const uint32_t kTaskStackSize = 4096;
+  static constexpr const UBaseType_t kTaskPriority = 1;
+
+  SmartLightBenchmark(SmartLightCommandBus& commands,
+                      IRTransmitter& ir_transmitter, MatterLight& matter_light)
+      : commands_(commands),
+        ir_transmitter_(ir_transmitter),
+        matter_light_(matter_light) {}
+
+  void begin();
+  bool start(int inputs);
+  bool running() const { return running_.load(); }
+
+ private:
+  SmartLightCommandBus& commands_;
+  IRTransmitter& ir_transmitter_;
+  MatterLight& matter_light_;
+  std::atomic<bool> running_{false};
+  std::atomic<TaskHandle_t> task_{nullptr};  //< set by the task itself
+  int inputs_ = 0;
+  uint32_t latencies_us_[kMaxInputs] = {};
+  int latency_count_ = 0;
+  int missed_count_ = 0;
+  std::atomic<uint32_t> web_request_count_{0};
+  std::atomic<uint32_t> frame_us_{0};  //< start of the last frame
+
+  void run_();
+  void loadWeb_();
+  void report_();
+  static void taskEntry_(void* this_ptr);
+  static void webTaskEntry_(void* this_ptr);
+  static void onSend_(void* this_ptr);
+};
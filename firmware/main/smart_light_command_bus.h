@@ -0,0 +1,137 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "app_log.h"
+#include "ir_remote.h"
+#include "matter_light_events.h"
+#include "mpsc_queue.h"
+
+/* an input for the automation pipeline, from whichever source */
+struct SmartLightCommand {
+  enum class Source : uint8_t { Button, Ir, Matter, Web, Serial };
+  enum class Type : uint8_t {
+    ToggleLight,
+    SetLight,  //< value
+    SetSwitch,  //< value
+    SetNight,  //< value
+    IrLightOn,  //< press
+    IrLightOff,  //< press
+    Matter,  //< matter, a run of events merged
+  };
+
+  Type type = Type::ToggleLight;
+  Source source = Source::Button;
+  bool value = false;
+  uint32_t tag = 0;  //< for the source to tell its commands apart
+  uint32_t timestamp_ms = 0;  //< set by push()
+  IRRemote::Press press;
+  MatterLightEvents::LatestState matter;
+
+  SmartLightCommand() = default;
+  SmartLightCommand(Type type, Source source, bool value = false)
+      : type(type), source(source), value(value) {}
+
+  static const char* sourceName(Source source);
+};
+
+/**
+ * @brief The one queue every input source pushes its commands into.
+ *
+ * The web and Matter tasks push from their own tasks, and the controller
+ * pushes the button and IR inputs it polls, so the pipeline sees them all
+ * in the order they arrived. The controller pops up to kBatchSize commands
+ * per pass and comes back for the rest right away, so a burst does not
+ * hold up the rest of the loop. Matter commands next to each other are
+ * merged into one on pop(), as each of them carries the whole state.
+ */
+class SmartLightCommandBus {
+ public:
+  static constexpr const size_t kQueueSize = 32;
+  static constexpr const size_t kBatchSize = 8;
+
+  /* called from the pushing task after a command is queued */
+  void onPush(void (*notify)(void*), void* arg) {
+    notify_arg_ = arg;
+    notify_ = notify;
+  }
+
+  bool push(SmartLightCommand command);
+  /* push() without counting or logging the drop, for a caller that keeps
+   * the command somewhere else when the queue is full */
+  bool tryPush(SmartLightCommand command);
+  bool pop(SmartLightCommand& command);
+  bool empty() const { return queue_.empty(); }
+
+  uint32_t getPoppedCount() const { return popped_count_; }
+  uint32_t getDroppedCount() const { return dropped_count_.load(); }
+  uint32_t getCoalescedCount() const { return coalesced_count_; }
+  uint32_t getMaxLatencyMs() const { return max_latency_ms_; }
+
+ private:
+  MpscQueue<SmartLightCommand, kQueueSize> queue_;
+  void (*notify_)(void*) = nullptr;
+  void* notify_arg_ = nullptr;
+  std::atomic<uint32_t> dropped_count_{0};
+  uint32_t popped_count_ = 0;  //< consumer only
+  uint32_t coalesced_count_ = 0;  //< consumer only
+  uint32_t max_latency_ms_ = 0;  //< from push to pop, consumer only
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline const char* SmartLightCommand::sourceName(Source source) {
+  switch (source) {
+    case Source::Button:
+      return "Button";
+    case Source::Ir:
+      return "IR";
+    case Source::Matter:
+      return "Matter";
+    case Source::Web:
+      return "Web";
+    case Source::Serial:
+      return "Serial";
+  }
+  return "Unknown";
+}
+
+inline bool SmartLightCommandBus::push(SmartLightCommand command) {
+  if (tryPush(command)) return true;
+  dropped_count_.fetch_add(1, std::memory_order_relaxed);
+  LOGW("[Cmd] Queue full, %s command dropped",
+       SmartLightCommand::sourceName(command.source));
+  return false;
+}
+
+inline bool SmartLightCommandBus::tryPush(SmartLightCommand command) {
+  command.timestamp_ms = AppClock::millis();
+  if (!queue_.push(command)) return false;
+  if (notify_) notify_(notify_arg_);
+  return true;
+}
+
+inline bool SmartLightCommandBus::pop(SmartLightCommand& command) {
+  if (!queue_.pop(command)) return false;
+  using Type = SmartLightCommand::Type;
+  if (command.type == Type::Matter) {
+    /* the latency is that of the oldest one */
+    SmartLightCommand next;
+    while (queue_.front() && queue_.front()->type == Type::Matter &&
+           queue_.pop(next)) {
+      command.matter.merge(next.matter);
+      ++popped_count_;
+      ++coalesced_count_;
+    }
+  }
+  const uint32_t latency_ms = AppClock::millis() - command.timestamp_ms;
+  if (latency_ms > max_latency_ms_) max_latency_ms_ = latency_ms;
+  ++popped_count_;
+  return true;
+}
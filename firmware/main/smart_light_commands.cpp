@@ -5,8 +5,12 @@
 
 #include "smart_light_commands.h"
 
+#include <cinttypes>
 #include <cstdlib>
 
+#include "ir_code_storage.h"
+#include "ir_replay.h"
+
 bool SmartLightCommandHandler::handle() {
   command_parser_.update();
   if (!command_parser_.available()) return false;
@@ -33,6 +37,15 @@ bool SmartLightCommandHandler::handle() {
   if (cmd == "record" || cmd == "r") {
     return handleRecord(tokens);
   }
+  if (cmd == "lib" || cmd == "l") {
+    return handleLibrary(tokens);
+  }
+  if (cmd == "macro" || cmd == "m") {
+    return handleMacro(tokens);
+  }
+  if (cmd == "trace") {
+    return handleTrace(tokens);
+  }
   if (cmd == "timeout" || cmd == "t") {
     return handleTimeout(tokens);
   }
@@ -42,6 +55,22 @@ bool SmartLightCommandHandler::handle() {
   if (cmd == "nightlight" || cmd == "nl") {
     return handleNightlight(tokens);
   }
+  if (cmd == "dimmer" || cmd == "d") {
+    return handleDimmer(tokens);
+  }
+  if (cmd == "verify" || cmd == "v") {
+    return handleVerify(tokens);
+  }
+  if (cmd == "state" || cmd == "s") {
+    return handleState(tokens);
+  }
+  if (cmd == "bench") {
+    return handleBench(tokens);
+  }
+  if (cmd == "power") {
+    handlePower();
+    return false;
+  }
   return false;
 }
 
@@ -53,16 +82,49 @@ void SmartLightCommandHandler::printHelp() const {
   LOGI("- hostname <name>   : Set hostname (current: %s)",
        settings_.hostname.c_str());
   LOGI("- record <on|off|night> : Record IR data for Light/Night actions");
+  LOGI("- record <status|cancel> : Show or cancel the recording in progress");
+  LOGI("- lib [list]        : List IR codes in the library");
+  LOGI("- lib <learn|send|show|delete> <name> : Manage a library IR code");
+  LOGI("- lib rename <name> <new name> : Rename a library IR code");
+  LOGI("- lib send <name> <emitter> : Send on one IR emitter only (0-%d)",
+       ir_remote_.getTxChannelCount() - 1);
+  LOGI("- macro <run|show> <statements> : Run or compile an IR macro");
+  LOGI("- macro cancel      : Cancel the IR macro in progress");
+  LOGI("- trace <start|stop|dump|replay> : Record and replay IR frames");
+  LOGI("- trace synth [frames] [jitter_us] [glitches] [seed] : Test trace");
   LOGI("- timeout <seconds> : Set light OFF timeout in seconds (current: %d)",
        settings_.light_off_timeout_seconds);
   LOGI("- ambient <on|off>  : Ambient Light Mode (current: %s)",
        settings_.ambient_light_mode_enabled ? "on" : "off");
   LOGI("- nightlight <on|off> : Night Light Endpoint (current: %s, reboot required)",
        settings_.night_light_feature_enabled ? "on" : "off");
+  LOGI("- dimmer <on|off>   : Dimmable Light Endpoint (current: %s, reboot required)",
+       settings_.dimmer_feature_enabled ? "on" : "off");
+  LOGI("- dimmer steps <n>  : Presses from darkest to full (current: %d)",
+       settings_.dimmer_steps);
+  LOGI("- verify <on|off|dump> : Check ON/OFF with the brightness sensor (current: %s)",
+       settings_.verify_enabled ? "on" : "off");
+  LOGI("- state <light|switch|night> <on|off> : Set a state as from the WebUI");
+  LOGI("- bench [inputs]    : Measure input to IR latency under load (max %d)",
+       SmartLightBenchmark::kMaxInputs);
+  LOGI("- power             : Show the time spent in each power state");
 }
 
 void SmartLightCommandHandler::handleInfo() const {
-  LOGI("Brightness Sensor Value: %f", brightness_sensor_.getNormalized());
+  LOGI("Brightness Sensor Value: %f (%d mV, %d lx)",
+       brightness_sensor_.getNormalized(), brightness_sensor_.getMillivolts(),
+       brightness_sensor_.getLux());
+  LOGI("IR: %d emitters, %d receivers (duplicates: %" PRIu32 ")",
+       ir_remote_.getTxChannelCount(), ir_remote_.getRxChannelCount(),
+       ir_remote_.getDuplicateCount());
+  LOGI("Commands: %" PRIu32 " applied, %" PRIu32
+       " dropped, max latency %" PRIu32 " ms",
+       commands_.getPoppedCount(), commands_.getDroppedCount(),
+       commands_.getMaxLatencyMs());
+  LOGI("Matter: %" PRIu32 " coalesced on the bus, %" PRIu32
+       " overflowed (%" PRIu32 " coalesced)",
+       commands_.getCoalescedCount(), matter_light_.getOverflowCount(),
+       matter_light_.getCoalescedCount());
 }
 
 bool SmartLightCommandHandler::handleHostname(
@@ -79,35 +141,190 @@ bool SmartLightCommandHandler::handleHostname(
 bool SmartLightCommandHandler::handleRecord(
     const std::vector<std::string>& tokens) {
   if (tokens.size() < 2) {
-    LOGE("Usage: record <on|off|night>");
+    LOGE("Usage: record <on|off|night|status|cancel>");
+    return false;
+  }
+  if (tokens[1] == "status") {
+    LOGI("[IR] Learning %s: %s (%d/%d captured, %" PRIu32 " ms left)",
+         SmartLightLearning::targetName(learning_.target()),
+         SmartLightLearning::stateName(learning_.state()),
+         learning_.captured(), learning_.required(), learning_.remainingMs());
+    return false;
+  }
+  if (tokens[1] == "cancel") {
+    learning_.cancel();
     return false;
   }
 
-  ir_remote_.clear();
-  LOGI("[IR] Receiver Listening ...");
-  if (!ir_remote_.waitForAvailable(10000)) {
-    LOGW("[IR] Timeout");
+  SmartLightLearning::Target target;
+  if (!SmartLightLearning::parseTarget(tokens[1].c_str(), target)) {
+    LOGE("Usage: record <on|off|night|status|cancel>");
     return false;
   }
+  /* captures are collected from the controller loop, see handle() */
+  learning_.start(target);
+  return false;
+}
 
-  const auto ir_data = ir_remote_.get();
-  if (tokens[1] == "on") {
-    settings_.ir_data_light_on = ir_data;
-    settings_store_.saveIrDataLightOn(settings_.ir_data_light_on);
+bool SmartLightCommandHandler::handleLibrary(
+    const std::vector<std::string>& tokens) {
+  auto& library = ir_code_library_;
+  const std::string sub = tokens.size() < 2 ? "list" : tokens[1];
+  if (!library.ready()) {
+    LOGE("[IR-Lib] Library not available");
+    return false;
+  }
+  if (sub == "list") {
+    IRCodeLibrary::Entry entry;
+    for (size_t i = 0; library.entry(i, entry); ++i) {
+      LOGI("[IR-Lib] %-23s %-4s %3u bytes", entry.name,
+           IRProtocolCodec::protocolName(entry.protocol()), entry.size);
+    }
+    LOGI("[IR-Lib] %zu codes, %zu/%zu bytes", library.count(),
+         library.usedBytes(), library.capacity());
+    return false;
+  }
+  if (tokens.size() < 3) {
+    LOGE("Usage: lib <list|learn|send|show|delete|rename> [name] [new name]");
+    return false;
+  }
+
+  const char* name = tokens[2].c_str();
+  if (sub == "learn") {
+    /* captures are collected from the controller loop, see handle() */
+    learning_.startLibrary(name);
+    return false;
+  }
+  if (sub == "rename") {
+    if (tokens.size() < 4 || !library.rename(name, tokens[3].c_str())) {
+      LOGE("[IR-Lib] Failed to rename %s", name);
+    }
+    return false;
+  }
+  if (sub == "delete") {
+    if (!library.remove(name)) LOGE("[IR-Lib] Failed to delete %s", name);
+    return false;
+  }
+
+  IRCodeLibrary::Entry entry;
+  if (!library.find(name, entry)) {
+    LOGE("[IR-Lib] %s not found", name);
+    return false;
+  }
+  if (sub == "send") {
+    IRRemote::ChannelMask channels = IRRemote::kAllChannels;
+    if (tokens.size() >= 4) {
+      const int emitter = atoi(tokens[3].c_str());
+      if (emitter < 0 || emitter >= ir_remote_.getTxChannelCount()) {
+        LOGE("emitter must be 0 to %d", ir_remote_.getTxChannelCount() - 1);
+        return false;
+      }
+      channels = 1 << emitter;
+    }
+    ir_transmitter_.post(IRCodeLibrary::transmitKey(entry), entry.record,
+                         entry.size, entry.name,
+                         IRTransmitter::Priority::Normal,
+                         IRTransmitter::kCoalesceWindowMs, channels);
+    return false;
+  }
+  if (sub == "show") {
+    IRCode code;
+    if (IRCodeStorage::unpack(entry.record, entry.size, code) &&
+        IRCodeStorage::unpack(code)) {
+      IRProtocolCodec::print(code, entry.name);
+    }
+    return false;
+  }
+
+  LOGE("Usage: lib <list|learn|send|show|delete|rename> [name] [new name]");
+  return false;
+}
+
+bool SmartLightCommandHandler::handleMacro(
+    const std::vector<std::string>& tokens) {
+  const std::string sub = tokens.size() < 2 ? "" : tokens[1];
+  if (sub == "cancel") {
+    ir_macro_runner_.cancel();
+    return false;
+  }
+  if ((sub != "run" && sub != "show") || tokens.size() < 3) {
+    LOGE("Usage: macro <run|show> <statements> or macro cancel");
+    return false;
+  }
+  std::string text;
+  for (size_t i = 2; i < tokens.size(); ++i) {
+    if (i > 2) text += ' ';
+    text += tokens[i];
+  }
+  IRMacro::Program program;
+  if (!IRMacro::compile(text.c_str(), program)) return false;
+  if (sub == "show") {
+    IRMacro::print(program);
+    return false;
+  }
+  /* presses are sent from the controller loop, see handle() */
+  ir_macro_runner_.start(program);
+  return false;
+}
+
+bool SmartLightCommandHandler::handleTrace(
+    const std::vector<std::string>& tokens) {
+  auto& trace = ir_remote_.trace();
+  const std::string sub = tokens.size() < 2 ? "" : tokens[1];
+  if (sub == "start") {
+    if (!trace.start(IRRemote::RMT_RESOLUTION_HZ)) {
+      LOGE("[IR-Trace] Failed to allocate %zu bytes",
+           IRTraceRecorder::kCapacity);
+      return false;
+    }
+    LOGI("[IR-Trace] Recording ...");
+    return false;
+  }
+  if (sub == "stop") {
+    trace.stop();
+    LOGI("[IR-Trace] Stopped (%zu bytes, %" PRIu32 " frames dropped)",
+         trace.size(), trace.droppedCount());
+    return false;
+  }
+  if (sub == "dump") {
+    /* hex lines, restore the binary trace with `xxd -r -p` */
+    const uint8_t* data = trace.data();
+    const size_t size = data ? trace.size() : 0;
+    LOGI("[IR-Trace] BEGIN (%zu bytes)", size);
+    for (size_t i = 0; i < size; ++i) {
+      printf("%02x", data[i]);
+      if (i % 32 == 31 || i + 1 == size) printf("\n");
+    }
+    LOGI("[IR-Trace] END");
     return false;
   }
-  if (tokens[1] == "off") {
-    settings_.ir_data_light_off = ir_data;
-    settings_store_.saveIrDataLightOff(settings_.ir_data_light_off);
+  if (sub == "replay") {
+    IRReplay::Stats stats;
+    if (!trace.data() || !IRReplay::run(trace.data(), trace.size(), stats)) {
+      LOGE("[IR-Trace] No valid trace to replay");
+      return false;
+    }
+    IRReplay::print(stats);
     return false;
   }
-  if (tokens[1] == "night") {
-    settings_.ir_data_night = ir_data;
-    settings_store_.saveIrDataNight(settings_.ir_data_night);
+  if (sub == "synth") {
+    IRReplay::SynthOptions options;
+    if (tokens.size() > 2) options.frames = atoi(tokens[2].c_str());
+    if (tokens.size() > 3) options.jitter_us = atoi(tokens[3].c_str());
+    if (tokens.size() > 4) options.glitches = atoi(tokens[4].c_str());
+    options.seed = tokens.size() > 5 ? strtoul(tokens[5].c_str(), nullptr, 0)
+                                     : esp_random();
+    if (!IRReplay::synthesize(trace, options)) {
+      LOGE("[IR-Trace] Failed to allocate %zu bytes",
+           IRTraceRecorder::kCapacity);
+      return false;
+    }
+    LOGI("[IR-Trace] Synthesized %zu bytes (seed: %" PRIu32 ")", trace.size(),
+         options.seed);
     return false;
   }
 
-  LOGE("Usage: record <on|off|night>");
+  LOGE("Usage: trace <start|stop|dump|replay|synth>");
   return false;
 }
 
@@ -173,3 +390,103 @@ bool SmartLightCommandHandler::handleNightlight(
   ESP.restart();
   return false;
 }
+
+bool SmartLightCommandHandler::handleDimmer(
+    const std::vector<std::string>& tokens) {
+  if (tokens.size() >= 3 && tokens[1] == "steps") {
+    const int steps = atoi(tokens[2].c_str());
+    if (steps < 1 || steps > 100) {
+      LOGE("steps must be 1 to 100");
+      return false;
+    }
+    settings_.dimmer_steps = steps;
+    settings_store_.saveDimmerSteps(steps);
+    LOGI("[Dimmer] %d steps (reboot required)", steps);
+    return false;
+  }
+  if (tokens.size() < 2 || (tokens[1] != "on" && tokens[1] != "off")) {
+    LOGE("Usage: dimmer <on|off> or dimmer steps <n>");
+    return false;
+  }
+
+  settings_.dimmer_feature_enabled = tokens[1] == "on";
+  settings_store_.saveDimmerFeatureEnabled(settings_.dimmer_feature_enabled);
+  LOGI("[Dimmer] %s -> rebooting...",
+       settings_.dimmer_feature_enabled ? "on" : "off");
+  ESP.restart();
+  return false;
+}
+
+bool SmartLightCommandHandler::handleVerify(
+    const std::vector<std::string>& tokens) {
+  if (tokens.size() >= 2 && tokens[1] == "dump") {
+    verifier_.dump();
+    return false;
+  }
+  if (tokens.size() < 2 || (tokens[1] != "on" && tokens[1] != "off")) {
+    LOGE("Usage: verify <on|off|dump>");
+    return false;
+  }
+
+  settings_.verify_enabled = tokens[1] == "on";
+  settings_store_.saveVerifyEnabled(settings_.verify_enabled);
+  if (!settings_.verify_enabled) verifier_.cancel();
+  LOGI("[Verify] %s", settings_.verify_enabled ? "on" : "off");
+  return false;
+}
+
+bool SmartLightCommandHandler::handleState(
+    const std::vector<std::string>& tokens) {
+  using Type = SmartLightCommand::Type;
+  if (tokens.size() < 3 || (tokens[2] != "on" && tokens[2] != "off") ||
+      (tokens[1] != "light" && tokens[1] != "switch" &&
+       tokens[1] != "night")) {
+    LOGE("Usage: state <light|switch|night> <on|off>");
+    return false;
+  }
+  const Type type = tokens[1] == "light"    ? Type::SetLight
+                    : tokens[1] == "switch" ? Type::SetSwitch
+                                            : Type::SetNight;
+  /* applied by the pipeline along with the other inputs, in order */
+  commands_.push(SmartLightCommand(type, SmartLightCommand::Source::Serial,
+                                   tokens[2] == "on"));
+  return false;
+}
+
+bool SmartLightCommandHandler::handleBench(
+    const std::vector<std::string>& tokens) {
+  const int inputs = tokens.size() > 1 ? atoi(tokens[1].c_str())
+                                       : SmartLightBenchmark::kDefaultInputs;
+  if (inputs <= 0) {
+    LOGE("Usage: bench [inputs]");
+    return false;
+  }
+  /* the light is toggled for real, inputs times */
+  benchmark_.start(inputs);
+  return false;
+}
+
+void SmartLightCommandHandler::handlePower() const {
+  const PowerManager::Stats stats = power_.getStats();
+  const auto percent = [&stats](int64_t us) {
+    return stats.uptime_us ? 100.0f * us / stats.uptime_us : 0.0f;
+  };
+  /* awake at the lowest frequency, with no lock held */
+  const int64_t idle_us = stats.uptime_us - stats.sleep_us - stats.locked_us;
+  LOGI("[Power] %s, up %.1f s", PowerManager::kEnabled ? "Power save" : "Off",
+       stats.uptime_us / 1e6f);
+  LOGI("[Power] Locked %.1f s (%.1f%%), idle %.1f s (%.1f%%), light sleep "
+       "%.1f s (%.1f%%, %" PRIu32 " times)",
+       stats.locked_us / 1e6f, percent(stats.locked_us), idle_us / 1e6f,
+       percent(idle_us), stats.sleep_us / 1e6f, percent(stats.sleep_us),
+       stats.sleep_count);
+  for (int i = 0; i < PowerManager::kLockCount; ++i) {
+    LOGI("[Power] Lock %s: %.1f s (%.1f%%, %" PRIu32 " times)",
+         PowerManager::getLockName(PowerManager::Lock(i)),
+         stats.held_us[i] / 1e6f, percent(stats.held_us[i]),
+         stats.hold_count[i]);
+  }
+#if CONFIG_PM_PROFILING
+  esp_pm_dump_locks(stdout);
+#endif
+}
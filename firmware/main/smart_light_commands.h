@@ -9,20 +9,46 @@
 #include "app_log.h"
 #include "brightness_sensor.h"
 #include "command_parser.h"
+#include "ir_code_library.h"
+#include "ir_macro.h"
 #include "ir_remote.h"
+#include "ir_transmitter.h"
+#include "matter_light.h"
+#include "power_manager.h"
+#include "smart_light_benchmark.h"
+#include "smart_light_command_bus.h"
+#include "smart_light_learning.h"
 #include "smart_light_settings.h"
+#include "smart_light_verifier.h"
 
 class SmartLightCommandHandler {
  public:
   SmartLightCommandHandler(CommandParser& command_parser,
                            SmartLightSettings& settings,
                            SmartLightSettingsStore& settings_store,
-                           IRRemote& ir_remote,
+                           SmartLightLearning& learning,
+                           IRCodeLibrary& ir_code_library, IRRemote& ir_remote,
+                           IRTransmitter& ir_transmitter,
+                           IRMacroRunner& ir_macro_runner,
+                           SmartLightVerifier& verifier,
+                           SmartLightCommandBus& commands,
+                           MatterLight& matter_light,
+                           SmartLightBenchmark& benchmark,
+                           PowerManager& power,
                            BrightnessSensor& brightness_sensor)
       : command_parser_(command_parser),
         settings_(settings),
         settings_store_(settings_store),
+        learning_(learning),
+        ir_code_library_(ir_code_library),
         ir_remote_(ir_remote),
+        ir_transmitter_(ir_transmitter),
+        ir_macro_runner_(ir_macro_runner),
+        verifier_(verifier),
+        commands_(commands),
+        matter_light_(matter_light),
+        benchmark_(benchmark),
+        power_(power),
         brightness_sensor_(brightness_sensor) {}
 
   bool handle();
@@ -31,14 +57,31 @@ class SmartLightCommandHandler {
   CommandParser& command_parser_;
   SmartLightSettings& settings_;
   SmartLightSettingsStore& settings_store_;
+  SmartLightLearning& learning_;
+  IRCodeLibrary& ir_code_library_;
   IRRemote& ir_remote_;
+  IRTransmitter& ir_transmitter_;
+  IRMacroRunner& ir_macro_runner_;
+  SmartLightVerifier& verifier_;
+  SmartLightCommandBus& commands_;
+  MatterLight& matter_light_;
+  SmartLightBenchmark& benchmark_;
+  PowerManager& power_;
   BrightnessSensor& brightness_sensor_;
 
   void printHelp() const;
   void handleInfo() const;
+  void handlePower() const;
   bool handleHostname(const std::vector<std::string>& tokens);
   bool handleRecord(const std::vector<std::string>& tokens);
+  bool handleLibrary(const std::vector<std::string>& tokens);
+  bool handleMacro(const std::vector<std::string>& tokens);
+  bool handleTrace(const std::vector<std::string>& tokens);
   bool handleTimeout(const std::vector<std::string>& tokens);
   bool handleAmbient(const std::vector<std::string>& tokens);
   bool handleNightlight(const std::vector<std::string>& tokens);
+  bool handleDimmer(const std::vector<std::string>& tokens);
+  bool handleVerify(const std::vector<std::string>& tokens);
+  bool handleState(const std::vector<std::string>& tokens);
+  bool handleBench(const std::vector<std::string>& tokens);
 };
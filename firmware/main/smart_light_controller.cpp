@@ -9,79 +9,347 @@
 #include <esp_wifi.h>
 #include <mdns.h>
 
+#include <algorithm>
+#include <mutex>
+
 #include "app_log.h"
 #include "ota_utils.h"
 
 SmartLightController::SmartLightController()
-    : command_handler_(command_parser_, settings_, settings_store_, ir_remote_,
-                       brightness_sensor_),
-      web_(settings_, settings_store_, ir_remote_, led_) {}
+    : learning_(settings_, settings_store_, ir_code_library_, ir_remote_,
+                led_),
+      command_handler_(command_parser_, settings_, settings_store_, learning_,
+                       ir_code_library_, ir_remote_, ir_transmitter_,
+                       ir_macro_runner_, verifier_, commands_, matter_light_,
+                       benchmark_, power_, brightness_sensor_),
+      web_(settings_, settings_store_, settings_lock_, commands_, learning_,
+           ir_code_library_, ir_transmitter_, power_) {}
 
 void SmartLightController::begin() {
+  /* this is the Arduino loop task, which handle() runs in */
+  vTaskPrioritySet(nullptr, CONFIG_APP_TASK_PRIORITY_LOOP);
+  LOGI("[Tasks] %s layout, loop on core %d at priority %d",
+       CONFIG_APP_TASK_LAYOUT_NAME, xPortGetCoreID(),
+       CONFIG_APP_TASK_PRIORITY_LOOP);
+#if CONFIG_APP_TASK_LAYOUT_SPLIT
+  if (xPortGetCoreID() != CONFIG_APP_CORE_REALTIME) {
+    LOGW("[Tasks] Set CONFIG_ARDUINO_RUNNING_CORE to %d for this layout",
+         CONFIG_APP_CORE_REALTIME);
+  }
+#endif
+  timers_.advance(AppClock::millis());
   led_.setBackground(RgbLed::Color::Green);
 
   if (!settings_store_.begin()) {
     LOGE("[Prefs] Failed to open settings");
   }
   settings_ = settings_store_.load();
-
-  ir_remote_.begin(CONFIG_APP_PIN_IR_TRANSMITTER, CONFIG_APP_PIN_IR_RECEIVER);
+  if (!settings_lock_.begin()) {
+    LOGE("[Prefs] Failed to create settings lock");
+  }
+  setupEvents_();
+
+  const int ir_tx_pins[] = CONFIG_APP_PINS_IR_TRANSMITTER;
+  const int ir_rx_pins[] = CONFIG_APP_PINS_IR_RECEIVER;
+  ir_remote_.begin(ir_tx_pins, sizeof(ir_tx_pins) / sizeof(ir_tx_pins[0]),
+                   ir_rx_pins, sizeof(ir_rx_pins) / sizeof(ir_rx_pins[0]));
+  if (!ir_transmitter_.begin()) {
+    LOGE("[IR-Tx] Failed to start transmitter task");
+  }
+  benchmark_.begin();
+  if (!brightness_sensor_.begin()) {
+    LOGE("[ADC] Failed to start brightness sensor");
+  }
+  ir_code_library_.begin();
+  if (settings_.dimmer_feature_enabled) {
+    dimmer_.begin(settings_.dimmer_steps);
+  }
 
   last_light_state_ = false;
   last_switch_state_ = true;
   last_night_state_ = false;
+  matter_light_.onEvent(onMatterEvent_, this);
   matter_light_.begin(last_light_state_, last_switch_state_, last_night_state_,
-                      settings_.night_light_feature_enabled);
-  if (esp_wifi_set_ps(WIFI_PS_NONE) != ESP_OK) {
-    LOGW("[Wi-Fi] Failed to disable power save");
+                      settings_.night_light_feature_enabled,
+                      settings_.dimmer_feature_enabled,
+                      SmartLightDimmer::kMaxLevel);
+  /* after Matter, which starts Wi-Fi */
+  power_.addWakePin(btn_.pin());
+  power_.addWakePin(motion_sensor_.pin());
+  for (int pin : ir_rx_pins) power_.addWakePin(pin);
+  if (!power_.begin()) {
+    LOGE("[Power] Failed to enable power save");
   }
+  /* until the first pass finds the room empty */
+  if (PowerManager::kEnabled) power_.hold(PowerManager::Lock::Awake, true);
 
   setupOta();
-  web_.begin();
+  timers_.arm(pairing_log_timer_, kPairingLogMs);
+  publishWebState_();
+  if (!web_.begin()) {
+    LOGE("[Web] Failed to start web server");
+  }
 }
 
 void SmartLightController::handle() {
+  const EventBits_t events = events_.wait(wait_timeout_ms_);
+  {
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    timers_.advance(AppClock::millis());
+    if (parked_ && (events & AppEvents::kIrReceived)) {
+      /* the receivers were off, the frame that woke us is lost */
+      timers_.arm(ir_wake_timer_, kIrWakeMs);
+    }
+  }
   ArduinoOTA.handle();
 
   btn_.update();
-  led_.update();
   motion_sensor_.update();
-  brightness_sensor_.update(
-      static_cast<float>(settings_.ambient_light_threshold_percent) / 100.0f);
-  web_.setObservedStates(
-      last_light_state_, last_switch_state_, last_night_state_,
-      static_cast<int>(brightness_sensor_.getNormalized() * 100.0f + 0.5f));
-  web_.handle();
+  float ambient_light_threshold;
+  {
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    armMotionTimers_();
+    ambient_light_threshold =
+        static_cast<float>(settings_.ambient_light_threshold_percent) /
+        100.0f;
+  }
+  brightness_sensor_.update(ambient_light_threshold);
   if (web_.consumeRebootRequested()) {
     ESP.restart();
   }
   syncHostnames_();
+  SmartLightRuntimeState state;
+  {
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    learning_.handle();
+    if (btn_.pressed()) {
+      commands_.push(SmartLightCommand(SmartLightCommand::Type::ToggleLight,
+                                       SmartLightCommand::Source::Button));
+    }
+    pushIrInput_();
+    state = buildRuntimeState_();
+  }
+
+  if (automationDue_(state)) runAutomation_(state);
+  verifyLightState_();
+  {
+    /* the runs send codes of the library from the flash in place */
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    dimmer_.handle(last_light_state_);
+    ir_macro_runner_.handle(last_light_state_);
+  }
+  updateOccupancyLog(state.occupancy_state);
+  updateStatusLed(state);
+  handleDecommission();
+  publishWebState_();
+  {
+    /* under the lock, as the web task may arm a timer through learning_ */
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    wait_timeout_ms_ = waitTimeoutMs_();
+  }
+  updatePower_(state);
+}
+
+void SmartLightController::setupEvents_() {
+  if (!events_.begin()) {
+    LOGE("[Events] Failed to create event group, polling instead");
+    return;
+  }
+  attachInterruptArg(btn_.pin(), AppEvents::gpioIsr<AppEvents::kButton>,
+                     &events_, CHANGE);
+  attachInterruptArg(motion_sensor_.pin(),
+                     AppEvents::gpioIsr<AppEvents::kMotion>, &events_, CHANGE);
+  ir_remote_.onReceived(AppEvents::notifyFromIsr<AppEvents::kIrReceived>,
+                        &events_);
+  commands_.onPush(AppEvents::notify<AppEvents::kCommand>, &events_);
+#if !ARDUINO_USB_CDC_ON_BOOT
+  /* the USB CDC console has no such callback and is read on the next tick */
+  Serial.onReceive([this]() { events_.set(AppEvents::kSerial); });
+#endif
+}
 
-  SmartLightRuntimeState state = buildRuntimeState_();
+uint32_t SmartLightController::waitTimeoutMs_() const {
+  /* a pass takes a batch of commands, the rest are taken right after */
+  if (!commands_.empty() || matter_light_.hasLatest()) return 0;
+  /* work in progress follows the clock rather than the inputs */
+  if (working_()) return kTickMs;
+  const uint32_t idle_timeout_ms = parked_ ? kParkedTimeoutMs : kIdleTimeoutMs;
+  return std::min(idle_timeout_ms,
+                  timers_.getMillisUntilNext(AppClock::millis()));
+}
+
+bool SmartLightController::working_() const {
+  return btn_.busy() || learning_.active() || ir_remote_.assembling() ||
+         verifier_.active() || dimmer_.running() || ir_macro_runner_.running();
+}
+
+void SmartLightController::armMotionTimers_() {
+  int64_t motion_end_ms;
+  if (!motion_sensor_.getLastMotionEndMs(motion_end_ms)) {
+    timers_.cancel(occupancy_timer_);
+    timers_.cancel(light_off_timer_);
+    motion_timers_set_ = false;
+    return;
+  }
+  /* armed once per motion, and again if the timeout setting changes */
+  const bool motion_ended =
+      !motion_timers_set_ || motion_end_ms != motion_end_ms_;
+  /* in 64 bits, the motion may have ended longer ago than the wheel spans */
+  const int64_t now_ms = AppClock::nowMs();
+  const auto arm = [&](TimerWheel::Timer& timer, int seconds) {
+    const int64_t delay_ms = motion_end_ms + seconds * int64_t(1000) - now_ms;
+    timers_.arm(timer, std::clamp<int64_t>(delay_ms, 0, INT32_MAX));
+  };
+  if (motion_ended) {
+    arm(occupancy_timer_, SmartLightAutomation::kOccupancyTimeoutSeconds);
+  }
+  if (motion_ended ||
+      settings_.light_off_timeout_seconds != light_off_timeout_seconds_) {
+    /* the rule waits for more than the timeout */
+    arm(light_off_timer_, settings_.light_off_timeout_seconds + 1);
+  }
+  motion_timers_set_ = true;
+  motion_end_ms_ = motion_end_ms;
+  light_off_timeout_seconds_ = settings_.light_off_timeout_seconds;
+}
+
+void SmartLightController::updatePower_(const SmartLightRuntimeState& state) {
+  if (!PowerManager::kEnabled) return;
+  bool awake;
+  {
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    /* parked, an IR frame is lost, so only while nobody is in the room */
+    awake = state.occupancy_state || ir_wake_timer_.armed() || working_() ||
+            wait_timeout_ms_ == 0 || !ir_transmitter_.idle();
+    if (!awake) led_.release();  //< set up again if its color has changed
+  }
+  if (awake != parked_) return;
+  parked_ = !awake;
+  const int ir_rx_pins[] = CONFIG_APP_PINS_IR_RECEIVER;
+  if (awake) {
+    power_.hold(PowerManager::Lock::Awake, true);
+    for (int pin : ir_rx_pins) detachInterrupt(pin);
+    ir_remote_.setReceiversEnabled(true);
+    brightness_sensor_.setSampling(true);
+  } else {
+    /* the ADC lets the chip sleep once stopped, the brightness is only
+     * needed when someone comes in */
+    brightness_sensor_.setSampling(false);
+    /* the receivers only wake the loop by their edges now */
+    ir_remote_.setReceiversEnabled(false);
+    for (int pin : ir_rx_pins) {
+      attachInterruptArg(pin, AppEvents::gpioIsr<AppEvents::kIrReceived>,
+                         &events_, CHANGE);
+    }
+    power_.hold(PowerManager::Lock::Awake, false);
+  }
+  LOGI("[Power] %s", awake ? "Awake" : "Parked, light sleep allowed");
+}
+
+bool SmartLightController::automationDue_(
+    const SmartLightRuntimeState& state) {
+  /* besides the commands, the rules only read these, so with none of them
+   * changed a pass would commit the same outputs again */
+  const uint8_t inputs =
+      state.occupancy_state << 0 | state.is_bright << 1 |
+      state.ambient_light_mode_enabled << 2 |
+      (state.seconds_since_last_motion > state.light_off_timeout_seconds)
+          << 3;
+  const bool inputs_changed = inputs != last_automation_inputs_;
+  last_automation_inputs_ = inputs;
+  return inputs_changed || !commands_.empty() || matter_light_.hasLatest();
+}
+
+void SmartLightController::runAutomation_(SmartLightRuntimeState& state) {
   const SmartLightRuntimeState previous_state = state;
   WebAction web_action = WebAction::None;
   bool web_requested_value = false;
-  if (web_.consumeRequestedLightState(state.light_state)) {
-    web_action = WebAction::Light;
-    web_requested_value = state.light_state;
-  } else if (web_.consumeRequestedSwitchState(state.switch_state)) {
-    web_action = WebAction::Switch;
-    web_requested_value = state.switch_state;
-  } else if (web_.consumeRequestedNightState(state.night_state)) {
-    web_action = WebAction::Night;
-    web_requested_value = state.night_state;
-  }
-  const SmartLightRuntimeState directly_requested_state = state;
-  applyMatterEvents(state);
-  SmartLightAutomation::applyButtonPress(btn_.pressed(), state);
-  applyIrInput(state);
-  SmartLightAutomation::applyDerivedRules(previous_state, state);
+  SmartLightRuntimeState directly_requested_state = state;
+  bool force_light_resync = false;
+  /* frames caused only by the automation rules yield to requested ones */
+  bool requested_output_change = false;
+  /* each command is followed by the rules, as if it had a pass of its own,
+   * and only the state after the batch is committed */
+  size_t count = 0;
+  const auto apply = [&](const SmartLightCommand& command) {
+    ++count;
+    const SmartLightRuntimeState before = state;
+    applyCommand_(command, state, force_light_resync);
+    requested_output_change |= state.light_state != before.light_state ||
+                               state.night_state != before.night_state;
+    if (command.source == SmartLightCommand::Source::Web) {
+      web_action = command.type == SmartLightCommand::Type::SetLight
+                       ? WebAction::Light
+                   : command.type == SmartLightCommand::Type::SetSwitch
+                       ? WebAction::Switch
+                       : WebAction::Night;
+      web_requested_value = command.value;
+      directly_requested_state = state;
+      web_.requestTaken(command.tag);
+    }
+    SmartLightAutomation::applyDerivedRules(before, state);
+  };
+  SmartLightCommand command;
+  while (count < SmartLightCommandBus::kBatchSize && commands_.pop(command)) {
+    apply(command);
+  }
+  /* Matter events that overflowed the bus are newer than any on it, so they
+   * are taken only once the bus has been drained */
+  SmartLightCommand overflow(SmartLightCommand::Type::Matter,
+                             SmartLightCommand::Source::Matter);
+  if (commands_.empty() && matter_light_.takeLatest(overflow.matter)) {
+    apply(overflow);
+  }
+  if (!count) SmartLightAutomation::applyDerivedRules(previous_state, state);
+  if (force_light_resync) {
+    last_light_state_ = !state.light_state;
+  }
   reportWebAction_(web_action, web_requested_value, directly_requested_state,
                    state);
-  commitOutputs_(state);
-  updateOccupancyLog(state.occupancy_state);
-  updateStatusLed(state);
-  handleDecommission();
+  commitOutputs_(state, requested_output_change
+                            ? IRTransmitter::Priority::Normal
+                            : IRTransmitter::Priority::Low);
+}
+
+void SmartLightController::applyCommand_(const SmartLightCommand& command,
+                                         SmartLightRuntimeState& state,
+                                         bool& force_light_resync) {
+  const char* source = SmartLightCommand::sourceName(command.source);
+  switch (command.type) {
+    case SmartLightCommand::Type::ToggleLight:
+      SmartLightAutomation::applyButtonPress(true, state);
+      break;
+    case SmartLightCommand::Type::SetLight:
+      state.light_state = command.value;
+      LOGW("[LightState] %d (%s)", state.light_state, source);
+      break;
+    case SmartLightCommand::Type::SetSwitch:
+      state.switch_state = command.value;
+      LOGW("[SwitchState] %d (%s)", state.switch_state, source);
+      break;
+    case SmartLightCommand::Type::SetNight:
+      state.night_state = command.value;
+      LOGW("[NightState] %d (%s)", state.night_state, source);
+      break;
+    case SmartLightCommand::Type::IrLightOn:
+    case SmartLightCommand::Type::IrLightOff:
+      applyIrCode_(command.type == SmartLightCommand::Type::IrLightOn,
+                   command.press, state);
+      break;
+    case SmartLightCommand::Type::Matter:
+      applyMatterEvent_(command.matter, state, force_light_resync);
+      break;
+  }
+}
+
+bool SmartLightController::onMatterEvent_(const MatterLight::Event& event,
+                                          void* this_ptr) {
+  auto* self = static_cast<SmartLightController*>(this_ptr);
+  SmartLightCommand command(SmartLightCommand::Type::Matter,
+                            SmartLightCommand::Source::Matter);
+  command.matter.merge(event);
+  /* when the bus is full, MatterLight keeps the latest state instead */
+  return self->commands_.tryPush(command);
 }
 
 void SmartLightController::setupOta() {
@@ -108,26 +376,25 @@ void SmartLightController::setupOta() {
 }
 
 void SmartLightController::syncHostnames_() {
-  bool hostname_updated = command_handler_.handle();
-  if (web_.hostnameUpdated()) {
-    hostname_updated = true;
-    web_.clearHostnameUpdated();
-  }
-
-  if (hostname_updated) {
-    ArduinoOTA.setHostname(settings_.hostname.c_str());
-    syncAdditionalMdnsHostname_(true);
-  } else {
-    syncAdditionalMdnsHostname_(false);
+  bool hostname_updated;
+  std::string hostname;
+  {
+    /* the serial console changes the settings as the web server does */
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    hostname_updated = command_handler_.handle();
+    if (web_.consumeHostnameUpdated()) hostname_updated = true;
+    if (!hostname_updated && !mdns_sync_due_) return;
+    hostname = settings_.hostname;
+    /* checked again a while after each attempt, the address may change */
+    mdns_sync_due_ = false;
+    timers_.arm(mdns_retry_timer_, kMdnsRetryMs);
   }
+  if (hostname_updated) ArduinoOTA.setHostname(hostname.c_str());
+  syncAdditionalMdnsHostname_(hostname);
 }
 
-void SmartLightController::syncAdditionalMdnsHostname_(bool force) {
-  constexpr unsigned long kRetryIntervalMs = 1000;
-  const unsigned long now = millis();
-  if (!force && now - last_mdns_sync_attempt_ms_ < kRetryIntervalMs) return;
-  last_mdns_sync_attempt_ms_ = now;
-
+void SmartLightController::syncAdditionalMdnsHostname_(
+    const std::string& hostname) {
   esp_netif_t* netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
   esp_netif_ip_info_t ip_info{};
   if (!netif || esp_netif_get_ip_info(netif, &ip_info) != ESP_OK ||
@@ -135,7 +402,7 @@ void SmartLightController::syncAdditionalMdnsHostname_(bool force) {
     return;
   }
 
-  if (!mdns_hostname_.empty() && mdns_hostname_ != settings_.hostname) {
+  if (!mdns_hostname_.empty() && mdns_hostname_ != hostname) {
     const esp_err_t err = mdns_delegate_hostname_remove(mdns_hostname_.c_str());
     if (err != ESP_OK) {
       LOGW("[mDNS] Failed to remove %s.local: %s", mdns_hostname_.c_str(),
@@ -154,25 +421,24 @@ void SmartLightController::syncAdditionalMdnsHostname_(bool force) {
 
   if (mdns_hostname_.empty()) {
     const esp_err_t err =
-        mdns_delegate_hostname_add(settings_.hostname.c_str(), &address);
+        mdns_delegate_hostname_add(hostname.c_str(), &address);
     if (err != ESP_OK) {
       if (err != last_mdns_error_) {
-        LOGW("[mDNS] Failed to add %s.local: %s", settings_.hostname.c_str(),
+        LOGW("[mDNS] Failed to add %s.local: %s", hostname.c_str(),
              esp_err_to_name(err));
       }
       last_mdns_error_ = err;
       return;
     }
     last_mdns_error_ = ESP_OK;
-    if (!mdns_hostname_exists(settings_.hostname.c_str())) {
+    if (!mdns_hostname_exists(hostname.c_str())) {
       char primary_hostname[MDNS_NAME_BUF_LEN] = {};
       const esp_err_t get_err = mdns_hostname_get(primary_hostname);
-      LOGW("[mDNS] %s.local was not added (primary: %s)",
-           settings_.hostname.c_str(),
+      LOGW("[mDNS] %s.local was not added (primary: %s)", hostname.c_str(),
            get_err == ESP_OK ? primary_hostname : "unavailable");
       return;
     }
-    mdns_hostname_ = settings_.hostname;
+    mdns_hostname_ = hostname;
     mdns_ipv4_address_ = ip_info.ip.addr;
     LOGI("[mDNS] Added additional hostname: %s.local -> " IPSTR,
          mdns_hostname_.c_str(), IP2STR(&ip_info.ip));
@@ -206,7 +472,8 @@ SmartLightRuntimeState SmartLightController::buildRuntimeState_() const {
   return state;
 }
 
-void SmartLightController::commitOutputs_(const SmartLightRuntimeState& state) {
+void SmartLightController::commitOutputs_(const SmartLightRuntimeState& state,
+                                          IRTransmitter::Priority priority) {
   const bool suppress_night_off_signal =
       last_night_state_ && !state.night_state && !last_light_state_ &&
       state.light_state;
@@ -214,63 +481,107 @@ void SmartLightController::commitOutputs_(const SmartLightRuntimeState& state) {
       last_light_state_ && !state.light_state && !last_night_state_ &&
       state.night_state;
   commitSwitchState(state);
-  commitNightState(state, suppress_night_off_signal);
-  commitLightState(state, suppress_light_off_signal);
+  commitNightState(state, suppress_night_off_signal, priority);
+  commitLightState(state, suppress_light_off_signal, priority);
 }
 
-void SmartLightController::sendIrSignal_(const IRRemote::IRData& data,
-                                         const char* label) {
-  LOGW("[IR-Tx] %s (size: %zu)", label, data.size());
-  led_.blinkOnce(RgbLed::Color::Green);
-  ir_remote_.send(data);
-  LOGW("[IR-Tx] %s sent", label);
-  delay(100);
+void SmartLightController::sendIrSignal_(const IRCode& code, const char* label,
+                                         IRTransmitter::Priority priority) {
+  IRRemote::IRData data;
+  if (!IRProtocolCodec::encode(code, data)) {
+    LOGW("[IR-Tx] %s not recorded", label);
+    return;
+  }
+  LOGI("[IR-Tx] %s queued (%s)", label,
+       IRProtocolCodec::protocolName(code.protocol));
+  blinkLed_(RgbLed::Color::Green);
+  /* all codes drive the same lamp, so only its latest state is sent */
+  ir_transmitter_.post(kIrKeyLamp, std::move(data), label, priority);
 }
 
-void SmartLightController::applyMatterEvents(SmartLightRuntimeState& state) {
-  MatterLight::Event event;
-  if (!matter_light_.getEvent(event, 0)) return;
-
-  bool force_light_resync = false;
-  SmartLightAutomation::applyMatterEvent(event, state, force_light_resync);
-  if (force_light_resync) {
-    last_light_state_ = !state.light_state;
+void SmartLightController::applyMatterEvent_(
+    const MatterLight::LatestState& latest, SmartLightRuntimeState& state,
+    bool& force_light_resync) {
+  if (latest.events > 1) {
+    LOGI("[Matter] %u events coalesced", latest.events);
+  }
+  SmartLightAutomation::applyMatterEvent(latest.event, state,
+                                         force_light_resync);
+  /* an on/off among the merged events still resends the frame */
+  if (latest.light_switched) force_light_resync = true;
+  if (latest.light_level != MatterLight::kNullLevel) {
+    dimmer_.setLevel(latest.light_level);
   }
 }
 
-void SmartLightController::applyIrInput(SmartLightRuntimeState& state) {
-  if (!ir_remote_.available()) return;
+void SmartLightController::rebuildIrCodeIndex_() {
+  /* learned timings stay packed from boot until the first frame arrives */
+  IRCodeStorage::unpack(settings_.ir_code_light_on);
+  IRCodeStorage::unpack(settings_.ir_code_light_off);
+  ir_code_index_.clear();
+  ir_code_index_.add(kIrCodeLightOn, settings_.ir_code_light_on);
+  ir_code_index_.add(kIrCodeLightOff, settings_.ir_code_light_off);
+  ir_code_index_revision_ = settings_.ir_code_revision;
+}
 
-  const auto ir_data = ir_remote_.get();
-  ir_remote_.clear();
-  if (IRRemote::isIrDataEqual(ir_data, settings_.ir_data_light_on)) {
-    LOGI("[IR-Rx] Light ON Signal Received");
-    if (!state.light_state) {
-      state.light_state = true;
-      state.switch_state = true;
-    } else {
-      state.switch_state = !state.switch_state;
+void SmartLightController::pushIrInput_() {
+  /* frames belong to the learning session while it is listening */
+  if (learning_.active() || !ir_remote_.available()) return;
+
+  if (ir_code_index_revision_ != settings_.ir_code_revision) {
+    rebuildIrCodeIndex_();
+  }
+  /* codes queued while the loop was blocked are pushed in order, and a
+   * held button arrives as a single press */
+  ir_remote_.drain([this](const IRRemote::IRData& data,
+                          const IRRemote::Press& press) {
+    const IRCode ir_code = IRProtocolCodec::fromRaw(data);
+    IRCodeIndex::Id id;
+    if (!ir_code_index_.find(ir_code, id)) {
+      LOGW("[IR-Rx] Unknown Signal Received");
+      IRProtocolCodec::print(ir_code);
+      return;
     }
-    LOGW("[SwitchState] %d (IR)", state.switch_state);
-    led_.blinkOnce(RgbLed::Color::Green);
-    return;
+    SmartLightCommand command(id == kIrCodeLightOn
+                                  ? SmartLightCommand::Type::IrLightOn
+                                  : SmartLightCommand::Type::IrLightOff,
+                              SmartLightCommand::Source::Ir);
+    command.press = press;
+    commands_.push(command);
+  });
+}
+
+void SmartLightController::applyIrCode_(bool on, const IRRemote::Press& press,
+                                        SmartLightRuntimeState& state) {
+  if (press.held_ms) {
+    LOGI("[IR-Rx] Light %s Signal Held (%" PRIu32 " ms, %u repeats)",
+         on ? "ON" : "OFF", press.held_ms, press.repeats);
+  } else {
+    LOGI("[IR-Rx] Light %s Signal Received", on ? "ON" : "OFF");
   }
+  SmartLightAutomation::applyIrPress(on, press.held_ms, state);
+  blinkLed_(RgbLed::Color::Green);
+}
 
-  if (IRRemote::isIrDataEqual(ir_data, settings_.ir_data_light_off)) {
-    LOGI("[IR-Rx] Light OFF Signal Received");
-    if (state.light_state) {
-      state.light_state = false;
-      state.switch_state = false;
+void SmartLightController::verifyLightState_() {
+  if (!settings_.verify_enabled) return;
+  const auto result = verifier_.handle(brightness_sensor_.getNormalized(),
+                                       ir_transmitter_.pending(kIrKeyLamp));
+  if (result == SmartLightVerifier::Result::Retry) {
+    /* the committed state goes out again, the lamp is not told anything new */
+    if (last_light_state_) {
+      sendIrSignal_(settings_.ir_code_light_on, "Light ON (retry)",
+                    IRTransmitter::Priority::Normal);
+      dimmer_.lightTurnedOn();
     } else {
-      state.switch_state = !state.switch_state;
+      sendIrSignal_(settings_.ir_code_light_off, "Light OFF (retry)",
+                    IRTransmitter::Priority::Normal);
     }
-    LOGW("[SwitchState] %d (IR)", state.switch_state);
-    led_.blinkOnce(RgbLed::Color::Green);
-    return;
+  } else if (result == SmartLightVerifier::Result::Desync) {
+    LOGE("[Verify] Lamp out of sync with the light state %d",
+         last_light_state_);
+    blinkLed_(RgbLed::Color::Red);
   }
-
-  LOGW("[IR-Rx] Unknown Signal Received");
-  IRRemote::print(ir_data);
 }
 
 void SmartLightController::commitSwitchState(
@@ -281,30 +592,40 @@ void SmartLightController::commitSwitchState(
 }
 
 void SmartLightController::commitNightState(const SmartLightRuntimeState& state,
-                                            bool suppress_off_signal) {
+                                            bool suppress_off_signal,
+                                            IRTransmitter::Priority priority) {
   if (last_night_state_ == state.night_state) return;
   last_night_state_ = state.night_state;
   matter_light_.setNightState(state.night_state);
+  /* the night light is too dim to tell from the ambient light */
+  verifier_.cancel();
 
   if (state.night_state) {
-    sendIrSignal_(settings_.ir_data_night, "Night ON");
+    sendIrSignal_(settings_.ir_code_night, "Night ON", priority);
   } else if (!suppress_off_signal) {
-    sendIrSignal_(settings_.ir_data_light_off, "Light OFF (Night OFF)");
+    sendIrSignal_(settings_.ir_code_light_off, "Light OFF (Night OFF)",
+                  priority);
   }
 }
 
 void SmartLightController::commitLightState(const SmartLightRuntimeState& state,
-                                            bool suppress_off_signal) {
+                                            bool suppress_off_signal,
+                                            IRTransmitter::Priority priority) {
   if (last_light_state_ == state.light_state) return;
 
   last_light_state_ = state.light_state;
   matter_light_.setLightState(state.light_state);
 
   if (state.light_state) {
-    sendIrSignal_(settings_.ir_data_light_on, "Light ON");
+    sendIrSignal_(settings_.ir_code_light_on, "Light ON", priority);
+    dimmer_.lightTurnedOn();
   } else if (!suppress_off_signal) {
-    sendIrSignal_(settings_.ir_data_light_off, "Light OFF");
+    sendIrSignal_(settings_.ir_code_light_off, "Light OFF", priority);
+  } else {
+    verifier_.cancel();
+    return;
   }
+  if (settings_.verify_enabled) verifier_.expect(state.light_state);
 }
 
 void SmartLightController::updateOccupancyLog(bool occupancy_state) {
@@ -319,8 +640,26 @@ void SmartLightController::updateOccupancyLog(bool occupancy_state) {
 
 void SmartLightController::updateStatusLed(
     const SmartLightRuntimeState& state) {
-  led_.setBackground(SmartLightAutomation::selectStatusColor(
-      state, matter_light_.isCommissioned(), matter_light_.isConnected()));
+  const RgbLed::Color color = SmartLightAutomation::selectStatusColor(
+      state, matter_light_.isCommissioned(), matter_light_.isConnected());
+  std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+  led_.setBackground(color);
+}
+
+void SmartLightController::blinkLed_(RgbLed::Color color) {
+  /* the learning session started by the web task blinks it too */
+  std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+  led_.blinkOnce(color);
+}
+
+void SmartLightController::publishWebState_() {
+  SmartLightWeb::ObservedState observed;
+  observed.light_state = last_light_state_;
+  observed.switch_state = last_switch_state_;
+  observed.night_state = last_night_state_;
+  observed.ambient_light_percent =
+      static_cast<int>(brightness_sensor_.getNormalized() * 100.0f + 0.5f);
+  web_.publishObservedState(observed);
 }
 
 void SmartLightController::reportWebAction_(
@@ -372,11 +711,12 @@ void SmartLightController::reportWebAction_(
     message += linked_changes;
     message += "にしました。";
   }
+  std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
   web_.showStatus(message);
 }
 
 void SmartLightController::handleDecommission() {
-  if (btn_.longHoldStarted()) led_.blinkOnce(RgbLed::Color::Magenta);
+  if (btn_.longHoldStarted()) blinkLed_(RgbLed::Color::Magenta);
   if (btn_.longPressed()) {
     if (matter_light_.isCommissioned()) {
       matter_light_.decommission();
@@ -384,13 +724,9 @@ void SmartLightController::handleDecommission() {
       matter_light_.openCommissioningWindow();
     }
   }
+}
 
-  if (!matter_light_.isCommissioned()) {
-    static long last_pairing_log_ms_ = 0;
-    const long now = millis();
-    if (now - last_pairing_log_ms_ > 10000) {
-      last_pairing_log_ms_ = now;
-      matter_light_.printOnboarding();
-    }
-  }
+void SmartLightController::logPairing_() {
+  if (!matter_light_.isCommissioned()) matter_light_.printOnboarding();
+  timers_.arm(pairing_log_timer_, kPairingLogMs);
 }
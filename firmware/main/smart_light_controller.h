@@ -8,17 +8,30 @@
 #include <ArduinoOTA.h>
 
 #include "app_config.h"
+#include "app_events.h"
 #include "brightness_sensor.h"
 #include "button.h"
 #include "command_parser.h"
+#include "ir_code_index.h"
+#include "ir_code_library.h"
+#include "ir_macro.h"
+#include "ir_protocol.h"
 #include "ir_remote.h"
+#include "ir_transmitter.h"
 #include "matter_light.h"
 #include "motion_sensor.h"
+#include "power_manager.h"
 #include "rgb_led.h"
 #include "smart_light_automation.h"
+#include "smart_light_benchmark.h"
+#include "smart_light_command_bus.h"
 #include "smart_light_commands.h"
+#include "smart_light_dimmer.h"
+#include "smart_light_learning.h"
 #include "smart_light_settings.h"
+#include "smart_light_verifier.h"
 #include "smart_light_web.h"
+#include "timer_wheel.h"
 
 class SmartLightController {
  public:
@@ -29,42 +42,120 @@ class SmartLightController {
 
  private:
   enum class WebAction { None, Light, Switch, Night };
+  enum IrCodeId : IRCodeIndex::Id { kIrCodeLightOn, kIrCodeLightOff };
+  static constexpr const uint16_t kIrKeyLamp = 0;  //< on, off and night codes
+  static constexpr const uint16_t kIrKeyDimmer = 1;
+  static constexpr const uint16_t kIrKeyMacro = 2;
+  static constexpr const uint32_t kTickMs = 10;  //< while work is running
+  /* OTA is polled and the ambient light is sampled */
+  static constexpr const uint32_t kIdleTimeoutMs = 100;
+  /* while parked in the power save mode */
+  static constexpr const uint32_t kParkedTimeoutMs = 1000;
+  /* awake after an IR edge while parked, for the presses that follow */
+  static constexpr const uint32_t kIrWakeMs = 5000;
+  static constexpr const uint32_t kMdnsRetryMs = 1000;
+  static constexpr const uint32_t kPairingLogMs = 10000;
+
+  AppEvents events_;
+  TimerWheel timers_;  //< advanced by each pass, under settings_lock_
+  PowerManager power_;
 
   Button btn_{CONFIG_APP_PIN_BUTTON};
-  RgbLed led_{CONFIG_APP_PIN_RGB_LED};
+  RgbLed led_{CONFIG_APP_PIN_RGB_LED, timers_};
   MotionSensor motion_sensor_{CONFIG_APP_PIN_MOTION_SENSOR};
   BrightnessSensor brightness_sensor_{CONFIG_APP_PIN_LIGHT_SENSOR};
   IRRemote ir_remote_;
+  IRTransmitter ir_transmitter_{ir_remote_, power_};
+  IRCodeLibrary ir_code_library_;
+  SmartLightDimmer dimmer_{ir_code_library_, ir_transmitter_, kIrKeyDimmer};
+  IRMacroRunner ir_macro_runner_{ir_code_library_, ir_transmitter_,
+                                 kIrKeyMacro};
+  SmartLightVerifier verifier_;
+  SmartLightCommandBus commands_;
   CommandParser command_parser_{Serial};
   SmartLightSettingsStore settings_store_;
   SmartLightSettings settings_;
+  /* taken around each step that touches what the web task shares; the IR
+   * codes and verify_enabled are only written on this task, and are read
+   * here without it */
+  SmartLightSettingsLock settings_lock_;
   MatterLight matter_light_;
+  SmartLightBenchmark benchmark_{commands_, ir_transmitter_, matter_light_};
+  SmartLightLearning learning_;
   SmartLightCommandHandler command_handler_;
   SmartLightWeb web_;
+  IRCodeIndex ir_code_index_;
+  uint32_t ir_code_index_revision_ = UINT32_MAX;  //< built on first frame
 
   bool last_light_state_ = false;
   bool last_switch_state_ = false;
   bool last_night_state_ = false;
   bool last_occupancy_state_ = false;
+  uint8_t last_automation_inputs_ = UINT8_MAX;  //< run on the first pass
+  uint32_t wait_timeout_ms_ = 0;  //< for the next pass
   std::string mdns_hostname_;
   uint32_t mdns_ipv4_address_ = 0;
-  unsigned long last_mdns_sync_attempt_ms_ = 0;
+  bool mdns_sync_due_ = true;
   esp_err_t last_mdns_error_ = ESP_OK;
+  bool motion_timers_set_ = false;  //< for the motion that ended last
+  int64_t motion_end_ms_ = 0;
+  int light_off_timeout_seconds_ = 0;  //< that light_off_timer_ is for
+  bool parked_ = false;  //< IR receivers off, light sleep allowed
+
+  /* the motion rules change once enough seconds have passed; the timers
+   * only have to wake the loop, which then sees the change */
+  TimerWheel::Timer occupancy_timer_{[](void*) {}, nullptr};
+  TimerWheel::Timer light_off_timer_{[](void*) {}, nullptr};
+  TimerWheel::Timer ir_wake_timer_{[](void*) {}, nullptr};
+  TimerWheel::Timer mdns_retry_timer_{
+      [](void* self) {
+        static_cast<SmartLightController*>(self)->mdns_sync_due_ = true;
+      },
+      this};
+  TimerWheel::Timer pairing_log_timer_{
+      [](void* self) {
+        static_cast<SmartLightController*>(self)->logPairing_();
+      },
+      this};
+
+  void setupEvents_();
+  uint32_t waitTimeoutMs_() const;
+  bool working_() const;
+  void armMotionTimers_();
+  void updatePower_(const SmartLightRuntimeState& state);
+  void logPairing_();
+  bool automationDue_(const SmartLightRuntimeState& state);
+  void runAutomation_(SmartLightRuntimeState& state);
+  void applyCommand_(const SmartLightCommand& command,
+                     SmartLightRuntimeState& state, bool& force_light_resync);
+  static bool onMatterEvent_(const MatterLight::Event& event, void* this_ptr);
   void setupOta();
   void syncHostnames_();
-  void syncAdditionalMdnsHostname_(bool force);
+  void syncAdditionalMdnsHostname_(const std::string& hostname);
   SmartLightRuntimeState buildRuntimeState_() const;
-  void commitOutputs_(const SmartLightRuntimeState& state);
-  void sendIrSignal_(const IRRemote::IRData& data, const char* label);
-  void applyMatterEvents(SmartLightRuntimeState& state);
-  void applyIrInput(SmartLightRuntimeState& state);
+  void commitOutputs_(const SmartLightRuntimeState& state,
+                      IRTransmitter::Priority priority);
+  void sendIrSignal_(const IRCode& code, const char* label,
+                     IRTransmitter::Priority priority);
+  void applyMatterEvent_(const MatterLight::LatestState& latest,
+                         SmartLightRuntimeState& state,
+                         bool& force_light_resync);
+  void rebuildIrCodeIndex_();
+  void pushIrInput_();
+  void applyIrCode_(bool on, const IRRemote::Press& press,
+                    SmartLightRuntimeState& state);
+  void verifyLightState_();
   void commitSwitchState(const SmartLightRuntimeState& state);
   void commitNightState(const SmartLightRuntimeState& state,
-                        bool suppress_off_signal);
+                        bool suppress_off_signal,
+                        IRTransmitter::Priority priority);
   void commitLightState(const SmartLightRuntimeState& state,
-                        bool suppress_off_signal);
+                        bool suppress_off_signal,
+                        IRTransmitter::Priority priority);
   void updateOccupancyLog(bool occupancy_state);
   void updateStatusLed(const SmartLightRuntimeState& state);
+  void blinkLed_(RgbLed::Color color);
+  void publishWebState_();
   void reportWebAction_(WebAction action, bool requested_value,
                         const SmartLightRuntimeState& directly_requested_state,
                         const SmartLightRuntimeState& final_state);
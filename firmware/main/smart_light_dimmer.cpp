@@ -0,0 +1,71 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "smart_light_dimmer.h"
+
+#include <algorithm>
+
+#include "app_log.h"
+
+bool SmartLightDimmer::begin(int steps) {
+  steps_ = std::max(1, std::min(steps, 100));
+  target_ = position_ = steps_;
+  if (!IRMacro::compile(kProgram, program_)) {
+    LOGE("[Dimmer] Failed to compile the dimming macro");
+    return false;
+  }
+  LOGI("[Dimmer] %d steps, codes: %s / %s", steps_, kCodeUp, kCodeDown);
+  return true;
+}
+
+void SmartLightDimmer::setLevel(uint8_t level) {
+  if (steps_ == 0) return;
+  const int target = stepOf_(level);
+  const int position = this->position();
+  target_ = target;
+  LOGI("[Dimmer] Level %u -> step %d/%d (%+d)", level, target, steps_,
+       target - position);
+  if (runner_.running()) {
+    /* the run in progress takes the shortest way to the new target */
+    runner_.setArgument(target - position);
+  } else if (target != position) {
+    runner_.start(program_, target - position);
+  }
+}
+
+void SmartLightDimmer::lightTurnedOn() {
+  if (steps_ == 0) return;
+  runner_.cancel();
+  position_ = steps_;
+  if (target_ != position_) {
+    runner_.start(program_, target_ - position_, kOnDelayMs);
+  }
+}
+
+void SmartLightDimmer::handle(bool light_on) {
+  if (!runner_.running()) return;
+  if (!light_on) {
+    /* presses would only wake the lamp up or be ignored */
+    runner_.cancel();
+  } else {
+    runner_.handle(light_on);
+  }
+  if (!runner_.running()) position_ = target_ - runner_.argument();
+}
+
+int SmartLightDimmer::position() const {
+  return runner_.running() ? target_ - runner_.argument() : position_;
+}
+
+int SmartLightDimmer::stepOf_(uint8_t level) const {
+  const int clamped = std::max(kMinLevel, std::min(level, kMaxLevel));
+  const int range = kMaxLevel - kMinLevel;
+  return ((clamped - kMinLevel) * steps_ + range / 2) / range;
+}
+
+uint8_t SmartLightDimmer::levelOf_(int step) const {
+  const int range = kMaxLevel - kMinLevel;
+  return kMinLevel + (step * range + steps_ / 2) / steps_;
+}
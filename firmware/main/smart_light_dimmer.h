@@ -0,0 +1,65 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "ir_code_library.h"
+#include "ir_macro.h"
+#include "ir_transmitter.h"
+
+/**
+ * @brief Dims a lamp that only has "brighten" and "darken" IR buttons.
+ *
+ * Matter levels are mapped to one of `steps` + 1 lamp positions, and a level
+ * change runs the dimming macro, which presses the library codes kCodeUp or
+ * kCodeDown once per step. The macro argument is the number of steps still
+ * to go, so a level change that arrives during a run retargets that run:
+ * queued changes merge into the shortest press sequence from the position
+ * reached so far, instead of replaying every intermediate level. A press is
+ * counted in the direction it goes as soon as it is posted, the step comes
+ * before the send, so a change made while it is still on its way starts
+ * from where the lamp will be. A press that fails to post ends the run one
+ * step off, until the lamp is turned on again.
+ *
+ * The lamp is assumed to come on at full brightness. Once it is on, it is
+ * dimmed back to the last level after kOnDelayMs, and a run is canceled
+ * while the lamp is off, keeping the level to go back to.
+ */
+class SmartLightDimmer {
+ public:
+  static constexpr const char* kCodeUp = "dim.up";
+  static constexpr const char* kCodeDown = "dim.down";
+  static constexpr const char* kProgram =
+      "while steps; if up; step; send dim.up; else; step; send dim.down;"
+      " end; wait 300; end";
+  static constexpr const uint8_t kMinLevel = 1;  //< Matter LevelControl
+  static constexpr const uint8_t kMaxLevel = 254;
+  static constexpr const uint32_t kOnDelayMs = 1000;  //< lamp powering up
+
+  SmartLightDimmer(IRCodeLibrary& library, IRTransmitter& transmitter,
+                   uint16_t transmit_key)
+      : runner_(library, transmitter, transmit_key) {}
+
+  bool begin(int steps);
+  void setLevel(uint8_t level);
+  void lightTurnedOn();
+  void handle(bool light_on);
+
+  bool running() const { return runner_.running(); }
+  int steps() const { return steps_; }
+  int position() const;
+  uint8_t level() const { return levelOf_(position()); }
+
+ private:
+  IRMacro::Program program_;
+  IRMacroRunner runner_;
+  int steps_ = 0;
+  int target_ = 0;    //< position to reach
+  int position_ = 0;  //< position reached while no run is in progress
+
+  int stepOf_(uint8_t level) const;
+  uint8_t levelOf_(int step) const;
+};
@@ -0,0 +1,181 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "smart_light_learning.h"
+
+#include <cstring>
+
+#include "app_log.h"
+
+bool SmartLightLearning::start(Target target, int captures) {
+  if (active()) {
+    LOGW("[IR] Learning %s already in progress", targetName(target_));
+    return false;
+  }
+  learner_.begin(captures);
+  state_ = State::Listening;
+  target_ = target;
+  conflicts_ = 0;
+  ++session_;
+  deadline_ms_ = AppClock::millis() + kCaptureTimeoutMs;
+  ir_remote_.clear();
+  led_.blinkOnce(RgbLed::Color::Green, kCaptureTimeoutMs + 1000);
+  LOGI("[IR] Learning %s: press the button %d times", targetName(target_),
+       learner_.target());
+  return true;
+}
+
+bool SmartLightLearning::startLibrary(const char* name, int captures) {
+  if (!library_.ready() || !IRCodeLibrary::isValidName(name)) {
+    LOGW("[IR] Invalid library code name: %s", name);
+    return false;
+  }
+  if (active()) {
+    LOGW("[IR] Learning %s already in progress", targetName(target_));
+    return false;
+  }
+  strlcpy(library_name_, name, sizeof(library_name_));
+  return start(Target::Library, captures);
+}
+
+void SmartLightLearning::cancel() {
+  if (!active()) return;
+  state_ = State::Canceled;
+  led_.blinkOnce(RgbLed::Color::Red, kResultIndicatorMs);
+  LOGW("[IR] Learning %s canceled", targetName(target_));
+}
+
+void SmartLightLearning::handle() {
+  if (!active()) return;
+
+  if (ir_remote_.available()) {
+    learner_.add(ir_remote_.get());
+    ir_remote_.pop();
+    if (learner_.count() >= learner_.target()) return finish_();
+    deadline_ms_ = AppClock::millis() + kCaptureTimeoutMs;
+    led_.blinkOnce(RgbLed::Color::Blue, kResultIndicatorMs);
+    LOGI("[IR] Press the button again (%d/%d)", learner_.count() + 1,
+         learner_.target());
+    return;
+  }
+  if (int32_t(AppClock::millis() - deadline_ms_) >= 0) {
+    LOGW("[IR] Timeout (%d/%d captured)", learner_.count(),
+         learner_.target());
+    finish_();
+  }
+}
+
+uint32_t SmartLightLearning::remainingMs() const {
+  if (!active()) return 0;
+  const int32_t remaining = deadline_ms_ - AppClock::millis();
+  return remaining > 0 ? remaining : 0;
+}
+
+bool SmartLightLearning::parseTarget(const char* name, Target& target) {
+  for (const auto candidate : {Target::LightOn, Target::LightOff,
+                               Target::Night}) {
+    if (strcmp(name, targetName(candidate)) == 0) {
+      target = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* SmartLightLearning::targetName(Target target) {
+  switch (target) {
+    case Target::LightOn:
+      return "on";
+    case Target::LightOff:
+      return "off";
+    case Target::Night:
+      return "night";
+    case Target::Library:
+      return "library";
+  }
+  return "unknown";
+}
+
+const char* SmartLightLearning::stateName(State state) {
+  switch (state) {
+    case State::Idle:
+      return "idle";
+    case State::Listening:
+      return "listening";
+    case State::Succeeded:
+      return "succeeded";
+    case State::Failed:
+      return "failed";
+    case State::Canceled:
+      return "canceled";
+  }
+  return "unknown";
+}
+
+IRCode& SmartLightLearning::codeOf_(Target target) {
+  switch (target) {
+    case Target::LightOn:
+      return settings_.ir_code_light_on;
+    case Target::LightOff:
+      return settings_.ir_code_light_off;
+    case Target::Night:
+    case Target::Library:
+      break;
+  }
+  return settings_.ir_code_night;
+}
+
+void SmartLightLearning::finish_() {
+  IRCode ir_code;
+  if (!learner_.build(ir_code)) {
+    state_ = State::Failed;
+    led_.blinkOnce(RgbLed::Color::Red, kResultIndicatorMs);
+    LOGW("[IR] Learning %s failed", targetName(target_));
+    return;
+  }
+
+  /* warn when a press could also be taken for another learned button */
+  for (const auto other : {Target::LightOn, Target::LightOff, Target::Night}) {
+    if (other == target_) continue;
+    IRCode& learned = codeOf_(other);
+    IRCodeStorage::unpack(learned);
+    if (!IRLearner::isAmbiguous(ir_code, learned)) continue;
+    LOGW("[IR] Learned code is ambiguous with the %s code",
+         targetName(other));
+    conflicts_ |= 1 << static_cast<int>(other);
+  }
+
+  if (!save_(ir_code)) {
+    state_ = State::Failed;
+    led_.blinkOnce(RgbLed::Color::Red, kResultIndicatorMs);
+    LOGW("[IR] Failed to save %s", targetName(target_));
+    return;
+  }
+  state_ = State::Succeeded;
+  led_.blinkOnce(conflicts_ ? RgbLed::Color::Yellow : RgbLed::Color::Green,
+                 kResultIndicatorMs);
+  LOGI("[IR] Learning %s succeeded (%d captures)", targetName(target_),
+       learner_.count());
+}
+
+bool SmartLightLearning::save_(const IRCode& code) {
+  if (target_ == Target::Library) return library_.put(library_name_, code);
+  codeOf_(target_) = code;
+  ++settings_.ir_code_revision;
+  switch (target_) {
+    case Target::LightOn:
+      settings_store_.saveIrCodeLightOn(settings_.ir_code_light_on);
+      break;
+    case Target::LightOff:
+      settings_store_.saveIrCodeLightOff(settings_.ir_code_light_off);
+      break;
+    case Target::Night:
+      settings_store_.saveIrCodeNight(settings_.ir_code_night);
+      break;
+    case Target::Library:
+      break;
+  }
+  return true;
+}
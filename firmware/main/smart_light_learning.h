@@ -0,0 +1,83 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "ir_code_library.h"
+#include "ir_learner.h"
+#include "ir_remote.h"
+#include "rgb_led.h"
+#include "smart_light_settings.h"
+
+/**
+ * @brief IR learning session shared by the web UI and the serial console.
+ *
+ * start() only arms the session; captures are collected by handle(), which
+ * is ticked from the controller loop, so the control path keeps running
+ * while the user presses the remote. Each press must come within the
+ * capture timeout of the previous one (or of the start). A code can also
+ * be learned into the IR code library under a name.
+ */
+class SmartLightLearning {
+ public:
+  enum class Target : uint8_t { LightOn, LightOff, Night, Library };
+  enum class State : uint8_t { Idle, Listening, Succeeded, Failed, Canceled };
+
+  static constexpr const uint32_t kCaptureTimeoutMs = 10000;
+  static constexpr const uint16_t kResultIndicatorMs = 500;
+
+  SmartLightLearning(SmartLightSettings& settings,
+                     SmartLightSettingsStore& settings_store,
+                     IRCodeLibrary& library, IRRemote& ir_remote, RgbLed& led)
+      : settings_(settings),
+        settings_store_(settings_store),
+        library_(library),
+        ir_remote_(ir_remote),
+        led_(led) {}
+
+  bool start(Target target, int captures = IRLearner::kCapturesDefault);
+  bool startLibrary(const char* name,
+                    int captures = IRLearner::kCapturesDefault);
+  void cancel();
+  void handle();
+
+  bool active() const { return state_ == State::Listening; }
+  bool finished() const {
+    return state_ != State::Idle && state_ != State::Listening;
+  }
+  State state() const { return state_; }
+  Target target() const { return target_; }
+  const char* libraryName() const { return library_name_; }
+  uint32_t session() const { return session_; }
+  int captured() const { return learner_.count(); }
+  int required() const { return learner_.target(); }
+  uint32_t remainingMs() const;
+  bool conflictsWith(Target target) const {
+    return conflicts_ & (1 << static_cast<int>(target));
+  }
+
+  static bool parseTarget(const char* name, Target& target);
+  static const char* targetName(Target target);
+  static const char* stateName(State state);
+
+ private:
+  SmartLightSettings& settings_;
+  SmartLightSettingsStore& settings_store_;
+  IRCodeLibrary& library_;
+  IRRemote& ir_remote_;
+  RgbLed& led_;
+  IRLearner learner_;
+  State state_ = State::Idle;
+  Target target_ = Target::LightOn;
+  uint32_t session_ = 0;
+  uint32_t deadline_ms_ = 0;
+  uint8_t conflicts_ = 0;  //< bit mask of Target
+  char library_name_[IRCodeLibrary::kNameSize] = "";  //< for Target::Library
+
+  IRCode& codeOf_(Target target);
+  void finish_();
+  bool save_(const IRCode& code);
+};
@@ -10,6 +10,7 @@ bool SmartLightSettingsStore::begin() {
 }
 
 SmartLightSettings SmartLightSettingsStore::load() {
+  migrate_();
   SmartLightSettings settings;
   settings.device_name =
       prefs_.getString(SmartLightSettings::kPrefDeviceName,
@@ -28,12 +29,19 @@ SmartLightSettings SmartLightSettingsStore::load() {
                     SmartLightSettings::kAmbientLightThresholdPercentDefault);
   settings.night_light_feature_enabled =
       prefs_.getBool(SmartLightSettings::kPrefNightFeature, true);
-  IRRemote::loadFromPreferences(prefs_, SmartLightSettings::kPrefIrOn,
-                                settings.ir_data_light_on);
-  IRRemote::loadFromPreferences(prefs_, SmartLightSettings::kPrefIrOff,
-                                settings.ir_data_light_off);
-  IRRemote::loadFromPreferences(prefs_, SmartLightSettings::kPrefIrNight,
-                                settings.ir_data_night);
+  settings.dimmer_feature_enabled =
+      prefs_.getBool(SmartLightSettings::kPrefDimmerFeature, false);
+  settings.dimmer_steps =
+      prefs_.getInt(SmartLightSettings::kPrefDimmerSteps,
+                    SmartLightSettings::kDimmerStepsDefault);
+  settings.verify_enabled =
+      prefs_.getBool(SmartLightSettings::kPrefVerify, false);
+  IRCodeStorage::loadFromPreferences(prefs_, SmartLightSettings::kPrefIrOn,
+                                     settings.ir_code_light_on);
+  IRCodeStorage::loadFromPreferences(prefs_, SmartLightSettings::kPrefIrOff,
+                                     settings.ir_code_light_off);
+  IRCodeStorage::loadFromPreferences(prefs_, SmartLightSettings::kPrefIrNight,
+                                     settings.ir_code_night);
 
   LOGI("[Prefs] device_name: %s", settings.device_name.c_str());
   LOGI("[Prefs] hostname: %s", settings.hostname.c_str());
@@ -45,12 +53,35 @@ SmartLightSettings SmartLightSettingsStore::load() {
        settings.ambient_light_threshold_percent);
   LOGI("[Prefs] night_light_feature_enabled: %d",
        settings.night_light_feature_enabled);
-  LOGI("[Prefs] IR ON Data size: %zu", settings.ir_data_light_on.size());
-  LOGI("[Prefs] IR OFF Data size: %zu", settings.ir_data_light_off.size());
-  LOGI("[Prefs] IR NIGHT Data size: %zu", settings.ir_data_night.size());
+  LOGI("[Prefs] dimmer_feature_enabled: %d (steps: %d)",
+       settings.dimmer_feature_enabled, settings.dimmer_steps);
+  LOGI("[Prefs] verify_enabled: %d", settings.verify_enabled);
+  LOGI("[Prefs] IR ON Code: %s",
+       IRProtocolCodec::protocolName(settings.ir_code_light_on.protocol));
+  LOGI("[Prefs] IR OFF Code: %s",
+       IRProtocolCodec::protocolName(settings.ir_code_light_off.protocol));
+  LOGI("[Prefs] IR NIGHT Code: %s",
+       IRProtocolCodec::protocolName(settings.ir_code_night.protocol));
   return settings;
 }
 
+void SmartLightSettingsStore::migrate_() {
+  const int version = prefs_.getInt(SmartLightSettings::kPrefVersion, 1);
+  if (version >= SmartLightSettings::kPrefVersionCurrent) return;
+  if (prefs_.isKey(SmartLightSettings::kPrefAmbientThreshold)) {
+    /* version 1 divided the 12-bit sample by 1023, so the same light was
+     * about four times the percentage it is now */
+    const int old_percent =
+        prefs_.getInt(SmartLightSettings::kPrefAmbientThreshold);
+    const int percent = (old_percent * 1023 + 4095 / 2) / 4095;
+    prefs_.putInt(SmartLightSettings::kPrefAmbientThreshold, percent);
+    LOGW("[Prefs] ambient_light_threshold_percent: %d -> %d (12-bit scale)",
+         old_percent, percent);
+  }
+  prefs_.putInt(SmartLightSettings::kPrefVersion,
+                SmartLightSettings::kPrefVersionCurrent);
+}
+
 void SmartLightSettingsStore::saveDeviceName(const std::string& device_name) {
   prefs_.putString(SmartLightSettings::kPrefDeviceName, device_name.c_str());
 }
@@ -76,14 +107,28 @@ void SmartLightSettingsStore::saveNightLightFeatureEnabled(bool enabled) {
   prefs_.putBool(SmartLightSettings::kPrefNightFeature, enabled);
 }
 
-void SmartLightSettingsStore::saveIrDataLightOn(const IRRemote::IRData& data) {
-  IRRemote::saveToPreferences(prefs_, SmartLightSettings::kPrefIrOn, data);
+void SmartLightSettingsStore::saveDimmerFeatureEnabled(bool enabled) {
+  prefs_.putBool(SmartLightSettings::kPrefDimmerFeature, enabled);
+}
+
+void SmartLightSettingsStore::saveDimmerSteps(int steps) {
+  prefs_.putInt(SmartLightSettings::kPrefDimmerSteps, steps);
+}
+
+void SmartLightSettingsStore::saveVerifyEnabled(bool enabled) {
+  prefs_.putBool(SmartLightSettings::kPrefVerify, enabled);
+}
+
+void SmartLightSettingsStore::saveIrCodeLightOn(const IRCode& code) {
+  IRCodeStorage::saveToPreferences(prefs_, SmartLightSettings::kPrefIrOn, code);
 }
 
-void SmartLightSettingsStore::saveIrDataLightOff(const IRRemote::IRData& data) {
-  IRRemote::saveToPreferences(prefs_, SmartLightSettings::kPrefIrOff, data);
+void SmartLightSettingsStore::saveIrCodeLightOff(const IRCode& code) {
+  IRCodeStorage::saveToPreferences(prefs_, SmartLightSettings::kPrefIrOff,
+                                   code);
 }
 
-void SmartLightSettingsStore::saveIrDataNight(const IRRemote::IRData& data) {
-  IRRemote::saveToPreferences(prefs_, SmartLightSettings::kPrefIrNight, data);
+void SmartLightSettingsStore::saveIrCodeNight(const IRCode& code) {
+  IRCodeStorage::saveToPreferences(prefs_, SmartLightSettings::kPrefIrNight,
+                                   code);
 }
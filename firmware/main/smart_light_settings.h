@@ -5,11 +5,14 @@
 #pragma once
 
 #include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 
 #include <string>
 
 #include "app_log.h"
-#include "ir_remote.h"
+#include "ir_code_storage.h"
+#include "ir_protocol.h"
 
 struct SmartLightSettings {
   static constexpr const char* kPrefNamespace = "matter";
@@ -22,11 +25,18 @@ struct SmartLightSettings {
   static constexpr const char* kPrefIrOff = "ir_off";
   static constexpr const char* kPrefIrNight = "ir_night";
   static constexpr const char* kPrefNightFeature = "night_feat";
+  static constexpr const char* kPrefDimmerFeature = "dimmer_feat";
+  static constexpr const char* kPrefDimmerSteps = "dimmer_steps";
+  static constexpr const char* kPrefVerify = "verify";
+  static constexpr const char* kPrefVersion = "version";
+  /* 2: the ambient threshold is relative to the 12-bit full scale */
+  static constexpr int kPrefVersionCurrent = 2;
 
   static constexpr const char* kDeviceNameDefault = "スマートライト";
   static constexpr const char* kHostnameDefault = "esp32-matter-light";
   static constexpr int kLightOffTimeoutSecondsDefault = 5 * 60;
-  static constexpr int kAmbientLightThresholdPercentDefault = 50;
+  static constexpr int kAmbientLightThresholdPercentDefault = 12;
+  static constexpr int kDimmerStepsDefault = 10;
 
   std::string device_name = kDeviceNameDefault;
   std::string hostname = kHostnameDefault;
@@ -34,9 +44,42 @@ struct SmartLightSettings {
   bool ambient_light_mode_enabled = true;
   int ambient_light_threshold_percent = kAmbientLightThresholdPercentDefault;
   bool night_light_feature_enabled = true;
-  IRRemote::IRData ir_data_light_on;
-  IRRemote::IRData ir_data_light_off;
-  IRRemote::IRData ir_data_night;
+  bool dimmer_feature_enabled = false;
+  int dimmer_steps = kDimmerStepsDefault;  //< presses from darkest to full
+  bool verify_enabled = false;  //< check on/off with the brightness sensor
+  IRCode ir_code_light_on;
+  IRCode ir_code_light_off;
+  IRCode ir_code_night;
+  uint32_t ir_code_revision = 0;  //< bumped whenever a learned code changes
+};
+
+/**
+ * @brief Serializes access to the settings across tasks.
+ *
+ * The controller holds it only around the steps of a pass that touch them,
+ * not while it polls OTA, updates mDNS or hands frames to the transmitter;
+ * the web server holds it only around the parts of a request that touch
+ * them, and saves to NVS without it, as NVS serializes its writes itself.
+ * It also covers the learning session, the IR code library, the status LED
+ * and the timers it arms, which the web server shares with the controller
+ * the same way.
+ * It meets BasicLockable, for std::lock_guard.
+ */
+class SmartLightSettingsLock {
+ public:
+  bool begin() {
+    mutex_ = xSemaphoreCreateMutex();
+    return mutex_ != nullptr;
+  }
+  void lock() {
+    if (mutex_) xSemaphoreTake(mutex_, portMAX_DELAY);
+  }
+  void unlock() {
+    if (mutex_) xSemaphoreGive(mutex_);
+  }
+
+ private:
+  SemaphoreHandle_t mutex_ = nullptr;
 };
 
 class SmartLightSettingsStore {
@@ -50,10 +93,15 @@ class SmartLightSettingsStore {
   void saveAmbientLightModeEnabled(bool enabled);
   void saveAmbientLightThresholdPercent(int threshold_percent);
   void saveNightLightFeatureEnabled(bool enabled);
-  void saveIrDataLightOn(const IRRemote::IRData& data);
-  void saveIrDataLightOff(const IRRemote::IRData& data);
-  void saveIrDataNight(const IRRemote::IRData& data);
+  void saveDimmerFeatureEnabled(bool enabled);
+  void saveDimmerSteps(int steps);
+  void saveVerifyEnabled(bool enabled);
+  void saveIrCodeLightOn(const IRCode& code);
+  void saveIrCodeLightOff(const IRCode& code);
+  void saveIrCodeNight(const IRCode& code);
 
  private:
   Preferences prefs_;
+
+  void migrate_();
 };
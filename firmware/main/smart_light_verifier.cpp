@@ -0,0 +1,96 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+
+#include "smart_light_verifier.h"
+
+#include <cinttypes>
+
+#include "app_log.h"
+
+void SmartLightVerifier::expect(bool light_on) {
+  /* the baseline is the brightness before this frame, even if the one
+   * before is still being verified */
+  detector_.arm(light_on ? BrightnessStepDetector::Direction::Up
+                         : BrightnessStepDetector::Direction::Down);
+  light_on_ = light_on;
+  retries_ = 0;
+  log_size_ = 0;
+  enter_(Phase::Sending);
+}
+
+void SmartLightVerifier::cancel() {
+  if (phase_ == Phase::Idle) return;
+  detector_.disarm();
+  enter_(Phase::Idle);
+}
+
+SmartLightVerifier::Result SmartLightVerifier::handle(float brightness,
+                                                      bool frame_pending) {
+  const uint32_t now = AppClock::millis();
+  if (int32_t(now - next_sample_ms_) < 0) return Result::None;
+  next_sample_ms_ = now + kSamplePeriodMs;
+  detector_.add(brightness);
+  if (phase_ == Phase::Idle) return Result::None;
+
+  if (log_size_ < kLogSize) {
+    log_[log_size_++] = static_cast<uint16_t>(brightness * 1000.0f + 0.5f);
+  }
+  if (detector_.detected()) {
+    ++confirmed_count_;
+    LOGI("[Verify] Light %s confirmed (step: %+.3f, retries: %d)",
+         light_on_ ? "ON" : "OFF", detector_.step(), retries_);
+    cancel();
+    return Result::Confirmed;
+  }
+  switch (phase_) {
+    case Phase::Sending:
+      if (!frame_pending) enter_(Phase::Window);
+      return Result::None;
+    case Phase::Window:
+      if (now - phase_start_ms_ < kWindowMs) return Result::None;
+      if (retries_ == kMaxRetries) {
+        ++desync_count_;
+        LOGE("[Verify] Light %s not confirmed after %d retries (step: %+.3f)",
+             light_on_ ? "ON" : "OFF", retries_, detector_.step());
+        cancel();
+        return Result::Desync;
+      }
+      enter_(Phase::Backoff);
+      return Result::None;
+    case Phase::Backoff:
+      if (now - phase_start_ms_ < (kBackoffMs << retries_)) {
+        return Result::None;
+      }
+      ++retries_;
+      ++retry_count_;
+      LOGW("[Verify] Light %s not confirmed, retry %d/%d",
+           light_on_ ? "ON" : "OFF", retries_, kMaxRetries);
+      enter_(Phase::Sending);
+      return Result::Retry;
+    case Phase::Idle:
+      break;
+  }
+  return Result::None;
+}
+
+void SmartLightVerifier::dump() const {
+  LOGI("[Verify] confirmed: %" PRIu32 ", retries: %" PRIu32
+       ", desyncs: %" PRIu32,
+       confirmed_count_, retry_count_, desync_count_);
+  LOGI("[Verify] Last: Light %s, baseline %.3f, %d samples every %" PRIu32
+       " ms (x1000)",
+       light_on_ ? "ON" : "OFF", detector_.baseline(), log_size_,
+       kSamplePeriodMs);
+  for (int i = 0; i < log_size_; ++i) {
+    printf("%u", log_[i]);
+    if (i != log_size_ - 1) printf(",");
+  }
+  printf("\n");
+}
+
+void SmartLightVerifier::enter_(Phase phase) {
+  phase_ = phase;
+  phase_start_ms_ = AppClock::millis();
+}
@@ -0,0 +1,60 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <Arduino.h>
+
+#include "brightness_step_detector.h"
+
+/**
+ * @brief Checks with the brightness sensor that the lamp followed a frame.
+ *
+ * expect() is called when an on/off frame is posted, and baselines the
+ * brightness seen before it. Once the frame has left the transmitter, the
+ * brightness has kWindowMs to step in the expected direction. If it does
+ * not, handle() asks for the frame to be sent again after a growing backoff,
+ * and after kMaxRetries it reports a desync: the lamp is not in the state
+ * that was committed. A step seen during a backoff still confirms the state.
+ *
+ * The samples of the last verification are kept for `verify dump`, so that
+ * traces of real lamps can be fed to the detector off the device.
+ */
+class SmartLightVerifier {
+ public:
+  enum class Result { None, Confirmed, Retry, Desync };
+
+  static constexpr const uint32_t kSamplePeriodMs = 50;
+  static constexpr const uint32_t kWindowMs = 1500;  //< lamp powering up
+  static constexpr const uint32_t kBackoffMs = 500;  //< doubled every retry
+  static constexpr const int kMaxRetries = 3;
+  static constexpr const int kLogSize = 256;  //< 12.8 s, the longest run
+
+  void expect(bool light_on);
+  void cancel();
+  Result handle(float brightness, bool frame_pending);
+  void dump() const;
+
+  bool active() const { return phase_ != Phase::Idle; }
+  uint32_t getConfirmedCount() const { return confirmed_count_; }
+  uint32_t getRetryCount() const { return retry_count_; }
+  uint32_t getDesyncCount() const { return desync_count_; }
+
+ private:
+  enum class Phase : uint8_t { Idle, Sending, Window, Backoff };
+
+  BrightnessStepDetector detector_;
+  Phase phase_ = Phase::Idle;
+  bool light_on_ = false;
+  int retries_ = 0;
+  uint32_t phase_start_ms_ = 0;
+  uint32_t next_sample_ms_ = 0;
+  uint32_t confirmed_count_ = 0;
+  uint32_t retry_count_ = 0;
+  uint32_t desync_count_ = 0;
+  uint16_t log_[kLogSize] = {};  //< brightness x 1000 since expect()
+  int log_size_ = 0;
+
+  void enter_(Phase phase);
+};
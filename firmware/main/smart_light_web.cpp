@@ -5,6 +5,8 @@
 
 #include "smart_light_web.h"
 
+#include <mutex>
+
 #include "web_utils.h"
 
 namespace {
@@ -13,9 +15,6 @@ constexpr char kWebPageTemplate[] =
 #include "smart_light_web_page.inc"
     ;
 
-constexpr uint16_t kIrRecordTimeoutMs = 10000;
-constexpr uint16_t kIrResultIndicatorMs = 500;
-
 void replaceToggleValues(String& html, const char* action_key,
                          const char* class_key, const char* state_key,
                          bool enabled, const char* on_text = "オン",
@@ -40,44 +39,133 @@ String buildNightControl(bool enabled) {
   return html;
 }
 
-}  // namespace
+const char* buttonLabel(SmartLightLearning::Target target) {
+  switch (target) {
+    case SmartLightLearning::Target::LightOn:
+      return "点灯";
+    case SmartLightLearning::Target::LightOff:
+      return "消灯";
+    case SmartLightLearning::Target::Night:
+    case SmartLightLearning::Target::Library:
+      break;
+  }
+  return "常夜灯";
+}
 
-void SmartLightWeb::begin() {
-  server_.on("/", HTTP_GET, [this]() { handleRoot(); });
-  server_.on("/settings", HTTP_POST, [this]() { handleSaveSettings(); });
-  server_.on("/record", HTTP_POST, [this]() { handleRecord(); });
-  server_.on("/action", HTTP_POST, [this]() { handleAction(); });
-  server_.begin();
-  LOGI("[Web] HTTP server started on port 80");
+String learningLabel(const SmartLightLearning& learning) {
+  if (learning.target() == SmartLightLearning::Target::Library) {
+    return String("「") + escapeHtml(learning.libraryName()) + "」";
+  }
+  return String(buttonLabel(learning.target())) + "ボタン";
 }
 
-void SmartLightWeb::handle() { server_.handleClient(); }
+String buildLibraryList(const IRCodeLibrary& library) {
+  if (!library.ready()) {
+    return "<p class=\"mini\">ライブラリ用のパーティションがありません。</p>";
+  }
+  if (library.count() == 0) {
+    return "<p class=\"mini\">登録されたコードはありません。</p>";
+  }
+  String html = "<div class=\"library-list\">";
+  IRCodeLibrary::Entry entry;
+  for (size_t i = 0; library.entry(i, entry); ++i) {
+    const String name = escapeHtml(entry.name);
+    html += "<form class=\"row library-item\" method=\"post\" "
+            "action=\"/library\"><span><strong>";
+    html += name;
+    html += "</strong> <span class=\"mini\">";
+    html += IRProtocolCodec::protocolName(entry.protocol());
+    html += "</span></span><input type=\"hidden\" name=\"name\" value=\"";
+    html += name;
+    /* valid names need no escaping inside the script either */
+    html += "\"><input type=\"hidden\" name=\"new_name\">"
+            "<span class=\"group\">"
+            "<button name=\"op\" value=\"send\">送信</button>"
+            "<button class=\"warn\" name=\"op\" value=\"rename\" "
+            "onclick=\"var n=prompt('新しい名前','";
+    html += name;
+    html += "');if(!n)return false;this.form.new_name.value=n\">名前変更</button>"
+            "<button class=\"warn\" name=\"op\" value=\"delete\" "
+            "onclick=\"return confirm('削除しますか？')\">削除</button>"
+            "</span></form>";
+  }
+  html += "</div><p class=\"mini\">";
+  html += library.count();
+  html += "件、";
+  html += library.usedBytes();
+  html += "/";
+  html += library.capacity();
+  html += "バイト使用中</p>";
+  return html;
+}
 
-void SmartLightWeb::setObservedStates(bool light_state, bool switch_state,
-                                      bool night_state,
-                                      int ambient_light_percent) {
-  observed_light_state_ = light_state;
-  observed_switch_state_ = switch_state;
-  observed_night_state_ = night_state;
-  observed_ambient_light_percent_ = ambient_light_percent;
+String buildLearningNotice(const SmartLightLearning& learning) {
+  /* the page polls the session and reloads itself once it has finished */
+  String html = "<div class=\"notice\">";
+  html += learningLabel(learning);
+  html += "を記録中です。リモコンの同じボタンを送信してください（"
+          "<span id=\"learning-count\">";
+  html += learning.captured();
+  html += "/";
+  html += learning.required();
+  html += "</span>）。</div>"
+          "<script>(function poll(){setTimeout(function(){"
+          "fetch('/record/status').then(function(r){return r.json()})"
+          ".then(function(s){if(s.state!=='listening')"
+          "return location.replace('/');"
+          "document.getElementById('learning-count').textContent="
+          "s.captured+'/'+s.required;poll()}).catch(poll)},1000)})()"
+          "</script>";
+  return html;
 }
 
-bool SmartLightWeb::consumeRequestedLightState(bool& light_state) {
-  return requested_light_state_.consume(light_state);
+}  // namespace
+
+bool SmartLightWeb::begin() {
+  server_.on("/", HTTP_GET, [this]() { handleRoot(); });
+  server_.on("/settings", HTTP_POST,
+             [this]() { redirectAfter_(&SmartLightWeb::saveSettings_); });
+  server_.on("/record", HTTP_POST,
+             [this]() { redirectAfter_(&SmartLightWeb::startRecord_); });
+  server_.on("/record/status", HTTP_GET, [this]() { handleRecordStatus(); });
+  server_.on("/library", HTTP_GET, [this]() { handleLibraryList(); });
+  server_.on("/library", HTTP_POST,
+             [this]() { redirectAfter_(&SmartLightWeb::updateLibrary_); });
+  server_.on("/action", HTTP_POST, [this]() { handleAction(); });
+  server_.enableDelay(false);  //< the task sleeps between polls itself
+  server_.begin();
+  if (xTaskCreatePinnedToCore(taskEntry_, "web", kTaskStackSize, this,
+                              kTaskPriority, &task_,
+                              CONFIG_APP_CORE_NETWORK) != pdPASS) {
+    LOGE("[Web] Failed to create task");
+    return false;
+  }
+  LOGI("[Web] HTTP server started on port 80");
+  return true;
 }
 
-bool SmartLightWeb::consumeRequestedSwitchState(bool& switch_state) {
-  return requested_switch_state_.consume(switch_state);
+void SmartLightWeb::run_() {
+  for (;;) {
+    if (learning_session_) {
+      std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+      reportLearningResult_();
+    }
+    server_.handleClient();
+    const bool serving = server_.client().connected();
+    power_.hold(PowerManager::Lock::Http, serving);
+    vTaskDelay(pdMS_TO_TICKS(serving ? kPollMs : kIdlePollMs));
+  }
 }
 
-bool SmartLightWeb::consumeRequestedNightState(bool& night_state) {
-  return requested_night_state_.consume(night_state);
+void SmartLightWeb::taskEntry_(void* this_ptr) {
+  static_cast<SmartLightWeb*>(this_ptr)->run_();
 }
 
-bool SmartLightWeb::consumeRebootRequested() {
-  if (!reboot_requested_) return false;
-  reboot_requested_ = false;
-  return true;
+void SmartLightWeb::publishObservedState(const ObservedState& state) {
+  ObservedState& back = observed_.back();
+  back = state;
+  back.taken_request = taken_request_;
+  observed_.publish();
 }
 
 void SmartLightWeb::showStatus(const String& message, bool is_error) {
@@ -85,13 +173,36 @@ void SmartLightWeb::showStatus(const String& message, bool is_error) {
   status_is_error_ = is_error;
 }
 
+bool SmartLightWeb::postRequest_(SmartLightCommand::Type type, bool value) {
+  SmartLightCommand command(type, SmartLightCommand::Source::Web, value);
+  command.tag = ++request_sequence_;
+  if (!commands_.push(command)) return false;
+  /* wait for the controller to take it, the page shows the outcome */
+  const uint32_t start_ms = AppClock::millis();
+  while (int32_t(observed_.read().taken_request - command.tag) < 0 &&
+         AppClock::millis() - start_ms < kRequestWaitMs) {
+    vTaskDelay(1);
+  }
+  return true;
+}
+
 void SmartLightWeb::handleRoot() {
   logRequest(server_);
   sendPage();
 }
 
-void SmartLightWeb::handleSaveSettings() {
+void SmartLightWeb::redirectAfter_(void (SmartLightWeb::*action)()) {
   logRequest(server_);
+  (this->*action)();
+  redirectRoot(server_);
+}
+
+void SmartLightWeb::showStatusLocked_(const String& message, bool is_error) {
+  std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+  showStatus(message, is_error);
+}
+
+void SmartLightWeb::saveSettings_() {
   String device_name = server_.arg("device_name");
   device_name.trim();
   String hostname = server_.arg("hostname");
@@ -101,61 +212,169 @@ void SmartLightWeb::handleSaveSettings() {
   if (device_name.isEmpty() || device_name.length() > 64 ||
       !hostname.length() || timeout_seconds <= 0 || ambient_threshold < 0 ||
       ambient_threshold > 100) {
-    showStatus("入力内容を確認してください。設定は保存されませんでした。",
-               true);
-    return redirectRoot(server_);
+    showStatusLocked_(
+        "入力内容を確認してください。設定は保存されませんでした。", true);
+    return;
   }
 
-  settings_.device_name = device_name.c_str();
-  settings_.hostname = hostname.c_str();
-  settings_.light_off_timeout_seconds = timeout_seconds;
-  settings_.ambient_light_threshold_percent = ambient_threshold;
-
-  settings_store_.saveDeviceName(settings_.device_name);
-  settings_store_.saveHostname(settings_.hostname);
-  settings_store_.saveLightOffTimeoutSeconds(settings_.light_off_timeout_seconds);
-  settings_store_.saveAmbientLightThresholdPercent(
-      settings_.ambient_light_threshold_percent);
+  {
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    settings_.device_name = device_name.c_str();
+    settings_.hostname = hostname.c_str();
+    settings_.light_off_timeout_seconds = timeout_seconds;
+    settings_.ambient_light_threshold_percent = ambient_threshold;
+    showStatus("基本設定を保存しました。");
+  }
   hostname_updated_ = true;
-  showStatus("基本設定を保存しました。");
-  redirectRoot(server_);
+  /* NVS is written from the values parsed here, without the lock */
+  settings_store_.saveDeviceName(device_name.c_str());
+  settings_store_.saveHostname(hostname.c_str());
+  settings_store_.saveLightOffTimeoutSeconds(timeout_seconds);
+  settings_store_.saveAmbientLightThresholdPercent(ambient_threshold);
 }
 
-void SmartLightWeb::handleRecord() {
-  logRequest(server_);
-  const String target = server_.arg("target");
-  if (target != "on" && target != "off" && target != "night") {
-    showStatus("赤外線リモコンの記録対象が不正です。", true);
-    return redirectRoot(server_);
+void SmartLightWeb::startRecord_() {
+  SmartLightLearning::Target target;
+  if (!SmartLightLearning::parseTarget(server_.arg("target").c_str(),
+                                       target)) {
+    showStatusLocked_("赤外線リモコンの記録対象が不正です。", true);
+    return;
+  }
+  std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+  if (!learning_.start(target)) {
+    showStatus("別のボタンを記録中です。完了してからお試しください。", true);
+    return;
   }
+  learning_session_ = learning_.session();
+}
 
-  ir_remote_.clear();
-  led_.blinkOnce(RgbLed::Color::Green, kIrRecordTimeoutMs + 1000);
-  if (!ir_remote_.waitForAvailable(kIrRecordTimeoutMs)) {
-    led_.blinkOnce(RgbLed::Color::Red, kIrResultIndicatorMs);
-    showStatus("赤外線信号を受信できませんでした。もう一度お試しください。",
-               true);
-    return redirectRoot(server_);
+void SmartLightWeb::handleRecordStatus() {
+  String json = "{\"state\":\"";
+  {
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    json += SmartLightLearning::stateName(learning_.state());
+    json += "\",\"target\":\"";
+    json += SmartLightLearning::targetName(learning_.target());
+    json += "\",\"captured\":";
+    json += learning_.captured();
+    json += ",\"required\":";
+    json += learning_.required();
+    json += ",\"remaining_ms\":";
+    json += learning_.remainingMs();
+  }
+  json += "}";
+  server_.send(200, "application/json", json);
+}
+
+void SmartLightWeb::reportLearningResult_() {
+  if (!learning_session_ || learning_.session() != learning_session_ ||
+      !learning_.finished()) {
+    return;
+  }
+  learning_session_ = 0;
+  const String button = learningLabel(learning_);
+  switch (learning_.state()) {
+    case SmartLightLearning::State::Succeeded:
+      break;
+    case SmartLightLearning::State::Canceled:
+      return showStatus(button + "の記録を中止しました。", true);
+    default:
+      return showStatus(
+          "赤外線信号を受信できませんでした。もう一度お試しください。", true);
   }
 
-  const auto ir_data = ir_remote_.get();
-  String recorded_button;
-  if (target == "on") {
-    settings_.ir_data_light_on = ir_data;
-    settings_store_.saveIrDataLightOn(settings_.ir_data_light_on);
-    recorded_button = "点灯";
-  } else if (target == "off") {
-    settings_.ir_data_light_off = ir_data;
-    settings_store_.saveIrDataLightOff(settings_.ir_data_light_off);
-    recorded_button = "消灯";
+  String message = button + "の赤外線信号を記録しました（" +
+                   String(learning_.captured()) + "回受信）。";
+  String conflicts;
+  for (const auto other :
+       {SmartLightLearning::Target::LightOn,
+        SmartLightLearning::Target::LightOff,
+        SmartLightLearning::Target::Night}) {
+    if (!learning_.conflictsWith(other)) continue;
+    if (conflicts.length()) conflicts += "・";
+    conflicts += buttonLabel(other);
+  }
+  if (conflicts.length()) {
+    message += conflicts + "ボタンの信号と区別できない可能性があります。";
+    return showStatus(message, true);
+  }
+  showStatus(message);
+}
+
+void SmartLightWeb::updateLibrary_() {
+  const String op = server_.arg("op");
+  String name = server_.arg("name");
+  name.trim();
+  const String label = String("「") + escapeHtml(name.c_str()) + "」";
+  if (op == "learn") {
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    if (!IRCodeLibrary::isValidName(name.c_str())) {
+      showStatus("コード名は英数字と _ . - の23文字以内で入力してください。",
+                 true);
+    } else if (!learning_.startLibrary(name.c_str())) {
+      showStatus("別のボタンを記録中です。完了してからお試しください。", true);
+    } else {
+      learning_session_ = learning_.session();
+    }
+    return;
+  }
+  /* the flash is erased and written without the lock, see IRCodeLibrary */
+  if (op == "rename") {
+    String new_name = server_.arg("new_name");
+    new_name.trim();
+    if (ir_code_library_.rename(name.c_str(), new_name.c_str(),
+                                settings_lock_)) {
+      showStatusLocked_(label + "を「" + escapeHtml(new_name.c_str()) +
+                        "」に変更しました。");
+    } else {
+      showStatusLocked_(label + "の名前を変更できませんでした。", true);
+    }
+    return;
+  }
+  if (op == "delete") {
+    if (ir_code_library_.remove(name.c_str(), settings_lock_)) {
+      showStatusLocked_(label + "を削除しました。");
+    } else {
+      showStatusLocked_(label + "を削除できませんでした。", true);
+    }
+    return;
+  }
+
+  std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+  IRCodeLibrary::Entry entry;
+  if (op == "send" && ir_code_library_.find(name.c_str(), entry) &&
+      ir_transmitter_.post(IRCodeLibrary::transmitKey(entry), entry.record,
+                           entry.size, entry.name)) {
+    showStatus(label + "を送信しました。");
   } else {
-    settings_.ir_data_night = ir_data;
-    settings_store_.saveIrDataNight(settings_.ir_data_night);
-    recorded_button = "常夜灯";
+    showStatus(label + "を送信できませんでした。", true);
   }
-  led_.blinkOnce(RgbLed::Color::Green, kIrResultIndicatorMs);
-  showStatus(recorded_button + "ボタンの赤外線信号を記録しました。");
-  redirectRoot(server_);
+}
+
+void SmartLightWeb::handleLibraryList() {
+  String json = "{\"generation\":";
+  std::unique_lock<SmartLightSettingsLock> lock(settings_lock_);
+  json += ir_code_library_.generation();
+  json += ",\"used\":";
+  json += ir_code_library_.usedBytes();
+  json += ",\"capacity\":";
+  json += ir_code_library_.capacity();
+  json += ",\"codes\":[";
+  IRCodeLibrary::Entry entry;
+  for (size_t i = 0; ir_code_library_.entry(i, entry); ++i) {
+    /* names are limited to characters that need no escaping */
+    if (i) json += ",";
+    json += "{\"name\":\"";
+    json += entry.name;
+    json += "\",\"protocol\":\"";
+    json += IRProtocolCodec::protocolName(entry.protocol());
+    json += "\",\"size\":";
+    json += entry.size;
+    json += "}";
+  }
+  json += "]}";
+  lock.unlock();
+  server_.send(200, "application/json", json);
 }
 
 void SmartLightWeb::handleAction() {
@@ -165,44 +384,59 @@ void SmartLightWeb::handleAction() {
   const bool enabled = state == "on";
   if (state != "on" && state != "off") return redirectRoot(server_);
 
-  if (target == "light") {
-    requested_light_state_.request(enabled);
-    return redirectRoot(server_);
-  }
-  if (target == "switch") {
-    requested_switch_state_.request(enabled);
-    return redirectRoot(server_);
-  }
-  if (target == "night") {
-    requested_night_state_.request(enabled);
+  if (target == "light" || target == "switch" || target == "night") {
+    using Type = SmartLightCommand::Type;
+    const Type type = target == "light"    ? Type::SetLight
+                      : target == "switch" ? Type::SetSwitch
+                                           : Type::SetNight;
+    if (!postRequest_(type, enabled)) {
+      std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+      showStatus("操作を受け付けられませんでした。もう一度お試しください。",
+                 true);
+    }
     return redirectRoot(server_);
   }
   if (target == "ambient") {
-    settings_.ambient_light_mode_enabled = enabled;
+    {
+      std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+      settings_.ambient_light_mode_enabled = enabled;
+      showStatus(String("明るさ連動を") +
+                 (enabled ? "オン" : "オフ") + "にしました。");
+    }
     settings_store_.saveAmbientLightModeEnabled(enabled);
-    showStatus(String("明るさ連動を") +
-               (enabled ? "オン" : "オフ") + "にしました。");
     return redirectRoot(server_);
   }
   if (target == "night_feature") {
-    settings_.night_light_feature_enabled = enabled;
+    {
+      std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+      settings_.night_light_feature_enabled = enabled;
+      showStatus(String("常夜灯エンドポイントを") +
+                 (enabled ? "有効" : "無効") +
+                 "にしました。再起動しています。");
+    }
     settings_store_.saveNightLightFeatureEnabled(enabled);
-    showStatus(String("常夜灯エンドポイントを") +
-               (enabled ? "有効" : "無効") +
-               "にしました。再起動しています。");
+    /* the controller restarts once the page is out */
+    sendPage(true);
     reboot_requested_ = true;
-    return sendPage();
+    return;
   }
   redirectRoot(server_);
 }
 
-void SmartLightWeb::sendPage() {
-  server_.send(200, "text/html", buildPage());
-  status_message_ = "";
-  status_is_error_ = false;
+void SmartLightWeb::sendPage(bool rebooting) {
+  const ObservedState& observed = observed_.read();
+  String page;
+  {
+    std::lock_guard<SmartLightSettingsLock> lock(settings_lock_);
+    page = buildPage(observed, rebooting);
+    status_message_ = "";
+    status_is_error_ = false;
+  }
+  server_.send(200, "text/html", page);
 }
 
-String SmartLightWeb::buildPage() const {
+String SmartLightWeb::buildPage(const ObservedState& observed,
+                                bool rebooting) const {
   String html(kWebPageTemplate);
   html.reserve(html.length() + 512);
 
@@ -217,16 +451,17 @@ String SmartLightWeb::buildPage() const {
     status_notice += status_message_;
     status_notice += "</div>";
   }
+  if (learning_.active()) status_notice += buildLearningNotice(learning_);
   replaceTemplateValue(html, "{{STATUS_NOTICE}}", status_notice);
 
   replaceToggleValues(html, "{{LIGHT_ACTION}}", "{{LIGHT_CLASS}}",
-                      "{{LIGHT_STATE}}", observed_light_state_);
+                      "{{LIGHT_STATE}}", observed.light_state);
   replaceToggleValues(html, "{{SWITCH_ACTION}}", "{{SWITCH_CLASS}}",
-                      "{{SWITCH_STATE}}", observed_switch_state_);
+                      "{{SWITCH_STATE}}", observed.switch_state);
 
   if (settings_.night_light_feature_enabled) {
     replaceTemplateValue(html, "{{NIGHT_CONTROL}}",
-                         buildNightControl(observed_night_state_));
+                         buildNightControl(observed.night_state));
     replaceTemplateValue(
         html, "{{NIGHT_RECORD_BUTTON}}",
         "<button class=\"warn\" name=\"target\" value=\"night\">常夜灯ボタンを記録</button>");
@@ -235,14 +470,17 @@ String SmartLightWeb::buildPage() const {
     replaceTemplateValue(html, "{{NIGHT_RECORD_BUTTON}}", "");
   }
 
+  replaceTemplateValue(html, "{{IR_LIBRARY}}",
+                       buildLibraryList(ir_code_library_));
+
   replaceTemplateValue(html, "{{AMBIENT_VALUE}}",
-                       String(observed_ambient_light_percent_));
+                       String(observed.ambient_light_percent));
   replaceToggleValues(html, "{{AMBIENT_ACTION}}",
                       "{{AMBIENT_STATUS_CLASS}}",
                       "{{AMBIENT_STATUS_STATE}}",
                       settings_.ambient_light_mode_enabled);
   replaceTemplateValue(html, "{{REBOOT_NOTICE}}",
-                       reboot_requested_
+                       rebooting
                            ? "<div class=\"notice\">再起動しています。数秒待ってからページを再読み込みしてください。</div>"
                            : "");
   replaceTemplateValue(html, "{{DEVICE_NAME}}",
@@ -6,73 +6,117 @@
 
 #include <Arduino.h>
 #include <WebServer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 
-#include "ir_remote.h"
-#include "rgb_led.h"
+#include <atomic>
+
+#include "app_config.h"
+#include "ir_code_library.h"
+#include "ir_transmitter.h"
+#include "power_manager.h"
+#include "smart_light_command_bus.h"
+#include "smart_light_learning.h"
 #include "smart_light_settings.h"
+#include "triple_buffer.h"
 
+/**
+ * @brief Web UI, served from a task of its own.
+ *
+ * A slow or stalled browser connection only holds up this task, never the
+ * controller loop. The controller publishes the state shown on the page
+ * after each pass through a triple buffer, and the toggles on the page go
+ * back to it as commands on the command bus. A request is answered once the
+ * controller has taken its command, so the page after the redirect shows
+ * what it led to. Handlers hold the settings lock only while they touch the
+ * settings, the learning session or the IR code library: the settings are
+ * saved to NVS and the library flash is written without it, so the
+ * controller loop is not held up, and it is released before the response
+ * is sent.
+ *
+ * While a client is connected, the task holds a power lock and polls the
+ * server quickly; in the power save mode it polls slower in between, so
+ * that the chip may sleep.
+ */
 class SmartLightWeb {
  public:
+  struct ObservedState {
+    bool light_state = false;
+    bool switch_state = false;
+    bool night_state = false;
+    int ambient_light_percent = 0;
+    uint32_t taken_request = 0;  //< filled in by publishObservedState()
+  };
+
+  static constexpr const uint32_t kRequestWaitMs = 200;
+  static constexpr const uint32_t kPollMs = 5;
+  static constexpr const uint32_t kIdlePollMs =
+      PowerManager::kEnabled ? 50 : kPollMs;
+  static constexpr const uint32_t kTaskStackSize = 8192;  //< page building
+  static constexpr const UBaseType_t kTaskPriority =
+      CONFIG_APP_TASK_PRIORITY_WEB;
+
   SmartLightWeb(SmartLightSettings& settings,
                 SmartLightSettingsStore& settings_store,
-                IRRemote& ir_remote, RgbLed& led)
+                SmartLightSettingsLock& settings_lock,
+                SmartLightCommandBus& commands, SmartLightLearning& learning,
+                IRCodeLibrary& ir_code_library, IRTransmitter& ir_transmitter,
+                PowerManager& power)
       : settings_(settings),
         settings_store_(settings_store),
-        ir_remote_(ir_remote),
-        led_(led) {}
+        settings_lock_(settings_lock),
+        commands_(commands),
+        learning_(learning),
+        ir_code_library_(ir_code_library),
+        ir_transmitter_(ir_transmitter),
+        power_(power) {}
 
-  void begin();
-  void handle();
-  void setObservedStates(bool light_state, bool switch_state, bool night_state,
-                         int ambient_light_percent);
+  bool begin();
 
-  bool hostnameUpdated() const { return hostname_updated_; }
-  void clearHostnameUpdated() { hostname_updated_ = false; }
-  bool consumeRequestedLightState(bool& light_state);
-  bool consumeRequestedSwitchState(bool& switch_state);
-  bool consumeRequestedNightState(bool& night_state);
-  bool consumeRebootRequested();
+  /* controller side */
+  void publishObservedState(const ObservedState& state);
+  bool consumeHostnameUpdated() { return hostname_updated_.exchange(false); }
+  /* a command pushed by the web server, by its tag, has been applied */
+  void requestTaken(uint32_t tag) { taken_request_ = tag; }
+  bool consumeRebootRequested() { return reboot_requested_.exchange(false); }
+  /* the settings lock must be held */
   void showStatus(const String& message, bool is_error = false);
 
  private:
-  struct PendingState {
-    bool pending = false;
-    bool value = false;
-
-    void request(bool requested_value) {
-      value = requested_value;
-      pending = true;
-    }
-
-    bool consume(bool& requested_value) {
-      if (!pending) return false;
-      requested_value = value;
-      pending = false;
-      return true;
-    }
-  };
-
   SmartLightSettings& settings_;
   SmartLightSettingsStore& settings_store_;
-  IRRemote& ir_remote_;
-  RgbLed& led_;
+  SmartLightSettingsLock& settings_lock_;
+  SmartLightCommandBus& commands_;
+  SmartLightLearning& learning_;
+  IRCodeLibrary& ir_code_library_;
+  IRTransmitter& ir_transmitter_;
+  PowerManager& power_;
   WebServer server_{80};
-  bool hostname_updated_ = false;
-  bool observed_light_state_ = false;
-  bool observed_switch_state_ = false;
-  bool observed_night_state_ = false;
-  int observed_ambient_light_percent_ = 0;
-  PendingState requested_light_state_;
-  PendingState requested_switch_state_;
-  PendingState requested_night_state_;
-  bool reboot_requested_ = false;
+  TaskHandle_t task_ = nullptr;
+  TripleBuffer<ObservedState> observed_;
+  uint32_t request_sequence_ = 0;  //< web task only
+  uint32_t taken_request_ = 0;  //< controller only
+  std::atomic<bool> hostname_updated_{false};
+  std::atomic<bool> reboot_requested_{false};
+  uint32_t learning_session_ = 0;  //< session started from the web, if any
   String status_message_;
   bool status_is_error_ = false;
 
+  void run_();
+  static void taskEntry_(void* this_ptr);
+  bool postRequest_(SmartLightCommand::Type type, bool value);
+  /* runs a POST action, which takes the settings lock itself, then
+   * redirects */
+  void redirectAfter_(void (SmartLightWeb::*action)());
+  void showStatusLocked_(const String& message, bool is_error = false);
   void handleRoot();
-  void handleSaveSettings();
-  void handleRecord();
+  void saveSettings_();
+  void startRecord_();
+  void handleRecordStatus();
+  void reportLearningResult_();
+  void updateLibrary_();
+  void handleLibraryList();
   void handleAction();
-  void sendPage();
-  String buildPage() const;
+  void sendPage(bool rebooting = false);
+  String buildPage(const ObservedState& observed, bool rebooting) const;
 };
@@ -0,0 +1,212 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief Hierarchical timer wheel for the timeouts of one task.
+ *
+ * A timer is linked into one of the kSlots slots of a level by its expiry,
+ * so arm() and cancel() are O(1). Level 0 has a slot per millisecond, and
+ * each level above has a slot per turn of the one below; when a slot of an
+ * upper level comes up, its timers move down, and those of level 0 expire.
+ * advance() skips the slots that are empty, so the owner only has to call
+ * it when it wakes up, and getMillisUntilNext() tells when that should be.
+ *
+ * Times are AppClock::millis() values compared by their difference, so the
+ * wheel is not affected by their wrap. Timers further away than
+ * kMaxDelayMs are parked at that distance and placed again when it comes.
+ * Callbacks run in advance(), and may arm or cancel any timer.
+ */
+class TimerWheel {
+ public:
+  using Callback = void (*)(void* arg);
+
+  static constexpr const int kLevels = 4;
+  static constexpr const int kSlotBits = 6;
+  static constexpr const uint32_t kSlots = 1 << kSlotBits;
+  static constexpr const uint32_t kMaxDelayMs =
+      (1ul << (kSlotBits * kLevels)) - 1;  //< about 4.6 hours
+
+  class Timer {
+   public:
+    Timer(Callback callback, void* arg) : callback_(callback), arg_(arg) {}
+    Timer(const Timer&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+    bool armed() const { return list_ != nullptr; }
+    uint32_t expiry() const { return expiry_ms_; }
+
+   private:
+    friend class TimerWheel;
+
+    const Callback callback_;
+    void* const arg_;
+    uint32_t expiry_ms_ = 0;
+    Timer** list_ = nullptr;  //< the head it is linked to, if armed
+    Timer* prev_ = nullptr;
+    Timer* next_ = nullptr;
+    uint8_t level_ = 0;
+    uint8_t slot_ = 0;
+  };
+
+  /* the time of the last advance(), which arm() is relative to */
+  uint32_t now() const { return now_ms_; }
+
+  /* an expiry that has passed fires on the next advance() */
+  void armAt(Timer& timer, uint32_t expiry_ms);
+  void arm(Timer& timer, uint32_t delay_ms) {
+    armAt(timer, now_ms_ + delay_ms);
+  }
+  void cancel(Timer& timer);
+  void advance(uint32_t now_ms);
+
+  /* UINT32_MAX if no timer is armed; it may come before the expiry, when
+   * the timers of an upper level move down */
+  uint32_t getMillisUntilNext(uint32_t now_ms) const;
+
+ private:
+  static constexpr const uint8_t kFiring = kLevels;  //< level of fired_
+
+  Timer* slots_[kLevels][kSlots] = {};
+  uint64_t occupied_[kLevels] = {};  //< a bit per slot with a timer
+  Timer* fired_ = nullptr;  //< taken out of a slot, callbacks pending
+  uint32_t now_ms_ = 0;
+
+  void place_(Timer& timer);
+  void link_(Timer& timer, uint8_t level, uint8_t slot);
+  void unlink_(Timer& timer);
+  Timer* take_(uint8_t level, uint8_t slot);
+  bool nextTick_(uint32_t& tick) const;
+  void tick_();
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+inline void TimerWheel::armAt(Timer& timer, uint32_t expiry_ms) {
+  if (timer.armed()) unlink_(timer);
+  /* slot now_ms_ of level 0 has been handled already */
+  const int32_t delay = expiry_ms - now_ms_;
+  timer.expiry_ms_ = delay > 0 ? expiry_ms : now_ms_ + 1;
+  place_(timer);
+}
+
+inline void TimerWheel::cancel(Timer& timer) {
+  if (timer.armed()) unlink_(timer);
+}
+
+inline void TimerWheel::advance(uint32_t now_ms) {
+  while (int32_t(now_ms - now_ms_) > 0) {
+    uint32_t tick;
+    if (!nextTick_(tick) || int32_t(tick - now_ms) > 0) {
+      now_ms_ = now_ms;  //< nothing happens in between
+      return;
+    }
+    now_ms_ = tick - 1;
+    tick_();
+  }
+}
+
+inline uint32_t TimerWheel::getMillisUntilNext(uint32_t now_ms) const {
+  uint32_t tick;
+  if (!nextTick_(tick)) return UINT32_MAX;
+  const int32_t remaining = tick - now_ms;
+  return remaining > 0 ? remaining : 0;
+}
+
+inline void TimerWheel::place_(Timer& timer) {
+  const uint32_t delay = timer.expiry_ms_ - now_ms_;
+  const uint32_t at =
+      int32_t(delay) <= 0      ? now_ms_
+      : delay > kMaxDelayMs ? now_ms_ + kMaxDelayMs
+                            : timer.expiry_ms_;
+  const uint32_t distance = at - now_ms_;
+  uint8_t level = 0;
+  while (level + 1 < kLevels && distance >> (kSlotBits * (level + 1))) {
+    ++level;
+  }
+  link_(timer, level, (at >> (kSlotBits * level)) & (kSlots - 1));
+}
+
+inline void TimerWheel::link_(Timer& timer, uint8_t level, uint8_t slot) {
+  Timer** list = level == kFiring ? &fired_ : &slots_[level][slot];
+  timer.list_ = list;
+  timer.level_ = level;
+  timer.slot_ = slot;
+  timer.prev_ = nullptr;
+  timer.next_ = *list;
+  if (*list) (*list)->prev_ = &timer;
+  *list = &timer;
+  if (level != kFiring) occupied_[level] |= uint64_t(1) << slot;
+}
+
+inline void TimerWheel::unlink_(Timer& timer) {
+  if (timer.prev_) {
+    timer.prev_->next_ = timer.next_;
+  } else {
+    *timer.list_ = timer.next_;
+  }
+  if (timer.next_) timer.next_->prev_ = timer.prev_;
+  if (timer.level_ != kFiring && !*timer.list_) {
+    occupied_[timer.level_] &= ~(uint64_t(1) << timer.slot_);
+  }
+  timer.list_ = nullptr;
+  timer.prev_ = timer.next_ = nullptr;
+}
+
+inline TimerWheel::Timer* TimerWheel::take_(uint8_t level, uint8_t slot) {
+  Timer* head = slots_[level][slot];
+  slots_[level][slot] = nullptr;
+  occupied_[level] &= ~(uint64_t(1) << slot);
+  return head;
+}
+
+inline bool TimerWheel::nextTick_(uint32_t& tick) const {
+  bool found = false;
+  uint32_t nearest = 0;  //< from now_ms_
+  for (int level = 0; level < kLevels; ++level) {
+    if (!occupied_[level]) continue;
+    const int shift = kSlotBits * level;
+    const uint32_t turn = now_ms_ >> shift;
+    /* rotated so that bit 0 is the slot after the current one */
+    const uint32_t first = (turn + 1) & (kSlots - 1);
+    const uint64_t rotated = first ? occupied_[level] >> first |
+                                         occupied_[level] << (kSlots - first)
+                                   : occupied_[level];
+    const uint32_t turns = __builtin_ctzll(rotated) + 1;
+    const uint32_t distance = ((turn + turns) << shift) - now_ms_;
+    if (!found || distance < nearest) nearest = distance;
+    found = true;
+  }
+  tick = now_ms_ + nearest;
+  return found;
+}
+
+inline void TimerWheel::tick_() {
+  ++now_ms_;
+  /* the upper levels move down first, in case one of them is due now */
+  for (int level = kLevels - 1; level > 0; --level) {
+    const int shift = kSlotBits * level;
+    if (now_ms_ & ((1ul << shift) - 1)) continue;
+    Timer* timer = take_(level, (now_ms_ >> shift) & (kSlots - 1));
+    while (timer) {
+      Timer* next = timer->next_;
+      place_(*timer);
+      timer = next;
+    }
+  }
+  /* a callback may cancel one of the fired timers, so they stay linked */
+  fired_ = take_(0, now_ms_ & (kSlots - 1));
+  for (Timer* timer = fired_; timer; timer = timer->next_) {
+    timer->list_ = &fired_;
+    timer->level_ = kFiring;
+  }
+  while (fired_) {
+    Timer& timer = *fired_;
+    unlink_(timer);
+    timer.callback_(timer.arg_);
+  }
+}
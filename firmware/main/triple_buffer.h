@@ -0,0 +1,52 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @brief Hands the latest value from one task over to another.
+ *
+ * Of the three slots, one belongs to the writer, one to the reader, and the
+ * third holds the value published last. publish() swaps the writer's slot
+ * with it, and read() swaps the reader's slot with it if it is newer than
+ * what the reader has. Neither side ever waits for the other or sees a slot
+ * being written; values the reader did not get to are skipped.
+ */
+template <typename T>
+class TripleBuffer {
+ public:
+  /* writer side */
+  T& back() { return slots_[back_]; }
+  void publish() {
+    const uint8_t middle =
+        middle_.exchange(back_ | kFresh, std::memory_order_acq_rel);
+    back_ = middle & kIndexMask;
+  }
+  void publish(const T& value) {
+    back() = value;
+    publish();
+  }
+
+  /* reader side, the reference is valid until the next read() */
+  const T& read() {
+    if (middle_.load(std::memory_order_relaxed) & kFresh) {
+      const uint8_t middle =
+          middle_.exchange(front_, std::memory_order_acq_rel);
+      front_ = middle & kIndexMask;
+    }
+    return slots_[front_];
+  }
+
+ private:
+  static constexpr const uint8_t kIndexMask = 0x03;
+  static constexpr const uint8_t kFresh = 0x04;  //< not read yet
+
+  T slots_[3] = {};
+  uint8_t back_ = 0;  //< writer only
+  std::atomic<uint8_t> middle_{1};
+  uint8_t front_ = 2;  //< reader only
+};
@@ -0,0 +1,63 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+/* the part of the Arduino core the tested modules use, for the host */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <freertos/FreeRTOS.h>
+
+#include "app_clock.h"
+
+#define IRAM_ATTR
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define INPUT_PULLDOWN 0x09
+#define OUTPUT 0x03
+#define CHANGE 0x03
+
+inline unsigned long millis() { return AppClock::millis(); }
+inline unsigned long micros() { return AppClock::micros(); }
+/* nothing else runs on the virtual clock, so a delay moves it */
+inline void delay(uint32_t ms) { AppClock::advance(int64_t(ms) * 1000); }
+inline void delayMicroseconds(uint32_t us) { AppClock::advance(us); }
+inline void yield() {}
+
+/* the levels of the pins, for a test to drive the inputs */
+inline uint8_t arduino_stub_pins[64] = {};
+
+inline void pinMode(uint8_t, uint8_t) {}
+inline int digitalRead(uint8_t pin) { return arduino_stub_pins[pin]; }
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+  arduino_stub_pins[pin] = value;
+}
+inline uint16_t analogRead(uint8_t) { return 0; }
+inline void rgbLedWrite(uint8_t, uint8_t, uint8_t, uint8_t) {}
+inline bool rmtDeinit(int) { return true; }
+
+inline size_t strlcpy(char* dst, const char* src, size_t size) {
+  const size_t length = strlen(src);
+  if (size) {
+    const size_t n = std::min(length, size - 1);
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return length;
+}
@@ -0,0 +1,91 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+/* NVS in memory, one namespace per instance */
+class Preferences {
+ public:
+  bool begin(const char*, bool read_only = false) {
+    read_only_ = read_only;
+    return true;
+  }
+  void end() {}
+  bool clear() {
+    values_.clear();
+    return true;
+  }
+  bool isKey(const char* key) const { return values_.count(key); }
+  bool remove(const char* key) { return values_.erase(key); }
+
+  size_t putBytes(const char* key, const void* value, size_t size) {
+    if (read_only_) return 0;
+    const auto* bytes = static_cast<const uint8_t*>(value);
+    values_[key].assign(bytes, bytes + size);
+    return size;
+  }
+  size_t getBytesLength(const char* key) const {
+    const auto it = values_.find(key);
+    return it == values_.end() ? 0 : it->second.size();
+  }
+  size_t getBytes(const char* key, void* buffer, size_t size) const {
+    const auto it = values_.find(key);
+    if (it == values_.end() || it->second.size() > size) return 0;
+    memcpy(buffer, it->second.data(), it->second.size());
+    return it->second.size();
+  }
+
+  size_t putBool(const char* key, bool value) { return put_(key, value); }
+  bool getBool(const char* key, bool value = false) const {
+    return get_(key, value);
+  }
+  size_t putUChar(const char* key, uint8_t value) { return put_(key, value); }
+  uint8_t getUChar(const char* key, uint8_t value = 0) const {
+    return get_(key, value);
+  }
+  size_t putInt(const char* key, int32_t value) { return put_(key, value); }
+  int32_t getInt(const char* key, int32_t value = 0) const {
+    return get_(key, value);
+  }
+  size_t putUInt(const char* key, uint32_t value) { return put_(key, value); }
+  uint32_t getUInt(const char* key, uint32_t value = 0) const {
+    return get_(key, value);
+  }
+  size_t putFloat(const char* key, float value) { return put_(key, value); }
+  float getFloat(const char* key, float value = 0.0f) const {
+    return get_(key, value);
+  }
+  size_t putString(const char* key, const char* value) {
+    return putBytes(key, value, strlen(value));
+  }
+  size_t getString(const char* key, char* value, size_t size) const {
+    const auto it = values_.find(key);
+    if (it == values_.end() || it->second.size() >= size) return 0;
+    memcpy(value, it->second.data(), it->second.size());
+    value[it->second.size()] = '\0';
+    return it->second.size() + 1;
+  }
+
+ private:
+  std::map<std::string, std::vector<uint8_t>> values_;
+  bool read_only_ = false;
+
+  template <typename T>
+  size_t put_(const char* key, T value) {
+    return putBytes(key, &value, sizeof(value));
+  }
+  template <typename T>
+  T get_(const char* key, T value) const {
+    const auto it = values_.find(key);
+    if (it == values_.end() || it->second.size() != sizeof(T)) return value;
+    memcpy(&value, it->second.data(), sizeof(T));
+    return value;
+  }
+};
@@ -0,0 +1,73 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <algorithm>
+
+#include "driver/rmt_types.h"
+
+typedef struct {
+  gpio_num_t gpio_num;
+  rmt_clock_source_t clk_src;
+  uint32_t resolution_hz;
+  size_t mem_block_symbols;
+  int intr_priority;
+  struct {
+    uint32_t invert_in : 1;
+    uint32_t with_dma : 1;
+  } flags;
+} rmt_rx_channel_config_t;
+typedef struct {
+  rmt_symbol_word_t* received_symbols;
+  size_t num_symbols;
+  struct {
+    uint32_t is_last : 1;
+  } flags;
+} rmt_rx_done_event_data_t;
+typedef bool (*rmt_rx_done_callback_t)(rmt_channel_handle_t,
+                                       const rmt_rx_done_event_data_t*,
+                                       void*);
+typedef struct {
+  rmt_rx_done_callback_t on_recv_done;
+} rmt_rx_event_callbacks_t;
+typedef struct {
+  uint32_t signal_range_min_ns;
+  uint32_t signal_range_max_ns;
+  struct {
+    uint32_t en_partial_rx : 1;
+  } flags;
+} rmt_receive_config_t;
+
+inline esp_err_t rmt_new_rx_channel(const rmt_rx_channel_config_t* config,
+                                    rmt_channel_handle_t* channel) {
+  *channel = &rmt_stub_channels.emplace_back();
+  (*channel)->gpio_num = config->gpio_num;
+  return 0;
+}
+inline esp_err_t rmt_rx_register_event_callbacks(
+    rmt_channel_handle_t channel, const rmt_rx_event_callbacks_t* callbacks,
+    void* user_data) {
+  channel->rx_callback = reinterpret_cast<void*>(callbacks->on_recv_done);
+  channel->rx_user_data = user_data;
+  return 0;
+}
+inline esp_err_t rmt_receive(rmt_channel_handle_t channel, void* buffer,
+                             size_t size, const rmt_receive_config_t*) {
+  channel->rx_buffer = static_cast<rmt_symbol_word_t*>(buffer);
+  channel->rx_buffer_size = size / sizeof(rmt_symbol_word_t);
+  return 0;
+}
+
+/* the driver has received symbols into the buffer, as from its ISR */
+inline bool rmt_stub_receive(rmt_channel_handle_t channel,
+                             const rmt_symbol_word_t* symbols, size_t count,
+                             bool last) {
+  if (!channel->rx_callback || count > channel->rx_buffer_size) return false;
+  std::copy(symbols, symbols + count, channel->rx_buffer);
+  rmt_rx_done_event_data_t edata{channel->rx_buffer, count, {last}};
+  reinterpret_cast<rmt_rx_done_callback_t>(channel->rx_callback)(
+      channel, &edata, channel->rx_user_data);
+  return true;
+}
@@ -0,0 +1,91 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include "driver/rmt_types.h"
+
+typedef struct {
+  gpio_num_t gpio_num;
+  rmt_clock_source_t clk_src;
+  uint32_t resolution_hz;
+  size_t mem_block_symbols;
+  size_t trans_queue_depth;
+  int intr_priority;
+  struct {
+    uint32_t invert_out : 1;
+    uint32_t with_dma : 1;
+  } flags;
+} rmt_tx_channel_config_t;
+typedef struct {
+  size_t num_symbols;
+} rmt_tx_done_event_data_t;
+typedef bool (*rmt_tx_done_callback_t)(rmt_channel_handle_t,
+                                       const rmt_tx_done_event_data_t*,
+                                       void*);
+typedef struct {
+  rmt_tx_done_callback_t on_trans_done;
+} rmt_tx_event_callbacks_t;
+typedef struct {
+} rmt_copy_encoder_config_t;
+typedef struct {
+  uint32_t frequency_hz;
+  float duty_cycle;
+  struct {
+    uint32_t polarity_active_low : 1;
+    uint32_t always_on : 1;
+  } flags;
+} rmt_carrier_config_t;
+typedef struct {
+  int loop_count;
+  struct {
+    uint32_t eot_level : 1;
+    uint32_t queue_nonblocking : 1;
+  } flags;
+} rmt_transmit_config_t;
+
+/* in the order they were created, for the tests to look at */
+inline std::vector<rmt_channel_handle_t> rmt_stub_tx_channels;
+
+inline esp_err_t rmt_new_tx_channel(const rmt_tx_channel_config_t* config,
+                                    rmt_channel_handle_t* channel) {
+  *channel = &rmt_stub_channels.emplace_back();
+  (*channel)->gpio_num = config->gpio_num;
+  rmt_stub_tx_channels.push_back(*channel);
+  return 0;
+}
+inline esp_err_t rmt_tx_register_event_callbacks(
+    rmt_channel_handle_t, const rmt_tx_event_callbacks_t*, void*) {
+  return 0;
+}
+inline esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t*,
+                                      rmt_encoder_handle_t* encoder) {
+  static rmt_encoder_t copy_encoder;
+  *encoder = &copy_encoder;
+  return 0;
+}
+inline esp_err_t rmt_apply_carrier(rmt_channel_handle_t,
+                                   const rmt_carrier_config_t*) {
+  return 0;
+}
+inline esp_err_t rmt_enable(rmt_channel_handle_t channel) {
+  channel->enabled = true;
+  return 0;
+}
+inline esp_err_t rmt_disable(rmt_channel_handle_t channel) {
+  channel->enabled = false;
+  return 0;
+}
+/* done at once, the caller sees the channel busy until onTxDone */
+inline esp_err_t rmt_transmit(rmt_channel_handle_t channel,
+                              rmt_encoder_handle_t, const void* payload,
+                              size_t size, const rmt_transmit_config_t*) {
+  const auto* symbols = static_cast<const rmt_symbol_word_t*>(payload);
+  channel->transmitted.emplace_back(
+      symbols, symbols + size / sizeof(rmt_symbol_word_t));
+  return 0;
+}
+inline esp_err_t rmt_tx_wait_all_done(rmt_channel_handle_t, int) {
+  return 0;
+}
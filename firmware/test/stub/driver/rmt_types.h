@@ -0,0 +1,45 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+/* the RMT driver of ESP-IDF, recording what it is given, for the host */
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+typedef int esp_err_t;
+typedef int gpio_num_t;
+
+typedef union {
+  struct {
+    uint16_t duration0 : 15;
+    uint16_t level0 : 1;
+    uint16_t duration1 : 15;
+    uint16_t level1 : 1;
+  };
+  uint32_t val;
+} rmt_symbol_word_t;
+
+typedef enum { RMT_CLK_SRC_DEFAULT } rmt_clock_source_t;
+
+struct rmt_channel_t {
+  int gpio_num = -1;
+  bool enabled = false;
+  std::vector<std::vector<rmt_symbol_word_t>> transmitted;
+  /* a receiver: where rmt_receive() was asked to put the symbols, and the
+   * callback to tell of them, see rmt_stub_receive() */
+  void* rx_callback = nullptr;
+  void* rx_user_data = nullptr;
+  rmt_symbol_word_t* rx_buffer = nullptr;
+  size_t rx_buffer_size = 0;
+};
+struct rmt_encoder_t {};
+typedef rmt_channel_t* rmt_channel_handle_t;
+typedef rmt_encoder_t* rmt_encoder_handle_t;
+
+/* every channel created, they live as long as the test */
+inline std::deque<rmt_channel_t> rmt_stub_channels;
@@ -0,0 +1,94 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+/* the partition API of ESP-IDF over a flash image in RAM, for the host */
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+typedef int esp_err_t;
+#ifndef ESP_OK
+#define ESP_OK 0
+#define ESP_FAIL -1
+#endif
+
+typedef enum { ESP_PARTITION_TYPE_DATA = 0x01 } esp_partition_type_t;
+typedef int esp_partition_subtype_t;
+typedef enum { ESP_PARTITION_MMAP_DATA } esp_partition_mmap_memory_t;
+typedef uint32_t esp_partition_mmap_handle_t;
+
+typedef struct {
+  uint32_t size;
+  uint32_t erase_size;
+} esp_partition_t;
+
+/* the one partition there is, erased to 0xFF as a new chip is */
+struct esp_partition_stub_t {
+  esp_partition_t partition = {0, 4096};
+  std::vector<uint8_t> flash;
+  bool present = true;
+  int writes_left = -1;  //< fails the writes after that many, if not -1
+  int erase_count = 0;
+  std::function<void()> on_access;  //< before every erase and write
+
+  void reset(uint32_t size) {
+    partition.size = size;
+    flash.assign(size, 0xFF);
+    present = true;
+    writes_left = -1;
+    erase_count = 0;
+    on_access = nullptr;
+  }
+};
+inline esp_partition_stub_t esp_partition_stub;
+
+inline const esp_partition_t* esp_partition_find_first(
+    esp_partition_type_t, esp_partition_subtype_t, const char*) {
+  return esp_partition_stub.present ? &esp_partition_stub.partition
+                                    : nullptr;
+}
+
+inline esp_err_t esp_partition_mmap(const esp_partition_t*, size_t offset,
+                                    size_t size, esp_partition_mmap_memory_t,
+                                    const void** ptr,
+                                    esp_partition_mmap_handle_t* handle) {
+  auto& stub = esp_partition_stub;
+  if (offset + size > stub.flash.size()) return ESP_FAIL;
+  *ptr = stub.flash.data() + offset;
+  *handle = 1;
+  return ESP_OK;
+}
+
+inline void esp_partition_munmap(esp_partition_mmap_handle_t) {}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t* partition,
+                                           size_t offset, size_t size) {
+  auto& stub = esp_partition_stub;
+  if (stub.on_access) stub.on_access();
+  if (offset % partition->erase_size || size % partition->erase_size ||
+      offset + size > stub.flash.size()) {
+    return ESP_FAIL;
+  }
+  memset(stub.flash.data() + offset, 0xFF, size);
+  ++stub.erase_count;
+  return ESP_OK;
+}
+
+/* NOR flash: a write only clears bits */
+inline esp_err_t esp_partition_write(const esp_partition_t*, size_t offset,
+                                     const void* data, size_t size) {
+  auto& stub = esp_partition_stub;
+  if (stub.on_access) stub.on_access();
+  if (offset + size > stub.flash.size()) return ESP_FAIL;
+  if (stub.writes_left == 0) return ESP_FAIL;
+  if (stub.writes_left > 0) --stub.writes_left;
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; ++i) stub.flash[offset + i] &= bytes[i];
+  return ESP_OK;
+}
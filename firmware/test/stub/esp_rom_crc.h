@@ -0,0 +1,21 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/* CRC-32 as the ROM computes it, with the running value not inverted */
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf,
+                                 uint32_t len) {
+  crc = ~crc;
+  for (uint32_t i = 0; i < len; ++i) {
+    crc ^= buf[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
@@ -0,0 +1,23 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <atomic>
+
+/* a spinlock, as the critical sections of the dual-core port are */
+struct portMUX_TYPE {
+  std::atomic<bool> locked{false};
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {
+  while (mux->locked.exchange(true, std::memory_order_acquire)) {
+  }
+}
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+  mux->locked.store(false, std::memory_order_release);
+}
+#define portENTER_CRITICAL_ISR portENTER_CRITICAL
+#define portEXIT_CRITICAL_ISR portEXIT_CRITICAL
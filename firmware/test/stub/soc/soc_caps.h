@@ -0,0 +1,12 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+/* the capabilities of the ESP32-C6, the default target */
+#define SOC_RMT_MEM_WORDS_PER_CHANNEL 48
+#define SOC_RMT_TX_CANDIDATES_PER_GROUP 2
+#define SOC_RMT_RX_CANDIDATES_PER_GROUP 2
+#define SOC_ADC_DIGI_RESULT_BYTES 4
+#define SOC_CPU_CORES_NUM 1
@@ -0,0 +1,201 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "brightness_filter.h"
+#include "test_utils.h"
+
+/*
+ * Runs sample streams through the brightness filter, as the conversion
+ * callback of BrightnessSensor does: 12-bit samples at kSampleRateHz, one
+ * output per kOversample of them. Given a file of raw samples, one per line
+ * or separated by commas, it replays that instead and prints the outputs:
+ *
+ *   ./test_brightness_filter samples.txt
+ */
+
+static constexpr int kSampleRateHz = 1000;  //< BrightnessSensor's
+static constexpr int kOversample = BrightnessFilter::kOversample;
+
+/* a small deterministic generator, the streams are the same every time */
+static uint32_t nextRandom(uint32_t& state) {
+  state = state * 1664525u + 1013904223u;
+  return state >> 8;
+}
+
+/* a level with noise of +-noise, as the phototransistor reads in a room */
+static std::vector<uint16_t> noisy(int level, int noise, int outputs,
+                                   uint32_t& state) {
+  std::vector<uint16_t> samples;
+  for (int i = 0; i < outputs * kOversample; ++i) {
+    const int value = level + int(nextRandom(state) % (2 * noise + 1)) - noise;
+    samples.push_back(std::clamp(value, 0, int(BrightnessFilter::kSampleMax)));
+  }
+  return samples;
+}
+
+/* the output after each kOversample samples */
+static std::vector<uint16_t> run(BrightnessFilter& filter,
+                                 const std::vector<uint16_t>& samples) {
+  std::vector<uint16_t> outputs;
+  for (const uint16_t sample : samples) {
+    const uint32_t before = filter.outputCount();
+    filter.add(sample);
+    if (filter.outputCount() != before) outputs.push_back(filter.sample());
+  }
+  return outputs;
+}
+
+static void range(const std::vector<uint16_t>& values, size_t from, int& min,
+                  int& max) {
+  min = INT32_MAX;
+  max = INT32_MIN;
+  for (size_t i = from; i < values.size(); ++i) {
+    min = std::min<int>(min, values[i]);
+    max = std::max<int>(max, values[i]);
+  }
+}
+
+/* the noise of the room averages out, from the first output on */
+static void testSteady() {
+  uint32_t state = 1;
+  BrightnessFilter filter;
+  TEST_EXPECT(!filter.ready());
+  const auto outputs = run(filter, noisy(2000, 60, 100, state));
+  TEST_EXPECT(filter.ready());
+  TEST_EXPECT_EQ(outputs.size(), 100);
+  int min, max;
+  range(outputs, 0, min, max);
+  printf("steady   2000 +-60 -> %d..%d\n", min, max);
+  TEST_EXPECT(min >= 2000 - 20 && max <= 2000 + 20);
+  const float normalized = filter.normalized();
+  TEST_EXPECT(std::fabs(normalized - 2000.0f / 4095) < 0.005f);
+}
+
+/* a fluorescent lamp on 50 Hz mains flickers at 100 Hz, deep */
+static void testFlicker() {
+  std::vector<uint16_t> samples;
+  for (int i = 0; i < 200 * kOversample; ++i) {
+    const double t = double(i) / kSampleRateHz;
+    samples.push_back(2000 + 600 * std::sin(2 * M_PI * 100 * t + 0.3));
+  }
+  BrightnessFilter filter;
+  const auto outputs = run(filter, samples);
+  int min, max;
+  range(outputs, 10, min, max);
+  printf("flicker  2000 +-600 -> %d..%d\n", min, max);
+  TEST_EXPECT(max - min <= 2 * 41);  //< 2 % of the full scale
+  TEST_EXPECT(min >= 2000 - 41 && max <= 2000 + 41);
+}
+
+/* a camera flash over a whole output, or a glitch of a single sample */
+static void testSpikes() {
+  uint32_t state = 2;
+  auto samples = noisy(1000, 20, 60, state);
+  for (int i = 20 * kOversample; i < 21 * kOversample; ++i) {
+    samples[i] = BrightnessFilter::kSampleMax;
+  }
+  samples[40 * kOversample + 7] = BrightnessFilter::kSampleMax;
+  samples[45 * kOversample + 3] = 0;
+  BrightnessFilter filter;
+  const auto outputs = run(filter, samples);
+  int min, max;
+  range(outputs, 0, min, max);
+  printf("spikes   1000 +-20 -> %d..%d\n", min, max);
+  TEST_EXPECT(min >= 1000 - 10 && max <= 1000 + 10);
+}
+
+/* the light turned on, 500 to 3000, with no overshoot */
+static void testStep() {
+  uint32_t state = 3;
+  auto samples = noisy(500, 20, 20, state);
+  const auto after = noisy(3000, 20, 40, state);
+  samples.insert(samples.end(), after.begin(), after.end());
+  BrightnessFilter filter;
+  const auto outputs = run(filter, samples);
+  int settled = -1;  //< outputs after the step to within 1 %
+  for (size_t i = 20; i < outputs.size(); ++i) {
+    TEST_EXPECT(outputs[i] + 10 >= outputs[i - 1]);
+    TEST_EXPECT(outputs[i] <= 3000 + 10);
+    if (settled < 0 && outputs[i] >= 3000 - 41) settled = i - 20;
+  }
+  printf("step     500 -> 3000 in %d outputs (%d ms)\n", settled + 1,
+         (settled + 1) * kOversample * 1000 / kSampleRateHz);
+  /* the median holds it one output, the IIR takes the rest */
+  TEST_EXPECT(settled >= 0 && settled <= 16);
+  /* and back down the same way */
+  const auto down = run(filter, noisy(500, 20, 40, state));
+  TEST_EXPECT(down.back() <= 500 + 10);
+  TEST_EXPECT(down[0] >= 3000 - 41);
+}
+
+/* out-of-range samples count as the full scale */
+static void testSaturation() {
+  BrightnessFilter filter;
+  run(filter, std::vector<uint16_t>(8 * kOversample, 0xFFFF));
+  TEST_EXPECT_EQ(filter.sample(), BrightnessFilter::kSampleMax);
+  TEST_EXPECT(filter.normalized() <= 1.0f);
+  TEST_EXPECT(filter.normalized() > 0.999f);
+}
+
+/* after a reset, the first output is the level, not a ramp from the last */
+static void testReset() {
+  uint32_t state = 4;
+  BrightnessFilter filter;
+  run(filter, noisy(3500, 20, 20, state));
+  filter.reset();
+  TEST_EXPECT(!filter.ready());
+  TEST_EXPECT_EQ(filter.outputCount(), 0);
+  const auto outputs = run(filter, noisy(300, 20, 1, state));
+  TEST_EXPECT_EQ(outputs.size(), 1);
+  if (outputs.empty()) return;
+  TEST_EXPECT(outputs[0] >= 300 - 10 && outputs[0] <= 300 + 10);
+}
+
+static int replayFile(const char* path) {
+  std::ifstream file(path);
+  std::vector<uint16_t> samples;
+  std::string line;
+  while (std::getline(file, line)) {
+    for (size_t i = 0; i < line.size();) {
+      if (!isdigit(static_cast<unsigned char>(line[i]))) {
+        ++i;
+        continue;
+      }
+      size_t length;
+      samples.push_back(std::stoul(line.substr(i), &length));
+      i += length;
+    }
+  }
+  if (samples.size() < size_t(kOversample)) {
+    fprintf(stderr, "%s: less than %d samples\n", path, kOversample);
+    return 1;
+  }
+  BrightnessFilter filter;
+  const auto outputs = run(filter, samples);
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    printf("%6u ms %4u\n", unsigned((i + 1) * kOversample * 1000 /
+                                    kSampleRateHz),
+           outputs[i]);
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) return replayFile(argv[1]);
+  TEST_RUN(testSteady);
+  TEST_RUN(testFlicker);
+  TEST_RUN(testSpikes);
+  TEST_RUN(testStep);
+  TEST_RUN(testSaturation);
+  TEST_RUN(testReset);
+  return TEST_RESULT();
+}
@@ -0,0 +1,189 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "brightness_step_detector.h"
+#include "smart_light_verifier.h"
+#include "test_utils.h"
+
+/*
+ * Runs brightness traces through the step detector and the verifier. The
+ * traces are in the format of `verify dump`: the brightness x1000, one
+ * sample every SmartLightVerifier::kSamplePeriodMs. Given a dump saved to a
+ * file, it replays that instead and reports where the step was detected:
+ *
+ *   ./test_brightness_step_detector on|off dump.txt
+ */
+
+using Direction = BrightnessStepDetector::Direction;
+
+struct Trace {
+  const char* name;
+  Direction direction;
+  const char* before;  //< samples before the frame, the baseline
+  const char* after;   //< samples from the frame on
+  int detected_at;     //< sample of `after` the step is detected at, or -1
+};
+
+static const Trace kTraces[] = {
+    /* an LED ceiling lamp at night, on within a few samples */
+    {"led on", Direction::Up, "5,5,5,5,5,5,5,5",
+     "5,5,5,5,45,107,117,114,113,112,113,112,112", 6},
+    /* a fluorescent lamp that ramps up over a second and flickers */
+    {"ramp on", Direction::Up, "8,7,8,7,8,7,7,8",
+     "7,8,7,11,15,18,24,27,32,37,44,50,58,65,72,83,90,96,98,100,99,101", 8},
+    /* turned off in daylight, which stays */
+    {"day off", Direction::Down, "153,151,149,152,151,152,150,151",
+     "151,151,150,149,147,135,126,122,122,123,121,122", 7},
+    /* the light off at night, down to the glow of a standby LED */
+    {"night off", Direction::Down, "113,112,113,112,112,113,112,113",
+     "112,112,113,30,4,2,2,2,2", 5},
+    /* a camera flash or a passing headlight, one sample long */
+    {"spike", Direction::Up, "10,10,10,10,10,10,10,10",
+     "10,10,10,10,97,10,10,10,10,10,10,10,10,10,10,10", -1},
+    /* clouds over a bright room, the lamp does not respond */
+    {"clouds", Direction::Up, "128,132,124,130,135,126,129,131",
+     "133,136,130,127,134,137,135,132,128,125,130,137,135,129,126,128", -1},
+    /* a lamp too dim to tell from the daylight */
+    {"too dim", Direction::Up, "175,174,176,175,175,176,175,175",
+     "175,175,175,175,181,182,182,182,182,183,182,181", -1},
+};
+
+static std::vector<float> parse(const std::string& text) {
+  std::vector<float> samples;
+  std::stringstream stream(text);
+  std::string value;
+  while (std::getline(stream, value, ',')) {
+    if (!value.empty()) samples.push_back(std::stof(value) / 1000.0f);
+  }
+  return samples;
+}
+
+/* the sample of `after` the step is detected at, or -1 */
+static int detect(const std::vector<float>& before,
+                  const std::vector<float>& after, Direction direction) {
+  BrightnessStepDetector detector;
+  for (const float value : before) detector.add(value);
+  detector.arm(direction);
+  for (size_t i = 0; i < after.size(); ++i) {
+    detector.add(after[i]);
+    if (detector.detected()) return i;
+  }
+  return -1;
+}
+
+static void testTraces() {
+  for (const auto& trace : kTraces) {
+    const int at =
+        detect(parse(trace.before), parse(trace.after), trace.direction);
+    printf("%-10s detected at %d (expected %d)\n", trace.name, at,
+           trace.detected_at);
+    TEST_EXPECT_EQ(at, trace.detected_at);
+  }
+}
+
+/* the history is taken while disarmed only, and starts over on every arm */
+static void testBaseline() {
+  BrightnessStepDetector detector;
+  detector.arm(Direction::Up);
+  TEST_EXPECT(detector.baseline() == 0.0f);
+  for (int i = 0; i < BrightnessStepDetector::kHistorySize * 2; ++i) {
+    detector.add(i < BrightnessStepDetector::kHistorySize ? 0.9f : 0.1f);
+  }
+  detector.disarm();
+  for (int i = 0; i < 4; ++i) detector.add(0.2f);
+  detector.arm(Direction::Down);
+  TEST_EXPECT(detector.baseline() > 0.199f && detector.baseline() < 0.201f);
+  TEST_EXPECT(!detector.detected());
+  for (int i = 0; i < BrightnessStepDetector::kSettleSamples; ++i) {
+    TEST_EXPECT(!detector.detected());
+    detector.add(0.1f);
+  }
+  TEST_EXPECT(detector.detected());
+  TEST_EXPECT(detector.step() < -0.099f);
+  detector.disarm();
+  TEST_EXPECT(!detector.detected());
+}
+
+/* the verifier on the virtual clock, the frame on air for 4 samples, then
+ * the trace held at its last sample */
+static SmartLightVerifier::Result verify(SmartLightVerifier& verifier,
+                                         const Trace& trace, int& retries) {
+  const auto before = parse(trace.before);
+  const auto after = parse(trace.after);
+  const uint32_t period_us = SmartLightVerifier::kSamplePeriodMs * 1000;
+  for (const float value : before) {
+    AppClock::advance(period_us);
+    verifier.handle(value, false);
+  }
+  verifier.expect(trace.direction == Direction::Up);
+  retries = 0;
+  for (size_t i = 0; i < 1000; ++i) {
+    AppClock::advance(period_us);
+    const auto result = verifier.handle(after[std::min(i, after.size() - 1)],
+                                        i < 4);
+    if (result == SmartLightVerifier::Result::Retry) ++retries;
+    if (result == SmartLightVerifier::Result::Confirmed ||
+        result == SmartLightVerifier::Result::Desync) {
+      return result;
+    }
+  }
+  return SmartLightVerifier::Result::None;
+}
+
+static void testVerifier() {
+  AppClock::set(1'000'000);
+  SmartLightVerifier verifier;
+  int retries;
+  for (const auto& trace : kTraces) {
+    const auto result = verify(verifier, trace, retries);
+    if (trace.detected_at >= 0) {
+      TEST_EXPECT(result == SmartLightVerifier::Result::Confirmed);
+      TEST_EXPECT_EQ(retries, 0);
+    } else {
+      TEST_EXPECT(result == SmartLightVerifier::Result::Desync);
+      TEST_EXPECT_EQ(retries, SmartLightVerifier::kMaxRetries);
+    }
+    TEST_EXPECT(!verifier.active());
+  }
+  TEST_EXPECT_EQ(verifier.getDesyncCount(), 3);
+}
+
+static int replayFile(const char* on_off, const char* path) {
+  std::ifstream file(path);
+  std::string text, line;
+  while (std::getline(file, line)) {
+    /* the samples, without the log lines around them */
+    if (isdigit(static_cast<unsigned char>(line[0]))) text += line + ",";
+  }
+  const auto samples = parse(text);
+  if (samples.empty()) {
+    fprintf(stderr, "%s: no samples\n", path);
+    return 1;
+  }
+  /* a dump starts at the frame, the lamp cannot have responded yet */
+  const std::vector<float> before(samples.begin(), samples.begin() + 1);
+  const bool on = strcmp(on_off, "on") == 0;
+  const int at = detect(before, samples, on ? Direction::Up : Direction::Down);
+  if (at < 0) {
+    printf("%s: no step %s\n", path, on ? "up" : "down");
+  } else {
+    printf("%s: step %s detected at %d (%u ms)\n", path, on ? "up" : "down",
+           at, unsigned(at * SmartLightVerifier::kSamplePeriodMs));
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 2) return replayFile(argv[1], argv[2]);
+  TEST_RUN(testTraces);
+  TEST_RUN(testBaseline);
+  TEST_RUN(testVerifier);
+  return TEST_RESULT();
+}
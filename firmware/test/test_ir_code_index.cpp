@@ -0,0 +1,170 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include <chrono>
+#include <deque>
+
+#include "ir_code_index.h"
+#include "test_utils.h"
+
+using IRData = IRRemote::IRData;
+
+/* a pulse distance protocol none of the decoders knows, T = 500 us */
+static IRData makeFrame(uint32_t payload) {
+  IRData data = {5000, 2500};
+  for (int i = 0; i < 32; ++i) {
+    data.push_back(500);
+    data.push_back((payload >> i) & 1 ? 1500 : 500);
+  }
+  data.push_back(500);
+  return data;
+}
+
+static bool findLinear(const std::deque<IRCode>& codes,
+                       const IRCode& received, IRCodeIndex::Id& id) {
+  for (size_t i = 0; i < codes.size(); ++i) {
+    if (IRProtocolCodec::matches(received, codes[i])) {
+      id = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* learned from one capture, found again under the jitter of every press */
+static void expectFound(int jitter_us) {
+  std::deque<IRCode> codes;
+  IRCodeIndex index;
+  for (int i = 0; i < 32; ++i) {
+    codes.push_back(IRProtocolCodec::fromRaw(capture(makeFrame(rand()), 80,
+                                                     0)));
+    TEST_EXPECT(codes.back().protocol == IRProtocol::Raw);
+    index.add(i, codes.back());
+  }
+  TEST_EXPECT_EQ(index.rawGroupCount(), 1);
+  int found = 0, found_linear = 0;
+  for (int n = 0; n < 200; ++n) {
+    const int expected = n % codes.size();
+    IRCode received;
+    received.raw = capture(codes[expected].raw, 0, jitter_us);
+    IRCodeIndex::Id id = UINT16_MAX, id_linear = UINT16_MAX;
+    found += index.find(received, id) && id == expected;
+    found_linear += findLinear(codes, received, id_linear);
+  }
+  TEST_EXPECT_EQ(found_linear, 200);
+  TEST_EXPECT_EQ(found, found_linear);
+}
+
+static void testJitter60() { expectFound(60); }
+static void testJitter120() { expectFound(120); }
+
+/* whatever the linear compare finds, the index finds too */
+static void testSameAsLinear() {
+  std::deque<IRCode> codes;
+  IRCodeIndex index;
+  for (int i = 0; i < 64; ++i) {
+    IRCode code = IRProtocolCodec::fromRaw(makeFrame(rand()));
+    if (i % 2) {
+      /* a learned template, with its own bound per element */
+      code.tolerance.assign(code.raw.size(), 150 + rand() % 200);
+    }
+    codes.push_back(code);
+    index.add(i, codes.back());
+  }
+  for (int n = 0; n < 20000; ++n) {
+    IRCode received;
+    /* near the ends of the ranges too, where widths are ambiguous */
+    received.raw = capture(codes[n % codes.size()].raw, 0, 50 + n % 400);
+    IRCodeIndex::Id id, id_linear;
+    const bool found = index.find(received, id);
+    TEST_EXPECT_EQ(found, findLinear(codes, received, id_linear));
+    if (found) TEST_EXPECT(IRProtocolCodec::matches(received, codes[id]));
+  }
+}
+
+static void testDecodedAndOtherLengths() {
+  std::deque<IRCode> codes;
+  IRCodeIndex index;
+  IRCode nec;
+  nec.protocol = IRProtocol::NEC;
+  nec.bits = 32;
+  nec.address = 0x10;
+  nec.command = 0xEF10;
+  codes.push_back(nec);
+  codes.push_back(IRProtocolCodec::fromRaw(makeFrame(0x1234)));
+  IRData shorter = makeFrame(0x1234);
+  shorter.resize(shorter.size() - 2);
+  codes.push_back(IRProtocolCodec::fromRaw(shorter));
+  codes.push_back(IRCode{});  //< not learned, not indexed
+  for (size_t i = 0; i < codes.size(); ++i) index.add(i, codes[i]);
+  TEST_EXPECT_EQ(index.size(), 3);
+  TEST_EXPECT_EQ(index.rawGroupCount(), 2);
+
+  IRData data;
+  IRProtocolCodec::encode(nec, data);
+  IRCodeIndex::Id id = UINT16_MAX;
+  TEST_EXPECT(index.find(IRProtocolCodec::fromRaw(data), id));
+  TEST_EXPECT_EQ(id, 0);
+  IRCode received;
+  received.raw = capture(shorter, 60, 60);
+  TEST_EXPECT(index.find(received, id));
+  TEST_EXPECT_EQ(id, 2);
+  received.raw = capture(makeFrame(0x1235), 60, 60);
+  TEST_EXPECT(!index.find(received, id));
+}
+
+/* the cost of a lookup, against verifying every code in turn */
+static void benchmark() {
+  using Clock = std::chrono::steady_clock;
+  for (const int count : {3, 32, 256}) {
+    std::deque<IRCode> codes;
+    IRCodeIndex index;
+    for (int i = 0; i < count; ++i) {
+      codes.push_back(IRProtocolCodec::fromRaw(capture(makeFrame(rand()),
+                                                       80, 0)));
+      index.add(i, codes.back());
+    }
+    std::vector<IRCode> received(256);
+    for (size_t i = 0; i < received.size(); ++i) {
+      received[i].raw = capture(codes[i % count].raw, 0, 120);
+    }
+    constexpr int kRounds = 20;
+    int found_index = 0, found_linear = 0;
+    auto start = Clock::now();
+    for (int r = 0; r < kRounds; ++r) {
+      for (const auto& code : received) {
+        IRCodeIndex::Id id;
+        found_linear += findLinear(codes, code, id);
+      }
+    }
+    const double linear_ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - start)
+            .count() /
+        (kRounds * received.size());
+    start = Clock::now();
+    for (int r = 0; r < kRounds; ++r) {
+      for (const auto& code : received) {
+        IRCodeIndex::Id id;
+        found_index += index.find(code, id);
+      }
+    }
+    const double index_ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - start)
+            .count() /
+        (kRounds * received.size());
+    TEST_EXPECT_EQ(found_index, found_linear);
+    printf("%3d codes: linear %8.0f ns, index %6.0f ns per lookup\n", count,
+           linear_ns, index_ns);
+  }
+}
+
+int main() {
+  srand(1);
+  TEST_RUN(testJitter60);
+  TEST_RUN(testJitter120);
+  TEST_RUN(testSameAsLinear);
+  TEST_RUN(testDecodedAndOtherLengths);
+  TEST_RUN(benchmark);
+  return TEST_RESULT();
+}
@@ -0,0 +1,324 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include <esp_rom_crc.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "ir_code_library.h"
+#include "ir_code_storage.h"
+#include "test_utils.h"
+
+/* as in config/partitions.csv: 8 sectors, a bank of 4 on either side */
+static constexpr uint32_t kPartitionSize = 0x8000;
+static constexpr uint32_t kBankSize = 4 * 4096;
+
+static uint32_t le(const uint8_t* p, int bytes) {
+  uint32_t value = 0;
+  for (int i = 0; i < bytes; ++i) value |= uint32_t(p[i]) << (8 * i);
+  return value;
+}
+
+static IRCode makeCode(uint32_t seed) {
+  IRCode code;
+  if (seed % 2) {
+    code.protocol = IRProtocol::NEC;
+    code.bits = 32;
+    code.address = seed & 0xFFFF;
+    code.command = (seed >> 8) & 0xFFFF;
+  } else {
+    /* a captured pulse distance frame, jitter and all */
+    code.protocol = IRProtocol::Raw;
+    code.raw = {9000, 4500};
+    for (int i = 0; i < 32; ++i) {
+      code.raw.push_back(560 + (seed * 7 + i * 13) % 60);
+      code.raw.push_back(((seed >> i) & 1 ? 1690 : 560) + (seed + i) % 60);
+    }
+    code.raw.push_back(560);
+  }
+  return code;
+}
+
+/* the library holds what the reference map does, in name order */
+static void expectContents(const IRCodeLibrary& library,
+                           const std::map<std::string, uint32_t>& expected) {
+  TEST_EXPECT_EQ(library.count(), expected.size());
+  size_t index = 0;
+  for (const auto& [name, seed] : expected) {
+    IRCodeLibrary::Entry entry;
+    TEST_EXPECT(library.entry(index, entry));
+    TEST_EXPECT(entry.name == name);
+    IRCodeLibrary::Entry found;
+    TEST_EXPECT(library.find(name.c_str(), found));
+    TEST_EXPECT_EQ(found.index, index);
+    std::vector<uint8_t> record;
+    IRCodeStorage::pack(makeCode(seed), record);
+    TEST_EXPECT_EQ(entry.size, record.size());
+    TEST_EXPECT(memcmp(entry.record, record.data(), record.size()) == 0);
+    ++index;
+  }
+}
+
+static void testEmpty() {
+  esp_partition_stub.reset(kPartitionSize);
+  IRCodeLibrary library;
+  TEST_EXPECT(library.begin());
+  TEST_EXPECT_EQ(library.count(), 0);
+  TEST_EXPECT_EQ(library.generation(), 0);
+  TEST_EXPECT_EQ(library.capacity(), kBankSize);
+  IRCodeLibrary::Entry entry;
+  TEST_EXPECT(!library.find("power", entry));
+  TEST_EXPECT(!library.remove("power"));
+
+  /* a partition table from before the library, kept by an OTA update */
+  esp_partition_stub.present = false;
+  IRCodeLibrary missing;
+  TEST_EXPECT(!missing.begin());
+  TEST_EXPECT(!missing.ready());
+  TEST_EXPECT_EQ(missing.count(), 0);
+  TEST_EXPECT(!missing.find("power", entry));
+  TEST_EXPECT(!missing.entry(0, entry));
+  TEST_EXPECT(!missing.put("power", makeCode(1)));
+  TEST_EXPECT(!missing.rename("power", "tv.power"));
+}
+
+/* the header and the index, byte by byte */
+static void testFormat() {
+  esp_partition_stub.reset(kPartitionSize);
+  IRCodeLibrary library;
+  library.begin();
+  TEST_EXPECT(library.put("tv.power", makeCode(1)));
+  TEST_EXPECT(library.put("aircon.off", makeCode(2)));
+  /* the first change goes into bank 0, the second into bank 1 */
+  const uint8_t* bank = esp_partition_stub.flash.data() + kBankSize;
+  TEST_EXPECT(memcmp(bank, "IRLB", 4) == 0);
+  TEST_EXPECT_EQ(bank[4], IRCodeLibrary::kVersion);
+  TEST_EXPECT_EQ(le(bank + 6, 2), 2);
+  TEST_EXPECT_EQ(le(bank + 8, 4), 2);  //< generation
+  const size_t size = le(bank + 12, 4);
+  TEST_EXPECT_EQ(size, library.usedBytes());
+  TEST_EXPECT_EQ(le(bank + 16, 4),
+                 esp_rom_crc32_le(0, bank + IRCodeLibrary::kHeaderSize,
+                                  size - IRCodeLibrary::kHeaderSize));
+  /* sorted by name, records right after the index, in index order */
+  const uint8_t* e = bank + IRCodeLibrary::kHeaderSize;
+  TEST_EXPECT(strcmp(reinterpret_cast<const char*>(e), "aircon.off") == 0);
+  TEST_EXPECT_EQ(le(e + 24, 4),
+                 IRCodeLibrary::kHeaderSize + 2 * IRCodeLibrary::kEntrySize);
+  e += IRCodeLibrary::kEntrySize;
+  TEST_EXPECT(strcmp(reinterpret_cast<const char*>(e), "tv.power") == 0);
+  TEST_EXPECT_EQ(le(e + 24, 4), le(e - 8, 4) + le(e - 4, 2));
+  TEST_EXPECT_EQ(le(e + 24, 4) + le(e + 28, 2), size);
+  /* and each record is an IRCodeStorage record */
+  IRCode code;
+  TEST_EXPECT(IRCodeStorage::unpack(bank + le(e + 24, 4), le(e + 28, 2),
+                                    code));
+  TEST_EXPECT(code.protocol == IRProtocol::NEC);
+  TEST_EXPECT_EQ(code.address, 1);
+}
+
+static void testChanges() {
+  esp_partition_stub.reset(kPartitionSize);
+  IRCodeLibrary library;
+  library.begin();
+  std::map<std::string, uint32_t> expected;
+  for (uint32_t n = 0; n < 300; ++n) {
+    const std::string name = "code" + std::to_string(rand() % 40);
+    const int action = rand() % 4;
+    if (action == 0) {
+      TEST_EXPECT_EQ(library.remove(name.c_str()), expected.erase(name) == 1);
+    } else if (action == 1) {
+      const std::string to = "code" + std::to_string(rand() % 40);
+      const bool ok = expected.count(name) && !expected.count(to);
+      TEST_EXPECT_EQ(library.rename(name.c_str(), to.c_str()), ok);
+      if (ok) {
+        expected[to] = expected[name];
+        expected.erase(name);
+      }
+    } else {
+      TEST_EXPECT(library.put(name.c_str(), makeCode(n)));
+      expected[name] = n;
+    }
+  }
+  expectContents(library, expected);
+  /* after a reboot, the newer bank wins */
+  IRCodeLibrary reloaded;
+  TEST_EXPECT(reloaded.begin());
+  TEST_EXPECT_EQ(reloaded.generation(), library.generation());
+  expectContents(reloaded, expected);
+}
+
+static void testNames() {
+  TEST_EXPECT(IRCodeLibrary::isValidName("living.tv-power_2"));
+  TEST_EXPECT(!IRCodeLibrary::isValidName(""));
+  TEST_EXPECT(!IRCodeLibrary::isValidName("with space"));
+  TEST_EXPECT(!IRCodeLibrary::isValidName("a/b"));
+  TEST_EXPECT(IRCodeLibrary::isValidName("abcdefghijklmnopqrstuvw"));
+  TEST_EXPECT(!IRCodeLibrary::isValidName("abcdefghijklmnopqrstuvwx"));
+}
+
+/* an interrupted write leaves the previous library in place */
+static void testInterrupted() {
+  esp_partition_stub.reset(kPartitionSize);
+  std::map<std::string, uint32_t> expected;
+  {
+    IRCodeLibrary library;
+    library.begin();
+    for (uint32_t n = 0; n < 8; ++n) {
+      const std::string name = "code" + std::to_string(n);
+      library.put(name.c_str(), makeCode(n));
+      expected[name] = n;
+    }
+  }
+  /* cut off after every write of the change in turn, the last one is the
+   * header that commits it */
+  for (int writes = 0;; ++writes) {
+    IRCodeLibrary library;
+    library.begin();
+    const uint32_t generation = library.generation();
+    esp_partition_stub.writes_left = writes;
+    const bool done = library.put("late", makeCode(100));
+    esp_partition_stub.writes_left = -1;
+    IRCodeLibrary reloaded;
+    reloaded.begin();
+    if (done) {
+      expected["late"] = 100;
+      TEST_EXPECT_EQ(reloaded.generation(), generation + 1);
+      expectContents(reloaded, expected);
+      TEST_EXPECT(writes > 9);  //< 9 entries and their records
+      break;
+    }
+    TEST_EXPECT_EQ(reloaded.generation(), generation);
+    expectContents(reloaded, expected);
+  }
+}
+
+/* a broken bank is skipped for the other one */
+static void testCorrupted() {
+  esp_partition_stub.reset(kPartitionSize);
+  IRCodeLibrary library;
+  library.begin();
+  library.put("one", makeCode(1));
+  library.put("two", makeCode(2));  //< bank 1, generation 2
+  esp_partition_stub.flash[kBankSize + IRCodeLibrary::kHeaderSize] ^= 1;
+  IRCodeLibrary reloaded;
+  reloaded.begin();
+  TEST_EXPECT_EQ(reloaded.generation(), 1);
+  expectContents(reloaded, {{"one", 1}});
+}
+
+static void testFull() {
+  esp_partition_stub.reset(kPartitionSize);
+  IRCodeLibrary library;
+  library.begin();
+  int count = 0;
+  while (library.put(("code" + std::to_string(count)).c_str(),
+                     makeCode(2 * count))) {
+    ++count;
+  }
+  TEST_EXPECT(library.usedBytes() <= library.capacity());
+  TEST_EXPECT_EQ(library.count(), count);
+  /* a failed change keeps the library usable */
+  TEST_EXPECT(library.remove("code0"));
+  printf("%d raw captures of a 32-bit frame fill a %u byte bank\n", count,
+         unsigned(library.capacity()));
+}
+
+/* a change given the lock writes the flash without it, while readers keep
+ * the previous library and a change by a holder fails */
+static void testLocked() {
+  esp_partition_stub.reset(kPartitionSize);
+  IRCodeLibrary library;
+  library.begin();
+  library.put("one", makeCode(1));
+  struct Lock {
+    bool held = false;
+    void lock() { held = true; }
+    void unlock() { held = false; }
+  } lock;
+  int accesses = 0, locked = 0;
+  esp_partition_stub.on_access = [&] {
+    if (lock.held) ++locked;
+    if (accesses++) return;
+    std::lock_guard<Lock> guard(lock);
+    expectContents(library, {{"one", 1}});
+    TEST_EXPECT(!library.put("two", makeCode(2)));
+  };
+  TEST_EXPECT(library.put("late", makeCode(3), lock));
+  esp_partition_stub.on_access = nullptr;
+  TEST_EXPECT(accesses > 1);
+  TEST_EXPECT_EQ(locked, 0);
+  TEST_EXPECT(!lock.held);
+  expectContents(library, {{"late", 3}, {"one", 1}});
+  /* a failed change lets the next one in */
+  esp_partition_stub.writes_left = 0;
+  TEST_EXPECT(!library.rename("one", "two", lock));
+  esp_partition_stub.writes_left = -1;
+  TEST_EXPECT(library.rename("one", "two", lock));
+  TEST_EXPECT(library.remove("late"));
+  expectContents(library, {{"two", 1}});
+}
+
+/* a reader thread looks codes up under the lock as changes go on */
+static void testLockedTwoThreads() {
+  esp_partition_stub.reset(kPartitionSize);
+  IRCodeLibrary library;
+  library.begin();
+  std::mutex lock;
+  std::atomic<bool> done{false};
+  uint32_t lookups = 0, broken = 0;
+  std::thread reader([&] {
+    while (!done.load()) {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        IRCodeLibrary::Entry entry;
+        for (size_t i = 0; library.entry(i, entry); ++i) {
+          /* every code is stored under the name of its seed */
+          const uint32_t seed = atoi(entry.name + 4);
+          std::vector<uint8_t> record;
+          IRCodeStorage::pack(makeCode(seed), record);
+          if (entry.size != record.size() ||
+              memcmp(entry.record, record.data(), record.size()) != 0) {
+            ++broken;
+          }
+          ++lookups;
+        }
+      }
+      std::this_thread::yield();
+    }
+  });
+  std::map<std::string, bool> present;
+  for (uint32_t n = 0; n < 40; ++n) {
+    const std::string name = "code" + std::to_string(n % 8);
+    if (n % 3 == 2) {
+      TEST_EXPECT_EQ(library.remove(name.c_str(), lock), present[name]);
+      present[name] = false;
+    } else {
+      TEST_EXPECT(library.put(name.c_str(), makeCode(n % 8), lock));
+      present[name] = true;
+    }
+    std::this_thread::yield();
+  }
+  done.store(true);
+  reader.join();
+  TEST_EXPECT_EQ(broken, 0);
+  TEST_EXPECT(lookups > 0);
+}
+
+int main() {
+  srand(1);
+  TEST_RUN(testEmpty);
+  TEST_RUN(testFormat);
+  TEST_RUN(testChanges);
+  TEST_RUN(testNames);
+  TEST_RUN(testInterrupted);
+  TEST_RUN(testCorrupted);
+  TEST_RUN(testFull);
+  TEST_RUN(testLocked);
+  TEST_RUN(testLockedTwoThreads);
+  return TEST_RESULT();
+}
@@ -0,0 +1,201 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include "ir_code_storage.h"
+#include "test_utils.h"
+
+using IRData = IRRemote::IRData;
+
+/* a carrier period at 38 kHz, the most a stored width may move */
+static constexpr uint32_t kSpreadUs = 26;
+
+static IRCode rawCode(const IRData& data) {
+  IRCode code;
+  code.protocol = IRProtocol::Raw;
+  code.raw = data;
+  return code;
+}
+
+static IRCode roundTrip(const IRCode& code, size_t* record_size = nullptr) {
+  std::vector<uint8_t> record;
+  IRCodeStorage::pack(code, record);
+  if (record_size) *record_size = record.size();
+  IRCode loaded;
+  TEST_EXPECT(IRCodeStorage::unpack(record.data(), record.size(), loaded));
+  TEST_EXPECT(IRCodeStorage::unpack(loaded));
+  TEST_EXPECT(loaded.protocol == code.protocol);
+  TEST_EXPECT_EQ(loaded.repeat, code.repeat);
+  /* decode() expands the record alike, without an IRCode */
+  IRData expanded, encoded;
+  TEST_EXPECT(IRCodeStorage::decode(record.data(), record.size(), expanded));
+  TEST_EXPECT(IRProtocolCodec::encode(loaded, encoded));
+  TEST_EXPECT(expanded == encoded);
+  return loaded;
+}
+
+/* every width comes back within a carrier period of the captured one */
+static void expectClose(const IRCode& code, const IRCode& loaded) {
+  TEST_EXPECT_EQ(loaded.raw.size(), code.raw.size());
+  for (size_t i = 0; i < code.raw.size() && i < loaded.raw.size(); ++i) {
+    const int shift = int(loaded.raw[i]) - int(code.raw[i]);
+    TEST_EXPECT(std::abs(shift) <= int(kSpreadUs));
+  }
+}
+
+static void testWidthsApartStayApart() {
+  /* 20% apart, as two symbols of a raw code may be */
+  IRData data;
+  for (int i = 0; i < 40; ++i) data.push_back(i % 3 ? 1800 : 2200);
+  const IRCode loaded = roundTrip(rawCode(data));
+  TEST_EXPECT(loaded.raw == data);
+  /* as are widths closer than that, but more than a carrier period */
+  data = {600, 640, 600, 640, 600, 680, 600};
+  TEST_EXPECT(roundTrip(rawCode(data)).raw == data);
+}
+
+static void testRawCaptures() {
+  for (int n = 0; n < 500; ++n) {
+    IRData data = {uint16_t(3000 + rand() % 6000),
+                   uint16_t(1500 + rand() % 3000)};
+    const uint16_t t = 300 + rand() % 400;
+    const int bits = 8 + rand() % 120;
+    for (int i = 0; i < bits; ++i) {
+      data.push_back(t);
+      data.push_back(t * (rand() % 2 ? 3 : 1));
+    }
+    data.push_back(t);
+    const IRCode code = rawCode(capture(data, rand() % 120, rand() % 100));
+    expectClose(code, roundTrip(code));
+  }
+}
+
+static void testRandomWidths() {
+  /* more distinct widths than the dictionary holds, some are literals */
+  for (int n = 0; n < 200; ++n) {
+    IRData data(1 + rand() % 300);
+    for (auto& width : data) width = 1 + rand() % UINT16_MAX;
+    const IRCode code = rawCode(data);
+    expectClose(code, roundTrip(code));
+  }
+}
+
+static void testTolerance() {
+  for (int n = 0; n < 200; ++n) {
+    IRCode code = rawCode(capture(IRData(100, 560), 0, 200));
+    for (size_t i = 0; i < code.raw.size(); ++i) {
+      code.tolerance.push_back(50 + rand() % 300);
+    }
+    const IRCode loaded = roundTrip(code);
+    expectClose(code, loaded);
+    /* the stored bounds accept whatever the learned template did */
+    TEST_EXPECT_EQ(loaded.tolerance.size(), code.tolerance.size());
+    for (size_t i = 0; i < code.raw.size(); ++i) {
+      uint32_t min, max, loaded_min, loaded_max;
+      IRProtocolCodec::rawBounds(code, i, min, max);
+      IRProtocolCodec::rawBounds(loaded, i, loaded_min, loaded_max);
+      TEST_EXPECT(loaded_min <= min && max <= loaded_max);
+    }
+  }
+}
+
+static void testDecoded() {
+  IRCode code;
+  code.protocol = IRProtocol::AEHA;
+  code.bits = 48;
+  code.address = 0x2002;
+  code.command = 0x0D00'0D10;
+  code.repeat = 1;
+  const IRCode loaded = roundTrip(code);
+  TEST_EXPECT_EQ(loaded.bits, code.bits);
+  TEST_EXPECT_EQ(loaded.address, code.address);
+  TEST_EXPECT_EQ(loaded.command, code.command);
+}
+
+static void testBrokenRecords() {
+  std::vector<uint8_t> record;
+  IRCodeStorage::pack(rawCode({9000, 4500, 560, 1690, 560}), record);
+  IRCode code;
+  for (size_t i = 0; i < record.size(); ++i) {
+    std::vector<uint8_t> broken = record;
+    broken[i] ^= 0x10;
+    TEST_EXPECT(!IRCodeStorage::unpack(broken.data(), broken.size(), code));
+  }
+  TEST_EXPECT(!IRCodeStorage::unpack(record.data(), record.size() - 1, code));
+}
+
+static void testPreferences() {
+  Preferences prefs;
+  prefs.begin("ir");
+  const IRCode code = rawCode(capture(IRData(67, 560), 80, 40));
+  TEST_EXPECT(IRCodeStorage::saveToPreferences(prefs, "code", code));
+  IRCode loaded;
+  TEST_EXPECT(IRCodeStorage::loadFromPreferences(prefs, "code", loaded));
+  TEST_EXPECT(IRCodeStorage::unpack(loaded));
+  expectClose(code, loaded);
+  /* as recorded by older firmware, a plain array of widths */
+  TEST_EXPECT(IRRemote::saveToPreferences(prefs, "legacy", code.raw));
+  TEST_EXPECT(IRCodeStorage::loadFromPreferences(prefs, "legacy", loaded));
+  TEST_EXPECT(loaded.raw == code.raw);
+  prefs.end();
+}
+
+static IRCode makeCode(IRProtocol protocol, uint8_t bits, uint16_t address,
+                       uint64_t command, uint8_t repeat = 0) {
+  IRCode code;
+  code.protocol = protocol;
+  code.bits = bits;
+  code.address = address;
+  code.command = command;
+  code.repeat = repeat;
+  return code;
+}
+
+/* the record of a capture stored as a raw code, against its plain widths */
+static void sizeReport() {
+  struct Sample {
+    const char* name;
+    IRCode code;
+  };
+  const Sample samples[] = {
+      {"NEC", makeCode(IRProtocol::NEC, 32, 0xFF00, 0xBA45)},
+      {"NEC, 2 repeats", makeCode(IRProtocol::NEC, 32, 0xFF00, 0xBA45, 2)},
+      {"AEHA 48 bits", makeCode(IRProtocol::AEHA, 48, 0x2002, 0x0D000D10)},
+      {"AEHA 64 bits x2", makeCode(IRProtocol::AEHA, 64, 0x5AA5,
+                                   0xC1A2B3C4D5E6ull, 1)},
+      {"Sony 12 bits x3", makeCode(IRProtocol::Sony, 12, 0x01, 0x15, 2)},
+      {"Sony 20 bits x3", makeCode(IRProtocol::Sony, 20, 0x1A5, 0x7B, 2)},
+  };
+  printf("%-16s %6s %10s %10s %8s\n", "capture", "widths", "plain [B]",
+         "record [B]", "max [us]");
+  for (const auto& sample : samples) {
+    IRData sent;
+    TEST_EXPECT(IRProtocolCodec::encode(sample.code, sent));
+    /* a typical receiver module: marks 80 us longer, +-40 us jitter */
+    const IRCode code = rawCode(capture(sent, 80, 40));
+    size_t record_size = 0;
+    const IRCode loaded = roundTrip(code, &record_size);
+    expectClose(code, loaded);
+    int max_shift = 0;
+    for (size_t i = 0; i < code.raw.size(); ++i) {
+      max_shift =
+          std::max(max_shift, std::abs(int(loaded.raw[i]) - int(code.raw[i])));
+    }
+    printf("%-16s %6zu %10zu %10zu %8d\n", sample.name, code.raw.size(),
+           code.raw.size() * sizeof(IRRemote::IRDataElement), record_size,
+           max_shift);
+  }
+}
+
+int main() {
+  srand(1);
+  TEST_RUN(testWidthsApartStayApart);
+  TEST_RUN(testRawCaptures);
+  TEST_RUN(testRandomWidths);
+  TEST_RUN(testTolerance);
+  TEST_RUN(testDecoded);
+  TEST_RUN(testBrokenRecords);
+  TEST_RUN(testPreferences);
+  TEST_RUN(sizeReport);
+  return TEST_RESULT();
+}
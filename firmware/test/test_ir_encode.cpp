@@ -0,0 +1,160 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include "ir_remote.h"
+#include "test_utils.h"
+
+using IRData = IRRemote::IRData;
+using IRSymbols = IRRemote::IRSymbols;
+
+/* the waveform the RMT puts on air: levels and durations up to the end
+ * marker, with adjacent halves of the same level joined */
+static std::vector<std::pair<int, uint32_t>> waveform(
+    const IRSymbols& symbols, bool* terminated = nullptr) {
+  std::vector<std::pair<int, uint32_t>> levels;
+  auto add = [&](int level, uint32_t duration) {
+    if (!levels.empty() && levels.back().first == level) {
+      levels.back().second += duration;
+    } else {
+      levels.emplace_back(level, duration);
+    }
+  };
+  if (terminated) *terminated = false;
+  for (const auto& symbol : symbols) {
+    if (symbol.duration0 == 0) {
+      if (terminated) *terminated = true;
+      break;
+    }
+    add(symbol.level0, symbol.duration0);
+    if (symbol.duration1 == 0) {
+      if (terminated) *terminated = true;
+      break;
+    }
+    add(symbol.level1, symbol.duration1);
+  }
+  return levels;
+}
+
+/* the raw timings as marks and spaces, starting with a mark */
+static void expectWaveform(const IRData& data) {
+  IRSymbols symbols;
+  IRRemote::encode(data, symbols);
+  bool terminated = false;
+  const auto levels = waveform(symbols, &terminated);
+  TEST_EXPECT(terminated);
+  TEST_EXPECT_EQ(levels.size(), data.size());
+  for (size_t i = 0; i < levels.size() && i < data.size(); ++i) {
+    TEST_EXPECT_EQ(levels[i].first, (i & 1) ? 0 : 1);
+    TEST_EXPECT_EQ(levels[i].second, data[i]);
+  }
+}
+
+static void testNecFrame() {
+  /* leader, address 0x00 and command 0x45, the first bits of a NEC frame */
+  IRData data = {9000, 4500};
+  for (int i = 0; i < 32; ++i) {
+    data.push_back(560);
+    data.push_back((0x45u << 16 >> i) & 1 ? 1690 : 560);
+  }
+  data.push_back(560);  //< stop bit, odd size
+  expectWaveform(data);
+
+  IRSymbols symbols;
+  IRRemote::encode(data, symbols);
+  /* a mark and a space per symbol, the stop bit and the end in the last */
+  TEST_EXPECT_EQ(symbols.size(), (data.size() + 1) / 2);
+  TEST_EXPECT_EQ(symbols.back().duration0, 560);
+  TEST_EXPECT_EQ(symbols.back().level0, 1);
+  TEST_EXPECT_EQ(symbols.back().duration1, 0);
+}
+
+static void testEvenSizeIsTerminated() {
+  const IRData data = {3400, 1700, 430, 1300};
+  IRSymbols symbols;
+  IRRemote::encode(data, symbols);
+  TEST_EXPECT_EQ(symbols.size(), 3);
+  TEST_EXPECT_EQ(symbols.back().val, 0);
+  expectWaveform(data);
+}
+
+static void testLongDurationIsSplit() {
+  /* 60 ms and 40 ms do not fit the 15-bit field */
+  const IRData data = {60000, 40000, 500, 65535, 500};
+  IRSymbols symbols;
+  IRRemote::encode(data, symbols);
+  for (const auto& symbol : symbols) {
+    TEST_EXPECT(symbol.duration0 <= IRRemote::RMT_DURATION_MAX);
+    TEST_EXPECT(symbol.duration1 <= IRRemote::RMT_DURATION_MAX);
+  }
+  expectWaveform(data);
+}
+
+static void testZeroDurationIsSkipped() {
+  /* a zero in the middle would end the transmission early */
+  const IRData data = {500, 0, 700, 300, 500};
+  IRSymbols symbols;
+  IRRemote::encode(data, symbols);
+  bool terminated = false;
+  const auto levels = waveform(symbols, &terminated);
+  TEST_EXPECT(terminated);
+  TEST_EXPECT_EQ(levels.size(), 3);
+  if (levels.size() == 3) {
+    TEST_EXPECT_EQ(levels[0].second, 1200);  //< marks around the zero space
+    TEST_EXPECT_EQ(levels[1].second, 300);
+    TEST_EXPECT_EQ(levels[2].second, 500);
+  }
+}
+
+static void testEmpty() {
+  IRSymbols symbols = {rmt_symbol_word_t{}, rmt_symbol_word_t{}};
+  IRRemote::encode({}, symbols);
+  TEST_EXPECT_EQ(symbols.size(), 1);
+  TEST_EXPECT_EQ(symbols.back().val, 0);
+}
+
+static void testRandomFrames() {
+  srand(1);
+  for (int n = 0; n < 1000; ++n) {
+    IRData data(1 + rand() % 600);
+    for (auto& width : data) width = 1 + rand() % UINT16_MAX;
+    expectWaveform(data);
+  }
+}
+
+static void testSendToAllChannels() {
+  rmt_stub_tx_channels.clear();
+  IRRemote ir;
+  /* one more than the RMT channels the LED leaves, that one is left out */
+  const int tx[] = {1, 2, 4, 5};
+  const int rx[] = {3};
+  ir.begin(tx, IRRemote::IR_TX_CHANNELS_MAX + 1, rx, 1);
+  TEST_EXPECT_EQ(ir.getTxChannelCount(), IRRemote::IR_TX_CHANNELS_MAX);
+  TEST_EXPECT_EQ(rmt_stub_tx_channels.size(), IRRemote::IR_TX_CHANNELS_MAX);
+  const IRData data = {9000, 4500, 560, 560, 560};
+  IRSymbols expected;
+  IRRemote::encode(data, expected);
+  ir.send(data);
+  /* the pre-encoded symbols go to the driver as they are */
+  for (int i = 0; i < ir.getTxChannelCount(); ++i) {
+    rmt_channel_handle_t channel = rmt_stub_tx_channels.at(i);
+    TEST_EXPECT_EQ(channel->transmitted.size(), 1);
+    if (channel->transmitted.empty()) continue;
+    const auto& sent = channel->transmitted.back();
+    TEST_EXPECT_EQ(sent.size(), expected.size());
+    for (size_t j = 0; j < sent.size() && j < expected.size(); ++j) {
+      TEST_EXPECT_EQ(sent[j].val, expected[j].val);
+    }
+  }
+}
+
+int main() {
+  TEST_RUN(testNecFrame);
+  TEST_RUN(testEvenSizeIsTerminated);
+  TEST_RUN(testLongDurationIsSplit);
+  TEST_RUN(testZeroDurationIsSkipped);
+  TEST_RUN(testEmpty);
+  TEST_RUN(testRandomFrames);
+  TEST_RUN(testSendToAllChannels);
+  return TEST_RESULT();
+}
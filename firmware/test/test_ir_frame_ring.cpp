@@ -0,0 +1,178 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include <thread>
+
+#include "ir_chunk_pool.h"
+#include "ir_frame_ring.h"
+#include "test_utils.h"
+
+/* the widths of a synthetic frame, different for every frame */
+static uint16_t widthOf(uint32_t sequence, size_t index) {
+  return 100 + (sequence * 7919 + index * 104729) % 9000;
+}
+
+struct Frame {
+  uint32_t sequence;
+  uint16_t size;
+  uint16_t widths[32];
+};
+
+/* frames come in bursts that overrun the ring, and in between no faster
+ * than the consumer takes them */
+template <typename Ring>
+static void waitForSlot(const Ring& ring, size_t slots, uint32_t sequence) {
+  if (sequence % 1000 < 100) return;
+  while (ring.size() == slots) std::this_thread::yield();
+}
+
+/* the producer thread stands in for the ISR */
+static void testRingTwoThreads() {
+  constexpr uint32_t kFrames = 200'000;
+  IRFrameRing<Frame, 8> ring;
+  std::atomic<bool> done{false};
+  std::thread producer([&] {
+    for (uint32_t sequence = 0; sequence < kFrames; ++sequence) {
+      waitForSlot(ring, 8, sequence);
+      Frame* frame = ring.acquire();
+      if (!frame) continue;  //< counted as an overflow
+      frame->sequence = sequence;
+      frame->size = 1 + sequence % 32;
+      for (size_t i = 0; i < frame->size; ++i) {
+        frame->widths[i] = widthOf(sequence, i);
+      }
+      ring.publish();
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  uint32_t received = 0, corrupted = 0, reordered = 0;
+  int64_t last = -1;
+  auto drain = [&] {
+    /* several frames per pass, as the main loop does */
+    size_t count = 0;
+    while (ring.peek(count)) ++count;
+    if (!count) std::this_thread::yield();
+    for (size_t k = 0; k < count; ++k) {
+      const Frame* frame = ring.front();
+      if (int64_t(frame->sequence) <= last) ++reordered;
+      last = frame->sequence;
+      if (frame->size != 1 + frame->sequence % 32) ++corrupted;
+      for (size_t i = 0; i < frame->size && i < 32; ++i) {
+        if (frame->widths[i] != widthOf(frame->sequence, i)) ++corrupted;
+      }
+      ring.pop();
+      ++received;
+    }
+  };
+  while (!done.load(std::memory_order_acquire)) drain();
+  drain();
+  producer.join();
+
+  TEST_EXPECT_EQ(corrupted, 0);
+  TEST_EXPECT_EQ(reordered, 0);
+  TEST_EXPECT_EQ(ring.size(), 0);
+  /* every frame is either received or counted */
+  TEST_EXPECT_EQ(received + ring.overflowCount(), kFrames);
+  TEST_EXPECT(received > 0);
+  printf("ring: %u received, %u overflowed\n", received,
+         ring.overflowCount());
+}
+
+/* frames streamed into chunks, as the receiver does, and released by the
+ * reader once checked */
+static void testChunksTwoThreads() {
+  constexpr uint32_t kFrames = 200'000;
+  using Pool = IRChunkPool<uint16_t, 24, 32>;
+  struct ChainedFrame {
+    Pool::Index first;
+    uint32_t sequence;
+    uint16_t size;
+  };
+  Pool pool;
+  IRFrameRing<ChainedFrame, 8> ring;
+  std::atomic<bool> done{false};
+  std::atomic<uint32_t> out_of_chunks{0};
+  std::thread producer([&] {
+    Pool::Index spare = Pool::kNone;  //< chains of dropped frames
+    for (uint32_t sequence = 0; sequence < kFrames; ++sequence) {
+      const uint16_t size = 8 + sequence % 200;
+      /* between bursts, until the reader has released enough chunks,
+       * unless the rest are spares */
+      while (sequence % 1000 >= 100 && ring.size() &&
+             pool.available() < (size + 23) / 24) {
+        std::this_thread::yield();
+      }
+      Pool::Index first = Pool::kNone, last = Pool::kNone;
+      bool failed = false;
+      for (uint16_t i = 0; i < size && !failed; ++i) {
+        if (last == Pool::kNone || pool[last].size == 24) {
+          Pool::Index index = spare;
+          if (index != Pool::kNone) {
+            spare = pool[index].next;
+            pool[index].next = Pool::kNone;
+            pool[index].size = 0;
+          } else {
+            index = pool.allocate();
+          }
+          if (index == Pool::kNone) {
+            failed = true;
+            break;
+          }
+          (last == Pool::kNone ? first : pool[last].next) = index;
+          last = index;
+        }
+        pool[last].data[pool[last].size++] = widthOf(sequence, i);
+      }
+      if (!failed) waitForSlot(ring, 8, sequence);
+      ChainedFrame* frame = failed ? nullptr : ring.acquire();
+      if (!frame) {
+        /* only the reader releases, keep the chain */
+        if (failed) out_of_chunks.fetch_add(1, std::memory_order_relaxed);
+        if (last != Pool::kNone) pool[last].next = spare;
+        if (first != Pool::kNone) spare = first;
+        continue;
+      }
+      *frame = ChainedFrame{first, sequence, size};
+      ring.publish();
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  uint32_t received = 0, corrupted = 0;
+  auto drain = [&] {
+    if (!ring.front()) std::this_thread::yield();
+    while (const ChainedFrame* frame = ring.front()) {
+      uint16_t i = 0;
+      for (auto index = frame->first; index != Pool::kNone;
+           index = pool[index].next) {
+        for (size_t j = 0; j < pool[index].size; ++j, ++i) {
+          if (pool[index].data[j] != widthOf(frame->sequence, i)) {
+            ++corrupted;
+          }
+        }
+      }
+      if (i != frame->size) ++corrupted;
+      pool.release(frame->first);
+      ring.pop();
+      ++received;
+    }
+  };
+  while (!done.load(std::memory_order_acquire)) drain();
+  drain();
+  producer.join();
+
+  TEST_EXPECT_EQ(corrupted, 0);
+  TEST_EXPECT_EQ(received + ring.overflowCount() + out_of_chunks.load(),
+                 kFrames);
+  TEST_EXPECT(received > 0);
+  printf("chunks: %u received, %u overflowed, %u out of chunks\n", received,
+         ring.overflowCount(), out_of_chunks.load());
+}
+
+int main() {
+  TEST_RUN(testRingTwoThreads);
+  TEST_RUN(testChunksTwoThreads);
+  return TEST_RESULT();
+}
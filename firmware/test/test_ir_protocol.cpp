@@ -0,0 +1,134 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include "ir_protocol.h"
+#include "test_utils.h"
+
+using IRData = IRRemote::IRData;
+
+static void expectRoundTrip(const IRCode& code) {
+  IRData data;
+  TEST_EXPECT(IRProtocolCodec::encode(code, data));
+  /* on air, twice: as sent and as a receiver captures it */
+  for (const IRData& received : {data, capture(data, 100, 60)}) {
+    IRCode decoded;
+    TEST_EXPECT(IRProtocolCodec::decode(received, decoded));
+    TEST_EXPECT(decoded.protocol == code.protocol);
+    TEST_EXPECT_EQ(decoded.bits, code.bits);
+    TEST_EXPECT_EQ(decoded.address, code.address);
+    TEST_EXPECT_EQ(decoded.command, code.command);
+    TEST_EXPECT_EQ(decoded.repeat, code.repeat);
+    TEST_EXPECT(IRProtocolCodec::matches(decoded, code));
+    /* and rebuilt to the very same waveform */
+    IRData rebuilt;
+    TEST_EXPECT(IRProtocolCodec::encode(decoded, rebuilt));
+    TEST_EXPECT(rebuilt == data);
+  }
+}
+
+static IRCode makeCode(IRProtocol protocol, uint8_t bits, uint16_t address,
+                       uint64_t command, uint8_t repeat = 0) {
+  IRCode code;
+  code.protocol = protocol;
+  code.bits = bits;
+  code.address = address;
+  code.command = command;
+  code.repeat = repeat;
+  return code;
+}
+
+static void testNec() {
+  for (int n = 0; n < 200; ++n) {
+    const uint8_t command = rand();
+    expectRoundTrip(makeCode(IRProtocol::NEC, 32, rand(),
+                             command | (~command & 0xFF) << 8, n % 4));
+  }
+}
+
+static void testNecRepeatCode() {
+  IRData data;
+  IRProtocolCodec::encode(makeCode(IRProtocol::NEC, 32, 0xFF00, 0xBA45, 2),
+                          data);
+  /* frame, then gap and leader, 2250 us space and stop mark, twice */
+  TEST_EXPECT_EQ(data.size(), 2 + 64 + 1 + 2 * 4);
+  TEST_EXPECT_EQ(data[data.size() - 3], 9000);
+  TEST_EXPECT_EQ(data[data.size() - 2], 2250);
+}
+
+static void testAeha() {
+  for (int n = 0; n < 200; ++n) {
+    const uint8_t bits = 16 + rand() % 49;  //< 16 to 64 bits
+    const uint64_t payload = (uint64_t(rand()) << 32 | rand()) &
+                             (bits == 64 ? ~0ull : (1ull << bits) - 1);
+    expectRoundTrip(makeCode(IRProtocol::AEHA, bits, payload & 0xFFFF,
+                             payload >> 16, n % 3));
+  }
+}
+
+static void testSony() {
+  const uint8_t lengths[] = {12, 15, 20};
+  for (int n = 0; n < 200; ++n) {
+    const uint8_t bits = lengths[n % 3];
+    const uint32_t payload = rand() & ((1u << bits) - 1);
+    /* remotes send a Sony frame at least three times */
+    expectRoundTrip(makeCode(IRProtocol::Sony, bits, payload >> 7,
+                             payload & 0x7F, 2));
+  }
+}
+
+static void testUnknownIsRaw() {
+  /* an RC-5 like bi-phase frame matches none of the protocols */
+  IRData data;
+  for (int i = 0; i < 27; ++i) data.push_back(i % 3 ? 889 : 1778);
+  IRCode code = IRProtocolCodec::fromRaw(data);
+  TEST_EXPECT(code.protocol == IRProtocol::Raw);
+  TEST_EXPECT(code.raw == data);
+  IRData rebuilt;
+  TEST_EXPECT(IRProtocolCodec::encode(code, rebuilt));
+  TEST_EXPECT(rebuilt == data);
+}
+
+static void testDifferentFramesAreRaw() {
+  /* two different NEC frames in one capture do not survive a round trip */
+  IRData data, second;
+  IRProtocolCodec::encode(makeCode(IRProtocol::NEC, 32, 0x10, 0x20), data);
+  IRProtocolCodec::encode(makeCode(IRProtocol::NEC, 32, 0x10, 0x21), second);
+  data.push_back(40'000);
+  data.insert(data.end(), second.begin(), second.end());
+  IRCode code;
+  TEST_EXPECT(!IRProtocolCodec::decode(data, code));
+  TEST_EXPECT(IRProtocolCodec::fromRaw(data).protocol == IRProtocol::Raw);
+}
+
+static void testTruncatedIsRaw() {
+  IRData data;
+  IRProtocolCodec::encode(makeCode(IRProtocol::NEC, 32, 0x10, 0x20), data);
+  data.resize(40);  //< 19 bits, a NEC frame has 32
+  IRCode code;
+  TEST_EXPECT(!IRProtocolCodec::decode(data, code) ||
+              code.protocol != IRProtocol::NEC);
+}
+
+static void testMatches() {
+  IRCode learned = makeCode(IRProtocol::NEC, 32, 0x10, 0xEF10);
+  IRData data;
+  IRProtocolCodec::encode(learned, data);
+  IRCode received = IRProtocolCodec::fromRaw(capture(data, 120, 80));
+  TEST_EXPECT(IRProtocolCodec::matches(received, learned));
+  learned.command ^= 1;
+  TEST_EXPECT(!IRProtocolCodec::matches(received, learned));
+}
+
+int main() {
+  srand(1);
+  TEST_RUN(testNec);
+  TEST_RUN(testNecRepeatCode);
+  TEST_RUN(testAeha);
+  TEST_RUN(testSony);
+  TEST_RUN(testUnknownIsRaw);
+  TEST_RUN(testDifferentFramesAreRaw);
+  TEST_RUN(testTruncatedIsRaw);
+  TEST_RUN(testMatches);
+  return TEST_RESULT();
+}
@@ -0,0 +1,200 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include "ir_protocol.h"
+#include "ir_remote.h"
+#include "test_utils.h"
+
+using IRData = IRRemote::IRData;
+
+static constexpr int kRxPin = 5;
+
+struct Press {
+  int64_t at_us;  //< when available() turned true
+  size_t size;
+  IRRemote::Press press;
+};
+
+/* a receiver fed on the virtual clock as the RMT driver would, with the
+ * main loop polling available() every millisecond */
+class Air {
+ public:
+  Air() {
+    AppClock::set(1'000'000);
+    const int tx = -1;
+    ir_.begin(&tx, 0, &kRxPin, 1);
+    for (auto& channel : rmt_stub_channels) {
+      if (channel.gpio_num == kRxPin && channel.rx_callback) rx_ = &channel;
+    }
+    TEST_EXPECT(rx_ != nullptr);
+  }
+
+  /* a frame on air, reported a buffer at a time and an idle threshold after
+   * its end; returns the end of its last mark */
+  int64_t send(const IRData& data) {
+    IRRemote::IRSymbols symbols;
+    IRRemote::encode(data, symbols);
+    const size_t piece = IRRemote::RMT_RX_SYMBOL_BUFFER_SIZE;
+    size_t i = 0, n = 0;
+    for (;; i += piece) {
+      n = std::min(piece, symbols.size() - i);
+      for (size_t j = i; j < i + n; ++j) {
+        wait(symbols[j].duration0 + symbols[j].duration1);
+      }
+      if (i + n == symbols.size()) break;
+      rmt_stub_receive(rx_, &symbols[i], n, false);
+    }
+    const int64_t end_us = AppClock::nowUs();
+    wait(IRRemote::RAW_DATA_TIMEOUT_US);
+    rmt_stub_receive(rx_, &symbols[i], n, true);
+    return end_us;
+  }
+
+  /* time passes, the main loop polls */
+  void wait(int64_t us) {
+    const int64_t until = AppClock::nowUs() + us;
+    while (AppClock::nowUs() < until) {
+      AppClock::advance(std::min<int64_t>(1000, until - AppClock::nowUs()));
+      while (ir_.available()) {
+        presses_.push_back({AppClock::nowUs(), ir_.get().size(), ir_.press()});
+        ir_.pop();
+      }
+    }
+  }
+
+  const std::vector<Press>& presses() const { return presses_; }
+
+ private:
+  IRRemote ir_;
+  rmt_channel_t* rx_ = nullptr;
+  std::vector<Press> presses_;
+};
+
+static IRData encode(IRProtocol protocol, uint8_t bits, uint16_t address,
+                     uint64_t command) {
+  IRCode code;
+  code.protocol = protocol;
+  code.bits = bits;
+  code.address = address;
+  code.command = command;
+  IRData data;
+  IRProtocolCodec::encode(code, data);
+  return data;
+}
+
+static const IRData kNec = encode(IRProtocol::NEC, 32, 0xFF00, 0xBA45);
+static const IRData kNecRepeat = {9000, 2250, 560};
+static const IRData kAeha = encode(IRProtocol::AEHA, 48, 0x2002, 0x0D000D10);
+
+static uint32_t durationUs(const IRData& data) {
+  uint32_t sum = 0;
+  for (const auto width : data) sum += width;
+  return sum;
+}
+
+/* no part can follow a NEC frame, only a repeat code */
+static void testNecLatency() {
+  Air air;
+  const int64_t end_us = air.send(kNec);
+  air.wait(1'000'000);
+  TEST_EXPECT_EQ(air.presses().size(), 1);
+  if (air.presses().empty()) return;
+  const int64_t latency_us = air.presses()[0].at_us - end_us;
+  TEST_EXPECT(latency_us <= IRRemote::IR_FINALIZING_TIMEOUT_US +
+                                IRRemote::IR_REPEAT_CODE_MAX_US +
+                                IRRemote::RAW_DATA_TIMEOUT_US + 1000);
+  TEST_EXPECT_EQ(air.presses()[0].size, kNec.size());
+  TEST_EXPECT_EQ(air.presses()[0].press.held_ms, 0);
+  printf("NEC press available %lld ms after its end\n",
+         (long long)latency_us / 1000);
+}
+
+static void testNecHeld() {
+  Air air;
+  const int64_t start_us = AppClock::nowUs();
+  const int64_t code_end_us = air.send(kNec);
+  /* a repeat code every 108 ms, start to start */
+  air.wait(108'000 - durationUs(kNec) - IRRemote::RAW_DATA_TIMEOUT_US);
+  int64_t end_us = 0;
+  for (int i = 0; i < 5; ++i) {
+    end_us = air.send(kNecRepeat);
+    air.wait(108'000 - durationUs(kNecRepeat) -
+             IRRemote::RAW_DATA_TIMEOUT_US);
+  }
+  air.wait(1'000'000);
+  TEST_EXPECT_EQ(air.presses().size(), 1);
+  if (air.presses().empty()) return;
+  TEST_EXPECT_EQ(air.presses()[0].press.repeats, 5);
+  TEST_EXPECT(air.presses()[0].at_us - start_us < 5 * 108'000 + 200'000);
+  /* held from the end of the code on, not counting the code itself */
+  TEST_EXPECT_EQ(air.presses()[0].press.held_ms, (end_us - code_end_us) / 1000);
+}
+
+/* a remote that resends its frame instead folds into one press too */
+static void testNecResend() {
+  Air air;
+  for (int i = 0; i < 4; ++i) {
+    air.send(kNec);
+    air.wait(108'000 - durationUs(kNec) - IRRemote::RAW_DATA_TIMEOUT_US);
+  }
+  air.wait(1'000'000);
+  TEST_EXPECT_EQ(air.presses().size(), 1);
+  if (air.presses().empty()) return;
+  TEST_EXPECT_EQ(air.presses()[0].press.repeats, 3);
+}
+
+/* a resend published after its press is complete is no new press */
+static void testLateResend() {
+  Air air;
+  for (int i = 0; i < 4; ++i) {
+    air.send(kAeha);
+    air.wait(90'000 - IRRemote::RAW_DATA_TIMEOUT_US);
+  }
+  air.wait(1'000'000);
+  TEST_EXPECT_EQ(air.presses().size(), 1);
+}
+
+/* further parts of an air-conditioner code are waited for */
+static void testParts() {
+  Air air;
+  IRData part = {3400, 1700};
+  for (int i = 0; i < 19 * 8; ++i) {
+    part.push_back(430);
+    part.push_back(i % 3 ? 430 : 1300);
+  }
+  part.push_back(430);
+  int64_t end_us = 0;
+  for (int i = 0; i < 3; ++i) {
+    end_us = air.send(part);
+    air.wait(40'000 - IRRemote::RAW_DATA_TIMEOUT_US);
+  }
+  air.wait(1'000'000);
+  TEST_EXPECT_EQ(air.presses().size(), 1);
+  if (air.presses().empty()) return;
+  TEST_EXPECT_EQ(air.presses()[0].press.parts, 3);
+  TEST_EXPECT_EQ(air.presses()[0].press.held_ms, 0);
+  TEST_EXPECT_EQ(air.presses()[0].size, 3 * part.size() + 2);
+  TEST_EXPECT(air.presses()[0].at_us - end_us <=
+              IRRemote::IR_PART_SPAN_US + IRRemote::RAW_DATA_TIMEOUT_US +
+                  1000);
+}
+
+static void testTwoPresses() {
+  Air air;
+  air.send(kNec);
+  air.wait(300'000);
+  air.send(kNec);
+  air.wait(1'000'000);
+  TEST_EXPECT_EQ(air.presses().size(), 2);
+}
+
+int main() {
+  TEST_RUN(testNecLatency);
+  TEST_RUN(testNecHeld);
+  TEST_RUN(testNecResend);
+  TEST_RUN(testLateResend);
+  TEST_RUN(testParts);
+  TEST_RUN(testTwoPresses);
+  return TEST_RESULT();
+}
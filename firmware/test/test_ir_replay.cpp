@@ -0,0 +1,121 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include <fstream>
+#include <iterator>
+
+#include "ir_replay.h"
+#include "test_utils.h"
+
+/*
+ * Replays synthetic traces through the receiver under the virtual clock.
+ * Given a trace file, e.g. a `trace dump` restored with `xxd -r -p`, it
+ * replays that instead:
+ *
+ *   ./test_ir_replay trace.bin
+ */
+
+static void report(const char* name, const IRReplay::Stats& stats) {
+  char text[320];
+  IRReplay::format(stats, text, sizeof(text));
+  printf("%-8s %s\n", name, text);
+}
+
+static IRReplay::Stats replay(const char* name,
+                              const IRReplay::SynthOptions& options) {
+  IRTraceRecorder trace;
+  IRReplay::Stats stats;
+  TEST_EXPECT(IRReplay::synthesize(trace, options));
+  TEST_EXPECT(IRReplay::run(trace.data(), trace.size(), stats));
+  report(name, stats);
+  /* every frame is accounted for */
+  TEST_EXPECT_EQ(stats.parts + stats.repeats + stats.dropped +
+                     stats.truncated,
+                 stats.frames);
+  TEST_EXPECT_EQ(stats.truncated, 0);
+  return stats;
+}
+
+static IRReplay::SynthOptions quiet() {
+  IRReplay::SynthOptions options;
+  options.jitter_us = 0;
+  options.glitches = 0;
+  options.overlap_percent = 0;
+  options.repeat_percent = 0;
+  options.long_percent = 0;
+  return options;
+}
+
+static void testClean() {
+  const auto stats = replay("clean", quiet());
+  TEST_EXPECT_EQ(stats.frames, 32);
+  TEST_EXPECT_EQ(stats.decoded, 32);
+  TEST_EXPECT_EQ(stats.dropped, 0);
+  TEST_EXPECT_EQ(stats.filtered_edges, 0);
+}
+
+static void testGlitches() {
+  auto options = quiet();
+  options.jitter_us = 60;
+  options.glitches = 2;
+  const auto stats = replay("glitch", options);
+  /* the glitches are filtered out, the codes are not lost */
+  TEST_EXPECT_EQ(stats.decoded, 32);
+  TEST_EXPECT(stats.filtered_edges > 0);
+}
+
+static void testHeld() {
+  auto options = quiet();
+  options.repeat_percent = 50;
+  const auto stats = replay("held", options);
+  /* repeat codes fold into the press before them */
+  TEST_EXPECT(stats.repeats > 0);
+  TEST_EXPECT_EQ(stats.decoded + stats.repeats, stats.frames);
+  TEST_EXPECT_EQ(stats.dropped, 0);
+}
+
+static void testLongCodes() {
+  auto options = quiet();
+  options.long_percent = 50;
+  options.frames = 12;
+  const auto stats = replay("long", options);
+  /* an air-conditioner code is one code of several parts */
+  TEST_EXPECT(stats.parts > stats.decoded);
+  TEST_EXPECT_EQ((stats.parts - stats.decoded) %
+                     (IRReplay::kLongCodeParts - 1),
+                 0);
+  TEST_EXPECT_EQ(stats.dropped, 0);
+}
+
+static void testDefaults() {
+  const auto first = replay("default", IRReplay::SynthOptions{});
+  TEST_EXPECT(first.decoded > 0);
+  /* the result depends on the trace only */
+  const auto second = replay("again", IRReplay::SynthOptions{});
+  TEST_EXPECT_EQ(second.checksum, first.checksum);
+  TEST_EXPECT_EQ(second.decoded, first.decoded);
+}
+
+static int replayFile(const char* path) {
+  std::ifstream file(path, std::ios::binary);
+  const std::vector<uint8_t> trace{std::istreambuf_iterator<char>(file),
+                                   std::istreambuf_iterator<char>()};
+  IRReplay::Stats stats;
+  if (!IRReplay::run(trace.data(), trace.size(), stats)) {
+    fprintf(stderr, "%s: not a valid trace\n", path);
+    return 1;
+  }
+  report(path, stats);
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) return replayFile(argv[1]);
+  TEST_RUN(testClean);
+  TEST_RUN(testGlitches);
+  TEST_RUN(testHeld);
+  TEST_RUN(testLongCodes);
+  TEST_RUN(testDefaults);
+  return TEST_RESULT();
+}
@@ -0,0 +1,122 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include "motion_sensor.h"
+#include "smart_light_automation.h"
+#include "test_utils.h"
+
+/*
+ * Two months of a room on the virtual clock, past the 49.7-day wrap of
+ * millis(): someone there every evening, then away for longer than the
+ * wrap, then back. The motion sensor and the occupancy rules run once a
+ * second, as the controller's passes do while nothing else happens.
+ */
+
+static constexpr uint8_t kPirPin = 4;
+static constexpr int kLightOffTimeoutSeconds = 300;
+static constexpr int64_t kDayMs = 24 * 3'600'000ll;
+
+class Room {
+ public:
+  Room() {
+    AppClock::set(0);
+    state_.switch_state = true;
+    state_.light_off_timeout_seconds = kLightOffTimeoutSeconds;
+  }
+
+  /* a second passes, with the PIR output held as given */
+  void second(bool motion) {
+    arduino_stub_pins[kPirPin] = motion ? HIGH : LOW;
+    AppClock::advance(1'000'000);
+    sensor_.update();
+    state_.seconds_since_last_motion = sensor_.getSecondsSinceLastMotion();
+    state_.occupancy_state =
+        sensor_.isOccupied(SmartLightAutomation::kOccupancyTimeoutSeconds);
+    const bool light_state = state_.light_state;
+    SmartLightAutomation::applyOccupancyRules(state_);
+    if (light_state && !state_.light_state) {
+      int64_t motion_end_ms;
+      TEST_EXPECT(sensor_.getLastMotionEndMs(motion_end_ms));
+      off_after_ms_ = AppClock::nowMs() - motion_end_ms;
+      ++lights_off_;
+    }
+    if (light_state != state_.light_state) ++switches_;
+  }
+
+  /* someone in the room, moving now and then; the PIR holds its output
+   * for a few seconds each time */
+  void occupy(int minutes) {
+    for (int i = 0; i < minutes * 60; ++i) {
+      second(i % 45 < 5);
+      TEST_EXPECT(state_.light_state);
+    }
+  }
+
+  /* nobody in the room */
+  void leave(int64_t ms) {
+    for (int64_t i = 0; i < ms / 1000; ++i) second(false);
+  }
+
+  const SmartLightRuntimeState& state() const { return state_; }
+  int64_t offAfterMs() const { return off_after_ms_; }
+  int lightsOff() const { return lights_off_; }
+  int switches() const { return switches_; }
+
+ private:
+  MotionSensor sensor_{kPirPin};
+  SmartLightRuntimeState state_;
+  int64_t off_after_ms_ = 0;
+  int lights_off_ = 0;
+  int switches_ = 0;
+};
+
+/* a day, with someone in the room from 19:00 to 21:00 */
+static void evening(Room& room) {
+  room.leave(19 * 3'600'000ll);
+  room.occupy(120);
+  const int lights_off = room.lightsOff();
+  room.leave(5 * 3'600'000ll);
+  TEST_EXPECT_EQ(room.lightsOff(), lights_off + 1);
+  /* off once the timeout has passed, on the pass after it */
+  TEST_EXPECT(room.offAfterMs() > kLightOffTimeoutSeconds * 1000ll);
+  TEST_EXPECT(room.offAfterMs() <= (kLightOffTimeoutSeconds + 2) * 1000ll);
+}
+
+static void testTwoMonths() {
+  Room room;
+  for (int day = 0; day < 5; ++day) evening(room);
+  /* away for 52 days, the wrap of millis() among them */
+  const int64_t away_ms = 52 * kDayMs;
+  room.leave(away_ms);
+  TEST_EXPECT(!room.state().light_state);
+  TEST_EXPECT(!room.state().occupancy_state);
+  TEST_EXPECT(room.state().seconds_since_last_motion >= away_ms / 1000);
+  TEST_EXPECT(AppClock::nowMs() > int64_t(UINT32_MAX));
+  for (int day = 0; day < 3; ++day) evening(room);
+  TEST_EXPECT_EQ(room.lightsOff(), 8);
+  /* on and off once an evening, nothing in between */
+  TEST_EXPECT_EQ(room.switches(), 16);
+  printf("%d evenings over %lld days\n", room.lightsOff(),
+         (long long)(AppClock::nowMs() / kDayMs));
+}
+
+/* a sensor that has never seen motion reports the room empty forever */
+static void testNoMotion() {
+  AppClock::set(0);
+  MotionSensor sensor(kPirPin);
+  arduino_stub_pins[kPirPin] = LOW;
+  for (int day = 0; day < 60; ++day) {
+    AppClock::advance(kDayMs * 1000);
+    sensor.update();
+    TEST_EXPECT(
+        !sensor.isOccupied(SmartLightAutomation::kOccupancyTimeoutSeconds));
+    TEST_EXPECT_EQ(sensor.getSecondsSinceLastMotion(), INT_MAX);
+  }
+}
+
+int main() {
+  TEST_RUN(testTwoMonths);
+  TEST_RUN(testNoMotion);
+  return TEST_RESULT();
+}
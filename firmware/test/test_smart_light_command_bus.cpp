@@ -0,0 +1,153 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+#include "smart_light_command_bus.h"
+#include "test_utils.h"
+
+using Source = SmartLightCommand::Source;
+using Type = SmartLightCommand::Type;
+
+/* one producer thread per source, as the web, Matter and console tasks */
+static constexpr Source kSources[] = {Source::Web, Source::Matter,
+                                      Source::Serial, Source::Button};
+static constexpr int kProducers = 4;
+static constexpr uint32_t kCommands = 20'000;  //< per producer
+
+static SmartLightCommand makeCommand(int producer, uint32_t sequence) {
+  if (kSources[producer] == Source::Matter) {
+    SmartLightCommand command(Type::Matter, Source::Matter);
+    MatterLightEvents::Event event{};
+    event.timestamp_ms = sequence;
+    event.type = MatterLightEvents::EventType::LightLevel;
+    event.light_level = sequence % 254;
+    command.matter.merge(event);
+    command.tag = sequence;
+    return command;
+  }
+  SmartLightCommand command(Type::SetLight, kSources[producer],
+                            sequence % 2);
+  command.tag = sequence;
+  return command;
+}
+
+/*
+ * Each producer notes how many pushes had completed, on any thread, before
+ * it started its own. Those took their places in the queue first, so a
+ * command is popped after at least that many: the commands are applied in
+ * the order they arrived, not just in order per source.
+ */
+static void testArrivalOrder() {
+  SmartLightCommandBus bus;
+  std::atomic<uint32_t> completed{0};
+  static uint32_t seen[kProducers][kCommands];
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kProducers; ++p) {
+    producers.emplace_back([&, p] {
+      for (uint32_t sequence = 0; sequence < kCommands; ++sequence) {
+        seen[p][sequence] = completed.load(std::memory_order_acquire);
+        /* a full queue is waited out, nothing is dropped */
+        while (!bus.tryPush(makeCommand(p, sequence))) {
+          std::this_thread::yield();
+        }
+        completed.fetch_add(1, std::memory_order_release);
+        if (sequence % 64 == 0) std::this_thread::yield();
+      }
+    });
+  }
+
+  uint32_t next[kProducers] = {};
+  uint32_t popped = 0, early = 0, reordered = 0, batches = 0;
+  while (popped < kProducers * kCommands) {
+    SmartLightCommand command;
+    size_t taken = 0;
+    /* a batch per pass, as the controller takes them */
+    while (taken < SmartLightCommandBus::kBatchSize && bus.pop(command)) {
+      const int p = std::find(kSources, kSources + kProducers,
+                              command.source) -
+                    kSources;
+      TEST_EXPECT(p < kProducers);
+      if (p >= kProducers) break;
+      if (command.tag != next[p]) ++reordered;
+      if (popped < seen[p][command.tag]) ++early;
+      /* merged Matter commands count as the run they stand for */
+      const uint32_t count =
+          command.type == Type::Matter ? command.matter.events : 1;
+      if (command.type == Type::Matter &&
+          command.matter.event.timestamp_ms != command.tag + count - 1) {
+        ++reordered;
+      }
+      next[p] = command.tag + count;
+      popped += count;
+      ++taken;
+    }
+    if (taken) ++batches;
+    std::this_thread::yield();
+  }
+  for (auto& producer : producers) producer.join();
+
+  TEST_EXPECT_EQ(reordered, 0);
+  TEST_EXPECT_EQ(early, 0);
+  TEST_EXPECT(bus.empty());
+  TEST_EXPECT_EQ(bus.getPoppedCount(), kProducers * kCommands);
+  TEST_EXPECT_EQ(bus.getDroppedCount(), 0);
+  for (int p = 0; p < kProducers; ++p) TEST_EXPECT_EQ(next[p], kCommands);
+  printf("%u commands in %u batches, %u Matter commands merged\n", popped,
+         batches, bus.getCoalescedCount());
+}
+
+/* only a run of Matter commands is merged, the others stay in between */
+static void testMatterRuns() {
+  SmartLightCommandBus bus;
+  const Type types[] = {Type::Matter, Type::Matter, Type::SetLight,
+                        Type::Matter, Type::ToggleLight, Type::Matter,
+                        Type::Matter, Type::Matter};
+  uint32_t sequence = 0;
+  for (const Type type : types) {
+    SmartLightCommand command = makeCommand(
+        type == Type::Matter ? 1 : 0, sequence++);
+    command.type = type;
+    TEST_EXPECT(bus.push(command));
+  }
+  const uint32_t expected[][2] = {{0, 2}, {2, 1}, {3, 1}, {4, 1}, {5, 3}};
+  SmartLightCommand command;
+  for (const auto& [tag, events] : expected) {
+    TEST_EXPECT(bus.pop(command));
+    TEST_EXPECT_EQ(command.tag, tag);
+    if (command.type == Type::Matter) {
+      TEST_EXPECT_EQ(command.matter.events, events);
+      TEST_EXPECT_EQ(command.matter.event.timestamp_ms, tag + events - 1);
+    }
+  }
+  TEST_EXPECT(!bus.pop(command));
+  TEST_EXPECT_EQ(bus.getCoalescedCount(), 3);
+}
+
+/* a full queue drops the command and counts it, tryPush() only fails */
+static void testFull() {
+  SmartLightCommandBus bus;
+  for (uint32_t i = 0; i < SmartLightCommandBus::kQueueSize; ++i) {
+    TEST_EXPECT(bus.push(makeCommand(0, i)));
+  }
+  TEST_EXPECT(!bus.tryPush(makeCommand(0, 100)));
+  TEST_EXPECT_EQ(bus.getDroppedCount(), 0);
+  TEST_EXPECT(!bus.push(makeCommand(0, 101)));
+  TEST_EXPECT_EQ(bus.getDroppedCount(), 1);
+  /* the command waits in the queue for the controller */
+  AppClock::advance(250'000);
+  SmartLightCommand command;
+  TEST_EXPECT(bus.pop(command));
+  TEST_EXPECT_EQ(command.tag, 0);
+  TEST_EXPECT_EQ(bus.getMaxLatencyMs(), 250);
+}
+
+int main() {
+  TEST_RUN(testArrivalOrder);
+  TEST_RUN(testMatterRuns);
+  TEST_RUN(testFull);
+  return TEST_RESULT();
+}
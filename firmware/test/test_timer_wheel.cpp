@@ -0,0 +1,254 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "app_clock.h"
+#include "test_utils.h"
+#include "timer_wheel.h"
+
+/*
+ * Drives the wheel on the virtual clock as the controller does: it sleeps
+ * until getMillisUntilNext(), or less when a command wakes it up, and then
+ * advances to AppClock::millis().
+ */
+
+/* a timer that checks it fires at its expiry, not before and not after */
+struct Probe {
+  TimerWheel& wheel;
+  TimerWheel::Timer timer{&Probe::onFire, this};
+  uint32_t expiry_ms = 0;
+  bool armed = false;
+  int fired = 0;
+  void (*then)(Probe&) = nullptr;  //< run in the callback
+
+  explicit Probe(TimerWheel& wheel) : wheel(wheel) {}
+
+  void arm(uint32_t delay_ms) {
+    expiry_ms = wheel.now() + (delay_ms ? delay_ms : 1);
+    armed = true;
+    wheel.arm(timer, delay_ms);
+  }
+  void cancel() {
+    armed = false;
+    wheel.cancel(timer);
+  }
+
+  static void onFire(void* arg) {
+    Probe& probe = *static_cast<Probe*>(arg);
+    TEST_EXPECT(probe.armed);
+    TEST_EXPECT_EQ(probe.wheel.now(), probe.expiry_ms);
+    TEST_EXPECT(!probe.timer.armed());
+    probe.armed = false;
+    ++probe.fired;
+    if (probe.then) probe.then(probe);
+  }
+};
+
+/* a small deterministic generator, the runs are the same every time */
+static uint32_t nextRandom(uint32_t& state) {
+  state = state * 1664525u + 1013904223u;
+  return state >> 8;
+}
+
+/* sleeps at most max_sleep_ms, then advances the wheel to the clock */
+static void wake(TimerWheel& wheel, uint32_t max_sleep_ms) {
+  const uint32_t sleep_ms =
+      std::min(wheel.getMillisUntilNext(AppClock::millis()), max_sleep_ms);
+  AppClock::advance(int64_t(sleep_ms) * 1000);
+  wheel.advance(AppClock::millis());
+}
+
+/* the wheel of a device up for weeks, brought to the clock in steps of
+ * less than half the range of millis() */
+static void catchUp(TimerWheel& wheel) {
+  while (wheel.now() != AppClock::millis()) {
+    wheel.advance(wheel.now() + std::min<uint32_t>(
+                                    AppClock::millis() - wheel.now(),
+                                    INT32_MAX));
+  }
+}
+
+/* an expiry that has come and gone was missed */
+static int countLate(const std::vector<Probe*>& probes) {
+  int late = 0;
+  for (const Probe* probe : probes) {
+    if (probe->armed && int32_t(probe->wheel.now() - probe->expiry_ms) >= 0) {
+      ++late;
+    }
+  }
+  return late;
+}
+
+/* a delay on each side of every slot and level boundary */
+static void testBoundaries() {
+  AppClock::set(1'000'000);
+  TimerWheel wheel;
+  wheel.advance(AppClock::millis());
+  std::vector<uint32_t> delays = {0, 1, 2};
+  for (int level = 1; level < TimerWheel::kLevels; ++level) {
+    const uint32_t span = 1ul << (TimerWheel::kSlotBits * level);
+    delays.insert(delays.end(), {span - 1, span, span + 1, 3 * span + 7});
+  }
+  delays.insert(delays.end(),
+                {TimerWheel::kMaxDelayMs, TimerWheel::kMaxDelayMs + 1,
+                 TimerWheel::kMaxDelayMs + 3'600'000});
+  std::deque<Probe> probes;  //< they stay where they are
+  std::vector<Probe*> pointers;
+  for (const uint32_t delay : delays) {
+    probes.emplace_back(wheel);
+    probes.back().arm(delay);
+    pointers.push_back(&probes.back());
+  }
+  int wakes = 0;
+  while (wheel.getMillisUntilNext(AppClock::millis()) != UINT32_MAX &&
+         wakes < 10'000) {
+    wake(wheel, UINT32_MAX);
+    TEST_EXPECT_EQ(countLate(pointers), 0);
+    ++wakes;
+  }
+  for (const Probe& probe : probes) TEST_EXPECT_EQ(probe.fired, 1);
+  printf("%zu timers over %u h, %d wake-ups\n", probes.size(),
+         unsigned((wheel.now() - 1000) / 3'600'000), wakes);
+}
+
+/* a wake-up long after the expiry fires the timer once, at its expiry */
+static void testOversleep() {
+  AppClock::set(5'000'000);
+  TimerWheel wheel;
+  wheel.advance(AppClock::millis());
+  Probe probe(wheel);
+  probe.arm(100);
+  AppClock::advance(3'600'000'000);
+  wheel.advance(AppClock::millis());
+  TEST_EXPECT_EQ(probe.fired, 1);
+  TEST_EXPECT_EQ(wheel.now(), AppClock::millis());
+  TEST_EXPECT_EQ(wheel.getMillisUntilNext(AppClock::millis()), UINT32_MAX);
+  /* and a timer armed in the past fires on the next advance() */
+  wheel.armAt(probe.timer, wheel.now() - 10);
+  probe.armed = true;
+  probe.expiry_ms = wheel.now() + 1;
+  AppClock::advance(1000);
+  wheel.advance(AppClock::millis());
+  TEST_EXPECT_EQ(probe.fired, 2);
+}
+
+/* millis() wraps after 49.7 days, the wheel follows it */
+static void testWrap() {
+  AppClock::set((int64_t(UINT32_MAX) - 2'000) * 1000);
+  TimerWheel wheel;
+  catchUp(wheel);
+  Probe near(wheel), across(wheel), far(wheel);
+  near.arm(1'000);
+  across.arm(2'500);
+  far.arm(TimerWheel::kMaxDelayMs);
+  const std::vector<Probe*> probes = {&near, &across, &far};
+  for (int wakes = 0; wheel.getMillisUntilNext(AppClock::millis()) !=
+                          UINT32_MAX && wakes < 100'000; ++wakes) {
+    wake(wheel, 700);
+    TEST_EXPECT_EQ(countLate(probes), 0);
+  }
+  for (const Probe* probe : probes) TEST_EXPECT_EQ(probe->fired, 1);
+  TEST_EXPECT(wheel.now() < TimerWheel::kMaxDelayMs);
+}
+
+/* the callbacks may cancel a timer fired in the same tick, or arm any */
+static void testCallbacks() {
+  AppClock::set(0);
+  TimerWheel wheel;
+  Probe first(wheel), second(wheel), periodic(wheel);
+  static Probe *one, *other;
+  one = &first;
+  other = &second;
+  first.then = [](Probe&) { other->cancel(); };
+  second.then = [](Probe&) { one->cancel(); };
+  periodic.then = [](Probe& probe) {
+    if (probe.fired < 10) probe.arm(probe.fired * 50);
+  };
+  first.arm(200);
+  second.arm(200);
+  periodic.arm(0);
+  for (int wakes = 0; wheel.getMillisUntilNext(AppClock::millis()) !=
+                          UINT32_MAX && wakes < 10'000; ++wakes) {
+    wake(wheel, UINT32_MAX);
+  }
+  /* one of the two fired first and took the other out */
+  TEST_EXPECT_EQ(first.fired + second.fired, 1);
+  TEST_EXPECT_EQ(periodic.fired, 10);
+  TEST_EXPECT_EQ(wheel.now(), 1 + 50 * (1 + 9) * 9 / 2);
+}
+
+/*
+ * Many timers armed, re-armed and cancelled at random, by the loop and by
+ * each other's callbacks, with wake-ups at random as commands come in,
+ * over a day of virtual time and the wrap of millis().
+ */
+static void testRandom() {
+  static constexpr int kProbes = 64;
+  static constexpr uint32_t kDayMs = 24 * 3'600'000;
+  static uint32_t seed;
+  seed = 12345;
+  AppClock::set((int64_t(UINT32_MAX) - kDayMs / 2) * 1000);
+  TimerWheel wheel;
+  catchUp(wheel);
+  static std::vector<Probe*> probes;
+  std::deque<Probe> storage;
+  probes.clear();
+  for (int i = 0; i < kProbes; ++i) {
+    storage.emplace_back(wheel);
+    probes.push_back(&storage.back());
+  }
+  /* delays of every level, now and then past kMaxDelayMs */
+  static const auto delay = [](uint32_t& state) -> uint32_t {
+    const uint32_t value = nextRandom(state);
+    switch (value % 8) {
+      case 0: return value % 64;
+      case 1: return value % 4'096;
+      case 2: case 3: return value % 60'000;
+      case 4: case 5: return value % 3'600'000;
+      case 6: return value % TimerWheel::kMaxDelayMs;
+      default: return value % (TimerWheel::kMaxDelayMs * 2);
+    }
+  };
+  for (Probe* probe : probes) {
+    probe->then = [](Probe& self) {
+      const uint32_t value = nextRandom(seed);
+      if (value % 4) self.arm(delay(seed));
+      Probe& other = *probes[value % kProbes];
+      if (value % 16 == 0) other.cancel();
+      if (value % 16 == 1) other.arm(delay(seed));
+    };
+    probe->arm(delay(seed));
+  }
+  const uint32_t start_ms = wheel.now();
+  int wakes = 0, fired = 0, late = 0;
+  while (wheel.now() - start_ms < kDayMs && wakes < 1'000'000) {
+    const uint32_t value = nextRandom(seed);
+    wake(wheel, value % 3 ? UINT32_MAX : value % 5'000);
+    late += countLate(probes);
+    ++wakes;
+    /* a command re-arms or cancels one */
+    Probe& probe = *probes[value % kProbes];
+    if (value % 7 == 0) probe.cancel();
+    if (value % 7 == 1 || !probe.armed) probe.arm(delay(seed));
+  }
+  for (const Probe* probe : probes) {
+    fired += probe->fired;
+    TEST_EXPECT_EQ(probe->timer.armed(), probe->armed);
+  }
+  TEST_EXPECT_EQ(late, 0);
+  TEST_EXPECT(fired > 1'000);
+  printf("%d fired over a day, %d wake-ups\n", fired, wakes);
+}
+
+int main() {
+  TEST_RUN(testBoundaries);
+  TEST_RUN(testOversleep);
+  TEST_RUN(testWrap);
+  TEST_RUN(testCallbacks);
+  TEST_RUN(testRandom);
+  return TEST_RESULT();
+}
@@ -0,0 +1,65 @@
+/**
+ * SPDX-License-Identifier: LGPL-2.1
+ * @copyright 2025 Ryotaro Onuki
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+/**
+ * @brief Minimal checks for the host tests.
+ *
+ * A failed check prints where it is and counts, the test goes on; main()
+ * returns TEST_RESULT(), so ctest sees the failure.
+ */
+inline int test_failures = 0;
+
+#define TEST_EXPECT(cond)                                            \
+  do {                                                               \
+    if (!(cond)) {                                                   \
+      ++test_failures;                                               \
+      fprintf(stderr, "%s:%d: failed: %s\n", __FILE__, __LINE__,     \
+              #cond);                                                \
+    }                                                                \
+  } while (0)
+
+#define TEST_EXPECT_EQ(a, b)                                         \
+  do {                                                               \
+    const auto test_a_ = (a);                                        \
+    const auto test_b_ = (b);                                        \
+    if (!(test_a_ == test_b_)) {                                     \
+      ++test_failures;                                               \
+      fprintf(stderr, "%s:%d: failed: %s == %s (%lld vs %lld)\n",    \
+              __FILE__, __LINE__, #a, #b, (long long)test_a_,        \
+              (long long)test_b_);                                   \
+    }                                                                \
+  } while (0)
+
+#define TEST_RUN(test)                                               \
+  do {                                                               \
+    const int test_before_ = test_failures;                          \
+    test();                                                          \
+    fprintf(stderr, "[%s] %s\n",                                     \
+            test_failures == test_before_ ? "PASS" : "FAIL", #test); \
+  } while (0)
+
+#define TEST_RESULT() (test_failures ? 1 : 0)
+
+/* what a receiver module makes of a frame of mark and space widths, e.g.
+ * an IRRemote::IRData: marks stretched and spaces shrunk by stretch_us,
+ * with up to jitter_us of rand() jitter on every edge */
+template <typename Widths>
+Widths capture(const Widths& sent, int stretch_us, int jitter_us) {
+  Widths data = sent;
+  for (size_t i = 0; i < data.size(); ++i) {
+    const int jitter = jitter_us ? rand() % (2 * jitter_us + 1) - jitter_us
+                                 : 0;
+    const int width =
+        int(data[i]) + ((i & 1) ? -stretch_us : stretch_us) + jitter;
+    data[i] = std::clamp(width, 1, int(UINT16_MAX));
+  }
+  return data;
+}
@@ -1,6 +1,7 @@
 #!/usr/bin/env python3
 
-from dataclasses import dataclass, replace
+import re
+from dataclasses import dataclass, field, replace
 from html import escape
 from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
 from pathlib import Path
@@ -27,6 +28,9 @@ class PreviewState:
     status_message: str = ""
     status_is_error: bool = False
     settings_open: bool = False
+    library: list = field(
+        default_factory=lambda: [("aircon_off", "AEHA"), ("tv_power", "NEC")]
+    )
 
 
 @dataclass(frozen=True)
@@ -68,6 +72,30 @@ def night_control(enabled: bool) -> str:
     )
 
 
+def library_list(library) -> str:
+    if not library:
+        return '<p class="mini">登録されたコードはありません。</p>'
+    items = "".join(
+        '<form class="row library-item" method="post" action="/library">'
+        f'<span><strong>{escape(name)}</strong> <span class="mini">'
+        f"{protocol}</span></span>"
+        f'<input type="hidden" name="name" value="{escape(name, quote=True)}">'
+        '<input type="hidden" name="new_name"><span class="group">'
+        '<button name="op" value="send">送信</button>'
+        '<button class="warn" name="op" value="rename" '
+        f"onclick=\"var n=prompt('新しい名前','{escape(name)}');"
+        'if(!n)return false;this.form.new_name.value=n">名前変更</button>'
+        '<button class="warn" name="op" value="delete" '
+        "onclick=\"return confirm('削除しますか？')\">削除</button>"
+        "</span></form>"
+        for name, protocol in library
+    )
+    return (
+        f'<div class="library-list">{items}</div>'
+        f'<p class="mini">{len(library)}件、{45 * len(library)}/57344バイト使用中</p>'
+    )
+
+
 def read_template() -> str:
     source = TEMPLATE.read_text(encoding="utf-8").strip()
     prefix = 'R"HTML('
@@ -79,7 +107,7 @@ def read_template() -> str:
 
 def consume_state() -> PreviewState:
     with STATE_LOCK:
-        state = replace(STATE)
+        state = replace(STATE, library=list(STATE.library))
         STATE.status_message = ""
         STATE.status_is_error = False
         STATE.settings_open = False
@@ -127,6 +155,7 @@ def render() -> bytes:
         "{{NIGHT_FEATURE_ACTION}}": night_feature.action,
         "{{NIGHT_FEATURE_CLASS}}": night_feature.css_class,
         "{{NIGHT_FEATURE_STATE}}": night_feature.label,
+        "{{IR_LIBRARY}}": library_list(state.library),
         "{{NIGHT_RECORD_BUTTON}}": (
             '<button class="warn" name="target" value="night">'
             "常夜灯ボタンを記録</button>"
@@ -233,6 +262,8 @@ class PreviewHandler(BaseHTTPRequestHandler):
                 self.handle_action(form)
             elif self.path == "/record":
                 self.handle_record(form)
+            elif self.path == "/library":
+                self.handle_library(form)
             else:
                 set_status("不明な操作です。", True)
         self.redirect_root()
@@ -310,6 +341,41 @@ class PreviewHandler(BaseHTTPRequestHandler):
             return
         set_status(f"{names[target]}ボタンの赤外線信号を記録しました。")
 
+    def handle_library(self, form):
+        op = form.get("op", [""])[0]
+        name = form.get("name", [""])[0].strip()
+        new_name = form.get("new_name", [""])[0].strip()
+        names = [entry[0] for entry in STATE.library]
+        if op == "learn":
+            if not re.fullmatch(r"[0-9A-Za-z_.\-]{1,23}", name):
+                set_status(
+                    "コード名は英数字と _ . - の23文字以内で入力してください。",
+                    True,
+                )
+                return
+            STATE.library = sorted(
+                [entry for entry in STATE.library if entry[0] != name]
+                + [(name, "NEC")]
+            )
+            set_status(f"「{name}」の赤外線信号を記録しました。")
+        elif name not in names:
+            set_status(f"「{name}」が見つかりません。", True)
+        elif op == "send":
+            set_status(f"「{name}」を送信しました。")
+        elif op == "delete":
+            STATE.library = [e for e in STATE.library if e[0] != name]
+            set_status(f"「{name}」を削除しました。")
+        elif op == "rename" and re.fullmatch(
+            r"[0-9A-Za-z_.\-]{1,23}", new_name
+        ) and new_name not in names:
+            STATE.library = sorted(
+                (new_name if e[0] == name else e[0], e[1])
+                for e in STATE.library
+            )
+            set_status(f"「{name}」を「{new_name}」に変更しました。")
+        else:
+            set_status(f"「{name}」の名前を変更できませんでした。", True)
+
     def log_message(self, format, *args):
         print(format % args)
 